@@ -7,6 +7,7 @@
  *
  * @section intro_sec Introduction
  * This header file define some usefull functions for handling endianess values.\n
+ * Values are stored big-endian, multi-bytes accesses use a single unaligned host access when available (GCC / Clang).\n
  * \n
  * Please report bug to <skywodd at gmail.com>
  *
@@ -30,6 +31,19 @@
 
 /* Dependency */
 #include <stdint.h>
+#include <string.h>
+
+/* Fast path: single unaligned host load/store + byte swap (if needed) */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && !defined(ENDIAN_NO_FAST_ACCESS)
+#define ENDIAN_FAST_ACCESS
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ENDIAN_BE16(x) __builtin_bswap16(x)
+#define ENDIAN_BE32(x) __builtin_bswap32(x)
+#else
+#define ENDIAN_BE16(x) (x)
+#define ENDIAN_BE32(x) (x)
+#endif
+#endif
 
 /**
  * Get a byte (8 bits) from memory
@@ -52,7 +66,13 @@ static __inline__ uint8_t get8bitsValue(const uint8_t* buffer,
  */
 static __inline__ uint16_t get16bitsValue(const uint8_t* buffer,
 		const uint16_t address) {
+#ifdef ENDIAN_FAST_ACCESS
+	uint16_t value;
+	memcpy(&value, buffer + address, 2);
+	return ENDIAN_BE16(value);
+#else
 	return (buffer[address] << 8) | buffer[address + 1];
+#endif
 }
 
 /**
@@ -62,10 +82,16 @@ static __inline__ uint16_t get16bitsValue(const uint8_t* buffer,
  * @param address Base address of data
  * @return Double word value (32 bits)
  */
-static __inline__ uint16_t get32bitsValue(const uint8_t* buffer,
+static __inline__ uint32_t get32bitsValue(const uint8_t* buffer,
 		const uint16_t address) {
-	return (buffer[address] << 24) | (buffer[address] << 16)
-			| (buffer[address] << 8) | buffer[address + 1];
+#ifdef ENDIAN_FAST_ACCESS
+	uint32_t value;
+	memcpy(&value, buffer + address, 4);
+	return ENDIAN_BE32(value);
+#else
+	return ((uint32_t) buffer[address] << 24) | (buffer[address + 1] << 16)
+			| (buffer[address + 2] << 8) | buffer[address + 3];
+#endif
 }
 
 /**
@@ -89,8 +115,13 @@ static __inline__ void set8bitsValue(uint8_t* buffer, const uint16_t address,
  */
 static __inline__ void set16bitsValue(uint8_t* buffer, const uint16_t address,
 		const uint16_t value) {
+#ifdef ENDIAN_FAST_ACCESS
+	uint16_t raw = ENDIAN_BE16(value);
+	memcpy(buffer + address, &raw, 2);
+#else
 	buffer[address] = (value >> 8) & 0xFF;
 	buffer[address + 1] = value & 0xFF;
+#endif
 }
 
 /**
@@ -102,10 +133,15 @@ static __inline__ void set16bitsValue(uint8_t* buffer, const uint16_t address,
  */
 static __inline__ void set32bitsValue(uint8_t* buffer, const uint16_t address,
 		const uint32_t value) {
+#ifdef ENDIAN_FAST_ACCESS
+	uint32_t raw = ENDIAN_BE32(value);
+	memcpy(buffer + address, &raw, 4);
+#else
 	buffer[address] = (value >> 24) & 0xFF;
 	buffer[address + 1] = (value >> 16) & 0xFF;
 	buffer[address + 2] = (value >> 8) & 0xFF;
 	buffer[address + 3] = value & 0xFF;
+#endif
 }
 
 #endif /* _ENDIAN_UTILITY_H_ */
@@ -37,11 +37,61 @@
 /* Dependency */
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Memory definition */
 #ifndef MEMORY_MASK /* All lower bits MUST be set to "1" */
 #define MEMORY_MASK 0xFFFF
 #endif
 
+/* Fuzzing mode (require pages tracking and edges coverage) */
+#ifdef SKYCPU_FUZZING
+#ifndef SKYCPU_PAGE_TRACKING
+#define SKYCPU_PAGE_TRACKING
+#endif
+#ifndef SKYCPU_COVERAGE
+#define SKYCPU_COVERAGE
+#endif
+#endif
+
+/* Debugger mode (require pages tracking) */
+#ifdef SKYCPU_DEBUGGER
+#ifndef SKYCPU_PAGE_TRACKING
+#define SKYCPU_PAGE_TRACKING
+#endif
+#endif
+
+/* Pages definition (used by pages tracking) */
+#ifndef SKYCPU_PAGE_SHIFT /* Page size MUST be lower or equal to memory size */
+#define SKYCPU_PAGE_SHIFT 8
+#endif
+#define SKYCPU_PAGE_SIZE (1 << SKYCPU_PAGE_SHIFT)
+#define SKYCPU_PAGE_COUNT ((MEMORY_MASK + 1) >> SKYCPU_PAGE_SHIFT)
+
+/* Pages flags */
+#define SKYCPU_PAGE_DIRTY 1 /*!< Page written since last snapshot */
+#define SKYCPU_PAGE_CODE 2 /*!< Page hold translated code (AOT) */
+#define SKYCPU_PAGE_WATCH 4 /*!< Page hold debugger breakpoints or watchpoints */
+
+/* Channels definition */
+#ifndef SKYCPU_CHANNEL_COUNT /* MUST be a power of two */
+#define SKYCPU_CHANNEL_COUNT 16
+#endif
+
+/* Stall reasons (instruction not retired, PC still point to it) */
+#define SKYCPU_STALL_NONE 0 /*!< Last instruction retired */
+#define SKYCPU_STALL_FULL 1 /*!< SEND on a full channel */
+#define SKYCPU_STALL_EMPTY 2 /*!< RECV on an empty channel */
+#define SKYCPU_STALL_UNBOUND 3 /*!< SEND / RECV on an unbound channel */
+#define SKYCPU_STALL_WIDTH 4 /*!< SEND / RECV bits mode other than the channel width */
+
+/* Edges coverage definition */
+#ifndef SKYCPU_COVERAGE_SIZE /* MUST be a power of two, max 65536 */
+#define SKYCPU_COVERAGE_SIZE 65536
+#endif
+
 /**
  * Interrupts callback type definition
  *
@@ -56,6 +106,20 @@ typedef void (*SkyCPU_interrupt_callback_t)(uint32_t icode);
  */
 typedef void (*SkyCPU_breakpoint_callback_t)(uint32_t bcode);
 
+#ifdef SKYCPU_CHANNELS
+/**
+ * Channel type (see SkyCPU_channel.h)
+ */
+typedef struct SkyCPU_channel SkyCPU_channel_t;
+#endif
+
+#ifdef SKYCPU_METRICS
+/**
+ * Metrics record type (see SkyCPU_metrics.h)
+ */
+typedef struct SkyCPU_metrics SkyCPU_metrics_t;
+#endif
+
 /**
  *  CPU runtime structure
  */
@@ -63,9 +127,31 @@ typedef struct {
 	uint8_t registers[32 + 3]; /*!< General purpose register (+ 3 dummy bytes to avoid buffer overflow) */
 	uint8_t skip_next; /*!< If true the next instruction will not be committed */
 	uint16_t program_counter, stack_pointer; /*!< Program counter and stack pointer */
+#ifdef SKYCPU_MIRRORED_MEMORY
+	uint8_t* memory; /*!< Runtime memory space (mirrored mapping, see SkyCPU_mirror.h) */
+#else
 	uint8_t memory[MEMORY_MASK + 1]; /*!< Runtime memory space */
+#endif
 	SkyCPU_interrupt_callback_t interrupt_callback; /*!< Callback for INT */
 	SkyCPU_breakpoint_callback_t breakpoint_callback; /*!< Callback for BREAK */
+#ifdef SKYCPU_PAGE_TRACKING
+	uint8_t page_flags[SKYCPU_PAGE_COUNT]; /*!< Pages flags (dirty, ...) */
+	uint8_t page_events; /*!< Flags (except dirty) of all written pages */
+#endif
+#ifdef SKYCPU_COVERAGE
+	uint8_t* coverage_map; /*!< Edges coverage bitmap (SKYCPU_COVERAGE_SIZE bytes) */
+	uint16_t previous_location; /*!< Last hashed location (edges coverage) */
+#endif
+#ifdef SKYCPU_DEBUGGER
+	uint8_t trapped; /*!< If true a debugger trap was hit (PC point to it) */
+#endif
+#ifdef SKYCPU_CHANNELS
+	SkyCPU_channel_t* channels[SKYCPU_CHANNEL_COUNT]; /*!< Bound channels (NULL if unbound) */
+	uint8_t stall_reason; /*!< Why the last SEND / RECV did not retire (SKYCPU_STALL_*) */
+#endif
+#ifdef SKYCPU_METRICS
+	SkyCPU_metrics_t* metrics; /*!< Metrics record (NULL if not exported) */
+#endif
 } SkyCPU_runtime_t;
 
 /**
@@ -74,10 +160,29 @@ typedef struct {
  * @param runtime Pointer to the SkyCPU runtime instance to initialize
  */
 static __inline__ void SkyCPU_runtime_init(SkyCPU_runtime_t* runtime) {
-	uint8_t i = 0;
+	uint16_t i = 0;
 	for (; i < 38; ++i)
 		((uint8_t*) runtime)[i] = 0;
 	runtime->stack_pointer = MEMORY_MASK;
+#ifdef SKYCPU_PAGE_TRACKING
+	for (i = 0; i < SKYCPU_PAGE_COUNT; ++i)
+		runtime->page_flags[i] = 0;
+	runtime->page_events = 0;
+#endif
+#ifdef SKYCPU_COVERAGE
+	runtime->previous_location = 0;
+#endif
+#ifdef SKYCPU_DEBUGGER
+	runtime->trapped = 0;
+#endif
+#ifdef SKYCPU_CHANNELS
+	for (i = 0; i < SKYCPU_CHANNEL_COUNT; ++i)
+		runtime->channels[i] = 0;
+	runtime->stall_reason = SKYCPU_STALL_NONE;
+#endif
+#ifdef SKYCPU_METRICS
+	runtime->metrics = 0;
+#endif
 }
 
 /**
@@ -95,6 +200,54 @@ static __inline__ void SkyCPU_callback_setup(SkyCPU_runtime_t* runtime,
 	runtime->breakpoint_callback = breakpoint_callback;
 }
 
+#ifdef SKYCPU_PAGE_TRACKING
+/**
+ * Mark pages touched by a memory write as dirty (and record their others flags as events)
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param address Base address of the write
+ * @param size Size of the write (1, 2 or 4 bytes)
+ */
+static __inline__ void SkyCPU_page_touch(SkyCPU_runtime_t* runtime,
+		const uint16_t address, const uint8_t size) {
+	uint8_t* first = &runtime->page_flags[(address & MEMORY_MASK)
+			>> SKYCPU_PAGE_SHIFT];
+	uint8_t* last = &runtime->page_flags[((address + size - 1) & MEMORY_MASK)
+			>> SKYCPU_PAGE_SHIFT];
+	runtime->page_events |= (*first | *last) & ~SKYCPU_PAGE_DIRTY;
+	*first |= SKYCPU_PAGE_DIRTY;
+	*last |= SKYCPU_PAGE_DIRTY;
+}
+#endif
+
+#ifdef SKYCPU_COVERAGE
+/**
+ * Setup the edges coverage bitmap of a SkyCPU runtime instance
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance to setup
+ * @param coverage_map Pointer to the coverage bitmap (SKYCPU_COVERAGE_SIZE bytes)
+ */
+static __inline__ void SkyCPU_coverage_setup(SkyCPU_runtime_t* runtime,
+		uint8_t* coverage_map) {
+	runtime->coverage_map = coverage_map;
+	runtime->previous_location = 0;
+}
+
+/**
+ * Record an edge in the coverage bitmap (AFL style)
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param location Location reached (jump target or skip decision)
+ */
+static __inline__ void SkyCPU_coverage_edge(SkyCPU_runtime_t* runtime,
+		const uint32_t location) {
+	uint16_t current = (uint16_t) ((location * 0x9E3779B1UL) >> 16)
+			& (SKYCPU_COVERAGE_SIZE - 1);
+	runtime->coverage_map[current ^ runtime->previous_location]++;
+	runtime->previous_location = current >> 1;
+}
+#endif
+
 /**
  * Fill the SkyCPU memory with some raw data
  *
@@ -106,8 +259,12 @@ static __inline__ void SkyCPU_callback_setup(SkyCPU_runtime_t* runtime,
 static __inline__ void SkyCPU_memory_copy(SkyCPU_runtime_t* runtime,
 		const uint8_t* src_data, const uint16_t src_size, const uint16_t offset) {
 	uint16_t i = 0;
-	for (; i < src_size; ++i)
+	for (; i < src_size; ++i) {
 		runtime->memory[(i + offset) & MEMORY_MASK] = src_data[i];
+#ifdef SKYCPU_PAGE_TRACKING
+		SkyCPU_page_touch(runtime, i + offset, 1);
+#endif
+	}
 }
 
 /**
@@ -117,4 +274,8 @@ static __inline__ void SkyCPU_memory_copy(SkyCPU_runtime_t* runtime,
  */
 void SkyCPU_fetch_and_execute(SkyCPU_runtime_t* runtime);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _FASTSKYCPU_H_ */
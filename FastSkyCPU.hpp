@@ -0,0 +1,639 @@
+/**
+ * @file FastSkyCPU.hpp
+ * @brief C++20 front-end of the SkyCPU : compile-time assembler and typed runtime wrapper
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file is a header-only C++20 layer over the C runtime :\n
+ * - SkyCPU::assemble<"...">() assemble SkyCPU assembly at compile time into a std::array<uint8_t, N>,\n
+ *   encoding errors (unknown mnemonic, bad operand, constant out of range, ...) are compile errors.\n
+ * - SkyCPU::Runtime own a runtime instance (RAII, movable, not copyable) and call its INT / BRK callbacks\n
+ *   (any callable, lambdas included) directly: the instruction body (FastSkyCPU_execute.inc) is instantiated\n
+ *   with the callbacks types, no function pointer is involved.\n
+ * \n
+ * Assembly syntax: one instruction per line, "label:" prefix, "; comment" suffix, MNEMONIC.b / .w / .d\n
+ * (bits mode, optional without operands), operands r0 ... r31, PC, SP, #value, #label, [r0], [PC], [SP],\n
+ * [#address], [#label]. Values from 0 to 31 use inline constants. Directives: .byte and .word (big-endian).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Build flags (SKYCPU_*) MUST be the same for the C++ and the C source files.\n
+ * C helpers running the instance (SkyCPU_channel_run(), SkyCPU_debug_run(), ...) use the C callbacks of the runtime.
+ */
+
+#ifndef _FASTSKYCPU_HPP_
+#define _FASTSKYCPU_HPP_
+
+#if __cplusplus < 202002L
+#error "FastSkyCPU.hpp require C++20"
+#endif
+
+/* Dependency */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <utility>
+#include "FastSkyCPU.h"
+#include "Endian_utility.h"
+#include "FastSkyCPU_opcodes.h"
+#ifdef SKYCPU_CHANNELS
+#include "SkyCPU_channel.h"
+#endif
+#ifdef SKYCPU_METRICS
+#include "SkyCPU_metrics.h"
+#endif
+#ifdef SKYCPU_MIRRORED_MEMORY
+#include "SkyCPU_mirror.h"
+#endif
+
+namespace SkyCPU {
+
+namespace detail {
+
+/* Instruction body, callbacks called through the Hooks object (inlined) */
+#define SKYCPU_EXECUTE_PREFIX template <typename Hooks>
+#define SKYCPU_EXECUTE_FUNCTION execute
+#define SKYCPU_EXECUTE_PARAMETERS , Hooks& hooks
+#define SKYCPU_INTERRUPT(runtime, icode) hooks.interrupt(icode)
+#define SKYCPU_BREAKPOINT(runtime, bcode) hooks.breakpoint(bcode)
+#include "FastSkyCPU_execute.inc"
+#undef SKYCPU_EXECUTE_PREFIX
+#undef SKYCPU_EXECUTE_FUNCTION
+#undef SKYCPU_EXECUTE_PARAMETERS
+#undef SKYCPU_INTERRUPT
+#undef SKYCPU_BREAKPOINT
+
+/* Mnemonics (opcodes order, TRAP is reserved to the debugger) */
+inline constexpr std::string_view mnemonics[] = { "NOP", "RET", "JMP", "CALL",
+		"PUSH", "BRK", "INT", "INC", "DEC", "CLR", "SET", "NOT", "NEG", "SWAP",
+		"JNN", "JN", "SNN", "SN", "POP", "ADD", "SUB", "MUL", "DIV", "AND",
+		"NAND", "OR", "NOR", "XOR", "SBI", "CLI", "LSL", "LSR", "ROL", "ROR",
+		"MOV", "CXH", "JE", "JNE", "JG", "JGE", "JL", "JLE", "JBC", "JBS", "SE",
+		"SNE", "SG", "SGE", "SL", "SLE", "SBC", "SBS", "SEND", "RECV" };
+
+/* Assembler limits */
+inline constexpr std::size_t max_labels = 256;
+
+/**
+ * Label (name and address)
+ */
+struct Label {
+	std::string_view name;
+	std::uint16_t address = 0;
+};
+
+constexpr bool is_space(const char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+constexpr bool is_identifier(const char c, const bool first) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'
+			|| (!first && c >= '0' && c <= '9');
+}
+
+constexpr std::string_view trim(std::string_view text) {
+	while (!text.empty() && is_space(text.front()))
+		text.remove_prefix(1);
+	while (!text.empty() && is_space(text.back()))
+		text.remove_suffix(1);
+	return text;
+}
+
+constexpr bool equal_nocase(const std::string_view a, const std::string_view b) {
+	if (a.size() != b.size())
+		return false;
+	for (std::size_t i = 0; i < a.size(); ++i) {
+		char x = a[i], y = b[i];
+		if (x >= 'a' && x <= 'z')
+			x -= 'a' - 'A';
+		if (y >= 'a' && y <= 'z')
+			y -= 'a' - 'A';
+		if (x != y)
+			return false;
+	}
+	return true;
+}
+
+/* Parse a number (decimal, 0x hexadecimal, 0b binary, optional minus sign) */
+constexpr bool parse_number(std::string_view text, std::int64_t& value) {
+	std::int64_t base = 10, result = 0;
+	bool negative = false;
+	if (!text.empty() && text.front() == '-') {
+		negative = true;
+		text.remove_prefix(1);
+	}
+	if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+		base = 16, text.remove_prefix(2);
+	else if (text.size() > 2 && text[0] == '0'
+			&& (text[1] == 'b' || text[1] == 'B'))
+		base = 2, text.remove_prefix(2);
+	if (text.empty())
+		return false;
+	for (const char c : text) {
+		std::int64_t digit;
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+		if (digit >= base)
+			return false;
+		result = result * base + digit;
+		if (result > 0xFFFFFFFFLL)
+			return false;
+	}
+	value = negative ? -result : result;
+	return true;
+}
+
+/* Parse a register code (r0 ... r31) */
+constexpr bool parse_register(const std::string_view text, std::uint8_t& code) {
+	std::int64_t value = 0;
+	if (text.size() < 2 || (text[0] != 'r' && text[0] != 'R')
+			|| !parse_number(text.substr(1), value) || text[1] == '-'
+			|| value > 31)
+		return false;
+	code = static_cast<std::uint8_t>(value);
+	return true;
+}
+
+/**
+ * Two passes assembler (first pass: labels and size, second pass: bytes)
+ */
+class Assembler {
+public:
+	constexpr Assembler(const std::string_view source, const std::uint16_t origin) :
+			source_(source), origin_(origin) {
+		size_ = pass(nullptr, this);
+	}
+
+	/* Program size in bytes */
+	constexpr std::size_t size() const {
+		return size_;
+	}
+
+	/* Emit the program (size() bytes) */
+	constexpr void emit(std::uint8_t* output) const {
+		pass(output, nullptr);
+	}
+
+private:
+	std::string_view source_;
+	std::uint16_t origin_;
+	std::array<Label, max_labels> labels_ {};
+	std::size_t labels_count_ = 0;
+	std::size_t size_ = 0;
+
+	constexpr const Label* find_label(const std::string_view name) const {
+		for (std::size_t i = 0; i < labels_count_; ++i)
+			if (labels_[i].name == name)
+				return &labels_[i];
+		return nullptr;
+	}
+
+	constexpr void add_label(const std::string_view name, const std::size_t offset) {
+		if (name.empty() || !is_identifier(name.front(), true))
+			throw "SkyCPU assembler: bad label name";
+		for (const char c : name)
+			if (!is_identifier(c, false))
+				throw "SkyCPU assembler: bad label name";
+		if (find_label(name))
+			throw "SkyCPU assembler: duplicate label";
+		if (labels_count_ == max_labels)
+			throw "SkyCPU assembler: too many labels";
+		if (origin_ + offset > MEMORY_MASK)
+			throw "SkyCPU assembler: program too large";
+		labels_[labels_count_++] = Label { name, static_cast<std::uint16_t>(origin_
+				+ offset) };
+	}
+
+	/* Value of a constant (number or label, labels are unknown during the first pass) */
+	constexpr bool constant(const std::string_view text, std::int64_t& value,
+			const bool final) const {
+		if (parse_number(text, value))
+			return true;
+		if (text.empty() || !is_identifier(text.front(), true))
+			throw "SkyCPU assembler: bad constant";
+		if (const Label* label = find_label(text))
+			value = label->address;
+		else if (final)
+			throw "SkyCPU assembler: unknown label";
+		else
+			value = 0;
+		return false;
+	}
+
+	/* Store a big-endian value */
+	static constexpr void put(std::uint8_t* output, std::size_t& offset,
+			const std::uint32_t value, const std::size_t width) {
+		for (std::size_t i = 0; i < width; ++i, ++offset)
+			if (output)
+				output[offset] = static_cast<std::uint8_t>(value
+						>> (8 * (width - 1 - i)));
+	}
+
+	/* Encode an operand, return true if it is a raw constant (not writable) */
+	constexpr bool operand(std::string_view text, const std::uint8_t bits_mode,
+			std::uint8_t* output, std::size_t& offset) const {
+		const std::size_t width = bits_mode == DOUBLE_WORD ? 4 : bits_mode;
+		const bool pointer = text.size() >= 2 && text.front() == '['
+				&& text.back() == ']';
+		std::uint8_t code = 0;
+		std::int64_t value = 0;
+		if (pointer)
+			text = trim(text.substr(1, text.size() - 2));
+
+		/* Special function registers */
+		if (equal_nocase(text, "PC") || equal_nocase(text, "SP")) {
+			put(output, offset, (pointer ? 0x60 : 0x20)
+					| (equal_nocase(text, "PC") ? REGISTER_PC : REGISTER_SP), 1);
+			return false;
+		}
+
+		/* General purpose registers */
+		if (parse_register(text, code)) {
+			put(output, offset, (pointer ? 0x40 : 0x00) | code, 1);
+			return false;
+		}
+
+		/* Constants (inline if it is a number from 0 to 31) */
+		if (text.empty() || text.front() != '#')
+			throw "SkyCPU assembler: bad operand";
+		if (constant(trim(text.substr(1)), value, output != nullptr)
+				&& value >= 0 && value <= 31) {
+			put(output, offset, (pointer ? 0xE0 : 0xA0) | value, 1);
+			return !pointer;
+		}
+		if (pointer) {
+			if (value < 0 || value > MEMORY_MASK)
+				throw "SkyCPU assembler: address out of range";
+			put(output, offset, 0xC0, 1);
+			put(output, offset, static_cast<std::uint32_t>(value), 2);
+			return false;
+		}
+		if (value >= (1LL << (8 * width)) || value < -(1LL << (8 * width - 1)))
+			throw "SkyCPU assembler: constant out of range";
+		put(output, offset, 0x80, 1);
+		put(output, offset, static_cast<std::uint32_t>(value), width);
+		return true;
+	}
+
+	/* Encode a directive (.byte, .word) */
+	constexpr void directive(const std::string_view name, std::string_view values,
+			std::uint8_t* output, std::size_t& offset) const {
+		const std::size_t width = name == ".byte" ? 1 : name == ".word" ? 2 : 0;
+		if (!width)
+			throw "SkyCPU assembler: unknown directive";
+		while (!values.empty()) {
+			const std::size_t comma = values.find(',');
+			std::int64_t value = 0;
+			constant(trim(values.substr(0, comma)), value, output != nullptr);
+			if (value >= (1LL << (8 * width)) || value < -(1LL << (8 * width - 1)))
+				throw "SkyCPU assembler: constant out of range";
+			put(output, offset, static_cast<std::uint32_t>(value), width);
+			values = comma == std::string_view::npos ?
+					std::string_view() : values.substr(comma + 1);
+		}
+	}
+
+	/* Encode an instruction */
+	constexpr void instruction(const std::string_view text, std::uint8_t* output,
+			std::size_t& offset) const {
+		const std::size_t space = text.find_first_of(" \t");
+		const std::string_view name = text.substr(0, space);
+		std::string_view operands = space == std::string_view::npos ?
+				std::string_view() : trim(text.substr(space));
+		const std::size_t dot = name.find('.');
+		std::uint8_t opcode = 0, bits_mode = SINGLE_BYTE, count = 0, expected;
+		bool found = false;
+
+		/* Mnemonic and bits mode */
+		for (std::size_t i = 0; i < std::size(mnemonics) && !found; ++i)
+			if (equal_nocase(name.substr(0, dot), mnemonics[i]))
+				opcode = static_cast<std::uint8_t>(i), found = true;
+		if (!found)
+			throw "SkyCPU assembler: unknown mnemonic";
+		expected = opcode < INSTRUCTION_JMP ? 0 : opcode < INSTRUCTION_ADD ? 1 : 2;
+		if (dot != std::string_view::npos) {
+			const std::string_view suffix = name.substr(dot + 1);
+			if (equal_nocase(suffix, "b"))
+				bits_mode = SINGLE_BYTE;
+			else if (equal_nocase(suffix, "w"))
+				bits_mode = SINGLE_WORD;
+			else if (equal_nocase(suffix, "d"))
+				bits_mode = DOUBLE_WORD;
+			else
+				throw "SkyCPU assembler: bad bits mode (.b, .w or .d)";
+		} else if (expected)
+			throw "SkyCPU assembler: missing bits mode (.b, .w or .d)";
+		put(output, offset, (opcode << 2) | bits_mode, 1);
+
+		/* Operands (A is written back by INC ... SWAP, POP ... MOV, RECV, B also by CXH) */
+		while (!operands.empty()) {
+			const std::size_t comma = operands.find(',');
+			const bool raw = operand(trim(operands.substr(0, comma)), bits_mode,
+					output, offset);
+			if (raw && ((count == 0 && ((opcode >= INSTRUCTION_INC
+					&& opcode <= INSTRUCTION_SWAP)
+					|| (opcode >= INSTRUCTION_POP && opcode <= INSTRUCTION_CXH)
+					|| opcode == INSTRUCTION_RECV))
+					|| (count == 1 && opcode == INSTRUCTION_CXH)))
+				throw "SkyCPU assembler: destination is a constant";
+			++count;
+			operands = comma == std::string_view::npos ?
+					std::string_view() : trim(operands.substr(comma + 1));
+			if (comma != std::string_view::npos && operands.empty())
+				throw "SkyCPU assembler: missing operand";
+		}
+		if (count != expected)
+			throw "SkyCPU assembler: wrong operands count";
+	}
+
+	/* One pass over the source (labels added to collector if any), return the program size */
+	constexpr std::size_t pass(std::uint8_t* output, Assembler* collector) const {
+		std::string_view source = source_;
+		std::size_t offset = 0;
+		while (!source.empty()) {
+			const std::size_t end = source.find('\n');
+			std::string_view line = source.substr(0, end);
+			source = end == std::string_view::npos ?
+					std::string_view() : source.substr(end + 1);
+
+			/* Comment and label */
+			line = trim(line.substr(0, line.find(';')));
+			const std::size_t colon = line.find(':');
+			if (colon != std::string_view::npos) {
+				if (collector)
+					collector->add_label(trim(line.substr(0, colon)), offset);
+				line = trim(line.substr(colon + 1));
+			}
+			if (line.empty())
+				continue;
+
+			/* Directive or instruction */
+			if (line.front() == '.') {
+				const std::size_t space = line.find_first_of(" \t");
+				directive(line.substr(0, space), space == std::string_view::npos ?
+						std::string_view() : trim(line.substr(space)), output,
+						offset);
+			} else
+				instruction(line, output, offset);
+			if (origin_ + offset > MEMORY_MASK + 1)
+				throw "SkyCPU assembler: program too large";
+		}
+		return offset;
+	}
+};
+
+} /* namespace detail */
+
+/**
+ * Compile-time string (assembly source as template argument)
+ */
+template <std::size_t N>
+struct FixedString {
+	char data[N] {};
+
+	constexpr FixedString(const char (&source)[N]) {
+		for (std::size_t i = 0; i < N; ++i)
+			data[i] = source[i];
+	}
+
+	constexpr std::string_view view() const {
+		return std::string_view(data, N - 1);
+	}
+};
+
+/**
+ * Assemble a SkyCPU program at compile time
+ *
+ * @tparam Source Assembly source
+ * @tparam Origin Load address of the program (labels addresses)
+ * @return Program bytes
+ */
+template <FixedString Source, std::uint16_t Origin = 0>
+consteval auto assemble() {
+	constexpr detail::Assembler assembler(Source.view(), Origin);
+	std::array<std::uint8_t, assembler.size()> program {};
+	assembler.emit(program.data());
+	return program;
+}
+
+/**
+ * Callback doing nothing (default INT / BRK callbacks)
+ */
+struct NoCallback {
+	constexpr void operator()(std::uint32_t) const noexcept {
+	}
+};
+
+/**
+ * SkyCPU runtime instance (RAII owner, callbacks called directly)
+ *
+ * @tparam OnInterrupt INT callback type (callable with an uint32_t code)
+ * @tparam OnBreakpoint BRK callback type (callable with an uint32_t code)
+ */
+template <typename OnInterrupt = NoCallback, typename OnBreakpoint = NoCallback>
+class Runtime {
+public:
+	/**
+	 * Create a runtime instance (registers and memory cleared, SP at the end of memory)
+	 *
+	 * @param on_interrupt INT callback
+	 * @param on_breakpoint BRK callback
+	 * @throw std::bad_alloc Out of memory
+	 */
+	explicit Runtime(OnInterrupt on_interrupt = {}, OnBreakpoint on_breakpoint = {}) :
+			state_(new SkyCPU_runtime_t()), hooks_ { std::move(on_interrupt),
+					std::move(on_breakpoint) } {
+		SkyCPU_runtime_init(state_.get());
+		SkyCPU_callback_setup(state_.get(), ignore, ignore);
+#ifdef SKYCPU_MIRRORED_MEMORY
+		if (SkyCPU_mirror_map(state_.get()))
+			throw std::bad_alloc();
+#endif
+	}
+
+	Runtime(Runtime&&) noexcept = default;
+	Runtime& operator=(Runtime&&) noexcept = default;
+
+	/**
+	 * Copy a program into memory
+	 *
+	 * @param program Program bytes (ex: SkyCPU::assemble<"...">())
+	 * @param address Load address
+	 */
+	void load(const std::span<const std::uint8_t> program,
+			const std::uint16_t address = 0) {
+		SkyCPU_memory_copy(state_.get(), program.data(),
+				static_cast<std::uint16_t>(program.size()), address);
+	}
+
+	/**
+	 * Fetch and execute the next instruction
+	 */
+	void step() {
+		detail::execute(state_.get(), hooks_);
+	}
+
+	/**
+	 * Run some instructions
+	 *
+	 * @param max_instructions Instructions count
+	 */
+	void run(const std::uint64_t max_instructions) {
+		for (std::uint64_t i = 0; i < max_instructions; ++i)
+			detail::execute(state_.get(), hooks_);
+	}
+
+	/**
+	 * Run until a predicate is true (checked after each instruction) or the budget is exhausted
+	 *
+	 * @param done Predicate (ex: flag set by the BRK callback)
+	 * @param max_instructions Instructions budget
+	 * @return Number of executed instructions
+	 */
+	template <typename Predicate>
+	std::uint64_t run_until(Predicate&& done, const std::uint64_t max_instructions) {
+		std::uint64_t count = 0;
+		while (count < max_instructions) {
+			detail::execute(state_.get(), hooks_);
+			++count;
+			if (done())
+				break;
+		}
+		return count;
+	}
+
+	/**
+	 * Read a register (8 bits: r0 ... r31, 16 / 32 bits: big-endian from rN)
+	 *
+	 * @tparam T uint8_t, uint16_t or uint32_t
+	 * @param index Register index
+	 * @return Register value
+	 */
+	template <typename T>
+	T reg(const std::uint8_t index) const {
+		static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4,
+				"SkyCPU registers are 8, 16 or 32 bits wide");
+		if constexpr (sizeof(T) == 1)
+			return get8bitsValue(state_->registers, index & 31);
+		else if constexpr (sizeof(T) == 2)
+			return get16bitsValue(state_->registers, index & 31);
+		else
+			return get32bitsValue(state_->registers, index & 31);
+	}
+
+	/**
+	 * Write a register (8 bits: r0 ... r31, 16 / 32 bits: big-endian from rN)
+	 *
+	 * @tparam T uint8_t, uint16_t or uint32_t
+	 * @param index Register index
+	 * @param value Register value
+	 */
+	template <typename T>
+	void set_reg(const std::uint8_t index, const T value) {
+		static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4,
+				"SkyCPU registers are 8, 16 or 32 bits wide");
+		if constexpr (sizeof(T) == 1)
+			set8bitsValue(state_->registers, index & 31, value);
+		else if constexpr (sizeof(T) == 2)
+			set16bitsValue(state_->registers, index & 31, value);
+		else
+			set32bitsValue(state_->registers, index & 31, value);
+	}
+
+	std::uint16_t pc() const noexcept {
+		return state_->program_counter;
+	}
+
+	void set_pc(const std::uint16_t address) noexcept {
+		state_->program_counter = address;
+	}
+
+	std::uint16_t sp() const noexcept {
+		return state_->stack_pointer;
+	}
+
+	void set_sp(const std::uint16_t address) noexcept {
+		state_->stack_pointer = address;
+	}
+
+	std::span<std::uint8_t, MEMORY_MASK + 1> memory() noexcept {
+		return std::span<std::uint8_t, MEMORY_MASK + 1>(&state_->memory[0],
+				MEMORY_MASK + 1);
+	}
+
+	/**
+	 * Get the C runtime instance (for the C API: snapshots, channels, ...)
+	 *
+	 * @return Pointer to the SkyCPU runtime instance
+	 */
+	SkyCPU_runtime_t* get() noexcept {
+		return state_.get();
+	}
+
+	const SkyCPU_runtime_t* get() const noexcept {
+		return state_.get();
+	}
+
+private:
+	/* C callbacks (used by the C helpers only) */
+	static void ignore(std::uint32_t) {
+	}
+
+	/* Runtime deleter (mirrored memory unmapped first) */
+	struct Deleter {
+		void operator()(SkyCPU_runtime_t* runtime) const noexcept {
+#ifdef SKYCPU_MIRRORED_MEMORY
+			SkyCPU_mirror_unmap(runtime);
+#endif
+			delete runtime;
+		}
+	};
+
+	/* Hooks of the instruction body */
+	struct Hooks {
+		[[no_unique_address]] OnInterrupt on_interrupt;
+		[[no_unique_address]] OnBreakpoint on_breakpoint;
+
+		void interrupt(const std::uint32_t icode) {
+			on_interrupt(icode);
+		}
+
+		void breakpoint(const std::uint32_t bcode) {
+			on_breakpoint(bcode);
+		}
+	};
+
+	std::unique_ptr<SkyCPU_runtime_t, Deleter> state_;
+	Hooks hooks_;
+};
+
+} /* namespace SkyCPU */
+
+#endif /* _FASTSKYCPU_HPP_ */
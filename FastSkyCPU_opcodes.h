@@ -18,6 +18,18 @@
 #ifndef _FASTSKYCPU_OPCODES_H_
 #define _FASTSKYCPU_OPCODES_H_
 
+/* Bitwise macro */
+/* Instruction : [oooooobb] (o = opcode, b = bits mode) */
+#define INSTRUCTION_OPCODE(x) (((x) & 255) >> 2)
+#define INSTRUCTION_BITSMODE(x) ((x) & 3)
+/* Argument : [cpsrrrrr] (c = constant, p = pointer, s = sfr / inline constant (if c = 1), r = register code*/
+#define ARGUMENT_CONSTANT(x) ((x) & 128)
+#define ARGUMENT_POINTEDBY(x) ((x) & 64)
+#define ARGUMENT_SFRMODE(x) ((x) & 32)
+#define ARGUMENT_INLINECONST(x) ((x) & 32)
+#define ARGUMENT_REGISTERCODE(x) ((x) & 31)
+#define ARGUMENT_INLINEVALUE(x) ((x) & 31)
+
 /**
  * Instructions opcodes definition
  *
@@ -80,7 +92,14 @@ typedef enum {
 	INSTRUCTION_SL, /*!< SKIP if A < B */
 	INSTRUCTION_SLE, /*!< SKIP if A <= B */
 	INSTRUCTION_SBC, /*!< SKIP if !(A & (1 << B)) */
-	INSTRUCTION_SBS /*!< SKIP if A & (1 << B) */
+	INSTRUCTION_SBS, /*!< SKIP if A & (1 << B) */
+
+	/* Channels (SKYCPU_CHANNELS only) */
+	INSTRUCTION_SEND, /*!< channel(A) <- B (stall if full) */
+	INSTRUCTION_RECV, /*!< A = channel(B) (stall if empty) */
+
+	/* Reserved */
+	INSTRUCTION_TRAP = 63 /*!< debugger breakpoint (patched over an instruction, SKYCPU_DEBUGGER only) */
 } SkyCPU_instruction_opcode_t;
 
 /**
@@ -0,0 +1,598 @@
+/**
+ * @file SkyAOT.c
+ * @brief Ahead-of-time translator from SkyCPU guest images to C source
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program disassemble a fixed (not self-modifying) guest image, recover its control flow\n
+ * and emit C source with one function per basic block, to be compiled as a shared object\n
+ * and loaded with SkyCPU_aot_load().\n
+ * \n
+ * Usage : SkyAOT image.bin output.c [load_address [entry ...]] (addresses in hexadecimal)\n
+ * Build : cc -DSKYCPU_PAGE_TRACKING SkyAOT.c SkyCPU_decode.c -o SkyAOT\n
+ * Module : cc -O2 -shared -fPIC -DSKYCPU_PAGE_TRACKING output.c -o output.so\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "SkyCPU_decode.h"
+#include "SkyCPU_aot.h"
+
+/* Maximum instructions count of a block */
+#define MAX_BLOCK_LENGTH 64
+
+/* Translator context */
+typedef struct {
+	uint8_t memory[MEMORY_MASK + 1]; /* Guest image */
+	uint32_t image_start, image_end; /* Image bounds (end excluded) */
+	uint8_t leaders[MEMORY_MASK + 1]; /* Blocks entry points */
+	uint8_t code_pages[SKYCPU_PAGE_COUNT]; /* Pages holding translated code */
+	uint16_t worklist[MEMORY_MASK + 1]; /* Leaders to walk */
+	uint32_t worklist_count;
+	uint32_t max_block_length; /* Longest translated block */
+	uint16_t block_sizes[MEMORY_MASK + 1]; /* Bytes covered by each block (from its leader) */
+	FILE* output; /* Output source (NULL during discovery) */
+} translator_t;
+
+/* Emit some C code (nothing during discovery) */
+static void emit(translator_t* translator, const char* format, ...) {
+	va_list args;
+	if (!translator->output)
+		return;
+	va_start(args, format);
+	vfprintf(translator->output, format, args);
+	va_end(args);
+}
+
+/* Check if an address is inside the image */
+static int in_image(const translator_t* translator, const uint32_t address) {
+	return address >= translator->image_start && address < translator->image_end;
+}
+
+/* Add a new leader (discovery only) */
+static void add_leader(translator_t* translator, const uint16_t address) {
+	if (translator->output || !in_image(translator, address)
+			|| translator->leaders[address & MEMORY_MASK])
+		return;
+	translator->leaders[address & MEMORY_MASK] = 1;
+	translator->worklist[translator->worklist_count++] = address & MEMORY_MASK;
+}
+
+/* Check if an instruction can be translated */
+static int translatable(const translator_t* translator,
+		const SkyCPU_instruction_t* instruction) {
+	return SkyCPU_mnemonic(instruction->opcode) != NULL
+			&& instruction->opcode <= INSTRUCTION_SBS /* Channels may stall */
+			&& in_image(translator, instruction->address)
+			&& in_image(translator,
+					(uint32_t) instruction->address + instruction->length - 1);
+}
+
+/* Bits mode width in bytes (0 if none) */
+static uint8_t width_of(const uint8_t bits_mode) {
+	return (bits_mode == DOUBLE_WORD) ? 4 : bits_mode;
+}
+
+/* Address expression of a pointed argument */
+static void address_expression(const SkyCPU_argument_t* argument,
+		const uint16_t instruction_address, char* buffer, const size_t size) {
+	switch (argument->type) {
+	case ARGUMENT_TYPE_POINTED_CONSTANT:
+		snprintf(buffer, size, "0x%04X", (unsigned) (argument->value & 0xFFFF));
+		break;
+
+	case ARGUMENT_TYPE_POINTED_REGISTER:
+		snprintf(buffer, size, "get16bitsValue(runtime->registers, %u)",
+				argument->code);
+		break;
+
+	default: /* ARGUMENT_TYPE_POINTED_SFR */
+		if (argument->code == REGISTER_PC)
+			snprintf(buffer, size, "0x%04X", instruction_address);
+		else if (argument->code == REGISTER_SP)
+			snprintf(buffer, size, "runtime->stack_pointer");
+		else
+			snprintf(buffer, size, "0x0000");
+		break;
+	}
+}
+
+/* Read expression of an argument (same as fetch_argument() of the core) */
+static void read_expression(const SkyCPU_instruction_t* instruction,
+		const SkyCPU_argument_t* argument, char* buffer, const size_t size) {
+	uint8_t width = width_of(instruction->bits_mode) * 8;
+	char address[64];
+
+	/* Switch according argument type */
+	switch (argument->type) {
+	case ARGUMENT_TYPE_CONSTANT:
+		snprintf(buffer, size, "0x%08lXUL", (unsigned long) argument->value);
+		break;
+
+	case ARGUMENT_TYPE_REGISTER:
+		if (width)
+			snprintf(buffer, size, "get%ubitsValue(runtime->registers, %u)",
+					width, argument->code);
+		else
+			snprintf(buffer, size, "0");
+		break;
+
+	case ARGUMENT_TYPE_SFR:
+		if (argument->code == REGISTER_PC)
+			snprintf(buffer, size, "0x%04XUL",
+					(instruction->bits_mode == SINGLE_BYTE) ?
+							(instruction->address & 0xFF) : instruction->address);
+		else if (argument->code == REGISTER_SP)
+			snprintf(buffer, size, (instruction->bits_mode == SINGLE_BYTE) ?
+					"(runtime->stack_pointer & 0xFF)" : "runtime->stack_pointer");
+		else
+			snprintf(buffer, size, "0");
+		break;
+
+	default: /* Pointed arguments */
+		address_expression(argument, instruction->address, address,
+				sizeof(address));
+		if (width)
+			snprintf(buffer, size, "get%ubitsValue(runtime->memory, %s)", width,
+					address);
+		else
+			snprintf(buffer, size, "0");
+		break;
+	}
+}
+
+/* Emit the commit of a value into an argument (same as commit_register() of the core) */
+/* Return 1 if PC is written, 2 if memory is written, 0 otherwise */
+static int emit_commit(translator_t* translator,
+		const SkyCPU_instruction_t* instruction,
+		const SkyCPU_argument_t* argument, const char* value) {
+	uint8_t width = width_of(instruction->bits_mode);
+	char address[64];
+
+	/* Switch according argument type */
+	switch (argument->type) {
+	case ARGUMENT_TYPE_CONSTANT: /* Read only */
+		return 0;
+
+	case ARGUMENT_TYPE_REGISTER:
+		if (width)
+			emit(translator, "\tset%ubitsValue(runtime->registers, %u, %s);\n",
+					width * 8, argument->code, value);
+		return 0;
+
+	case ARGUMENT_TYPE_SFR:
+		if (argument->code == REGISTER_PC) {
+			emit(translator, "\truntime->program_counter = %s;\n", value);
+			return 1;
+		}
+		if (argument->code == REGISTER_SP)
+			emit(translator, "\truntime->stack_pointer = %s;\n", value);
+		return 0;
+
+	default: /* Pointed arguments */
+		if (!width)
+			return 0;
+		address_expression(argument, instruction->address, address,
+				sizeof(address));
+		emit(translator, "\taddress = %s;\n", address);
+		emit(translator, "\tset%ubitsValue(runtime->memory, address, %s);\n",
+				width * 8, value);
+		emit(translator, "\tSkyCPU_page_touch(runtime, address, %u);\n", width);
+		return 2;
+	}
+}
+
+/* Emit a block exit */
+static void emit_exit(translator_t* translator, const uint16_t address,
+		const int pending_skip) {
+	if (pending_skip)
+		emit(translator, "\truntime->skip_next = skip;\n");
+	emit(translator, "\truntime->program_counter = 0x%04X;\n", address);
+	emit(translator, "\treturn n;\n");
+}
+
+/* Emit the check of code pages writes */
+static void emit_code_check(translator_t* translator, const uint16_t next) {
+	emit(translator, "\tif (runtime->page_events & SKYCPU_PAGE_CODE) {\n");
+	emit(translator, "\t\truntime->program_counter = 0x%04X;\n", next);
+	emit(translator, "\t\treturn n;\n");
+	emit(translator, "\t}\n");
+}
+
+/* Emit the result computation of an ALU instruction (same as the core) */
+static void emit_result(translator_t* translator,
+		const SkyCPU_instruction_t* instruction) {
+	uint8_t mode = instruction->bits_mode;
+
+	/* Switch according instruction */
+	switch (instruction->opcode) {
+	case INSTRUCTION_ADD: emit(translator, "\tR = A + B;\n"); break;
+	case INSTRUCTION_SUB: emit(translator, "\tR = A - B;\n"); break;
+	case INSTRUCTION_MUL: emit(translator, "\tR = A * B;\n"); break;
+	case INSTRUCTION_DIV: emit(translator, "\tR = B ? A / B : 0;\n"); break;
+	case INSTRUCTION_INC: emit(translator, "\tR = A + 1;\n"); break;
+	case INSTRUCTION_DEC: emit(translator, "\tR = A - 1;\n"); break;
+	case INSTRUCTION_CLR: emit(translator, "\tR = 0;\n"); break;
+	case INSTRUCTION_SET: emit(translator, "\tR = 0xFFFFFFFF;\n"); break;
+	case INSTRUCTION_AND: emit(translator, "\tR = A & B;\n"); break;
+	case INSTRUCTION_NAND: emit(translator, "\tR = ~(A & B);\n"); break;
+	case INSTRUCTION_OR: emit(translator, "\tR = A | B;\n"); break;
+	case INSTRUCTION_NOR: emit(translator, "\tR = ~(A | B);\n"); break;
+	case INSTRUCTION_XOR: emit(translator, "\tR = A ^ B;\n"); break;
+	case INSTRUCTION_NOT: emit(translator, "\tR = ~A;\n"); break;
+	case INSTRUCTION_NEG: emit(translator, "\tR = !A;\n"); break;
+	case INSTRUCTION_SBI: emit(translator, "\tR = A | (1UL << (B & 31));\n"); break;
+	case INSTRUCTION_CLI: emit(translator, "\tR = A & ~(1UL << (B & 31));\n"); break;
+	case INSTRUCTION_LSL: emit(translator, "\tR = A << (B & 31);\n"); break;
+	case INSTRUCTION_LSR: emit(translator, "\tR = A >> (B & 31);\n"); break;
+	case INSTRUCTION_MOV: emit(translator, "\tR = B;\n"); break;
+
+	case INSTRUCTION_ROL:
+		if (mode == NO_TYPE)
+			emit(translator, "\tR = 0;\n");
+		else
+			emit(translator, "\tR = ((A & (1UL << %u)) ? 1 : 0) | (A << (B & 31));\n",
+					width_of(mode) * 8 - 1);
+		break;
+
+	case INSTRUCTION_ROR:
+		if (mode == NO_TYPE)
+			emit(translator, "\tR = 0;\n");
+		else
+			emit(translator, "\tR = ((A & 1) ? (1UL << %u) : 0) | (A >> (B & 31));\n",
+					width_of(mode) * 8 - 1);
+		break;
+
+	case INSTRUCTION_SWAP:
+		emit(translator, "\tR = 0;\n");
+		if (mode == SINGLE_BYTE)
+			emit(translator, "\tR = A;\n");
+		else if (mode == SINGLE_WORD) {
+			emit(translator, "\t((uint8_t*) &R)[1] = ((uint8_t*) &A)[0];\n");
+			emit(translator, "\t((uint8_t*) &R)[0] = ((uint8_t*) &A)[1];\n");
+		} else if (mode == DOUBLE_WORD) {
+			emit(translator, "\t((uint8_t*) &R)[3] = ((uint8_t*) &A)[0];\n");
+			emit(translator, "\t((uint8_t*) &R)[2] = ((uint8_t*) &A)[1];\n");
+			emit(translator, "\t((uint8_t*) &R)[1] = ((uint8_t*) &A)[2];\n");
+			emit(translator, "\t((uint8_t*) &R)[0] = ((uint8_t*) &A)[3];\n");
+		}
+		break;
+	}
+}
+
+/* Skip condition of a conditional instruction (same as the core) */
+static const char* skip_condition(const uint8_t opcode) {
+	switch (opcode) {
+	case INSTRUCTION_JN: case INSTRUCTION_SNN: return "A";
+	case INSTRUCTION_JNN: case INSTRUCTION_SN: return "!A";
+	case INSTRUCTION_JNE: case INSTRUCTION_SE: return "A == B";
+	case INSTRUCTION_JE: case INSTRUCTION_SNE: return "A != B";
+	case INSTRUCTION_JLE: case INSTRUCTION_SG: return "A > B";
+	case INSTRUCTION_JL: case INSTRUCTION_SGE: return "A >= B";
+	case INSTRUCTION_JGE: case INSTRUCTION_SL: return "A < B";
+	case INSTRUCTION_JG: case INSTRUCTION_SLE: return "A <= B";
+	case INSTRUCTION_JBS: case INSTRUCTION_SBC: return "!(A & (1UL << (B & 31)))";
+	default: /* INSTRUCTION_JBC, INSTRUCTION_SBS */ return "A & (1UL << (B & 31))";
+	}
+}
+
+/* Emit one instruction, return 1 if the block is over (instruction left the block) */
+static int emit_instruction(translator_t* translator,
+		const SkyCPU_instruction_t* instruction) {
+	uint16_t next = instruction->address + instruction->length;
+	const SkyCPU_argument_t* arg_A = &instruction->arguments[0];
+	const SkyCPU_argument_t* arg_B = &instruction->arguments[1];
+	uint8_t width = width_of(instruction->bits_mode);
+	char value[128];
+	int commit = 0;
+
+	/* Fetch arguments */
+	if (instruction->arguments_count >= 1) {
+		read_expression(instruction, arg_A, value, sizeof(value));
+		emit(translator, "\tA = %s;\n", value);
+	}
+	if (instruction->arguments_count >= 2) {
+		read_expression(instruction, arg_B, value, sizeof(value));
+		emit(translator, "\tB = %s;\n", value);
+	}
+
+	/* Conditional instructions */
+	if (SkyCPU_is_conditional(instruction->opcode)) {
+		emit(translator, "\tskip = (%s) ? 1 : 0;\n",
+				skip_condition(instruction->opcode));
+		return 0;
+	}
+
+	/* Switch according instruction */
+	switch (instruction->opcode) {
+	case INSTRUCTION_NOP:
+		return 0;
+
+	case INSTRUCTION_RET:
+		emit(translator, "\truntime->program_counter = "
+				"get16bitsValue(runtime->memory, runtime->stack_pointer);\n");
+		emit(translator, "\truntime->stack_pointer += 2;\n");
+		emit(translator, "\treturn n;\n");
+		return 1;
+
+	case INSTRUCTION_JMP:
+		if (arg_A->type == ARGUMENT_TYPE_CONSTANT)
+			add_leader(translator, arg_A->value & 0xFFFF);
+		emit(translator, "\truntime->program_counter = A & 0xFFFF;\n");
+		emit(translator, "\treturn n;\n");
+		return 1;
+
+	case INSTRUCTION_CALL:
+		if (arg_A->type == ARGUMENT_TYPE_CONSTANT)
+			add_leader(translator, arg_A->value & 0xFFFF);
+		add_leader(translator, next);
+		emit(translator, "\truntime->stack_pointer -= 2;\n");
+		emit(translator, "\tset16bitsValue(runtime->memory, "
+				"runtime->stack_pointer, 0x%04X);\n", next);
+		emit(translator, "\tSkyCPU_page_touch(runtime, runtime->stack_pointer, 2);\n");
+		emit(translator, "\truntime->program_counter = A & 0xFFFF;\n");
+		emit(translator, "\treturn n;\n");
+		return 1;
+
+	case INSTRUCTION_BRK:
+	case INSTRUCTION_INT:
+		add_leader(translator, next);
+		emit(translator, "\truntime->program_counter = 0x%04X;\n", next);
+		emit(translator, "\truntime->%s_callback(A);\n",
+				(instruction->opcode == INSTRUCTION_BRK) ?
+						"breakpoint" : "interrupt");
+		emit(translator, "\treturn n;\n");
+		return 1;
+
+	case INSTRUCTION_PUSH:
+		if (!width)
+			return 0;
+		emit(translator, "\truntime->stack_pointer -= %u;\n", width);
+		emit(translator, "\tset%ubitsValue(runtime->memory, "
+				"runtime->stack_pointer, A);\n", width * 8);
+		emit(translator, "\tSkyCPU_page_touch(runtime, runtime->stack_pointer, %u);\n",
+				width);
+		emit_code_check(translator, next);
+		return 0;
+
+	case INSTRUCTION_POP:
+		if (width) {
+			emit(translator, "\tR = get%ubitsValue(runtime->memory, "
+					"runtime->stack_pointer);\n", width * 8);
+			emit(translator, "\truntime->stack_pointer += %u;\n", width);
+		} else
+			emit(translator, "\tR = 0;\n");
+		commit = emit_commit(translator, instruction, arg_A, "R");
+		break;
+
+	case INSTRUCTION_CXH:
+		commit = emit_commit(translator, instruction, arg_B, "A");
+		commit |= emit_commit(translator, instruction, arg_A, "B");
+		break;
+
+	default: /* ALU instructions */
+		emit_result(translator, instruction);
+		commit = emit_commit(translator, instruction, arg_A, "R");
+		if (instruction->opcode == INSTRUCTION_MOV && (commit & 1)
+				&& arg_B->type == ARGUMENT_TYPE_CONSTANT)
+			add_leader(translator, arg_B->value & 0xFFFF);
+		break;
+	}
+
+	/* PC written : leave the block */
+	if (commit & 1) {
+		emit(translator, "\treturn n;\n");
+		return 1;
+	}
+
+	/* Memory written : check for code pages writes */
+	if (commit & 2)
+		emit_code_check(translator, next);
+	return 0;
+}
+
+/* Walk (and emit) a block, starting at a leader */
+static void walk_block(translator_t* translator, const uint16_t leader) {
+	SkyCPU_instruction_t instruction;
+	uint32_t length = 0;
+	uint16_t address = leader;
+	int guarded = 0, labelled = 0, over;
+	char text[64];
+
+	/* Empty block (nothing to translate at entry point) */
+	SkyCPU_decode(translator->memory, address, &instruction);
+	if (!translatable(translator, &instruction)) {
+		add_leader(translator, address + instruction.length);
+		return;
+	}
+
+	/* Block prologue */
+	emit(translator, "/* Block 0x%04X */\n", leader);
+	emit(translator, "static uint32_t block_%04X(SkyCPU_runtime_t* runtime) {\n",
+			leader);
+	emit(translator, "\tuint32_t n = 0, A = 0, B = 0, R = 0;\n");
+	emit(translator, "\tuint16_t address = 0;\n");
+	emit(translator, "\tuint8_t skip = 0;\n");
+	emit(translator, "\t(void) A; (void) B; (void) R; (void) address; (void) skip;\n\n");
+
+	/* Walk instructions */
+	for (;;) {
+
+		/* Label (target of a skip) */
+		if (labelled)
+			emit(translator, "L_%04X:\n", address);
+
+		/* Check for block end (before the instruction) */
+		SkyCPU_decode(translator->memory, address, &instruction);
+		if (length >= MAX_BLOCK_LENGTH || !translatable(translator, &instruction)
+				|| (address != leader && translator->leaders[address])) {
+			add_leader(translator, address);
+			emit_exit(translator, address, guarded);
+			break;
+		}
+
+		/* Instruction header */
+		SkyCPU_disassemble(&instruction, text, sizeof(text));
+		emit(translator, "\t/* 0x%04X: %s */\n", address, text);
+		emit(translator, "\t++n;\n");
+		if (guarded) /* Skipped instruction : go to the next one */
+			emit(translator, "\tif (skip) {\n\t\tskip = 0;\n\t\tgoto L_%04X;\n\t}\n",
+					(uint16_t) (address + instruction.length));
+		++length;
+
+		/* Mark code pages */
+		translator->code_pages[(address & MEMORY_MASK) >> SKYCPU_PAGE_SHIFT] = 1;
+		translator->code_pages[((address + instruction.length - 1) & MEMORY_MASK)
+				>> SKYCPU_PAGE_SHIFT] = 1;
+		translator->block_sizes[leader] = (uint16_t) (address
+				+ instruction.length - leader);
+
+		/* Instruction body */
+		over = emit_instruction(translator, &instruction);
+		emit(translator, "\n");
+
+		/* A left block end only if not skippable */
+		labelled = guarded;
+		if (over && guarded)
+			over = 0;
+		guarded = SkyCPU_is_conditional(instruction.opcode);
+		if (over)
+			break;
+		address += instruction.length;
+	}
+
+	/* Block epilogue */
+	emit(translator, "}\n\n");
+	if (length > translator->max_block_length)
+		translator->max_block_length = length;
+}
+
+/* Program entry point */
+int main(int argc, char** argv) {
+	static translator_t translator;
+	uint32_t load_address = 0, size, i, entries_count = 0, pages_count = 0;
+	FILE* file;
+
+	/* Check arguments */
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s image.bin output.c [load_address [entry ...]]\n",
+				argv[0]);
+		return 1;
+	}
+	if (argc > 3)
+		load_address = strtoul(argv[3], NULL, 16) & MEMORY_MASK;
+
+	/* Load guest image */
+	file = fopen(argv[1], "rb");
+	if (!file) {
+		perror(argv[1]);
+		return 1;
+	}
+	size = fread(translator.memory + load_address, 1,
+			MEMORY_MASK + 1 - load_address, file);
+	fclose(file);
+	translator.image_start = load_address;
+	translator.image_end = load_address + size;
+
+	/* Discover blocks from entry points */
+	if (argc > 4)
+		for (i = 4; i < (uint32_t) argc; ++i)
+			add_leader(&translator, strtoul(argv[i], NULL, 16));
+	else
+		add_leader(&translator, load_address);
+	while (translator.worklist_count)
+		walk_block(&translator,
+				translator.worklist[--translator.worklist_count]);
+
+	/* Open output */
+	translator.output = fopen(argv[2], "w");
+	if (!translator.output) {
+		perror(argv[2]);
+		return 1;
+	}
+	memset(translator.code_pages, 0, sizeof(translator.code_pages));
+	translator.max_block_length = 0;
+
+	/* Emit blocks */
+	emit(&translator, "/* Generated by SkyAOT from \"%s\" (do not edit) */\n\n",
+			argv[1]);
+	emit(&translator, "#include \"SkyCPU_aot.h\"\n\n");
+	for (i = 0; i <= MEMORY_MASK; ++i)
+		if (translator.leaders[i]) {
+			SkyCPU_instruction_t instruction;
+			SkyCPU_decode(translator.memory, i, &instruction);
+			if (translatable(&translator, &instruction)) {
+				walk_block(&translator, i);
+				++entries_count;
+			}
+		}
+
+	/* Emit blocks table */
+	emit(&translator, "static const SkyCPU_aot_entry_t entries[] = {\n");
+	for (i = 0; i <= MEMORY_MASK; ++i)
+		if (translator.leaders[i]) {
+			SkyCPU_instruction_t instruction;
+			SkyCPU_decode(translator.memory, i, &instruction);
+			if (translatable(&translator, &instruction))
+				emit(&translator, "\t{ 0x%04X, block_%04X, %u },\n", i, i,
+						translator.block_sizes[i]);
+		}
+	emit(&translator, "\t{ 0, 0, 0 }\n};\n\n");
+
+	/* Emit code pages content (compared on attach and after code writes) */
+	for (i = 0; i < SKYCPU_PAGE_COUNT; ++i)
+		if (translator.code_pages[i]) {
+			uint32_t j;
+			emit(&translator, "static const uint8_t page_%u[SKYCPU_PAGE_SIZE] = {", i);
+			for (j = 0; j < SKYCPU_PAGE_SIZE; ++j)
+				emit(&translator, "%s0x%02X%s", (j % 16) ? " " : "\n\t",
+						translator.memory[(i << SKYCPU_PAGE_SHIFT) + j],
+						(j + 1 < SKYCPU_PAGE_SIZE) ? "," : "");
+			emit(&translator, "\n};\n\n");
+		}
+
+	/* Emit code pages table */
+	emit(&translator, "static const SkyCPU_aot_page_t pages[] = {\n");
+	for (i = 0; i < SKYCPU_PAGE_COUNT; ++i)
+		if (translator.code_pages[i]) {
+			emit(&translator, "\t{ %u, 0x%08lXUL, page_%u },\n", i,
+					(unsigned long) SkyCPU_aot_checksum(translator.memory, i), i);
+			++pages_count;
+		}
+	emit(&translator, "\t{ 0, 0, 0 }\n};\n\n");
+
+	/* Emit module descriptor */
+	emit(&translator, "const SkyCPU_aot_descriptor_t skycpu_aot_module = {\n");
+	emit(&translator, "\tSKYCPU_AOT_VERSION, %u, %lu,\n", SKYCPU_PAGE_SHIFT,
+			(unsigned long) translator.max_block_length);
+	emit(&translator, "\t%lu, entries,\n", (unsigned long) entries_count);
+	emit(&translator, "\t%lu, pages\n};\n", (unsigned long) pages_count);
+	fclose(translator.output);
+
+	/* Report */
+	printf("%lu blocks, %lu code pages, longest block %lu instructions\n",
+			(unsigned long) entries_count, (unsigned long) pages_count,
+			(unsigned long) translator.max_block_length);
+	return 0;
+}
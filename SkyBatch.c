@@ -0,0 +1,169 @@
+/**
+ * @file SkyBatch.c
+ * @brief Run one guest image over every record of a columnar input file
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program load a guest image, boot it (run until its first BRK), then run it over every record of an\n
+ * input batch file on a pool of workers (see SkyCPU_batch.h). Each record is copied into the guest input buffer\n
+ * (size in r0:r1), the guest run from the booted state until BRK, then the guest output buffer is written into\n
+ * the output batch file. Records per second and records latency percentiles are printed at the end.\n
+ * With SKYCPU_NUMA, -n choose the workers placement (unpinned, local or remote, see SkyCPU_batch_placement_t)\n
+ * and the throughput of each node is printed too.\n
+ * \n
+ * Usage : SkyBatch [-w workers] [-i input_address] [-o output_address] [-s output_size] [-m max_instructions] [-n unpinned|local|remote] image.bin[@load_address] input.skyb output.skyb\n
+ * Build : cc -O2 -DSKYCPU_PAGE_TRACKING SkyBatch.c SkyCPU_batch.c FastSkyCPU.c SkyCPU_snapshot.c -lpthread -o SkyBatch\n
+ * Build (NUMA) : cc -O2 -DSKYCPU_PAGE_TRACKING -DSKYCPU_NUMA SkyBatch.c SkyCPU_batch.c SkyCPU_numa.c FastSkyCPU.c SkyCPU_snapshot.c -lpthread -lnuma -o SkyBatch\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_batch.h"
+#ifdef SKYCPU_MIRRORED_MEMORY
+#include "SkyCPU_mirror.h"
+#endif
+
+/* Batch settings */
+static uint32_t workers_count = 1;
+static uint32_t max_instructions = 10000000;
+static uint16_t input_address = 0x8000, output_address = 0x9000;
+static uint16_t output_size = 16;
+#ifdef SKYCPU_NUMA
+static SkyCPU_batch_placement_t placement = SKYCPU_BATCH_UNPINNED;
+#endif
+
+static int boot_image(SkyCPU_snapshot_t* image, const char* argument) {
+	static SkyCPU_runtime_t runtime;
+	static uint8_t buffer[MEMORY_MASK + 1];
+	char path[4096];
+	const char* at = strrchr(argument, '@');
+	uint16_t load_address = 0;
+	size_t size;
+	FILE* file;
+
+	/* Parse path[@load_address] */
+	snprintf(path, sizeof(path), "%.*s",
+			(int) (at ? (size_t) (at - argument) : strlen(argument)), argument);
+	if (at)
+		load_address = strtoul(at + 1, NULL, 16) & MEMORY_MASK;
+
+	/* Read image */
+	file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+	size = fread(buffer, 1, MEMORY_MASK + 1 - load_address, file);
+	fclose(file);
+
+	/* Load it (PC at load address) and run it until BRK */
+	SkyCPU_runtime_init(&runtime);
+#ifdef SKYCPU_MIRRORED_MEMORY
+	if (!runtime.memory && SkyCPU_mirror_map(&runtime))
+		return -1;
+#endif
+	memset(runtime.memory, 0, MEMORY_MASK + 1);
+	SkyCPU_memory_copy(&runtime, buffer, size, load_address);
+	runtime.program_counter = load_address;
+	if (SkyCPU_batch_boot(image, &runtime, max_instructions)) {
+		fprintf(stderr, "%s: no BRK within %u instructions (boot)\n", path,
+				max_instructions);
+		return -1;
+	}
+
+	/* No error */
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_snapshot_t image;
+	SkyCPU_batch_t batch;
+	int option;
+
+	/* Parse options */
+	while ((option = getopt(argc, argv, "w:i:o:s:m:n:")) != -1) {
+		switch (option) {
+		case 'w':
+			workers_count = atoi(optarg);
+			break;
+		case 'i':
+			input_address = strtoul(optarg, NULL, 16) & MEMORY_MASK;
+			break;
+		case 'o':
+			output_address = strtoul(optarg, NULL, 16) & MEMORY_MASK;
+			break;
+		case 's':
+			output_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			max_instructions = strtoul(optarg, NULL, 0);
+			break;
+#ifdef SKYCPU_NUMA
+		case 'n':
+			if (!strcmp(optarg, "local"))
+				placement = SKYCPU_BATCH_LOCAL;
+			else if (!strcmp(optarg, "remote"))
+				placement = SKYCPU_BATCH_REMOTE;
+			else if (strcmp(optarg, "unpinned"))
+				optind = argc;
+			break;
+#endif
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (argc - optind != 3 || !workers_count) {
+		fprintf(stderr, "Usage: %s [-w workers] [-i input_address] [-o output_address] [-s output_size] [-m max_instructions] [-n unpinned|local|remote] image.bin[@load_address] input.skyb output.skyb\n",
+				argv[0]);
+		return 1;
+	}
+
+	/* Boot the image once */
+	if (boot_image(&image, argv[optind]))
+		return 1;
+
+	/* Run all records */
+	if (SkyCPU_batch_open(&batch, &image, argv[optind + 1], argv[optind + 2],
+			input_address, output_address, output_size, max_instructions)) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+#ifdef SKYCPU_NUMA
+	batch.placement = placement;
+#endif
+	if (SkyCPU_batch_run(&batch, workers_count)) {
+		fprintf(stderr, "Cannot start %u workers\n", workers_count);
+		SkyCPU_batch_close(&batch);
+		return 1;
+	}
+	SkyCPU_batch_report(&batch, stderr);
+	if (SkyCPU_batch_close(&batch)) {
+		perror(argv[optind + 2]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file SkyBatchgen.c
+ * @brief Build and dump the columnar batch files of SkyBatch
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program build an input batch file (see SkyCPU_batch.h) from raw column files: each column file hold\n
+ * the values of one column, one value of the column width per record, back to back. All columns MUST hold the\n
+ * same records count. With -d it print a batch file instead (input or output file), one record per line with\n
+ * its columns in hexadecimal (the last column of an output file is the status, see SkyCPU_batch_status_t).\n
+ * \n
+ * Usage : SkyBatchgen input.skyb width:column.bin [width:column.bin ...]\n
+ * Usage : SkyBatchgen -d file.skyb\n
+ * Build : cc -O2 -DSKYCPU_PAGE_TRACKING SkyBatchgen.c -o SkyBatchgen\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_batch.h"
+
+/* Read a whole file (NULL on error) */
+static uint8_t* read_file(const char* path, size_t* size) {
+	uint8_t* buffer;
+	long length;
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return NULL;
+	}
+	if (fseek(file, 0, SEEK_END) || (length = ftell(file)) < 0
+			|| fseek(file, 0, SEEK_SET)) {
+		perror(path);
+		fclose(file);
+		return NULL;
+	}
+	buffer = malloc(length ? length : 1);
+	if (!buffer || fread(buffer, 1, length, file) != (size_t) length) {
+		fprintf(stderr, "%s: read error\n", path);
+		free(buffer);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+	*size = length;
+	return buffer;
+}
+
+static int build(const char* path, const int count, char** columns) {
+	SkyCPU_batch_header_t header;
+	uint8_t* data[SKYCPU_BATCH_MAX_COLUMNS];
+	size_t size;
+	uint32_t row = 0;
+	FILE* file;
+	int i, result = 1;
+
+	/* Columns (width:path) */
+	if (count > SKYCPU_BATCH_MAX_COLUMNS) {
+		fprintf(stderr, "At most %d columns\n", SKYCPU_BATCH_MAX_COLUMNS);
+		return 1;
+	}
+	memset(&header, 0, sizeof(header));
+	memset(data, 0, sizeof(data));
+	header.magic = SKYCPU_BATCH_MAGIC;
+	header.version = SKYCPU_BATCH_VERSION;
+	header.columns = count;
+	for (i = 0; i < count; ++i) {
+		char* colon = strchr(columns[i], ':');
+		header.widths[i] = colon ? strtoul(columns[i], NULL, 0) : 0;
+		if (!header.widths[i]) {
+			fprintf(stderr, "%s: expected width:column.bin\n", columns[i]);
+			goto cleanup;
+		}
+		row += header.widths[i];
+		data[i] = read_file(colon + 1, &size);
+		if (!data[i])
+			goto cleanup;
+		if (size % header.widths[i]
+				|| (i && size / header.widths[i] != header.records)) {
+			fprintf(stderr, "%s: not %llu values of %u bytes\n", colon + 1,
+					(unsigned long long) header.records, header.widths[i]);
+			goto cleanup;
+		}
+		header.records = size / header.widths[i];
+	}
+	if (row > MEMORY_MASK) {
+		fprintf(stderr, "Records larger than the guest memory\n");
+		goto cleanup;
+	}
+
+	/* Header then each column data */
+	file = fopen(path, "wb");
+	if (!file) {
+		perror(path);
+		goto cleanup;
+	}
+	result = fwrite(&header, sizeof(header), 1, file) != 1;
+	for (i = 0; i < count && !result; ++i)
+		result = fwrite(data[i], header.widths[i], header.records, file)
+				!= header.records;
+	if (fclose(file) || result) {
+		perror(path);
+		result = 1;
+	}
+
+cleanup:
+	for (i = 0; i < count; ++i)
+		free(data[i]);
+	return result;
+}
+
+static int dump(const char* path) {
+	const SkyCPU_batch_header_t* header;
+	uint64_t record, offset, row = 0;
+	uint32_t i, j;
+	size_t size;
+	uint8_t* file = read_file(path, &size);
+	if (!file)
+		return 1;
+
+	/* Check the header and the columns */
+	header = (const SkyCPU_batch_header_t*) file;
+	if (size < sizeof(SkyCPU_batch_header_t)
+			|| header->magic != SKYCPU_BATCH_MAGIC
+			|| header->version != SKYCPU_BATCH_VERSION || !header->columns
+			|| header->columns > SKYCPU_BATCH_MAX_COLUMNS) {
+		fprintf(stderr, "%s: not a batch file\n", path);
+		free(file);
+		return 1;
+	}
+	for (i = 0; i < header->columns; ++i)
+		row += header->widths[i];
+	if (!row || header->records
+			> (size - sizeof(SkyCPU_batch_header_t)) / row) {
+		fprintf(stderr, "%s: truncated batch file\n", path);
+		free(file);
+		return 1;
+	}
+
+	/* One record per line, columns in hexadecimal */
+	printf("records=%llu columns=%u widths=", (unsigned long long) header->records,
+			header->columns);
+	for (i = 0; i < header->columns; ++i)
+		printf(i ? ",%u" : "%u", header->widths[i]);
+	printf("\n");
+	for (record = 0; record < header->records; ++record) {
+		printf("%llu:", (unsigned long long) record);
+		offset = sizeof(SkyCPU_batch_header_t);
+		for (i = 0; i < header->columns; ++i) {
+			printf(" ");
+			for (j = 0; j < header->widths[i]; ++j)
+				printf("%02x", file[offset + record * header->widths[i] + j]);
+			offset += header->records * header->widths[i];
+		}
+		printf("\n");
+	}
+	free(file);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+
+	/* Dump or build */
+	if (argc == 3 && !strcmp(argv[1], "-d"))
+		return dump(argv[2]);
+	if (argc >= 3 && argv[1][0] != '-')
+		return build(argv[1], argc - 2, argv + 2);
+	fprintf(stderr, "Usage: %s input.skyb width:column.bin [width:column.bin ...]\n       %s -d file.skyb\n",
+			argv[0], argv[0]);
+	return 1;
+}
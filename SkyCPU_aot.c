@@ -0,0 +1,161 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <dlfcn.h>
+#include <string.h>
+#include "SkyCPU_aot.h"
+
+int SkyCPU_aot_load(SkyCPU_aot_module_t* module, const char* path) {
+	uint32_t i = 0;
+
+	/* Open shared object */
+	memset(module, 0, sizeof(SkyCPU_aot_module_t));
+	module->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!module->handle)
+		return -1;
+
+	/* Get & check module descriptor */
+	module->descriptor = (const SkyCPU_aot_descriptor_t*) dlsym(
+			module->handle, "skycpu_aot_module");
+	if (!module->descriptor
+			|| module->descriptor->version != SKYCPU_AOT_VERSION
+			|| module->descriptor->page_shift != SKYCPU_PAGE_SHIFT) {
+		SkyCPU_aot_unload(module);
+		return -1;
+	}
+
+	/* Build blocks lookup table (blocks covering too many pages are interpreted) */
+	for (; i < module->descriptor->entries_count; ++i) {
+		const SkyCPU_aot_entry_t* entry = &module->descriptor->entries[i];
+		uint16_t address = entry->address & MEMORY_MASK;
+		uint32_t first = address >> SKYCPU_PAGE_SHIFT;
+		uint32_t last = (address + entry->size - 1) >> SKYCPU_PAGE_SHIFT;
+		if (!entry->size || last - first >= 255)
+			continue;
+		module->blocks[address] = entry->block;
+		module->spans[address] = last - first + 1;
+	}
+
+	/* No error */
+	return 0;
+}
+
+void SkyCPU_aot_unload(SkyCPU_aot_module_t* module) {
+	if (module->handle)
+		dlclose(module->handle);
+	memset(module, 0, sizeof(SkyCPU_aot_module_t));
+}
+
+/**
+ * Check if a code page still hold its translated content (checksum as fast reject, then bytes compared)
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param page Pointer to the code page
+ * @return True if the page is unchanged
+ */
+static int page_matches(const SkyCPU_runtime_t* runtime,
+		const SkyCPU_aot_page_t* page) {
+	return SkyCPU_aot_checksum(runtime->memory, page->page) == page->checksum
+			&& !memcmp(runtime->memory + ((uint32_t) page->page << SKYCPU_PAGE_SHIFT),
+					page->content, SKYCPU_PAGE_SIZE);
+}
+
+int SkyCPU_aot_attach(const SkyCPU_aot_module_t* module,
+		SkyCPU_runtime_t* runtime) {
+	const SkyCPU_aot_page_t* pages = module->descriptor->pages;
+	uint32_t i = 0;
+
+	/* Check code pages against instance memory */
+	for (; i < module->descriptor->pages_count; ++i)
+		if (pages[i].page >= SKYCPU_PAGE_COUNT
+				|| !page_matches(runtime, &pages[i]))
+			return -1;
+
+	/* Flag code pages */
+	for (i = 0; i < module->descriptor->pages_count; ++i)
+		runtime->page_flags[pages[i].page] |= SKYCPU_PAGE_CODE;
+	runtime->page_events &= ~SKYCPU_PAGE_CODE;
+
+	/* No error */
+	return 0;
+}
+
+/**
+ * Check if all pages covered by a block still hold the translated code
+ *
+ * @param module Pointer to the attached module
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param address Block address
+ * @return True if the block can run
+ */
+static int block_valid(const SkyCPU_aot_module_t* module,
+		const SkyCPU_runtime_t* runtime, const uint16_t address) {
+	uint32_t page = address >> SKYCPU_PAGE_SHIFT, n = module->spans[address];
+	for (; n; --n, page = (page + 1) & (SKYCPU_PAGE_COUNT - 1))
+		if (!(runtime->page_flags[page] & SKYCPU_PAGE_CODE))
+			return 0;
+	return 1;
+}
+
+uint32_t SkyCPU_aot_check(const SkyCPU_aot_module_t* module,
+		SkyCPU_runtime_t* runtime) {
+	const SkyCPU_aot_page_t* pages = module->descriptor->pages;
+	uint32_t i = 0, count = 0;
+
+	/* Compare every code page with its translated content */
+	for (; i < module->descriptor->pages_count; ++i) {
+		if (page_matches(runtime, &pages[i])) {
+			runtime->page_flags[pages[i].page] |= SKYCPU_PAGE_CODE;
+			continue;
+		}
+		runtime->page_flags[pages[i].page] &= ~SKYCPU_PAGE_CODE;
+		++count;
+	}
+	runtime->page_events &= ~SKYCPU_PAGE_CODE;
+	return count;
+}
+
+uint32_t SkyCPU_aot_run(const SkyCPU_aot_module_t* module,
+		SkyCPU_runtime_t* runtime, const uint32_t max_instructions,
+		const uint8_t* halted) {
+	uint32_t count = 0, max_block_length = module->descriptor->max_block_length;
+
+	/* Run until halted or out of budget */
+	while (count < max_instructions && !(halted && *halted)) {
+		uint16_t address = runtime->program_counter & MEMORY_MASK;
+		SkyCPU_aot_block_t block = module->blocks[address];
+
+		/* A code page was written (written back pages are translated code again) */
+		if (runtime->page_events & SKYCPU_PAGE_CODE)
+			SkyCPU_aot_check(module, runtime);
+
+		/* Translated block (if its pages are untouched and enough budget left) */
+		if (block && !runtime->skip_next
+				&& max_instructions - count >= max_block_length
+				&& block_valid(module, runtime, address)) {
+			count += block(runtime);
+
+		} else { /* Interpreter */
+			SkyCPU_fetch_and_execute(runtime);
+			++count;
+		}
+	}
+
+	/* Return retired instructions count */
+	return count;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file SkyCPU_aot.h
+ * @brief Ahead-of-time translated code runtime for SkyCPU
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define the runtime side of the SkyAOT translator.\n
+ * SkyAOT turn a fixed guest image into C source (one function per basic block),\n
+ * compiled as a shared object and loaded here with dlopen().\n
+ * Translated blocks are used instead of the interpreter. Once a code page is written, code pages are checked\n
+ * again (checksum then content) : blocks covering a modified page fall back to the interpreter, others keep running.\n
+ * \n
+ * Generated code also include this header to get its types and helpers.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_PAGE_TRACKING to be defined for ALL source files (generated ones included) !
+ */
+
+#ifndef _SKYCPU_AOT_H_
+#define _SKYCPU_AOT_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+#include "Endian_utility.h"
+
+#ifndef SKYCPU_PAGE_TRACKING
+#error "SkyCPU AOT runtime require SKYCPU_PAGE_TRACKING"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Translated module ABI version */
+#define SKYCPU_AOT_VERSION 3
+
+/**
+ * Translated block type definition
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance to run
+ * @return Number of retired instructions
+ */
+typedef uint32_t (*SkyCPU_aot_block_t)(SkyCPU_runtime_t* runtime);
+
+/**
+ * Translated block entry (exported by generated code)
+ */
+typedef struct {
+	uint16_t address; /*!< Guest address of the block */
+	SkyCPU_aot_block_t block; /*!< Translated block */
+	uint16_t size; /*!< Bytes covered by the block (from its address) */
+} SkyCPU_aot_entry_t;
+
+/**
+ * Translated code page (exported by generated code)
+ */
+typedef struct {
+	uint16_t page; /*!< Page number (SKYCPU_PAGE_SHIFT) */
+	uint32_t checksum; /*!< Page content checksum (FNV-1a, fast reject) */
+	const uint8_t* content; /*!< Translated page content (SKYCPU_PAGE_SIZE bytes) */
+} SkyCPU_aot_page_t;
+
+/**
+ * Translated module descriptor (exported by generated code as "skycpu_aot_module")
+ */
+typedef struct {
+	uint32_t version; /*!< SKYCPU_AOT_VERSION */
+	uint32_t page_shift; /*!< SKYCPU_PAGE_SHIFT of the translator */
+	uint32_t max_block_length; /*!< Maximum instructions count of a block */
+	uint32_t entries_count; /*!< Number of translated blocks */
+	const SkyCPU_aot_entry_t* entries; /*!< Translated blocks */
+	uint32_t pages_count; /*!< Number of code pages */
+	const SkyCPU_aot_page_t* pages; /*!< Code pages */
+} SkyCPU_aot_descriptor_t;
+
+/**
+ * Loaded module structure
+ */
+typedef struct {
+	void* handle; /*!< dlopen() handle */
+	const SkyCPU_aot_descriptor_t* descriptor; /*!< Module descriptor */
+	SkyCPU_aot_block_t blocks[MEMORY_MASK + 1]; /*!< Translated block by address (NULL if none) */
+	uint8_t spans[MEMORY_MASK + 1]; /*!< Pages covered by the block at each address */
+} SkyCPU_aot_module_t;
+
+/**
+ * Compute the checksum of a memory page (FNV-1a)
+ *
+ * @param memory Memory space
+ * @param page Page number
+ * @return Checksum of the page
+ */
+static __inline__ uint32_t SkyCPU_aot_checksum(const uint8_t* memory,
+		const uint16_t page) {
+	uint32_t hash = 2166136261UL, i = 0;
+	for (; i < SKYCPU_PAGE_SIZE; ++i)
+		hash = (hash ^ memory[((uint32_t) page << SKYCPU_PAGE_SHIFT) + i])
+				* 16777619UL;
+	return hash;
+}
+
+/**
+ * Load a translated module (shared object)
+ *
+ * @param module Pointer to the module structure to fill
+ * @param path Path of the shared object
+ * @return 0 on success, -1 on error
+ */
+int SkyCPU_aot_load(SkyCPU_aot_module_t* module, const char* path);
+
+/**
+ * Unload a translated module
+ *
+ * @param module Pointer to the module to unload
+ */
+void SkyCPU_aot_unload(SkyCPU_aot_module_t* module);
+
+/**
+ * Attach a translated module to a SkyCPU runtime instance
+ *
+ * @remarks Code pages are checked against the instance memory and flagged as code.
+ * @param module Pointer to the loaded module
+ * @param runtime Pointer to the SkyCPU runtime instance (program already in memory)
+ * @return 0 on success, -1 if the instance memory does not match the translated image
+ */
+int SkyCPU_aot_attach(const SkyCPU_aot_module_t* module,
+		SkyCPU_runtime_t* runtime);
+
+/**
+ * Check the code pages of an instance against the translated image
+ *
+ * @remarks Called by SkyCPU_aot_run() once a code page is written, call it after a snapshot restore too.
+ * Modified pages lose SKYCPU_PAGE_CODE (blocks covering them are interpreted), pages matching again get it back.
+ * @param module Pointer to the attached module
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @return Number of modified code pages
+ */
+uint32_t SkyCPU_aot_check(const SkyCPU_aot_module_t* module,
+		SkyCPU_runtime_t* runtime);
+
+/**
+ * Run a SkyCPU runtime instance using translated code when possible
+ *
+ * @remarks Blocks covering a modified code page are interpreted.
+ * @param module Pointer to the attached module
+ * @param runtime Pointer to the SkyCPU runtime instance to run
+ * @param max_instructions Instructions budget
+ * @param halted Pointer to a "stop now" flag set by callbacks (can be NULL)
+ * @return Number of retired instructions
+ */
+uint32_t SkyCPU_aot_run(const SkyCPU_aot_module_t* module,
+		SkyCPU_runtime_t* runtime, const uint32_t max_instructions,
+		const uint8_t* halted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_AOT_H_ */
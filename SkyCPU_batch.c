@@ -0,0 +1,410 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SkyCPU_batch.h"
+#include "Endian_utility.h"
+#include "FastSkyCPU_opcodes.h"
+#ifdef SKYCPU_MIRRORED_MEMORY
+#include "SkyCPU_mirror.h"
+#endif
+
+/* Guest of the current thread stopped with BRK (set by the callback) */
+static __thread uint8_t halted;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* BRK end the record (or the boot), INT is ignored */
+static void on_breakpoint(uint32_t bcode) {
+	(void) bcode;
+	halted = 1;
+}
+
+static void on_interrupt(uint32_t icode) {
+	(void) icode;
+}
+
+int SkyCPU_batch_boot(SkyCPU_snapshot_t* image, SkyCPU_runtime_t* runtime,
+		const uint32_t max_instructions) {
+	uint32_t count = 0;
+
+	/* Run until BRK */
+	halted = 0;
+	SkyCPU_callback_setup(runtime, on_interrupt, on_breakpoint);
+	while (!halted && count < max_instructions) {
+		SkyCPU_fetch_and_execute(runtime);
+		++count;
+	}
+	if (!halted)
+		return -1;
+
+	/* Snapshot the booted instance (PC after the BRK) */
+	SkyCPU_snapshot_take(image, runtime);
+	return 0;
+}
+
+int SkyCPU_batch_open(SkyCPU_batch_t* batch, const SkyCPU_snapshot_t* image,
+		const char* input_path, const char* output_path,
+		const uint16_t input_address, const uint16_t output_address,
+		const uint16_t output_size, const uint32_t max_instructions) {
+	SkyCPU_batch_header_t output_header;
+	struct stat status;
+	uint64_t offset = sizeof(SkyCPU_batch_header_t), row = 0;
+	uint32_t i;
+	int saved_errno;
+
+	/* Map the input file (read sequentially) */
+	memset(batch, 0, sizeof(SkyCPU_batch_t));
+	batch->output_fd = -1;
+	batch->input_fd = open(input_path, O_RDONLY);
+	if (batch->input_fd < 0 || fstat(batch->input_fd, &status) < 0)
+		goto error;
+	if ((size_t) status.st_size < sizeof(SkyCPU_batch_header_t)) {
+		errno = EINVAL;
+		goto error;
+	}
+	batch->input_length = status.st_size;
+	batch->input = mmap(NULL, batch->input_length, PROT_READ, MAP_SHARED,
+			batch->input_fd, 0);
+	if (batch->input == MAP_FAILED) {
+		batch->input = NULL;
+		goto error;
+	}
+	madvise((void*) batch->input, batch->input_length, MADV_SEQUENTIAL);
+
+	/* Check the header and the columns (record fit into the guest memory) */
+	batch->header = (const SkyCPU_batch_header_t*) batch->input;
+	batch->records = batch->header->records;
+	if (batch->header->magic != SKYCPU_BATCH_MAGIC
+			|| batch->header->version != SKYCPU_BATCH_VERSION
+			|| !batch->header->columns
+			|| batch->header->columns > SKYCPU_BATCH_MAX_COLUMNS) {
+		errno = EINVAL;
+		goto error;
+	}
+	for (i = 0; i < batch->header->columns; ++i)
+		row += batch->header->widths[i];
+	if (!row || row > MEMORY_MASK || batch->records
+			> (batch->input_length - sizeof(SkyCPU_batch_header_t)) / row) {
+		errno = EINVAL;
+		goto error;
+	}
+	for (i = 0; i < batch->header->columns; ++i) {
+		batch->columns[i] = offset;
+		offset += batch->records * batch->header->widths[i];
+	}
+	batch->input_size = row;
+
+	/* Create the output file at its final size and map it */
+	batch->output_length = sizeof(SkyCPU_batch_header_t)
+			+ batch->records * ((uint64_t) output_size + 1);
+	batch->output_fd = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (batch->output_fd < 0
+			|| ftruncate(batch->output_fd, batch->output_length) < 0)
+		goto error;
+	batch->output = mmap(NULL, batch->output_length, PROT_READ | PROT_WRITE,
+			MAP_SHARED, batch->output_fd, 0);
+	if (batch->output == MAP_FAILED) {
+		batch->output = NULL;
+		goto error;
+	}
+	memset(&output_header, 0, sizeof(output_header));
+	output_header.magic = SKYCPU_BATCH_MAGIC;
+	output_header.version = SKYCPU_BATCH_VERSION;
+	output_header.records = batch->records;
+	output_header.columns = 2;
+	output_header.widths[0] = output_size;
+	output_header.widths[1] = 1;
+	memcpy(batch->output, &output_header, sizeof(output_header));
+
+	/* Run parameters */
+	batch->image = image;
+	batch->input_address = input_address;
+	batch->output_address = output_address;
+	batch->output_size = output_size;
+	batch->max_instructions = max_instructions;
+	return 0;
+
+error:
+	saved_errno = errno;
+	SkyCPU_batch_close(batch);
+	errno = saved_errno;
+	return -1;
+}
+
+/**
+ * Allocate the instance of a worker, from the worker thread (pinned and placed following the batch policy)
+ *
+ * @param worker Pointer to the worker
+ * @return 0 on success, -1 on error
+ */
+static int worker_setup(SkyCPU_batch_worker_t* worker) {
+	SkyCPU_runtime_t* runtime;
+#ifdef SKYCPU_NUMA
+	int memory_node = worker->node;
+
+	/* Pin the worker, then allocate its instance on the chosen node */
+	if (worker->batch->placement == SKYCPU_BATCH_UNPINNED)
+		memory_node = worker->node = SkyCPU_numa_current_node();
+	else if (SkyCPU_numa_pin(worker->node))
+		return -1;
+	if (worker->batch->placement == SKYCPU_BATCH_REMOTE)
+		memory_node = worker->node + 1;
+	runtime = SkyCPU_numa_runtime_create(memory_node);
+	if (!runtime)
+		return -1;
+	worker->memory_node = SkyCPU_numa_node_of(runtime->memory);
+#else
+	/* First touch by the worker thread */
+	runtime = calloc(1, sizeof(SkyCPU_runtime_t));
+	if (!runtime)
+		return -1;
+	SkyCPU_runtime_init(runtime);
+#ifdef SKYCPU_MIRRORED_MEMORY
+	if (SkyCPU_mirror_map(runtime)) {
+		free(runtime);
+		return -1;
+	}
+#endif
+#endif
+
+	/* Instance start as the booted image */
+	SkyCPU_callback_setup(runtime, on_interrupt, on_breakpoint);
+	memset(runtime->page_flags, SKYCPU_PAGE_DIRTY, SKYCPU_PAGE_COUNT);
+	worker->runtime = runtime;
+	return 0;
+}
+
+/**
+ * Free the instance of a worker
+ *
+ * @param worker Pointer to the worker
+ */
+static void worker_cleanup(SkyCPU_batch_worker_t* worker) {
+	if (!worker->runtime)
+		return;
+#ifdef SKYCPU_NUMA
+	SkyCPU_numa_runtime_destroy(worker->runtime);
+#else
+#ifdef SKYCPU_MIRRORED_MEMORY
+	SkyCPU_mirror_unmap(worker->runtime);
+#endif
+	free(worker->runtime);
+#endif
+	worker->runtime = NULL;
+}
+
+/**
+ * Run one record
+ *
+ * @param worker Pointer to the worker
+ * @param record Record index
+ */
+static void run_record(SkyCPU_batch_worker_t* worker, const uint64_t record) {
+	SkyCPU_batch_t* batch = worker->batch;
+	SkyCPU_runtime_t* runtime = worker->runtime;
+	const SkyCPU_batch_header_t* header = batch->header;
+	uint8_t* output = batch->output + sizeof(SkyCPU_batch_header_t)
+			+ record * batch->output_size;
+	uint16_t address = batch->input_address;
+	uint32_t count = 0, i;
+
+	/* Reset to the booted image (dirty pages only) */
+	SkyCPU_snapshot_restore(batch->image, runtime);
+
+	/* Gather the record columns into the input buffer (size in r0:r1) */
+	for (i = 0; i < header->columns; ++i) {
+		SkyCPU_memory_copy(runtime,
+				batch->input + batch->columns[i] + record * header->widths[i],
+				header->widths[i], address);
+		address += header->widths[i];
+	}
+	set16bitsValue(runtime->registers, REGISTER_0, batch->input_size);
+
+	/* Run until BRK or out of budget */
+	halted = 0;
+	while (!halted && count < batch->max_instructions) {
+		SkyCPU_fetch_and_execute(runtime);
+		++count;
+	}
+
+	/* Output buffer and status */
+	for (i = 0; i < batch->output_size; ++i)
+		output[i] = runtime->memory[(batch->output_address + i) & MEMORY_MASK];
+	batch->output[sizeof(SkyCPU_batch_header_t)
+			+ batch->records * batch->output_size + record] = halted ?
+			SKYCPU_BATCH_DONE : SKYCPU_BATCH_BUDGET;
+	worker->instructions += count;
+	if (!halted)
+		++worker->exhausted;
+}
+
+static void* worker_main(void* argument) {
+	SkyCPU_batch_worker_t* worker = argument;
+	SkyCPU_batch_t* batch = worker->batch;
+
+	/* Own instance (stop all workers on error) */
+	if (worker_setup(worker)) {
+		worker->failed = 1;
+		__atomic_store_n(&batch->next, batch->records, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	/* Take records by chunks until the end of the input */
+	for (;;) {
+		uint64_t first = __atomic_fetch_add(&batch->next, SKYCPU_BATCH_CHUNK,
+				__ATOMIC_RELAXED), record;
+		if (first >= batch->records)
+			return NULL;
+		for (record = first; record < first + SKYCPU_BATCH_CHUNK
+				&& record < batch->records; ++record) {
+			uint64_t started = now_ns();
+			run_record(worker, record);
+			SkyCPU_latency_record(&worker->latency, now_ns() - started);
+			++worker->records;
+		}
+	}
+}
+
+int SkyCPU_batch_run(SkyCPU_batch_t* batch, const uint32_t workers_count) {
+	uint64_t started = now_ns();
+	uint32_t i, started_count = 0;
+	int result = 0;
+
+	/* Workers (instances allocated by the workers threads) */
+	free(batch->workers);
+	batch->workers = calloc(workers_count, sizeof(SkyCPU_batch_worker_t));
+	batch->workers_count = 0;
+	if (!workers_count || !batch->workers)
+		return -1;
+	batch->next = 0;
+	for (i = 0; i < workers_count; ++i) {
+		SkyCPU_batch_worker_t* worker = &batch->workers[i];
+		worker->batch = batch;
+#ifdef SKYCPU_NUMA
+		worker->node = i % SkyCPU_numa_nodes();
+		worker->memory_node = -1;
+#endif
+		if (pthread_create(&worker->thread, NULL, worker_main, worker)) {
+			result = -1;
+			break;
+		}
+		++started_count;
+	}
+
+	/* Wait for the end of the input (stop early on error) */
+	if (result)
+		__atomic_store_n(&batch->next, batch->records, __ATOMIC_RELAXED);
+	for (i = 0; i < started_count; ++i) {
+		pthread_join(batch->workers[i].thread, NULL);
+		if (batch->workers[i].failed)
+			result = -1;
+		worker_cleanup(&batch->workers[i]);
+	}
+	batch->workers_count = started_count;
+	batch->elapsed = now_ns() - started;
+	return result;
+}
+
+void SkyCPU_batch_report(const SkyCPU_batch_t* batch, FILE* stream) {
+	static SkyCPU_latency_t latency;
+	uint64_t records = 0, exhausted = 0, instructions = 0;
+	double seconds = batch->elapsed / 1e9;
+	uint32_t i;
+#ifdef SKYCPU_NUMA
+	int node;
+#endif
+
+	/* Merge workers */
+	memset(&latency, 0, sizeof(latency));
+	for (i = 0; i < batch->workers_count; ++i) {
+		SkyCPU_latency_merge(&latency, &batch->workers[i].latency);
+		records += batch->workers[i].records;
+		exhausted += batch->workers[i].exhausted;
+		instructions += batch->workers[i].instructions;
+	}
+	if (seconds <= 0)
+		seconds = 1e-9;
+
+	fprintf(stream, "records=%llu exhausted=%llu workers=%u time=%.3fs records/s=%.0f instructions/s=%.0f\n",
+			(unsigned long long) records, (unsigned long long) exhausted,
+			batch->workers_count, seconds, records / seconds,
+			instructions / seconds);
+#ifdef SKYCPU_NUMA
+	/* Per node throughput (local = workers with their guest memory on their node) */
+	for (node = 0; node < SKYCPU_NUMA_MAX_NODES; ++node) {
+		uint64_t node_records = 0, node_instructions = 0;
+		uint32_t node_workers = 0, node_local = 0;
+		for (i = 0; i < batch->workers_count; ++i) {
+			if (batch->workers[i].node != node)
+				continue;
+			++node_workers;
+			node_records += batch->workers[i].records;
+			node_instructions += batch->workers[i].instructions;
+			if (batch->workers[i].memory_node == node)
+				++node_local;
+		}
+		if (node_workers)
+			fprintf(stream, "node%d workers=%u local=%u records/s=%.0f instructions/s=%.0f\n",
+					node, node_workers, node_local, node_records / seconds,
+					node_instructions / seconds);
+	}
+#endif
+	fprintf(stream, "latency p50=%lluns p90=%lluns p99=%lluns p99.9=%lluns max=%lluns\n",
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 50),
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 90),
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 99),
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 99.9),
+			(unsigned long long) latency.max);
+}
+
+int SkyCPU_batch_close(SkyCPU_batch_t* batch) {
+	int result = 0;
+
+	/* Flush and unmap the output file */
+	if (batch->output) {
+		if (msync(batch->output, batch->output_length, MS_SYNC) < 0)
+			result = -1;
+		munmap(batch->output, batch->output_length);
+	}
+	if (batch->output_fd >= 0)
+		close(batch->output_fd);
+	if (batch->input)
+		munmap((void*) batch->input, batch->input_length);
+	if (batch->input_fd >= 0)
+		close(batch->input_fd);
+	free(batch->workers);
+	batch->output = NULL;
+	batch->input = NULL;
+	batch->output_fd = batch->input_fd = -1;
+	batch->workers = NULL;
+	batch->workers_count = 0;
+	return result;
+}
@@ -0,0 +1,202 @@
+/**
+ * @file SkyCPU_batch.h
+ * @brief Batch mode: run one booted image over every record of a columnar input file
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a data-parallel runner for "run this guest function over millions of records" jobs.\n
+ * The image is booted once (run until its first BRK) and snapshotted. Workers threads own a runtime instance each\n
+ * and take records by chunks: the instance is reset to the booted image (dirty pages only), the record is copied\n
+ * into the fixed guest input buffer (input size in r0:r1), the guest run until BRK, then the fixed guest output\n
+ * buffer is copied into the output file.\n
+ * \n
+ * Batch files (input and output) are columnar, in host byte order: a header (SkyCPU_batch_header_t) followed by\n
+ * each column data (records * column width bytes). The columns of a record are packed, in order, into the guest\n
+ * input buffer. Output files have two columns: output buffer (output size bytes) and status (SkyCPU_batch_status_t).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_PAGE_TRACKING (snapshots). Input files are memory mapped (read only), output files are created\n
+ * at their final size and memory mapped, records are written in place by the workers (any order).\n
+ * With SKYCPU_NUMA, workers are pinned and their instance allocated following the batch placement policy.
+ */
+
+#ifndef _SKYCPU_BATCH_H_
+#define _SKYCPU_BATCH_H_
+
+/* Dependency */
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_snapshot.h"
+#include "SkyCPU_job.h"
+#ifdef SKYCPU_NUMA
+#include "SkyCPU_numa.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Batch files definition */
+#define SKYCPU_BATCH_MAGIC 0x534B5942UL /* "SKYB" */
+#define SKYCPU_BATCH_VERSION 1
+#define SKYCPU_BATCH_MAX_COLUMNS 16
+
+/* Records taken at once by a worker */
+#define SKYCPU_BATCH_CHUNK 256
+
+/**
+ * Record status (output status column)
+ */
+typedef enum {
+	SKYCPU_BATCH_DONE, /*!< Guest stopped with BRK */
+	SKYCPU_BATCH_BUDGET /*!< Instructions budget exhausted */
+} SkyCPU_batch_status_t;
+
+/**
+ * Batch file header
+ */
+typedef struct {
+	uint32_t magic; /*!< SKYCPU_BATCH_MAGIC */
+	uint32_t version; /*!< SKYCPU_BATCH_VERSION */
+	uint64_t records; /*!< Records count */
+	uint32_t columns; /*!< Columns count (up to SKYCPU_BATCH_MAX_COLUMNS) */
+	uint32_t widths[SKYCPU_BATCH_MAX_COLUMNS]; /*!< Columns widths in bytes */
+	uint32_t reserved;
+} SkyCPU_batch_header_t;
+
+#ifdef SKYCPU_NUMA
+/**
+ * Workers placement policy (NUMA)
+ */
+typedef enum {
+	SKYCPU_BATCH_UNPINNED, /*!< Workers not pinned, instances allocated where the worker run at start */
+	SKYCPU_BATCH_LOCAL, /*!< Worker i pinned to node i, its instance allocated on node i (modulo nodes) */
+	SKYCPU_BATCH_REMOTE /*!< Worker i pinned to node i, its instance allocated on node i + 1 (comparison) */
+} SkyCPU_batch_placement_t;
+#endif
+
+struct SkyCPU_batch;
+
+/**
+ * Batch worker (one thread and runtime instance each)
+ */
+typedef struct {
+	struct SkyCPU_batch* batch; /*!< Batch run */
+	pthread_t thread; /*!< Worker thread */
+	SkyCPU_runtime_t* runtime; /*!< Runtime instance (allocated by the worker thread) */
+	SkyCPU_latency_t latency; /*!< Records latency (reset, input, run, output) */
+	uint64_t records; /*!< Records done */
+	uint64_t exhausted; /*!< Records stopped by the instructions budget */
+	uint64_t instructions; /*!< Retired instructions */
+	uint8_t failed; /*!< Instance allocation failure */
+#ifdef SKYCPU_NUMA
+	int node; /*!< Node running the worker */
+	int memory_node; /*!< Node holding the instance guest memory (-1 if unknown) */
+#endif
+} SkyCPU_batch_worker_t;
+
+/**
+ * Batch structure
+ */
+typedef struct SkyCPU_batch {
+	const SkyCPU_snapshot_t* image; /*!< Booted image */
+	uint16_t input_address; /*!< Guest input buffer */
+	uint16_t input_size; /*!< Record size (sum of the input columns widths) */
+	uint16_t output_address; /*!< Guest output buffer */
+	uint16_t output_size; /*!< Guest output buffer size */
+	uint32_t max_instructions; /*!< Instructions budget of a record */
+	int input_fd, output_fd; /*!< Batch files */
+	const uint8_t* input; /*!< Input file mapping */
+	uint8_t* output; /*!< Output file mapping */
+	size_t input_length, output_length; /*!< Files mappings sizes */
+	const SkyCPU_batch_header_t* header; /*!< Input file header */
+	uint64_t columns[SKYCPU_BATCH_MAX_COLUMNS]; /*!< Input columns offsets in the file */
+	uint64_t records; /*!< Records count */
+	uint64_t next; /*!< Next record to take (atomic) */
+	SkyCPU_batch_worker_t* workers; /*!< Workers of the last run */
+	uint32_t workers_count; /*!< Workers count */
+	uint64_t elapsed; /*!< Duration of the last run (nanoseconds) */
+#ifdef SKYCPU_NUMA
+	SkyCPU_batch_placement_t placement; /*!< Workers placement (set after open, SKYCPU_BATCH_UNPINNED by default) */
+#endif
+} SkyCPU_batch_t;
+
+/**
+ * Boot an image: run a loaded instance until its first BRK, then snapshot it
+ *
+ * @param image Pointer to the snapshot to fill
+ * @param runtime Pointer to the SkyCPU runtime instance (image loaded, callbacks replaced)
+ * @param max_instructions Instructions budget of the boot
+ * @return 0 on success, -1 on error (budget exhausted before BRK)
+ */
+int SkyCPU_batch_boot(SkyCPU_snapshot_t* image, SkyCPU_runtime_t* runtime,
+		const uint32_t max_instructions);
+
+/**
+ * Open a batch: map the input file, create and map the output file
+ *
+ * @param batch Pointer to the batch to open
+ * @param image Pointer to the booted image (MUST stay valid until the batch is closed)
+ * @param input_path Input batch file
+ * @param output_path Output batch file (created or truncated)
+ * @param input_address Guest input buffer
+ * @param output_address Guest output buffer
+ * @param output_size Guest output buffer size
+ * @param max_instructions Instructions budget of a record
+ * @return 0 on success, -1 on error (errno set, EINVAL for a bad input file)
+ */
+int SkyCPU_batch_open(SkyCPU_batch_t* batch, const SkyCPU_snapshot_t* image,
+		const char* input_path, const char* output_path,
+		const uint16_t input_address, const uint16_t output_address,
+		const uint16_t output_size, const uint32_t max_instructions);
+
+/**
+ * Run all the records of a batch
+ *
+ * @param batch Pointer to the batch
+ * @param workers_count Number of workers threads
+ * @return 0 on success, -1 on error (out of memory, threads creation failure)
+ */
+int SkyCPU_batch_run(SkyCPU_batch_t* batch, const uint32_t workers_count);
+
+/**
+ * Print the report of the last run (records per second, records latency percentiles, per node throughput with NUMA)
+ *
+ * @param batch Pointer to the batch
+ * @param stream Output stream
+ */
+void SkyCPU_batch_report(const SkyCPU_batch_t* batch, FILE* stream);
+
+/**
+ * Close a batch (output file flushed, workers freed)
+ *
+ * @param batch Pointer to the batch to close
+ * @return 0 on success, -1 on error (output file not flushed)
+ */
+int SkyCPU_batch_close(SkyCPU_batch_t* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_BATCH_H_ */
@@ -0,0 +1,369 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "SkyCPU_block.h"
+#include "Endian_utility.h"
+
+/* Memory size */
+#define MEMORY_SIZE ((uint32_t) MEMORY_MASK + 1)
+
+/* Guest ring areas */
+#define DESCRIPTOR(device, index) ((device)->ring_address + SKYCPU_BLOCK_HEADER_SIZE \
+		+ ((index) & ((device)->entries - 1)) * SKYCPU_BLOCK_DESCRIPTOR_SIZE)
+#define COMPLETION(device, index) ((device)->ring_address + SKYCPU_BLOCK_HEADER_SIZE \
+		+ (device)->entries * SKYCPU_BLOCK_DESCRIPTOR_SIZE \
+		+ ((index) & ((device)->entries - 1)) * SKYCPU_BLOCK_COMPLETION_SIZE)
+
+/* io_uring system calls (no liburing) */
+static int io_uring_setup(const uint32_t entries, struct io_uring_params* params) {
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(const int fd, const uint32_t to_submit,
+		const uint32_t min_complete, const uint32_t flags) {
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+
+/**
+ * Mark guest pages written by a request as dirty
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param address Buffer address
+ * @param length Buffer length
+ */
+static void touch_range(SkyCPU_runtime_t* runtime, const uint16_t address,
+		const uint32_t length) {
+#ifdef SKYCPU_PAGE_TRACKING
+	uint32_t offset = 0;
+	for (; offset < length; offset += 1UL << SKYCPU_PAGE_SHIFT)
+		SkyCPU_page_touch(runtime, address + offset, 1);
+	if (length)
+		SkyCPU_page_touch(runtime, address + length - 1, 1);
+#else
+	(void) runtime;
+	(void) address;
+	(void) length;
+#endif
+}
+
+/**
+ * Post a completion into the guest completion ring
+ *
+ * @param device Pointer to the block device
+ * @param tag Guest tag
+ * @param result Bytes transferred or -errno
+ */
+static void post_completion(SkyCPU_block_t* device, const uint16_t tag,
+		const int32_t result) {
+	uint8_t* memory = device->runtime->memory;
+	uint16_t tail = get16bitsValue(memory,
+			device->ring_address + SKYCPU_BLOCK_CQ_TAIL);
+	uint16_t entry = COMPLETION(device, tail);
+
+	/* Entry first, then the index */
+	set16bitsValue(memory, entry, tag);
+	set16bitsValue(memory, entry + 2, 0);
+	set32bitsValue(memory, entry + 4, (uint32_t) result);
+	set16bitsValue(memory, device->ring_address + SKYCPU_BLOCK_CQ_TAIL,
+			tail + 1);
+	touch_range(device->runtime, entry, SKYCPU_BLOCK_COMPLETION_SIZE);
+	touch_range(device->runtime, device->ring_address + SKYCPU_BLOCK_CQ_TAIL, 2);
+	device->completed++;
+	device->pending = 1;
+}
+
+/**
+ * Post the completions of finished io_uring requests
+ *
+ * @param device Pointer to the block device
+ * @return Number of completions posted
+ */
+static int reap_completions(SkyCPU_block_t* device) {
+	uint32_t head = *device->cq_head;
+	uint32_t tail = __atomic_load_n(device->cq_tail, __ATOMIC_ACQUIRE);
+	int posted = 0;
+
+	for (; head != tail; ++head, ++posted) {
+		struct io_uring_cqe* cqe = &device->cqes[head & *device->cq_mask];
+		uint32_t slot = (uint32_t) cqe->user_data;
+		SkyCPU_block_request_t* request = &device->requests[slot];
+
+		/* Data read into the guest memory */
+		if (request->opcode == SKYCPU_BLOCK_READ && cqe->res > 0)
+			touch_range(device->runtime, request->address, cqe->res);
+		post_completion(device, request->tag, cqe->res);
+
+		/* Release the slot */
+		device->free_slots[device->free_count++] = slot;
+		device->inflight--;
+	}
+	__atomic_store_n(device->cq_head, head, __ATOMIC_RELEASE);
+	return posted;
+}
+
+/**
+ * Check a guest request
+ *
+ * @param opcode Request opcode
+ * @param address Buffer address
+ * @param length Buffer length
+ * @return 0 if valid, -errno otherwise
+ */
+static int32_t check_request(const uint8_t opcode, const uint16_t address,
+		const uint16_t length) {
+	if (opcode < SKYCPU_BLOCK_READ || opcode > SKYCPU_BLOCK_FLUSH)
+		return -EINVAL;
+	if (opcode == SKYCPU_BLOCK_FLUSH)
+		return 0;
+#ifdef SKYCPU_MIRRORED_MEMORY
+	/* Buffers crossing the end of memory wrap around (mirror views) */
+	(void) address;
+#if MEMORY_MASK < 0xFFFF
+	if (length > MEMORY_SIZE)
+		return -EFAULT;
+#else
+	(void) length;
+#endif
+#else
+	if ((uint32_t) (address & MEMORY_MASK) + length > MEMORY_SIZE)
+		return -EFAULT;
+#endif
+	return 0;
+}
+
+int SkyCPU_block_init(SkyCPU_block_t* device, SkyCPU_runtime_t* runtime,
+		const int file_fd, const uint16_t ring_address, const uint16_t entries,
+		const uint16_t vector) {
+	struct io_uring_params params;
+	uint32_t i;
+
+	/* Check arguments */
+	if (!entries || (entries & (entries - 1))
+			|| entries > SKYCPU_BLOCK_MAX_ENTRIES
+			|| (uint32_t) ring_address + SKYCPU_BLOCK_RING_SIZE(entries)
+					> MEMORY_SIZE)
+		return -1;
+	memset(device, 0, sizeof(SkyCPU_block_t));
+	device->runtime = runtime;
+	device->file_fd = file_fd;
+	device->ring_address = ring_address;
+	device->entries = entries;
+	device->vector = vector;
+
+	/* Setup io_uring */
+	memset(&params, 0, sizeof(params));
+	device->ring_fd = io_uring_setup(entries, &params);
+	if (device->ring_fd < 0)
+		return -1;
+	device->sq_ring_size = params.sq_off.array
+			+ params.sq_entries * sizeof(uint32_t);
+	device->cq_ring_size = params.cq_off.cqes
+			+ params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (device->cq_ring_size > device->sq_ring_size)
+			device->sq_ring_size = device->cq_ring_size;
+		device->cq_ring_size = device->sq_ring_size;
+	}
+	device->sq_ring = mmap(NULL, device->sq_ring_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, device->ring_fd,
+			IORING_OFF_SQ_RING);
+	if (device->sq_ring == MAP_FAILED) {
+		device->sq_ring = 0;
+		SkyCPU_block_free(device);
+		return -1;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		device->cq_ring = device->sq_ring;
+	else {
+		device->cq_ring = mmap(NULL, device->cq_ring_size,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				device->ring_fd, IORING_OFF_CQ_RING);
+		if (device->cq_ring == MAP_FAILED) {
+			device->cq_ring = 0;
+			SkyCPU_block_free(device);
+			return -1;
+		}
+	}
+	device->sqes = mmap(NULL, entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, device->ring_fd,
+			IORING_OFF_SQES);
+	if (device->sqes == MAP_FAILED) {
+		device->sqes = 0;
+		SkyCPU_block_free(device);
+		return -1;
+	}
+	device->sq_head = (uint32_t*) (device->sq_ring + params.sq_off.head);
+	device->sq_tail = (uint32_t*) (device->sq_ring + params.sq_off.tail);
+	device->sq_mask = (uint32_t*) (device->sq_ring + params.sq_off.ring_mask);
+	device->sq_array = (uint32_t*) (device->sq_ring + params.sq_off.array);
+	device->cq_head = (uint32_t*) (device->cq_ring + params.cq_off.head);
+	device->cq_tail = (uint32_t*) (device->cq_ring + params.cq_off.tail);
+	device->cq_mask = (uint32_t*) (device->cq_ring + params.cq_off.ring_mask);
+	device->cqes = (struct io_uring_cqe*) (device->cq_ring + params.cq_off.cqes);
+
+	/* In-flight slots (up to entries, the completion ring can always hold them) */
+	device->requests = calloc(entries, sizeof(SkyCPU_block_request_t));
+	device->free_slots = malloc(entries * sizeof(uint32_t));
+	if (!device->requests || !device->free_slots) {
+		SkyCPU_block_free(device);
+		return -1;
+	}
+	for (i = 0; i < entries; ++i)
+		device->free_slots[i] = entries - 1 - i;
+	device->free_count = entries;
+
+	/* Clear the guest ring */
+	memset(runtime->memory + ring_address, 0, SKYCPU_BLOCK_RING_SIZE(entries));
+	touch_range(runtime, ring_address, SKYCPU_BLOCK_RING_SIZE(entries));
+
+	/* No error */
+	return 0;
+}
+
+void SkyCPU_block_free(SkyCPU_block_t* device) {
+
+	/* Wait for in-flight requests (their buffers are in the guest memory) */
+	while (device->inflight && device->ring_fd >= 0) {
+		if (io_uring_enter(device->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0
+				&& errno != EINTR)
+			break;
+		reap_completions(device);
+	}
+
+	/* Release io_uring */
+	if (device->sqes)
+		munmap(device->sqes, device->entries * sizeof(struct io_uring_sqe));
+	if (device->cq_ring && device->cq_ring != device->sq_ring)
+		munmap(device->cq_ring, device->cq_ring_size);
+	if (device->sq_ring)
+		munmap(device->sq_ring, device->sq_ring_size);
+	if (device->ring_fd >= 0)
+		close(device->ring_fd);
+	free(device->requests);
+	free(device->free_slots);
+	device->sqes = 0;
+	device->sq_ring = device->cq_ring = 0;
+	device->ring_fd = -1;
+	device->requests = 0;
+	device->free_slots = 0;
+}
+
+int SkyCPU_block_service(SkyCPU_block_t* device, const int wait) {
+	SkyCPU_runtime_t* runtime = device->runtime;
+	uint8_t* memory = runtime->memory;
+	uint16_t ring = device->ring_address;
+	uint16_t guest_head = get16bitsValue(memory, ring + SKYCPU_BLOCK_SQ_HEAD);
+	uint16_t guest_tail = get16bitsValue(memory, ring + SKYCPU_BLOCK_SQ_TAIL);
+	uint32_t tail = *device->sq_tail;
+	uint32_t to_submit;
+	int posted, ret;
+
+	/* Post finished requests first (room for new ones) */
+	posted = reap_completions(device);
+
+	/* Consume guest descriptors while the completion ring can hold their results */
+	while (guest_head != guest_tail) {
+		uint16_t pending = get16bitsValue(memory, ring + SKYCPU_BLOCK_CQ_TAIL)
+				- get16bitsValue(memory, ring + SKYCPU_BLOCK_CQ_HEAD);
+		uint16_t descriptor = DESCRIPTOR(device, guest_head);
+		uint8_t opcode = get8bitsValue(memory, descriptor);
+		uint16_t address = get16bitsValue(memory, descriptor + 2) & MEMORY_MASK;
+		uint16_t length = get16bitsValue(memory, descriptor + 4);
+		uint16_t tag = get16bitsValue(memory, descriptor + 6);
+		uint32_t sector = get32bitsValue(memory, descriptor + 8);
+		int32_t error = check_request(opcode, address, length);
+		struct io_uring_sqe* sqe;
+		uint32_t slot;
+
+		if ((uint32_t) pending + device->inflight >= device->entries)
+			break;
+		++guest_head;
+
+		/* Invalid request, completed at once */
+		if (error) {
+			post_completion(device, tag, error);
+			++posted;
+			continue;
+		}
+
+		/* Prepare the io_uring request (data moved from / to the guest memory) */
+		slot = device->free_slots[--device->free_count];
+		device->requests[slot].address = address;
+		device->requests[slot].length = length;
+		device->requests[slot].tag = tag;
+		device->requests[slot].opcode = opcode;
+		sqe = &device->sqes[tail & *device->sq_mask];
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->fd = device->file_fd;
+		sqe->user_data = slot;
+		if (opcode == SKYCPU_BLOCK_FLUSH) {
+			sqe->opcode = IORING_OP_FSYNC;
+			sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+		} else {
+			sqe->opcode = (opcode == SKYCPU_BLOCK_READ) ?
+					IORING_OP_READ : IORING_OP_WRITE;
+			sqe->addr = (uintptr_t) (memory + address);
+			sqe->len = length;
+			sqe->off = (uint64_t) sector * SKYCPU_BLOCK_SECTOR;
+		}
+		device->sq_array[tail & *device->sq_mask] = tail & *device->sq_mask;
+		++tail;
+		device->inflight++;
+		device->submitted++;
+	}
+	set16bitsValue(memory, ring + SKYCPU_BLOCK_SQ_HEAD, guest_head);
+	touch_range(runtime, ring + SKYCPU_BLOCK_SQ_HEAD, 2);
+	__atomic_store_n(device->sq_tail, tail, __ATOMIC_RELEASE);
+
+	/* Submit the batch (and wait for a completion if asked) */
+	to_submit = tail - __atomic_load_n(device->sq_head, __ATOMIC_ACQUIRE);
+	if (to_submit || (wait && device->inflight && !posted)) {
+		do {
+			ret = io_uring_enter(device->ring_fd, to_submit,
+					(wait && !posted) ? 1 : 0,
+					(wait && !posted) ? IORING_ENTER_GETEVENTS : 0);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0 && errno != EAGAIN && errno != EBUSY)
+			return -1;
+		if (wait)
+			posted += reap_completions(device);
+	}
+
+	/* Signal completions (host-injected CALL to the vector, kept pending until armed) */
+	if (device->pending && device->vector && !runtime->skip_next
+			&& get8bitsValue(memory, ring + SKYCPU_BLOCK_IRQ_ARMED)) {
+		device->pending = 0;
+		set8bitsValue(memory, ring + SKYCPU_BLOCK_IRQ_ARMED, 0);
+		touch_range(runtime, ring + SKYCPU_BLOCK_IRQ_ARMED, 1);
+		runtime->stack_pointer -= 2;
+		set16bitsValue(memory, runtime->stack_pointer,
+				runtime->program_counter);
+		touch_range(runtime, runtime->stack_pointer, 2);
+		runtime->program_counter = device->vector;
+		device->interrupts++;
+	}
+	return posted;
+}
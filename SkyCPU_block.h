@@ -0,0 +1,163 @@
+/**
+ * @file SkyCPU_block.h
+ * @brief Block storage peripheral (descriptor rings in guest memory, serviced with io_uring)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a virtual block device backed by a host file.\n
+ * The guest queue requests (read, write, flush) into a submission ring located in its own memory and keep running,\n
+ * the host service the ring between time slices: new requests are submitted to io_uring in one batch, data are\n
+ * read / written directly from / to the guest memory (no copy), completions are posted into the completion ring\n
+ * and signaled by an interrupt (host-injected CALL to the device vector).\n
+ * \n
+ * Guest ring layout (big-endian, at the ring address, ENTRIES = power of two up to 256):\n
+ * - header (16 bytes): sq_tail (guest), sq_head (host), cq_tail (host), cq_head (guest), all 16 bits free-running\n
+ *   indexes, then irq_armed (8 bits, set by the guest, cleared by the host when the interrupt is injected)\n
+ * - ENTRIES submission descriptors (16 bytes): opcode (8 bits), reserved (8 bits), buffer address (16 bits),\n
+ *   length (16 bits), tag (16 bits), sector (32 bits, SKYCPU_BLOCK_SECTOR bytes), reserved (32 bits)\n
+ * - ENTRIES completion entries (8 bytes): tag (16 bits), reserved (16 bits), result (32 bits signed, bytes\n
+ *   transferred or -errno)\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Linux only (io_uring, kernel 5.6 or newer), no liburing needed. SkyCPU_block_service() MUST be called by the\n
+ * thread running the instance, between time slices. Buffers of in-flight requests MUST NOT be touched by the guest\n
+ * (nor restored by a snapshot) until their completion is posted.
+ */
+
+#ifndef _SKYCPU_BLOCK_H_
+#define _SKYCPU_BLOCK_H_
+
+/* Dependency */
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "FastSkyCPU.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Guest ring definition */
+#define SKYCPU_BLOCK_SECTOR 512 /*!< Sector size in bytes */
+#define SKYCPU_BLOCK_MAX_ENTRIES 256 /*!< Maximum ring entries */
+#define SKYCPU_BLOCK_HEADER_SIZE 16
+#define SKYCPU_BLOCK_DESCRIPTOR_SIZE 16
+#define SKYCPU_BLOCK_COMPLETION_SIZE 8
+
+/* Guest ring header fields offsets */
+#define SKYCPU_BLOCK_SQ_TAIL 0
+#define SKYCPU_BLOCK_SQ_HEAD 2
+#define SKYCPU_BLOCK_CQ_TAIL 4
+#define SKYCPU_BLOCK_CQ_HEAD 6
+#define SKYCPU_BLOCK_IRQ_ARMED 8
+
+/**
+ * Guest ring size in bytes
+ *
+ * @param entries Ring entries
+ */
+#define SKYCPU_BLOCK_RING_SIZE(entries) (SKYCPU_BLOCK_HEADER_SIZE \
+		+ (entries) * (SKYCPU_BLOCK_DESCRIPTOR_SIZE + SKYCPU_BLOCK_COMPLETION_SIZE))
+
+/**
+ * Requests opcodes
+ */
+typedef enum {
+	SKYCPU_BLOCK_READ = 1, /*!< Read length bytes from sector into buffer */
+	SKYCPU_BLOCK_WRITE, /*!< Write length bytes from buffer at sector */
+	SKYCPU_BLOCK_FLUSH /*!< Flush the host file (fdatasync) */
+} SkyCPU_block_opcode_t;
+
+/**
+ * In-flight request
+ */
+typedef struct {
+	uint16_t address; /*!< Guest buffer address */
+	uint16_t length; /*!< Buffer length */
+	uint16_t tag; /*!< Guest tag */
+	uint8_t opcode; /*!< Request opcode (SkyCPU_block_opcode_t) */
+} SkyCPU_block_request_t;
+
+/**
+ * Block device structure
+ */
+typedef struct {
+	SkyCPU_runtime_t* runtime; /*!< Guest instance */
+	int file_fd; /*!< Backing file */
+	uint16_t ring_address; /*!< Guest ring address */
+	uint16_t entries; /*!< Guest ring entries */
+	uint16_t vector; /*!< Interrupt vector (0 = no interrupt, polling only) */
+	uint16_t inflight; /*!< Requests submitted to io_uring, not completed yet */
+	uint8_t pending; /*!< Completions posted since the last interrupt (not signaled yet) */
+	int ring_fd; /*!< io_uring file descriptor */
+	uint8_t* sq_ring; /*!< io_uring submission ring mapping */
+	uint8_t* cq_ring; /*!< io_uring completion ring mapping (same as sq_ring with IORING_FEAT_SINGLE_MMAP) */
+	size_t sq_ring_size, cq_ring_size; /*!< io_uring rings mappings sizes */
+	struct io_uring_sqe* sqes; /*!< io_uring submission entries */
+	uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array; /*!< io_uring submission ring fields */
+	uint32_t *cq_head, *cq_tail, *cq_mask; /*!< io_uring completion ring fields */
+	struct io_uring_cqe* cqes; /*!< io_uring completion entries */
+	uint32_t* free_slots; /*!< Free in-flight slots (stack) */
+	uint32_t free_count; /*!< Free in-flight slots count */
+	SkyCPU_block_request_t* requests; /*!< In-flight requests (by slot) */
+	uint64_t submitted; /*!< Requests submitted */
+	uint64_t completed; /*!< Completions posted (errors included) */
+	uint64_t interrupts; /*!< Interrupts injected */
+} SkyCPU_block_t;
+
+/**
+ * Initialize a block device (guest ring cleared)
+ *
+ * @param device Pointer to the block device to initialize
+ * @param runtime Pointer to the SkyCPU runtime instance using the device
+ * @param file_fd Backing file (opened by the caller, read-only files fail writes with -EBADF)
+ * @param ring_address Guest ring address (SKYCPU_BLOCK_RING_SIZE(entries) bytes)
+ * @param entries Guest ring entries (power of two, up to SKYCPU_BLOCK_MAX_ENTRIES)
+ * @param vector Interrupt vector (0 = no interrupt)
+ * @return 0 on success, -1 on error (bad arguments, io_uring not available, out of memory)
+ */
+int SkyCPU_block_init(SkyCPU_block_t* device, SkyCPU_runtime_t* runtime,
+		const int file_fd, const uint16_t ring_address, const uint16_t entries,
+		const uint16_t vector);
+
+/**
+ * Free a block device (wait for in-flight requests, the backing file is not closed)
+ *
+ * @param device Pointer to the block device to free
+ */
+void SkyCPU_block_free(SkyCPU_block_t* device);
+
+/**
+ * Service a block device: post completions, submit new requests (one batch), inject the interrupt
+ *
+ * @remarks The interrupt is injected (PUSH PC, PC = vector, like CALL) if completions were posted since the last
+ * one (by this call or a previous one), the guest armed it (irq_armed != 0) and no skip is pending. The handler
+ * re-arm it before RET: completions posted meanwhile are signaled by the next call.
+ * @param device Pointer to the block device
+ * @param wait If true and requests are in-flight, wait for at least one completion
+ * @return Number of completions posted, -1 on error (io_uring failure)
+ */
+int SkyCPU_block_service(SkyCPU_block_t* device, const int wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_BLOCK_H_ */
@@ -0,0 +1,90 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include "SkyCPU_channel.h"
+#ifdef SKYCPU_METRICS
+#include "SkyCPU_metrics.h"
+#endif
+
+int SkyCPU_channel_init(SkyCPU_channel_t* channel,
+		const SkyCPU_channel_kind_t kind, const uint8_t width,
+		const uint32_t capacity) {
+	uint32_t i = 0;
+
+	/* Check arguments */
+	if (!capacity || (capacity & (capacity - 1))
+			|| (width != 1 && width != 2 && width != 4))
+		return -1;
+
+	/* Setup channel */
+	channel->kind = kind;
+	channel->width = width;
+	channel->value_mask = (width == 4) ? 0xFFFFFFFFUL : (1UL << (width * 8)) - 1;
+	channel->mask = capacity - 1;
+	channel->head = 0;
+	channel->tail = 0;
+
+	/* Free cells (sequence == position) */
+	for (; i < capacity; ++i) {
+		channel->cells[i].sequence = i;
+		channel->cells[i].value = 0;
+	}
+
+	/* No error */
+	return 0;
+}
+
+uint32_t SkyCPU_channel_run(SkyCPU_runtime_t* runtime,
+		const uint32_t max_instructions) {
+	uint32_t count = 0;
+
+	/* Run until stalled or out of budget */
+#ifdef SKYCPU_METRICS
+	SkyCPU_metrics_slice(runtime);
+#endif
+	runtime->stall_reason = SKYCPU_STALL_NONE;
+	while (count < max_instructions) {
+		SkyCPU_fetch_and_execute(runtime);
+		if (runtime->stall_reason)
+			break;
+		++count;
+	}
+
+	/* Return retired instructions count */
+	return count;
+}
+
+uint64_t SkyCPU_channel_schedule(SkyCPU_runtime_t** runtimes,
+		const uint32_t count, const uint32_t slice,
+		const uint64_t max_instructions) {
+	uint64_t total = 0, round;
+	uint32_t i;
+
+	/* Round robin until all instances are stalled or out of budget */
+	do {
+		round = 0;
+		for (i = 0; i < count && total + round < max_instructions; ++i)
+			round += SkyCPU_channel_run(runtimes[i],
+					(max_instructions - total - round < slice) ?
+							(uint32_t) (max_instructions - total - round) : slice);
+		total += round;
+	} while (round && total < max_instructions);
+
+	/* Return retired instructions count */
+	return total;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file SkyCPU_channel.h
+ * @brief Lock-free message channels between SkyCPU runtime instances
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define typed (8, 16 or 32 bits) bounded channels, as single producer / single consumer\n
+ * or multiple producers / multiple consumers lock-free ring buffers.\n
+ * Channels hold no pointer and can live in shared memory (multiple processes).\n
+ * Guests use SEND.x channel, value and RECV.x destination, channel. An instance blocked on a full / empty channel\n
+ * stop with its PC on the stalled instruction (see SkyCPU_channel_run() and SkyCPU_channel_schedule()).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_CHANNELS to be defined for ALL source files !
+ */
+
+#ifndef _SKYCPU_CHANNEL_H_
+#define _SKYCPU_CHANNEL_H_
+
+/* Dependency */
+#include <stddef.h>
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_CHANNELS
+#error "SkyCPU channels require SKYCPU_CHANNELS"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Cache line size (producer and consumer indexes never share a line) */
+#define SKYCPU_CHANNEL_ALIGN 64
+
+/**
+ * Channel kinds
+ */
+typedef enum {
+	SKYCPU_CHANNEL_SPSC, /*!< Single producer, single consumer */
+	SKYCPU_CHANNEL_MPMC /*!< Multiple producers, multiple consumers */
+} SkyCPU_channel_kind_t;
+
+/**
+ * Channel cell
+ */
+typedef struct {
+	uint32_t sequence; /*!< Cell sequence number (MPMC only) */
+	uint32_t value; /*!< Message */
+} SkyCPU_channel_cell_t;
+
+/**
+ * Channel structure (followed by its cells)
+ */
+struct SkyCPU_channel {
+	uint8_t kind; /*!< Channel kind (SkyCPU_channel_kind_t) */
+	uint8_t width; /*!< Message width in bytes (1, 2 or 4) */
+	uint32_t value_mask; /*!< Message mask (according width) */
+	uint32_t mask; /*!< Capacity - 1 */
+	uint32_t head __attribute__((aligned(SKYCPU_CHANNEL_ALIGN))); /*!< Next message to receive */
+	uint32_t tail __attribute__((aligned(SKYCPU_CHANNEL_ALIGN))); /*!< Next message to send */
+	SkyCPU_channel_cell_t cells[] __attribute__((aligned(SKYCPU_CHANNEL_ALIGN))); /*!< Messages */
+};
+
+/**
+ * Get the memory size of a channel
+ *
+ * @param capacity Number of messages (MUST be a power of two)
+ * @return Size in bytes
+ */
+static __inline__ size_t SkyCPU_channel_size(const uint32_t capacity) {
+	return sizeof(SkyCPU_channel_t) + capacity * sizeof(SkyCPU_channel_cell_t);
+}
+
+/**
+ * Initialize a channel
+ *
+ * @param channel Pointer to the channel memory (SkyCPU_channel_size() bytes, SKYCPU_CHANNEL_ALIGN aligned)
+ * @param kind Channel kind (SPSC or MPMC)
+ * @param width Message width in bytes (1, 2 or 4)
+ * @param capacity Number of messages (MUST be a power of two)
+ * @return 0 on success, -1 on error (bad width or capacity)
+ */
+int SkyCPU_channel_init(SkyCPU_channel_t* channel,
+		const SkyCPU_channel_kind_t kind, const uint8_t width,
+		const uint32_t capacity);
+
+/**
+ * Bind a channel to a channel number of a SkyCPU runtime instance
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param number Channel number (0 to SKYCPU_CHANNEL_COUNT - 1)
+ * @param channel Pointer to the channel (NULL to unbind)
+ */
+static __inline__ void SkyCPU_channel_bind(SkyCPU_runtime_t* runtime,
+		const uint8_t number, SkyCPU_channel_t* channel) {
+	runtime->channels[number & (SKYCPU_CHANNEL_COUNT - 1)] = channel;
+}
+
+/**
+ * Send a message (guest SEND or host side)
+ *
+ * @param channel Pointer to the channel
+ * @param value Message (truncated to the channel width, guest SEND stall on a width mismatch instead)
+ * @return 1 on success, 0 if the channel is full
+ */
+static __inline__ int SkyCPU_channel_send(SkyCPU_channel_t* channel,
+		const uint32_t value) {
+	uint32_t position = __atomic_load_n(&channel->tail, __ATOMIC_RELAXED);
+
+	/* Single producer: own tail, check room against head */
+	if (channel->kind == SKYCPU_CHANNEL_SPSC) {
+		if (position - __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE)
+				> channel->mask)
+			return 0;
+		channel->cells[position & channel->mask].value = value
+				& channel->value_mask;
+		__atomic_store_n(&channel->tail, position + 1, __ATOMIC_RELEASE);
+		return 1;
+	}
+
+	/* Multiple producers: claim a free cell by its sequence number */
+	for (;;) {
+		SkyCPU_channel_cell_t* cell = &channel->cells[position & channel->mask];
+		int32_t difference = (int32_t) (__atomic_load_n(&cell->sequence,
+				__ATOMIC_ACQUIRE) - position);
+		if (difference == 0) {
+			if (__atomic_compare_exchange_n(&channel->tail, &position,
+					position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				cell->value = value & channel->value_mask;
+				__atomic_store_n(&cell->sequence, position + 1,
+						__ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (difference < 0)
+			return 0;
+		else
+			position = __atomic_load_n(&channel->tail, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Receive a message (guest RECV or host side)
+ *
+ * @param channel Pointer to the channel
+ * @param value Pointer to the received message
+ * @return 1 on success, 0 if the channel is empty
+ */
+static __inline__ int SkyCPU_channel_receive(SkyCPU_channel_t* channel,
+		uint32_t* value) {
+	uint32_t position = __atomic_load_n(&channel->head, __ATOMIC_RELAXED);
+
+	/* Single consumer: own head, check messages against tail */
+	if (channel->kind == SKYCPU_CHANNEL_SPSC) {
+		if (position == __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE))
+			return 0;
+		*value = channel->cells[position & channel->mask].value;
+		__atomic_store_n(&channel->head, position + 1, __ATOMIC_RELEASE);
+		return 1;
+	}
+
+	/* Multiple consumers: claim a full cell by its sequence number */
+	for (;;) {
+		SkyCPU_channel_cell_t* cell = &channel->cells[position & channel->mask];
+		int32_t difference = (int32_t) (__atomic_load_n(&cell->sequence,
+				__ATOMIC_ACQUIRE) - (position + 1));
+		if (difference == 0) {
+			if (__atomic_compare_exchange_n(&channel->head, &position,
+					position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*value = cell->value;
+				__atomic_store_n(&cell->sequence, position + channel->mask + 1,
+						__ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (difference < 0)
+			return 0;
+		else
+			position = __atomic_load_n(&channel->head, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Run a SkyCPU runtime instance until it stall on a channel or the budget is exhausted
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param max_instructions Instructions budget
+ * @return Number of retired instructions (runtime->stall_reason tell why it stopped early)
+ */
+uint32_t SkyCPU_channel_run(SkyCPU_runtime_t* runtime,
+		const uint32_t max_instructions);
+
+/**
+ * Run some SkyCPU runtime instances in round robin, a stalled instance yield to the next one
+ *
+ * @param runtimes Array of pointers to SkyCPU runtime instances
+ * @param count Number of instances
+ * @param slice Instructions budget of an instance per round
+ * @param max_instructions Total instructions budget
+ * @return Number of retired instructions (stop early if all instances are stalled)
+ */
+uint64_t SkyCPU_channel_schedule(SkyCPU_runtime_t** runtimes,
+		const uint32_t count, const uint32_t slice,
+		const uint64_t max_instructions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_CHANNEL_H_ */
@@ -0,0 +1,650 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_codecache.h"
+#include "SkyCPU_decode.h"
+#include "Endian_utility.h"
+#include "FastSkyCPU_opcodes.h"
+#ifdef SKYCPU_CHANNELS
+#include "SkyCPU_channel.h"
+#endif
+#ifdef SKYCPU_METRICS
+#include "SkyCPU_metrics.h"
+#endif
+
+/*
+ * Instruction body fed by a decoded instruction (instruction, arguments and constants not read from memory),
+ * instantiated once per instruction byte: opcode and bits mode are constants, the switches fold away
+ */
+#define SKYCPU_EXECUTE_PREFIX static __inline__ __attribute__((always_inline))
+#define SKYCPU_EXECUTE_FUNCTION decoded_execute
+#define SKYCPU_EXECUTE_PARAMETERS , const SkyCPU_decoded_t* decoded, const uint8_t raw
+#define SKYCPU_HELPER_PREFIX static __inline__ __attribute__((always_inline))
+#define SKYCPU_HELPER_PARAMETERS , const SkyCPU_decoded_t* decoded
+#define SKYCPU_HELPER_ARGUMENTS , decoded
+#define SKYCPU_FETCH_INSTRUCTION(runtime) ((runtime)->program_counter++, raw)
+#define SKYCPU_FETCH_ARGUMENT(runtime, address, offset) ((void) (address), decoded->arguments[(offset) != 0])
+#define SKYCPU_FETCH_CONSTANT8(runtime, address, offset) ((uint8_t) decoded->values[(offset) != 0])
+#define SKYCPU_FETCH_CONSTANT16(runtime, address, offset) ((uint16_t) decoded->values[(offset) != 0])
+#define SKYCPU_FETCH_CONSTANT32(runtime, address, offset) (decoded->values[(offset) != 0])
+#include "FastSkyCPU_execute.inc"
+
+/* Handlers (one per instruction byte) */
+typedef void (*handler_t)(SkyCPU_runtime_t* runtime,
+		const SkyCPU_decoded_t* decoded);
+#define HANDLER(high, low) \
+	static void handle_##high##low(SkyCPU_runtime_t* runtime, \
+			const SkyCPU_decoded_t* decoded) { \
+		decoded_execute(runtime, decoded, 0x##high##low); \
+	}
+#define HANDLERS(high) \
+	HANDLER(high, 0) HANDLER(high, 1) HANDLER(high, 2) HANDLER(high, 3) \
+	HANDLER(high, 4) HANDLER(high, 5) HANDLER(high, 6) HANDLER(high, 7) \
+	HANDLER(high, 8) HANDLER(high, 9) HANDLER(high, A) HANDLER(high, B) \
+	HANDLER(high, C) HANDLER(high, D) HANDLER(high, E) HANDLER(high, F)
+#define HANDLERS_ROW(high) \
+	handle_##high##0, handle_##high##1, handle_##high##2, handle_##high##3, \
+	handle_##high##4, handle_##high##5, handle_##high##6, handle_##high##7, \
+	handle_##high##8, handle_##high##9, handle_##high##A, handle_##high##B, \
+	handle_##high##C, handle_##high##D, handle_##high##E, handle_##high##F
+HANDLERS(0) HANDLERS(1) HANDLERS(2) HANDLERS(3) HANDLERS(4) HANDLERS(5)
+HANDLERS(6) HANDLERS(7) HANDLERS(8) HANDLERS(9) HANDLERS(A) HANDLERS(B)
+HANDLERS(C) HANDLERS(D) HANDLERS(E) HANDLERS(F)
+static const handler_t handlers[256] = { HANDLERS_ROW(0), HANDLERS_ROW(1),
+		HANDLERS_ROW(2), HANDLERS_ROW(3), HANDLERS_ROW(4), HANDLERS_ROW(5),
+		HANDLERS_ROW(6), HANDLERS_ROW(7), HANDLERS_ROW(8), HANDLERS_ROW(9),
+		HANDLERS_ROW(A), HANDLERS_ROW(B), HANDLERS_ROW(C), HANDLERS_ROW(D),
+		HANDLERS_ROW(E), HANDLERS_ROW(F) };
+
+/* Page offset mask */
+#define PAGE_OFFSET_MASK (SKYCPU_PAGE_SIZE - 1)
+
+/**
+ * Hash a page content (FNV-1a over 64 bits words, folded)
+ *
+ * @param content Page content
+ * @return Content hash
+ */
+static uint64_t hash_page(const uint8_t* content) {
+	uint64_t hash = 14695981039346656037ULL, word;
+	uint32_t i = 0;
+	for (; i + 8 <= SKYCPU_PAGE_SIZE; i += 8) {
+		memcpy(&word, content + i, 8);
+		hash = (hash ^ word) * 1099511628211ULL;
+		hash ^= hash >> 29;
+	}
+	for (; i < SKYCPU_PAGE_SIZE; ++i)
+		hash = (hash ^ content[i]) * 1099511628211ULL;
+	return hash;
+}
+
+/**
+ * Create a page of an instance memory (nothing decoded yet)
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param index Page number
+ * @param hash Content hash
+ * @return Page (references = 1), NULL if out of memory
+ */
+static SkyCPU_codecache_page_t* create_page(const SkyCPU_runtime_t* runtime,
+		const uint16_t index, const uint64_t hash) {
+	SkyCPU_codecache_page_t* page = calloc(1, sizeof(SkyCPU_codecache_page_t));
+	if (!page)
+		return 0;
+	page->hash = hash;
+	page->references = 1;
+	memcpy(page->content,
+			runtime->memory + ((uint32_t) index << SKYCPU_PAGE_SHIFT),
+			SKYCPU_PAGE_SIZE);
+	memset(page->slots, 0xFF, sizeof(page->slots));
+	return page;
+}
+
+/**
+ * Free a page and its decoded instructions
+ *
+ * @param page Pointer to the page
+ */
+static void free_page(SkyCPU_codecache_page_t* page) {
+	uint32_t chunk = 0;
+	for (; chunk < SKYCPU_CODECACHE_CHUNKS; ++chunk)
+		free(page->chunks[chunk]);
+	free(page);
+}
+
+/**
+ * Read a big endian constant of a decoded instruction
+ *
+ * @param bytes Constant bytes
+ * @param size Constant size (0, 1, 2 or 4 bytes)
+ * @return Constant value
+ */
+static uint32_t read_constant(const uint8_t* bytes, const uint8_t size) {
+	uint32_t value = 0;
+	uint8_t i = 0;
+	for (; i < size; ++i)
+		value = (value << 8) | bytes[i];
+	return value;
+}
+
+/**
+ * Decode an instruction (same encoded length and constants as the interpreter fetch)
+ *
+ * @param bytes Instruction bytes (up to SKYCPU_CODECACHE_PADDING bytes read)
+ * @param decoded Pointer to the decoded instruction to fill
+ * @return Encoded length
+ */
+static uint8_t decode_instruction(const uint8_t* bytes,
+		SkyCPU_decoded_t* decoded) {
+	uint8_t raw = bytes[0], bits_mode = INSTRUCTION_BITSMODE(raw);
+	uint8_t count = SkyCPU_arguments_count(INSTRUCTION_OPCODE(raw));
+	uint8_t length = 1, i = 0, argument, size;
+
+	decoded->instruction = raw;
+	decoded->arguments[0] = decoded->arguments[1] = 0;
+	decoded->values[0] = decoded->values[1] = 0;
+	for (; i < count; ++i) {
+		argument = bytes[length++];
+		decoded->arguments[i] = argument;
+		if (!ARGUMENT_CONSTANT(argument) || ARGUMENT_INLINECONST(argument))
+			continue;
+		size = ARGUMENT_POINTEDBY(argument) ? 2 : /* Address (fixed 16 bits) */
+				(bits_mode == DOUBLE_WORD) ? 4 : bits_mode;
+		decoded->values[i] = read_constant(bytes + length, size);
+		length += size;
+	}
+	return length;
+}
+
+/**
+ * Decode the instruction at an offset of a mapped page (page locked or private)
+ *
+ * @remarks Decoded from the page content (never from the instance memory, which may differ until checked).
+ * @param view Pointer to the view running the page
+ * @param index Page number
+ * @param offset Offset in the page
+ * @return Decoded instruction, NULL if out of memory or out of slots (interpreted)
+ */
+static const SkyCPU_decoded_t* decode_slot(SkyCPU_codecache_view_t* view,
+		const uint16_t index, const uint32_t offset) {
+	SkyCPU_codecache_page_t* page = view->pages[index];
+	uint32_t slot = page->slots[offset], chunk;
+	SkyCPU_decoded_t* decoded;
+	uint8_t length;
+
+	/* Decoded by another view meanwhile */
+	if (slot != SKYCPU_CODECACHE_UNDECODED)
+		return &page->chunks[slot / SKYCPU_CODECACHE_CHUNK][slot
+				% SKYCPU_CODECACHE_CHUNK];
+
+	/* Room for the instruction */
+	slot = page->decoded_count;
+	chunk = slot / SKYCPU_CODECACHE_CHUNK;
+	if (slot >= SKYCPU_CODECACHE_UNDECODED)
+		return 0;
+	if (!page->chunks[chunk]) {
+		decoded = malloc(SKYCPU_CODECACHE_CHUNK * sizeof(SkyCPU_decoded_t));
+		if (!decoded)
+			return 0;
+		__atomic_store_n(&page->chunks[chunk], decoded, __ATOMIC_RELEASE);
+	}
+
+	/* Decode (instructions crossing the page end depend on the next page: interpreted) */
+	decoded = &page->chunks[chunk][slot % SKYCPU_CODECACHE_CHUNK];
+	length = decode_instruction(page->content + offset, decoded);
+	decoded->length = (offset + length <= SKYCPU_PAGE_SIZE) ? length : 0;
+
+	/* Publish (entry fully written before its slot is visible) */
+	page->decoded_count = slot + 1;
+	__atomic_store_n(&page->slots[offset], slot, __ATOMIC_RELEASE);
+	return decoded;
+}
+
+/**
+ * Check if an instruction ends a straight-line run (next bytes may not be code)
+ *
+ * @param raw Instruction byte
+ * @return True if decoding stop after the instruction
+ */
+static uint8_t ends_run(const uint8_t raw) {
+	uint8_t opcode = INSTRUCTION_OPCODE(raw);
+	return opcode == INSTRUCTION_JMP || opcode == INSTRUCTION_RET
+			|| opcode == INSTRUCTION_BRK || opcode > INSTRUCTION_RECV;
+}
+
+/**
+ * Decode the straight-line run starting at an offset of a mapped page (first execution of this offset)
+ *
+ * @remarks Shared pages are extended under the cache lock (taken once per run), readers take no lock
+ * (slots published last). The run stop at an unconditional jump, RET, BRK, an unknown opcode, the page end
+ * or an offset already decoded.
+ * @param view Pointer to the view running the page
+ * @param index Page number
+ * @param offset Offset in the page
+ * @return Decoded instruction at the offset, NULL if out of memory or out of slots (interpreted)
+ */
+static const SkyCPU_decoded_t* decode_offset(SkyCPU_codecache_view_t* view,
+		const uint16_t index, const uint32_t offset) {
+	SkyCPU_codecache_page_t* page;
+	const SkyCPU_decoded_t *first, *decoded;
+	uint32_t next = offset, count;
+	uint8_t shared = view->states[index] == SKYCPU_CODECACHE_SHARED;
+
+	if (shared)
+		pthread_mutex_lock(&view->cache->lock);
+	page = view->pages[index];
+	count = page->decoded_count;
+	first = decoded = decode_slot(view, index, offset);
+	while (decoded && decoded->length && !ends_run(decoded->instruction)) {
+		next += decoded->length;
+		if (next >= SKYCPU_PAGE_SIZE
+				|| page->slots[next] != SKYCPU_CODECACHE_UNDECODED)
+			break;
+		decoded = decode_slot(view, index, next);
+	}
+	count = page->decoded_count - count;
+	if (shared)
+		pthread_mutex_unlock(&view->cache->lock);
+	__atomic_fetch_add(&view->cache->decoded, count, __ATOMIC_RELAXED);
+	return first;
+}
+
+/**
+ * Take a reference on a shared page
+ *
+ * @param page Pointer to the shared page
+ * @return True on success, false if the page is evicted
+ */
+static int acquire_page(SkyCPU_codecache_page_t* page) {
+	uint32_t references = __atomic_load_n(&page->references, __ATOMIC_RELAXED);
+	while (references != SKYCPU_CODECACHE_DEAD) {
+		if (__atomic_compare_exchange_n(&page->references, &references,
+				references + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Lookup a page content in the shared pages (no lock)
+ *
+ * @param view Pointer to the view doing the lookup
+ * @param content Page content
+ * @param hash Content hash
+ * @return Shared page (reference taken), NULL if not cached
+ */
+static SkyCPU_codecache_page_t* lookup_page(SkyCPU_codecache_view_t* view,
+		const uint8_t* content, const uint64_t hash) {
+	SkyCPU_codecache_t* cache = view->cache;
+	SkyCPU_codecache_page_t* page;
+
+	/* Announce the lookup epoch before reading the table (removed pages stay allocated) */
+	__atomic_store_n(&view->epoch,
+			__atomic_load_n(&cache->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	/* Walk the bucket */
+	page = __atomic_load_n(&cache->buckets[hash & cache->buckets_mask],
+			__ATOMIC_ACQUIRE);
+	for (; page; page = __atomic_load_n(&page->next, __ATOMIC_ACQUIRE))
+		if (page->hash == hash
+				&& !memcmp(page->content, content, SKYCPU_PAGE_SIZE)
+				&& acquire_page(page))
+			break;
+
+	/* End of the lookup */
+	__atomic_store_n(&view->epoch, 0, __ATOMIC_RELEASE);
+	return page;
+}
+
+/**
+ * Free removed pages no running lookup can see (cache locked)
+ *
+ * @param cache Pointer to the code cache
+ */
+static void reclaim_pages(SkyCPU_codecache_t* cache) {
+	SkyCPU_codecache_page_t **link = &cache->retired, *page;
+	SkyCPU_codecache_view_t* view = cache->views;
+	uint64_t oldest = ~0ULL, epoch;
+
+	/* Oldest running lookup */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (; view; view = view->next) {
+		epoch = __atomic_load_n(&view->epoch, __ATOMIC_SEQ_CST);
+		if (epoch && epoch < oldest)
+			oldest = epoch;
+	}
+
+	/* Pages removed before it started */
+	while ((page = *link)) {
+		if (page->retired_epoch < oldest) {
+			*link = page->retired_next;
+			free_page(page);
+		} else
+			link = &page->retired_next;
+	}
+}
+
+/**
+ * Evict all unused shared pages (cache locked)
+ *
+ * @param cache Pointer to the code cache
+ * @return Number of pages evicted
+ */
+static uint32_t evict_pages(SkyCPU_codecache_t* cache) {
+	uint32_t bucket = 0, count = 0;
+	uint32_t unused;
+
+	for (; bucket <= cache->buckets_mask; ++bucket) {
+		SkyCPU_codecache_page_t **link = &cache->buckets[bucket], *page;
+		while ((page = *link)) {
+
+			/* Page still mapped by a view */
+			unused = 0;
+			if (!__atomic_compare_exchange_n(&page->references, &unused,
+					SKYCPU_CODECACHE_DEAD, 0, __ATOMIC_ACQ_REL,
+					__ATOMIC_RELAXED)) {
+				link = &page->next;
+				continue;
+			}
+
+			/* Unlink (running lookups may still walk it) and retire */
+			__atomic_store_n(link, page->next, __ATOMIC_RELEASE);
+			page->retired_epoch = cache->epoch;
+			page->retired_next = cache->retired;
+			cache->retired = page;
+			++count;
+		}
+	}
+
+	/* New lookups start after the removals */
+	if (count) {
+		__atomic_store_n(&cache->epoch, cache->epoch + 1, __ATOMIC_SEQ_CST);
+		cache->pages -= count;
+		__atomic_fetch_add(&cache->evictions, count, __ATOMIC_RELAXED);
+	}
+	reclaim_pages(cache);
+	return count;
+}
+
+/**
+ * Insert a decoded page into the shared pages
+ *
+ * @param cache Pointer to the code cache
+ * @param page Pointer to the decoded page (references = 1)
+ * @return Shared page to use (page itself or an equal page inserted meanwhile), NULL if the cache is full
+ */
+static SkyCPU_codecache_page_t* insert_page(SkyCPU_codecache_t* cache,
+		SkyCPU_codecache_page_t* page) {
+	SkyCPU_codecache_page_t** bucket = &cache->buckets[page->hash
+			& cache->buckets_mask];
+	SkyCPU_codecache_page_t* other;
+
+	pthread_mutex_lock(&cache->lock);
+
+	/* Same content inserted by another view meanwhile */
+	for (other = *bucket; other; other = other->next) {
+		if (other->hash == page->hash
+				&& !memcmp(other->content, page->content, SKYCPU_PAGE_SIZE)
+				&& acquire_page(other)) {
+			pthread_mutex_unlock(&cache->lock);
+			free_page(page);
+			return other;
+		}
+	}
+
+	/* Room for the page */
+	if (cache->pages >= cache->capacity
+			&& (!evict_pages(cache) || cache->pages >= cache->capacity)) {
+		pthread_mutex_unlock(&cache->lock);
+		return 0;
+	}
+
+	/* Publish (page fully written before it is reachable) */
+	page->next = *bucket;
+	__atomic_store_n(bucket, page, __ATOMIC_RELEASE);
+	cache->pages++;
+	pthread_mutex_unlock(&cache->lock);
+	return page;
+}
+
+/**
+ * Release the decoded page of a view page
+ *
+ * @param view Pointer to the view
+ * @param index Page number
+ */
+static void release_page(SkyCPU_codecache_view_t* view, const uint16_t index) {
+	if (view->states[index] == SKYCPU_CODECACHE_SHARED)
+		__atomic_fetch_sub(&view->pages[index]->references, 1,
+				__ATOMIC_RELEASE);
+	else if (view->states[index] == SKYCPU_CODECACHE_PRIVATE)
+		free_page(view->pages[index]);
+	view->pages[index] = 0;
+	view->states[index] = SKYCPU_CODECACHE_NONE;
+}
+
+/**
+ * Map the decoded page of a view page (shared if cached or not modified by the instance, private otherwise)
+ *
+ * @param view Pointer to the view
+ * @param index Page number
+ * @return Decoded page, NULL on error (out of memory, page interpreted)
+ */
+static SkyCPU_codecache_page_t* map_page(SkyCPU_codecache_view_t* view,
+		const uint16_t index) {
+	SkyCPU_runtime_t* runtime = view->runtime;
+	const uint8_t* content = runtime->memory
+			+ ((uint32_t) index << SKYCPU_PAGE_SHIFT);
+	uint64_t hash = hash_page(content);
+	SkyCPU_codecache_page_t *page = lookup_page(view, content, hash), *shared;
+
+	if (page) { /* Decoded by another instance */
+		__atomic_fetch_add(&view->cache->hits, 1, __ATOMIC_RELAXED);
+		view->states[index] = SKYCPU_CODECACHE_SHARED;
+
+	} else { /* New page (decoded as its offsets are reached) */
+		page = create_page(runtime, index, hash);
+		if (!page)
+			return 0;
+		__atomic_fetch_add(&view->cache->misses, 1, __ATOMIC_RELAXED);
+		shared = view->rewrites[index] ? 0 : insert_page(view->cache, page);
+		if (shared) {
+			page = shared;
+			view->states[index] = SKYCPU_CODECACHE_SHARED;
+		} else
+			view->states[index] = SKYCPU_CODECACHE_PRIVATE;
+	}
+
+	/* Writes to the page are now reported */
+	view->pages[index] = page;
+	runtime->page_flags[index] |= SKYCPU_PAGE_CODE;
+	return page;
+}
+
+int SkyCPU_codecache_init(SkyCPU_codecache_t* cache, const uint32_t capacity) {
+	uint32_t buckets = 1;
+
+	/* Hash table (about one page per bucket) */
+	while (buckets < capacity && buckets < (1UL << 31))
+		buckets <<= 1;
+	cache->buckets = calloc(buckets, sizeof(SkyCPU_codecache_page_t*));
+	if (!cache->buckets)
+		return -1;
+	cache->buckets_mask = buckets - 1;
+	cache->capacity = capacity;
+	cache->pages = 0;
+	cache->epoch = 1;
+	cache->views = 0;
+	cache->retired = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->decoded = 0;
+	cache->evictions = 0;
+	pthread_mutex_init(&cache->lock, NULL);
+
+	/* No error */
+	return 0;
+}
+
+void SkyCPU_codecache_free(SkyCPU_codecache_t* cache) {
+	SkyCPU_codecache_page_t *page, *next;
+	uint32_t bucket = 0;
+
+	/* No view left: every page can be freed */
+	for (; bucket <= cache->buckets_mask; ++bucket) {
+		for (page = cache->buckets[bucket]; page; page = next) {
+			next = page->next;
+			free_page(page);
+		}
+	}
+	for (page = cache->retired; page; page = next) {
+		next = page->retired_next;
+		free_page(page);
+	}
+	free(cache->buckets);
+	cache->buckets = 0;
+	cache->retired = 0;
+	cache->pages = 0;
+	pthread_mutex_destroy(&cache->lock);
+}
+
+uint32_t SkyCPU_codecache_trim(SkyCPU_codecache_t* cache) {
+	uint32_t count;
+	pthread_mutex_lock(&cache->lock);
+	count = evict_pages(cache);
+	pthread_mutex_unlock(&cache->lock);
+	return count;
+}
+
+void SkyCPU_codecache_view_init(SkyCPU_codecache_view_t* view,
+		SkyCPU_codecache_t* cache, SkyCPU_runtime_t* runtime) {
+
+	/* Setup view */
+	view->cache = cache;
+	view->runtime = runtime;
+	view->epoch = 0;
+	memset(view->pages, 0, sizeof(view->pages));
+	memset(view->states, SKYCPU_CODECACHE_NONE, sizeof(view->states));
+	memset(view->rewrites, 0, sizeof(view->rewrites));
+
+	/* Register its lookups */
+	pthread_mutex_lock(&cache->lock);
+	view->next = cache->views;
+	cache->views = view;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void SkyCPU_codecache_view_free(SkyCPU_codecache_view_t* view) {
+	SkyCPU_codecache_view_t** link;
+	uint16_t index = 0;
+
+	/* Release decoded pages */
+	for (; index < SKYCPU_PAGE_COUNT; ++index) {
+		release_page(view, index);
+		view->runtime->page_flags[index] &= ~SKYCPU_PAGE_CODE;
+	}
+	view->runtime->page_events &= ~SKYCPU_PAGE_CODE;
+
+	/* Unregister */
+	pthread_mutex_lock(&view->cache->lock);
+	for (link = &view->cache->views; *link; link = &(*link)->next) {
+		if (*link == view) {
+			*link = view->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&view->cache->lock);
+}
+
+uint32_t SkyCPU_codecache_check(SkyCPU_codecache_view_t* view) {
+	SkyCPU_runtime_t* runtime = view->runtime;
+	uint16_t index = 0;
+	uint32_t count = 0;
+
+	runtime->page_events &= ~SKYCPU_PAGE_CODE;
+	for (; index < SKYCPU_PAGE_COUNT; ++index) {
+
+		/* Decoded page still matching the memory */
+		if (!view->pages[index]
+				|| !memcmp(view->pages[index]->content,
+						runtime->memory + ((uint32_t) index << SKYCPU_PAGE_SHIFT),
+						SKYCPU_PAGE_SIZE))
+			continue;
+
+		/* Modified: decoded again at next run (privately), or only interpreted */
+		release_page(view, index);
+		if (++view->rewrites[index] > SKYCPU_CODECACHE_MAX_REWRITES) {
+			view->states[index] = SKYCPU_CODECACHE_INTERPRETED;
+			runtime->page_flags[index] &= ~SKYCPU_PAGE_CODE;
+		}
+		++count;
+	}
+	return count;
+}
+
+uint32_t SkyCPU_codecache_run(SkyCPU_codecache_view_t* view,
+		const uint32_t max_instructions, const uint8_t* halted) {
+	SkyCPU_runtime_t* runtime = view->runtime;
+	uint32_t count = 0;
+
+	/* Run until halted or out of budget */
+	while (count < max_instructions && !(halted && *halted)) {
+		uint16_t index = (runtime->program_counter & MEMORY_MASK)
+				>> SKYCPU_PAGE_SHIFT;
+		SkyCPU_codecache_page_t* page;
+
+		/* A code page was written by the last instruction */
+		if (runtime->page_events & SKYCPU_PAGE_CODE)
+			SkyCPU_codecache_check(view);
+
+		/* Decoded page (mapped on first execution) */
+		page = view->pages[index];
+		if (!page && view->states[index] == SKYCPU_CODECACHE_NONE)
+			page = map_page(view, index);
+		if (!page) { /* Interpreted page */
+			SkyCPU_fetch_and_execute(runtime);
+			++count;
+			continue;
+		}
+
+		/* Run inside the page (interpreter for instructions crossing its end) */
+		do {
+			uint32_t offset = runtime->program_counter & PAGE_OFFSET_MASK;
+			uint32_t slot = __atomic_load_n(&page->slots[offset],
+					__ATOMIC_ACQUIRE);
+			const SkyCPU_decoded_t* decoded = (slot != SKYCPU_CODECACHE_UNDECODED) ?
+					&__atomic_load_n(&page->chunks[slot / SKYCPU_CODECACHE_CHUNK],
+							__ATOMIC_ACQUIRE)[slot % SKYCPU_CODECACHE_CHUNK] :
+					decode_offset(view, index, offset);
+			if (decoded && decoded->length)
+				handlers[decoded->instruction](runtime, decoded);
+			else
+				SkyCPU_fetch_and_execute(runtime);
+			++count;
+		} while (count < max_instructions && !(halted && *halted)
+				&& !(runtime->page_events & SKYCPU_PAGE_CODE)
+				&& ((runtime->program_counter & MEMORY_MASK)
+						>> SKYCPU_PAGE_SHIFT) == index);
+	}
+
+	/* Return retired instructions count */
+	return count;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file SkyCPU_codecache.h
+ * @brief Process-wide decoded code cache shared by SkyCPU runtime instances (keyed by code page content)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a cache of pre-decoded code pages shared by all instances of a process.\n
+ * A code page is stored under the hash of its content, every instance running the same page (same image, any load\n
+ * address) map the same decoded page. Only the straight-line runs starting at an executed PC are decoded (instruction\n
+ * byte, arguments bytes and constants), once for all instances, into chunks allocated on demand: data past an\n
+ * unconditional jump and never executed code cost nothing. Decoded instructions run through one handler per\n
+ * instruction byte (no instruction fetch, no constant read from memory). Lookups take no lock: removed pages are freed only once no lookup can still see them (epoch based\n
+ * reclamation, RCU style).\n
+ * \n
+ * Instances run through a view (per instance decoded pages table), code pages are flagged SKYCPU_PAGE_CODE:\n
+ * once an instance write into one of its code pages, the page is re-checked and, if modified, decoded again into a\n
+ * private copy (never shared, unless the new content is already cached). Pages rewritten too often are only interpreted.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_PAGE_TRACKING. Not compatible with SkyCPU_aot on the same instance (both use SKYCPU_PAGE_CODE).\n
+ * A view MUST be used by one thread at a time. After writing an instance memory without SkyCPU_page_touch()\n
+ * (ex: SkyCPU_snapshot_restore()), call SkyCPU_codecache_check().
+ */
+
+#ifndef _SKYCPU_CODECACHE_H_
+#define _SKYCPU_CODECACHE_H_
+
+/* Dependency */
+#include <stdint.h>
+#include <pthread.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_PAGE_TRACKING
+#error "SkyCPU code cache require SKYCPU_PAGE_TRACKING"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Private rewrites of a code page before it is only interpreted */
+#define SKYCPU_CODECACHE_MAX_REWRITES 4
+
+/* Views pages states */
+#define SKYCPU_CODECACHE_NONE 0 /*!< Page not decoded yet */
+#define SKYCPU_CODECACHE_SHARED 1 /*!< Page mapped on a shared decoded page */
+#define SKYCPU_CODECACHE_PRIVATE 2 /*!< Page mapped on a private decoded copy */
+#define SKYCPU_CODECACHE_INTERPRETED 3 /*!< Page rewritten too often, interpreted */
+
+/* Shared pages references count of an evicted page */
+#define SKYCPU_CODECACHE_DEAD 0xFFFFFFFFUL
+
+/* Decoded instructions per chunk (power of two, chunks allocated as runs are decoded) */
+#define SKYCPU_CODECACHE_CHUNK 16
+#define SKYCPU_CODECACHE_CHUNKS ((SKYCPU_PAGE_SIZE + SKYCPU_CODECACHE_CHUNK - 1) / SKYCPU_CODECACHE_CHUNK)
+
+/* Zeroed bytes after a page content (longest instruction - 1, instructions crossing the page end are interpreted) */
+#define SKYCPU_CODECACHE_PADDING 16
+
+/* Slot of an offset not decoded yet (slots fit a byte with the default 256 bytes pages) */
+#if SKYCPU_PAGE_SHIFT <= 8
+typedef uint8_t SkyCPU_codecache_slot_t;
+#define SKYCPU_CODECACHE_UNDECODED 0xFF
+#else
+typedef uint16_t SkyCPU_codecache_slot_t;
+#define SKYCPU_CODECACHE_UNDECODED 0xFFFF
+#endif
+
+/**
+ * Decoded instruction (length = 0 : instruction crossing the page end, interpreted)
+ */
+typedef struct {
+	uint8_t instruction; /*!< Instruction byte */
+	uint8_t length; /*!< Encoded length */
+	uint8_t arguments[2]; /*!< Arguments bytes (A, B) */
+	uint32_t values[2]; /*!< Arguments constants or constant addresses (A, B) */
+} SkyCPU_decoded_t;
+
+/**
+ * Decoded code page
+ */
+typedef struct SkyCPU_codecache_page {
+	struct SkyCPU_codecache_page* next; /*!< Next page of the bucket (read without lock) */
+	struct SkyCPU_codecache_page* retired_next; /*!< Next retired page */
+	uint64_t hash; /*!< Content hash */
+	uint64_t retired_epoch; /*!< Epoch of the removal */
+	uint32_t references; /*!< Views mapping the page (SKYCPU_CODECACHE_DEAD once evicted) */
+	uint32_t decoded_count; /*!< Decoded instructions */
+	uint8_t content[SKYCPU_PAGE_SIZE + SKYCPU_CODECACHE_PADDING]; /*!< Page content (decoded from, zero padded) */
+	SkyCPU_codecache_slot_t slots[SKYCPU_PAGE_SIZE]; /*!< Decoded instruction of each offset (SKYCPU_CODECACHE_UNDECODED if not decoded yet) */
+	SkyCPU_decoded_t* chunks[SKYCPU_CODECACHE_CHUNKS]; /*!< Decoded instructions (by slot, read without lock) */
+} SkyCPU_codecache_page_t;
+
+struct SkyCPU_codecache_view;
+
+/**
+ * Code cache structure
+ */
+typedef struct {
+	SkyCPU_codecache_page_t** buckets; /*!< Hash table (read without lock) */
+	uint32_t buckets_mask; /*!< Buckets count - 1 */
+	uint32_t capacity; /*!< Maximum shared pages */
+	uint32_t pages; /*!< Shared pages cached */
+	uint64_t epoch; /*!< Global epoch */
+	struct SkyCPU_codecache_view* views; /*!< Registered views (lookups epochs) */
+	SkyCPU_codecache_page_t* retired; /*!< Removed pages waiting for the end of older lookups */
+	pthread_mutex_t lock; /*!< Protect insertions, removals and views registration */
+	uint64_t hits; /*!< Lookups served by a shared page */
+	uint64_t misses; /*!< Pages created (content not cached yet, shared or private) */
+	uint64_t decoded; /*!< Instructions decoded (all pages) */
+	uint64_t evictions; /*!< Shared pages evicted */
+} SkyCPU_codecache_t;
+
+/**
+ * Code cache view (one per runtime instance)
+ */
+typedef struct SkyCPU_codecache_view {
+	SkyCPU_codecache_t* cache; /*!< Code cache */
+	SkyCPU_runtime_t* runtime; /*!< Runtime instance */
+	struct SkyCPU_codecache_view* next; /*!< Next registered view */
+	uint64_t epoch; /*!< Epoch of the running lookup (0 if none) */
+	SkyCPU_codecache_page_t* pages[SKYCPU_PAGE_COUNT]; /*!< Decoded page of each page (or NULL) */
+	uint8_t states[SKYCPU_PAGE_COUNT]; /*!< State of each page (SKYCPU_CODECACHE_*) */
+	uint8_t rewrites[SKYCPU_PAGE_COUNT]; /*!< Private rewrites of each page */
+} SkyCPU_codecache_view_t;
+
+/**
+ * Initialize a code cache
+ *
+ * @param cache Pointer to the code cache to initialize
+ * @param capacity Maximum shared pages (unused pages are evicted beyond, then pages are decoded privately)
+ * @return 0 on success, -1 on error (out of memory)
+ */
+int SkyCPU_codecache_init(SkyCPU_codecache_t* cache, const uint32_t capacity);
+
+/**
+ * Free a code cache (all views MUST be freed first)
+ *
+ * @param cache Pointer to the code cache to free
+ */
+void SkyCPU_codecache_free(SkyCPU_codecache_t* cache);
+
+/**
+ * Evict all unused shared pages and free removed pages no lookup can see anymore
+ *
+ * @param cache Pointer to the code cache
+ * @return Number of pages evicted
+ */
+uint32_t SkyCPU_codecache_trim(SkyCPU_codecache_t* cache);
+
+/**
+ * Initialize a view of a code cache for a SkyCPU runtime instance (registered into the cache)
+ *
+ * @param view Pointer to the view to initialize
+ * @param cache Pointer to the code cache
+ * @param runtime Pointer to the SkyCPU runtime instance
+ */
+void SkyCPU_codecache_view_init(SkyCPU_codecache_view_t* view,
+		SkyCPU_codecache_t* cache, SkyCPU_runtime_t* runtime);
+
+/**
+ * Free a view (decoded pages released, view unregistered)
+ *
+ * @param view Pointer to the view to free
+ */
+void SkyCPU_codecache_view_free(SkyCPU_codecache_view_t* view);
+
+/**
+ * Check the decoded pages of a view against the instance memory (modified pages are decoded again at next run)
+ *
+ * @remarks Done by SkyCPU_codecache_run() when a code page is written, call it after writing the instance
+ * memory without SkyCPU_page_touch() (ex: SkyCPU_snapshot_restore()).
+ * @param view Pointer to the view
+ * @return Number of modified pages
+ */
+uint32_t SkyCPU_codecache_check(SkyCPU_codecache_view_t* view);
+
+/**
+ * Run a SkyCPU runtime instance using decoded pages
+ *
+ * @param view Pointer to the view of the instance
+ * @param max_instructions Instructions budget
+ * @param halted Pointer to a "stop now" flag set by callbacks (can be NULL)
+ * @return Number of retired instructions
+ */
+uint32_t SkyCPU_codecache_run(SkyCPU_codecache_view_t* view,
+		const uint32_t max_instructions, const uint8_t* halted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_CODECACHE_H_ */
@@ -0,0 +1,311 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <string.h>
+#include "SkyCPU_debug.h"
+#include "FastSkyCPU_opcodes.h"
+
+/* TRAP opcode byte (bits mode ignored) */
+#define TRAP_OPCODE (INSTRUCTION_TRAP << 2)
+
+static SkyCPU_breakpoint_t* find_breakpoint(SkyCPU_debugger_t* debugger,
+		const uint16_t address) {
+	uint8_t i = 0;
+	for (; i < debugger->breakpoints_count; ++i)
+		if (debugger->breakpoints[i].address == address)
+			return &debugger->breakpoints[i];
+	return 0;
+}
+
+static void update_pages(SkyCPU_debugger_t* debugger) {
+	uint8_t* page_flags = debugger->runtime->page_flags;
+	uint16_t i = 0;
+
+	/* Clear all watch flags */
+	for (; i < SKYCPU_PAGE_COUNT; ++i)
+		page_flags[i] &= ~SKYCPU_PAGE_WATCH;
+
+	/* Flag pages holding breakpoints (patched code can be overwritten) */
+	for (i = 0; i < debugger->breakpoints_count; ++i)
+		page_flags[debugger->breakpoints[i].address >> SKYCPU_PAGE_SHIFT] |=
+				SKYCPU_PAGE_WATCH;
+
+	/* Flag pages holding watched memory */
+	for (i = 0; i < debugger->watchpoints_count; ++i) {
+		const SkyCPU_watchpoint_t* watchpoint = &debugger->watchpoints[i];
+		page_flags[watchpoint->address >> SKYCPU_PAGE_SHIFT] |=
+				SKYCPU_PAGE_WATCH;
+		page_flags[((watchpoint->address + watchpoint->length - 1)
+				& MEMORY_MASK) >> SKYCPU_PAGE_SHIFT] |= SKYCPU_PAGE_WATCH;
+	}
+}
+
+/* Debugger store (page dirty and its events raised, code copies dropped), watch event left as is (not a guest store) */
+static void debugger_store(SkyCPU_runtime_t* runtime, const uint16_t address,
+		const uint8_t value) {
+	const uint8_t watch = runtime->page_events & SKYCPU_PAGE_WATCH;
+	runtime->memory[address & MEMORY_MASK] = value;
+	SkyCPU_page_touch(runtime, address, 1);
+	runtime->page_events = (runtime->page_events & ~SKYCPU_PAGE_WATCH) | watch;
+}
+
+static void watch_read(const SkyCPU_runtime_t* runtime, const uint16_t address,
+		const uint8_t length, uint8_t* value) {
+	uint8_t i = 0;
+	for (; i < length; ++i)
+		value[i] = runtime->memory[(address + i) & MEMORY_MASK];
+}
+
+static SkyCPU_debug_stop_t check_events(SkyCPU_debugger_t* debugger) {
+	SkyCPU_runtime_t* runtime = debugger->runtime;
+	SkyCPU_debug_stop_t stop = SKYCPU_DEBUG_NONE;
+	uint8_t i = 0;
+
+	/* Watched pages written */
+	if (runtime->page_events & SKYCPU_PAGE_WATCH) {
+		runtime->page_events &= ~SKYCPU_PAGE_WATCH;
+
+		/* Patch again overwritten breakpoints (new original opcode) */
+		for (i = 0; i < debugger->breakpoints_count; ++i) {
+			SkyCPU_breakpoint_t* breakpoint = &debugger->breakpoints[i];
+			if (runtime->memory[breakpoint->address] != TRAP_OPCODE) {
+				breakpoint->original = runtime->memory[breakpoint->address];
+				debugger_store(runtime, breakpoint->address, TRAP_OPCODE);
+			}
+		}
+
+		/* Check watched memory */
+		for (i = 0; i < debugger->watchpoints_count; ++i) {
+			SkyCPU_watchpoint_t* watchpoint = &debugger->watchpoints[i];
+			uint8_t value[SKYCPU_DEBUG_MAX_WATCH_LENGTH];
+			watch_read(runtime, watchpoint->address, watchpoint->length, value);
+			if (memcmp(value, watchpoint->value, watchpoint->length)) {
+				memcpy(watchpoint->value, value, watchpoint->length);
+				if (stop == SKYCPU_DEBUG_NONE) {
+					debugger->stop_address = watchpoint->address;
+					stop = SKYCPU_DEBUG_WATCHPOINT;
+				}
+			}
+		}
+	}
+
+	/* Trap hit (breakpoint or stray TRAP opcode) */
+	if (runtime->trapped) {
+		runtime->trapped = 0;
+		if (stop == SKYCPU_DEBUG_NONE)
+			stop = find_breakpoint(debugger, runtime->program_counter) ?
+					SKYCPU_DEBUG_BREAKPOINT : SKYCPU_DEBUG_ILLEGAL;
+	}
+
+	/* Halt request */
+	if (debugger->halted) {
+		debugger->halted = 0;
+		if (stop == SKYCPU_DEBUG_NONE)
+			stop = SKYCPU_DEBUG_HALTED;
+	}
+
+	/* Return stop reason */
+	return stop;
+}
+
+void SkyCPU_debug_init(SkyCPU_debugger_t* debugger, SkyCPU_runtime_t* runtime) {
+	debugger->runtime = runtime;
+	debugger->breakpoints_count = 0;
+	debugger->watchpoints_count = 0;
+	debugger->stop_address = 0;
+	debugger->halted = 0;
+	runtime->trapped = 0;
+	update_pages(debugger);
+	runtime->page_events &= ~SKYCPU_PAGE_WATCH;
+}
+
+void SkyCPU_debug_detach(SkyCPU_debugger_t* debugger) {
+
+	/* Restore original code */
+	while (debugger->breakpoints_count)
+		SkyCPU_debug_breakpoint_remove(debugger,
+				debugger->breakpoints[0].address);
+
+	/* Forget watchpoints */
+	debugger->watchpoints_count = 0;
+	update_pages(debugger);
+	debugger->runtime->page_events &= ~SKYCPU_PAGE_WATCH;
+}
+
+int SkyCPU_debug_breakpoint_insert(SkyCPU_debugger_t* debugger,
+		const uint16_t address) {
+	SkyCPU_runtime_t* runtime = debugger->runtime;
+	SkyCPU_breakpoint_t* breakpoint;
+
+	/* Already set (GDB may insert breakpoints twice) */
+	if (find_breakpoint(debugger, address & MEMORY_MASK))
+		return 0;
+
+	/* Check for free slot */
+	if (debugger->breakpoints_count == SKYCPU_DEBUG_MAX_BREAKPOINTS)
+		return -1;
+
+	/* Patch TRAP opcode */
+	breakpoint = &debugger->breakpoints[debugger->breakpoints_count++];
+	breakpoint->address = address & MEMORY_MASK;
+	breakpoint->original = runtime->memory[breakpoint->address];
+	debugger_store(runtime, breakpoint->address, TRAP_OPCODE);
+	update_pages(debugger);
+
+	/* No error */
+	return 0;
+}
+
+int SkyCPU_debug_breakpoint_remove(SkyCPU_debugger_t* debugger,
+		const uint16_t address) {
+	SkyCPU_breakpoint_t* breakpoint = find_breakpoint(debugger,
+			address & MEMORY_MASK);
+
+	/* Check for existing breakpoint */
+	if (!breakpoint)
+		return -1;
+
+	/* Restore original opcode & drop slot */
+	debugger_store(debugger->runtime, breakpoint->address, breakpoint->original);
+	*breakpoint = debugger->breakpoints[--debugger->breakpoints_count];
+	update_pages(debugger);
+
+	/* No error */
+	return 0;
+}
+
+int SkyCPU_debug_watchpoint_insert(SkyCPU_debugger_t* debugger,
+		const uint16_t address, const uint8_t length) {
+	SkyCPU_watchpoint_t* watchpoint;
+
+	/* Check arguments & free slot */
+	if (!length || length > SKYCPU_DEBUG_MAX_WATCH_LENGTH
+			|| debugger->watchpoints_count == SKYCPU_DEBUG_MAX_WATCHPOINTS)
+		return -1;
+
+	/* Record current value */
+	watchpoint = &debugger->watchpoints[debugger->watchpoints_count++];
+	watchpoint->address = address & MEMORY_MASK;
+	watchpoint->length = length;
+	watch_read(debugger->runtime, watchpoint->address, length,
+			watchpoint->value);
+	update_pages(debugger);
+
+	/* No error */
+	return 0;
+}
+
+int SkyCPU_debug_watchpoint_remove(SkyCPU_debugger_t* debugger,
+		const uint16_t address, const uint8_t length) {
+	uint8_t i = 0;
+
+	/* Search watchpoint */
+	for (; i < debugger->watchpoints_count; ++i) {
+		if (debugger->watchpoints[i].address == (address & MEMORY_MASK)
+				&& debugger->watchpoints[i].length == length) {
+
+			/* Drop slot */
+			debugger->watchpoints[i] =
+					debugger->watchpoints[--debugger->watchpoints_count];
+			update_pages(debugger);
+			return 0;
+		}
+	}
+
+	/* No such watchpoint */
+	return -1;
+}
+
+uint8_t SkyCPU_debug_memory_read(const SkyCPU_debugger_t* debugger,
+		const uint16_t address) {
+	uint8_t i = 0;
+
+	/* Original opcode under breakpoints */
+	for (; i < debugger->breakpoints_count; ++i)
+		if (debugger->breakpoints[i].address == (address & MEMORY_MASK))
+			return debugger->breakpoints[i].original;
+
+	/* Plain memory */
+	return debugger->runtime->memory[address & MEMORY_MASK];
+}
+
+void SkyCPU_debug_memory_write(SkyCPU_debugger_t* debugger,
+		const uint16_t address, const uint8_t value) {
+	SkyCPU_breakpoint_t* breakpoint = find_breakpoint(debugger,
+			address & MEMORY_MASK);
+	uint8_t i = 0;
+
+	/* Update original opcode under breakpoints, memory otherwise */
+	if (breakpoint)
+		breakpoint->original = value;
+	else
+		debugger_store(debugger->runtime, address, value);
+
+	/* Watched values follow debugger writes (not a guest store) */
+	for (; i < debugger->watchpoints_count; ++i) {
+		SkyCPU_watchpoint_t* watchpoint = &debugger->watchpoints[i];
+		if (((address - watchpoint->address) & MEMORY_MASK) < watchpoint->length)
+			watch_read(debugger->runtime, watchpoint->address,
+					watchpoint->length, watchpoint->value);
+	}
+}
+
+SkyCPU_debug_stop_t SkyCPU_debug_step(SkyCPU_debugger_t* debugger) {
+	SkyCPU_runtime_t* runtime = debugger->runtime;
+	SkyCPU_breakpoint_t* breakpoint = find_breakpoint(debugger,
+			runtime->program_counter & MEMORY_MASK);
+
+	/* Step over breakpoint: execute original instruction, then patch again */
+	if (breakpoint) {
+		debugger_store(runtime, breakpoint->address, breakpoint->original);
+		SkyCPU_fetch_and_execute(runtime);
+		breakpoint->original = runtime->memory[breakpoint->address];
+		debugger_store(runtime, breakpoint->address, TRAP_OPCODE);
+
+	} else
+		SkyCPU_fetch_and_execute(runtime);
+
+	/* Return stop reason */
+	return check_events(debugger);
+}
+
+SkyCPU_debug_stop_t SkyCPU_debug_run(SkyCPU_debugger_t* debugger,
+		const uint32_t max_instructions) {
+	SkyCPU_runtime_t* runtime = debugger->runtime;
+	SkyCPU_debug_stop_t stop;
+	uint32_t count = 1;
+
+	/* Nothing to do */
+	if (!max_instructions)
+		return SKYCPU_DEBUG_NONE;
+
+	/* First instruction may be under a breakpoint */
+	stop = SkyCPU_debug_step(debugger);
+
+	/* Run until something happen (only debugger events are checked) */
+	while (stop == SKYCPU_DEBUG_NONE && count < max_instructions) {
+		SkyCPU_fetch_and_execute(runtime);
+		++count;
+		if (runtime->trapped || (runtime->page_events & SKYCPU_PAGE_WATCH)
+				|| debugger->halted)
+			stop = check_events(debugger);
+	}
+
+	/* Return stop reason */
+	return stop;
+}
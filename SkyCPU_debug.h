@@ -0,0 +1,206 @@
+/**
+ * @file SkyCPU_debug.h
+ * @brief Debugger (patched breakpoints & pages watchpoints) for SkyCPU runtime instances
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a debugger for SkyCPU runtime instances.\n
+ * Breakpoints are patched into guest memory (TRAP opcode), watchpoints use pages flags,\n
+ * so nothing is checked by the CPU core for unwatched pages and code without breakpoints.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_DEBUGGER to be defined for ALL source files !\n
+ * Opcode 63 (TRAP) is reserved for the debugger.
+ */
+
+#ifndef _SKYCPU_DEBUG_H_
+#define _SKYCPU_DEBUG_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_DEBUGGER
+#error "SkyCPU debugger require SKYCPU_DEBUGGER"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Debugger limits */
+#ifndef SKYCPU_DEBUG_MAX_BREAKPOINTS
+#define SKYCPU_DEBUG_MAX_BREAKPOINTS 64
+#endif
+#ifndef SKYCPU_DEBUG_MAX_WATCHPOINTS
+#define SKYCPU_DEBUG_MAX_WATCHPOINTS 16
+#endif
+#define SKYCPU_DEBUG_MAX_WATCH_LENGTH 8
+
+/**
+ * Debugger stop reasons
+ */
+typedef enum {
+	SKYCPU_DEBUG_NONE, /*!< Still running (budget exhausted or single step done) */
+	SKYCPU_DEBUG_BREAKPOINT, /*!< Breakpoint hit (PC point to it) */
+	SKYCPU_DEBUG_WATCHPOINT, /*!< Watched memory modified (see stop_address) */
+	SKYCPU_DEBUG_ILLEGAL, /*!< TRAP opcode without breakpoint */
+	SKYCPU_DEBUG_HALTED /*!< Halted by SkyCPU_debug_halt() */
+} SkyCPU_debug_stop_t;
+
+/**
+ * Breakpoint structure
+ */
+typedef struct {
+	uint16_t address; /*!< Patched address */
+	uint8_t original; /*!< Original opcode byte */
+} SkyCPU_breakpoint_t;
+
+/**
+ * Watchpoint structure
+ */
+typedef struct {
+	uint16_t address; /*!< Base address of watched memory */
+	uint8_t length; /*!< Size of watched memory (max SKYCPU_DEBUG_MAX_WATCH_LENGTH) */
+	uint8_t value[SKYCPU_DEBUG_MAX_WATCH_LENGTH]; /*!< Last known value */
+} SkyCPU_watchpoint_t;
+
+/**
+ * Debugger structure
+ */
+typedef struct {
+	SkyCPU_runtime_t* runtime; /*!< Debugged SkyCPU runtime instance */
+	SkyCPU_breakpoint_t breakpoints[SKYCPU_DEBUG_MAX_BREAKPOINTS]; /*!< Breakpoints */
+	SkyCPU_watchpoint_t watchpoints[SKYCPU_DEBUG_MAX_WATCHPOINTS]; /*!< Watchpoints */
+	uint8_t breakpoints_count, watchpoints_count; /*!< Number of breakpoints / watchpoints */
+	uint16_t stop_address; /*!< Watchpoint address of the last watchpoint stop */
+	uint8_t halted; /*!< If true the debugger must stop as soon as possible */
+} SkyCPU_debugger_t;
+
+/**
+ * Initialize a debugger and attach it to a SkyCPU runtime instance
+ *
+ * @param debugger Pointer to the debugger to initialize
+ * @param runtime Pointer to the SkyCPU runtime instance to debug
+ */
+void SkyCPU_debug_init(SkyCPU_debugger_t* debugger, SkyCPU_runtime_t* runtime);
+
+/**
+ * Remove all breakpoints and watchpoints (restore original code)
+ *
+ * @param debugger Pointer to the debugger
+ */
+void SkyCPU_debug_detach(SkyCPU_debugger_t* debugger);
+
+/**
+ * Insert a breakpoint (TRAP opcode patched into memory)
+ *
+ * @param debugger Pointer to the debugger
+ * @param address Address of the instruction
+ * @return 0 on success, -1 on error (too many breakpoints)
+ */
+int SkyCPU_debug_breakpoint_insert(SkyCPU_debugger_t* debugger,
+		const uint16_t address);
+
+/**
+ * Remove a breakpoint (original opcode restored)
+ *
+ * @param debugger Pointer to the debugger
+ * @param address Address of the instruction
+ * @return 0 on success, -1 on error (no such breakpoint)
+ */
+int SkyCPU_debug_breakpoint_remove(SkyCPU_debugger_t* debugger,
+		const uint16_t address);
+
+/**
+ * Insert a write watchpoint
+ *
+ * @param debugger Pointer to the debugger
+ * @param address Base address of watched memory
+ * @param length Size of watched memory (max SKYCPU_DEBUG_MAX_WATCH_LENGTH)
+ * @return 0 on success, -1 on error (too many watchpoints or bad length)
+ */
+int SkyCPU_debug_watchpoint_insert(SkyCPU_debugger_t* debugger,
+		const uint16_t address, const uint8_t length);
+
+/**
+ * Remove a write watchpoint
+ *
+ * @param debugger Pointer to the debugger
+ * @param address Base address of watched memory
+ * @param length Size of watched memory
+ * @return 0 on success, -1 on error (no such watchpoint)
+ */
+int SkyCPU_debug_watchpoint_remove(SkyCPU_debugger_t* debugger,
+		const uint16_t address, const uint8_t length);
+
+/**
+ * Read a byte of guest memory (original opcodes seen under breakpoints)
+ *
+ * @param debugger Pointer to the debugger
+ * @param address Address to read
+ * @return Byte value
+ */
+uint8_t SkyCPU_debug_memory_read(const SkyCPU_debugger_t* debugger,
+		const uint16_t address);
+
+/**
+ * Write a byte of guest memory (breakpoints kept in place, page marked dirty like a guest store)
+ *
+ * @param debugger Pointer to the debugger
+ * @param address Address to write
+ * @param value Byte value
+ */
+void SkyCPU_debug_memory_write(SkyCPU_debugger_t* debugger,
+		const uint16_t address, const uint8_t value);
+
+/**
+ * Execute a single instruction (stepping over a breakpoint at PC if any)
+ *
+ * @param debugger Pointer to the debugger
+ * @return Stop reason (SKYCPU_DEBUG_NONE if nothing special happened)
+ */
+SkyCPU_debug_stop_t SkyCPU_debug_step(SkyCPU_debugger_t* debugger);
+
+/**
+ * Run until a breakpoint, a watchpoint, a halt request or the end of the budget
+ *
+ * @param debugger Pointer to the debugger
+ * @param max_instructions Instructions budget
+ * @return Stop reason (SKYCPU_DEBUG_NONE if the budget is exhausted)
+ */
+SkyCPU_debug_stop_t SkyCPU_debug_run(SkyCPU_debugger_t* debugger,
+		const uint32_t max_instructions);
+
+/**
+ * Stop the debugged instance as soon as possible (to be called from callbacks)
+ *
+ * @param debugger Pointer to the debugger
+ */
+static __inline__ void SkyCPU_debug_halt(SkyCPU_debugger_t* debugger) {
+	debugger->halted = 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_DEBUG_H_ */
@@ -0,0 +1,168 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include "SkyCPU_decode.h"
+
+/* Mnemonics table (same order as SkyCPU_instruction_opcode_t) */
+static const char* const mnemonics[] = { "NOP", "RET", "JMP", "CALL", "PUSH",
+		"BRK", "INT", "INC", "DEC", "CLR", "SET", "NOT", "NEG", "SWAP", "JNN",
+		"JN", "SNN", "SN", "POP", "ADD", "SUB", "MUL", "DIV", "AND", "NAND", "OR",
+		"NOR", "XOR", "SBI", "CLI", "LSL", "LSR", "ROL", "ROR", "MOV", "CXH", "JE",
+		"JNE", "JG", "JGE", "JL", "JLE", "JBC", "JBS", "SE", "SNE", "SG", "SGE",
+		"SL", "SLE", "SBC", "SBS", "SEND", "RECV" };
+
+/* Bits mode suffixes */
+static const char bits_suffixes[] = { 'x', 'b', 'w', 'd' };
+
+/* Read a big endian value of "size" bytes (addresses wrap around) */
+static uint32_t read_value(const uint8_t* memory, const uint16_t address,
+		const uint8_t size) {
+	uint32_t value = 0;
+	uint8_t i = 0;
+	for (; i < size; ++i)
+		value = (value << 8) | memory[(address + i) & MEMORY_MASK];
+	return value;
+}
+
+/* Decode one argument, return its encoded size */
+static uint8_t decode_argument(const uint8_t* memory, const uint16_t address,
+		const uint8_t bits_mode, SkyCPU_argument_t* argument) {
+	uint8_t raw = memory[address & MEMORY_MASK];
+
+	/* Default values */
+	argument->raw = raw;
+	argument->code = ARGUMENT_REGISTERCODE(raw);
+	argument->inlined = 0;
+	argument->size = 1;
+	argument->value = 0;
+
+	/* Check for constant value */
+	if (ARGUMENT_CONSTANT(raw)) {
+		argument->type = ARGUMENT_POINTEDBY(raw) ?
+				ARGUMENT_TYPE_POINTED_CONSTANT : ARGUMENT_TYPE_CONSTANT;
+
+		/* Check for inline constant */
+		if (ARGUMENT_INLINECONST(raw)) {
+			argument->inlined = 1;
+			argument->value = ARGUMENT_INLINEVALUE(raw);
+
+		} else if (ARGUMENT_POINTEDBY(raw)) { /* Address (fixed 16 bits) */
+			argument->value = read_value(memory, address + 1, 2);
+			argument->size += 2;
+
+		} else { /* Value (bits mode) */
+			uint8_t size = (bits_mode == DOUBLE_WORD) ? 4 : bits_mode;
+			argument->value = read_value(memory, address + 1, size);
+			argument->size += size;
+		}
+
+	} else if (ARGUMENT_SFRMODE(raw)) { /* Special function register */
+		argument->type = ARGUMENT_POINTEDBY(raw) ?
+				ARGUMENT_TYPE_POINTED_SFR : ARGUMENT_TYPE_SFR;
+
+	} else { /* General purpose register */
+		argument->type = ARGUMENT_POINTEDBY(raw) ?
+				ARGUMENT_TYPE_POINTED_REGISTER : ARGUMENT_TYPE_REGISTER;
+	}
+
+	/* Return encoded size */
+	return argument->size;
+}
+
+/* Disassemble one argument */
+static int disassemble_argument(const SkyCPU_argument_t* argument,
+		char* buffer, const size_t size) {
+	const char* sfr = (argument->code == REGISTER_PC) ? "PC" :
+			(argument->code == REGISTER_SP) ? "SP" : "SFR?";
+
+	/* Switch according argument type */
+	switch (argument->type) {
+	case ARGUMENT_TYPE_CONSTANT:
+		return snprintf(buffer, size, "#%lu", (unsigned long) argument->value);
+
+	case ARGUMENT_TYPE_POINTED_CONSTANT:
+		return snprintf(buffer, size, "[#0x%04lX]",
+				(unsigned long) argument->value);
+
+	case ARGUMENT_TYPE_REGISTER:
+		return snprintf(buffer, size, "r%u", argument->code);
+
+	case ARGUMENT_TYPE_POINTED_REGISTER:
+		return snprintf(buffer, size, "[r%u]", argument->code);
+
+	case ARGUMENT_TYPE_SFR:
+		return snprintf(buffer, size, "%s", sfr);
+
+	default: /* ARGUMENT_TYPE_POINTED_SFR */
+		return snprintf(buffer, size, "[%s]", sfr);
+	}
+}
+
+const char* SkyCPU_mnemonic(const uint8_t opcode) {
+	if (opcode > INSTRUCTION_RECV)
+		return NULL;
+	return mnemonics[opcode];
+}
+
+uint8_t SkyCPU_decode(const uint8_t* memory, const uint16_t address,
+		SkyCPU_instruction_t* instruction) {
+	uint8_t i = 0, raw = memory[address & MEMORY_MASK];
+
+	/* Decode instruction byte */
+	instruction->address = address;
+	instruction->raw = raw;
+	instruction->opcode = INSTRUCTION_OPCODE(raw);
+	instruction->bits_mode = INSTRUCTION_BITSMODE(raw);
+	instruction->arguments_count = SkyCPU_arguments_count(instruction->opcode);
+	instruction->length = 1;
+
+	/* Decode arguments */
+	for (; i < instruction->arguments_count; ++i)
+		instruction->length += decode_argument(memory,
+				address + instruction->length, instruction->bits_mode,
+				&instruction->arguments[i]);
+
+	/* Return encoded length */
+	return instruction->length;
+}
+
+int SkyCPU_disassemble(const SkyCPU_instruction_t* instruction, char* buffer,
+		const size_t size) {
+	const char* mnemonic = SkyCPU_mnemonic(instruction->opcode);
+	size_t length;
+	uint8_t i = 0;
+
+	/* Mnemonic and bits mode */
+	if (mnemonic)
+		length = snprintf(buffer, size, "%s.%c", mnemonic,
+				bits_suffixes[instruction->bits_mode]);
+	else
+		length = snprintf(buffer, size, "DB 0x%02X", instruction->raw);
+
+	/* Arguments */
+	for (; mnemonic && i < instruction->arguments_count && length < size; ++i) {
+		length += snprintf(buffer + length, size - length, i ? ", " : " ");
+		if (length < size)
+			length += disassemble_argument(&instruction->arguments[i],
+					buffer + length, size - length);
+	}
+
+	/* Return text length */
+	return length;
+}
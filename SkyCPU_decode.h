@@ -0,0 +1,150 @@
+/**
+ * @file SkyCPU_decode.h
+ * @brief SkyCPU instructions decoder & disassembler
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define routines to decode SkyCPU instructions from a memory image.\n
+ * Decoded lengths follow exactly the arguments fetching of the SkyCPU core.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+#ifndef _SKYCPU_DECODE_H_
+#define _SKYCPU_DECODE_H_
+
+/* Dependency */
+#include <stdint.h>
+#include <stddef.h>
+#include "FastSkyCPU.h"
+#include "FastSkyCPU_opcodes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Arguments types definition
+ */
+typedef enum {
+	ARGUMENT_TYPE_CONSTANT, /*!< #value */
+	ARGUMENT_TYPE_POINTED_CONSTANT, /*!< [#address] */
+	ARGUMENT_TYPE_REGISTER, /*!< rN */
+	ARGUMENT_TYPE_POINTED_REGISTER, /*!< [rN] */
+	ARGUMENT_TYPE_SFR, /*!< PC or SP */
+	ARGUMENT_TYPE_POINTED_SFR /*!< [PC] or [SP] */
+} SkyCPU_argument_type_t;
+
+/**
+ * Decoded argument structure
+ */
+typedef struct {
+	uint8_t raw; /*!< Argument byte */
+	uint8_t type; /*!< Argument type (see SkyCPU_argument_type_t) */
+	uint8_t code; /*!< Register / SFR code */
+	uint8_t inlined; /*!< If true the constant is inlined in the argument byte */
+	uint8_t size; /*!< Encoded size (argument byte included) */
+	uint32_t value; /*!< Constant value or constant address */
+} SkyCPU_argument_t;
+
+/**
+ * Decoded instruction structure
+ */
+typedef struct {
+	uint16_t address; /*!< Address of the instruction */
+	uint8_t raw; /*!< Instruction byte */
+	uint8_t opcode; /*!< Instruction code (see SkyCPU_instruction_opcode_t) */
+	uint8_t bits_mode; /*!< Bits mode (see SkyCPU_instruction_bits_mode_t) */
+	uint8_t arguments_count; /*!< Number of arguments (0, 1 or 2) */
+	uint8_t length; /*!< Encoded length (instruction byte included) */
+	SkyCPU_argument_t arguments[2]; /*!< Decoded arguments (A, B) */
+} SkyCPU_instruction_t;
+
+/**
+ * Check if an instruction code is a conditional (skip the next instruction) one
+ *
+ * @param opcode Instruction code
+ * @return True if the instruction can set the "skip next" flag
+ */
+static __inline__ uint8_t SkyCPU_is_conditional(const uint8_t opcode) {
+	return (opcode >= INSTRUCTION_JNN && opcode <= INSTRUCTION_SN)
+			|| (opcode >= INSTRUCTION_JE && opcode <= INSTRUCTION_SBS);
+}
+
+/**
+ * Check if an instruction code commit its result into argument A
+ *
+ * @param opcode Instruction code
+ * @return True if the result is committed into argument A
+ */
+static __inline__ uint8_t SkyCPU_is_committing(const uint8_t opcode) {
+	return (opcode >= INSTRUCTION_INC && opcode <= INSTRUCTION_SWAP)
+			|| (opcode >= INSTRUCTION_POP && opcode <= INSTRUCTION_MOV)
+			|| opcode == INSTRUCTION_RECV;
+}
+
+/**
+ * Get the number of arguments of an instruction code
+ *
+ * @param opcode Instruction code
+ * @return Number of arguments (0, 1 or 2)
+ */
+static __inline__ uint8_t SkyCPU_arguments_count(const uint8_t opcode) {
+	if (opcode >= INSTRUCTION_ADD)
+		return 2;
+	if (opcode >= INSTRUCTION_JMP)
+		return 1;
+	return 0;
+}
+
+/**
+ * Get the mnemonic of an instruction code
+ *
+ * @param opcode Instruction code
+ * @return Mnemonic string, or NULL if the instruction code is unknown
+ */
+const char* SkyCPU_mnemonic(const uint8_t opcode);
+
+/**
+ * Decode an instruction from a memory image
+ *
+ * @param memory Memory image (MEMORY_MASK + 1 bytes, addresses wrap around)
+ * @param address Address of the instruction
+ * @param instruction Pointer to the decoded instruction structure to fill
+ * @return Encoded length of the instruction
+ */
+uint8_t SkyCPU_decode(const uint8_t* memory, const uint16_t address,
+		SkyCPU_instruction_t* instruction);
+
+/**
+ * Disassemble a decoded instruction (ex: "ADD.b r0, #1")
+ *
+ * @param instruction Pointer to the decoded instruction
+ * @param buffer Output text buffer
+ * @param size Output text buffer size
+ * @return Length of the text (as snprintf)
+ */
+int SkyCPU_disassemble(const SkyCPU_instruction_t* instruction, char* buffer,
+		const size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_DECODE_H_ */
@@ -0,0 +1,498 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "SkyCPU_dedup.h"
+
+/* Default scanner throttle (same as KSM) */
+#define DEFAULT_PAGES_TO_SCAN 100
+#define DEFAULT_SLEEP_MS 20
+
+/* Bytes of the runtime structure before the memory */
+#define RUNTIME_HEAD offsetof(SkyCPU_runtime_t, memory)
+
+/**
+ * Get the mapping size of an instance (header page, memory pages, runtime tail)
+ *
+ * @param store Pointer to the pages store
+ * @return Size in bytes
+ */
+static size_t instance_size(const SkyCPU_dedup_t* store) {
+	size_t tail = sizeof(SkyCPU_runtime_t) - RUNTIME_HEAD - (MEMORY_MASK + 1);
+	return store->page_size + (MEMORY_MASK + 1)
+			+ ((tail + store->page_size - 1) & ~(store->page_size - 1));
+}
+
+/**
+ * Hash a host page and tell if it is zeroed
+ *
+ * @param data Pointer to the page
+ * @param size Page size
+ * @param zero Set to 1 if the page is zeroed, 0 otherwise
+ * @return Page content hash
+ */
+static uint64_t page_hash(const uint8_t* data, const size_t size, int* zero) {
+	uint64_t hash = 0, bits = 0, word;
+	size_t i;
+	for (i = 0; i < size; i += sizeof(word)) {
+		memcpy(&word, data + i, sizeof(word));
+		bits |= word;
+		hash = ((hash << 29) | (hash >> 35)) ^ word;
+		hash *= 0x9E3779B97F4A7C15ULL;
+	}
+	*zero = !bits;
+	return hash ^ (hash >> 32);
+}
+
+/**
+ * Map a store page copy-on-write over an instance page
+ *
+ * @param store Pointer to the pages store
+ * @param instance Pointer to the instance header
+ * @param page Host page index in the instance memory
+ * @param index Store page index
+ * @return 0 on success, -1 on error
+ */
+static int map_page(SkyCPU_dedup_t* store, SkyCPU_dedup_instance_t* instance,
+		const uint32_t page, const int32_t index) {
+	if (mmap(instance->runtime->memory + page * store->page_size,
+			store->page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+			store->fd, (off_t) index * store->page_size) == MAP_FAILED)
+		return -1;
+	instance->pages[page] = index;
+	store->references[index]++;
+	store->pages_sharing++;
+	return 0;
+}
+
+/**
+ * Drop a zeroed instance page (fresh anonymous page, not resident until written)
+ *
+ * @param store Pointer to the pages store
+ * @param instance Pointer to the instance header
+ * @param page Host page index in the instance memory
+ * @return 0 on success, -1 on error
+ */
+static int drop_page(SkyCPU_dedup_t* store, SkyCPU_dedup_instance_t* instance,
+		const uint32_t page) {
+	if (mmap(instance->runtime->memory + page * store->page_size,
+			store->page_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+		return -1;
+	instance->pages[page] = SKYCPU_DEDUP_ZERO;
+	store->pages_zero++;
+	return 0;
+}
+
+/**
+ * Forget the sharing state of an instance page (the page itself is left as is)
+ *
+ * @param store Pointer to the pages store
+ * @param instance Pointer to the instance header
+ * @param page Host page index in the instance memory
+ */
+static void unshare_page(SkyCPU_dedup_t* store,
+		SkyCPU_dedup_instance_t* instance, const uint32_t page) {
+	int32_t index = instance->pages[page];
+	instance->pages[page] = SKYCPU_DEDUP_PRIVATE;
+
+	/* Zeroed page */
+	if (index == SKYCPU_DEDUP_ZERO) {
+		store->pages_zero--;
+		return;
+	}
+	if (index < 0)
+		return;
+
+	/* Store page still in use */
+	store->pages_sharing--;
+	if (--store->references[index])
+		return;
+
+	/* Unlink the store page from its bucket */
+	{
+		int32_t* link = &store->buckets[store->hashes[index]
+				& store->buckets_mask];
+		while (*link != index)
+			link = &store->next[*link];
+		*link = store->next[index];
+	}
+
+	/* Free its memory and put it in the free list */
+	fallocate(store->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			(off_t) index * store->page_size, store->page_size);
+	store->next[index] = store->free_head;
+	store->free_head = index;
+	store->pages_shared--;
+}
+
+/**
+ * Move an instance page content into a new store page
+ *
+ * @param store Pointer to the pages store
+ * @param data Pointer to the page content
+ * @param hash Page content hash
+ * @return Store page index, -1 if the store is full
+ */
+static int32_t store_page(SkyCPU_dedup_t* store, const uint8_t* data,
+		const uint64_t hash) {
+	int32_t index;
+	uint32_t bucket = hash & store->buckets_mask;
+
+	/* Reuse a freed page or take a new one */
+	if (store->free_head >= 0) {
+		index = store->free_head;
+		store->free_head = store->next[index];
+	} else if (store->used < store->capacity)
+		index = store->used++;
+	else
+		return -1;
+
+	/* Fill it and link it in its bucket */
+	memcpy(store->view + (size_t) index * store->page_size, data,
+			store->page_size);
+	store->hashes[index] = hash;
+	store->references[index] = 0;
+	store->next[index] = store->buckets[bucket];
+	store->buckets[bucket] = index;
+	store->pages_shared++;
+	return index;
+}
+
+/**
+ * Forget all unstable candidates (new full scan, instance released)
+ *
+ * @param store Pointer to the pages store
+ */
+static void reset_candidates(SkyCPU_dedup_t* store) {
+	memset(store->candidate_buckets, 0xFF,
+			(store->buckets_mask + 1) * sizeof(int32_t));
+	store->candidates_count = 0;
+}
+
+/**
+ * Scan one host page of a (locked) instance
+ *
+ * @param store Pointer to the pages store
+ * @param instance Pointer to the instance header
+ * @param page Host page index in the instance memory
+ * @return 1 if the page was shared or dropped, 0 otherwise
+ */
+static int scan_page(SkyCPU_dedup_t* store, SkyCPU_dedup_instance_t* instance,
+		const uint32_t page) {
+	uint8_t* data = instance->runtime->memory + page * store->page_size;
+	SkyCPU_dedup_candidate_t* candidate;
+	uint32_t bucket;
+	uint64_t hash;
+	int32_t index;
+	int zero;
+
+	/* Shared page: still untouched, or sharing broken by a write */
+	index = instance->pages[page];
+	if (index >= 0) {
+		if (!memcmp(data, store->view + (size_t) index * store->page_size,
+				store->page_size))
+			return 0;
+		unshare_page(store, instance, page);
+	}
+
+	/* Zeroed page: drop it (once) */
+	hash = page_hash(data, store->page_size, &zero);
+	if (zero) {
+		if (instance->pages[page] == SKYCPU_DEDUP_ZERO)
+			return 0;
+		return !drop_page(store, instance, page);
+	}
+	if (instance->pages[page] == SKYCPU_DEDUP_ZERO)
+		unshare_page(store, instance, page);
+	bucket = hash & store->buckets_mask;
+
+	/* Stable table: same content already in the store */
+	for (index = store->buckets[bucket]; index >= 0;
+			index = store->next[index]) {
+		if (store->hashes[index] == hash
+				&& !memcmp(data,
+						store->view + (size_t) index * store->page_size,
+						store->page_size))
+			return !map_page(store, instance, page, index);
+	}
+
+	/* Unstable table: same content seen in another page during this full scan */
+	for (index = store->candidate_buckets[bucket]; index >= 0;
+			index = candidate->next) {
+		SkyCPU_dedup_instance_t* other;
+		uint8_t* other_data;
+		candidate = &store->candidates[index];
+		other = store->instances[candidate->instance];
+		other_data = other->runtime->memory
+				+ candidate->page * store->page_size;
+		if (candidate->hash != hash || other_data == data)
+			continue;
+		if (other != instance && pthread_mutex_trylock(&other->lock))
+			continue;
+		if (other->pages[candidate->page] == SKYCPU_DEDUP_PRIVATE
+				&& !memcmp(data, other_data, store->page_size)) {
+			int32_t shared = store_page(store, data, hash);
+			int done = shared >= 0 && !map_page(store, instance, page, shared)
+					&& !map_page(store, other, candidate->page, shared);
+			if (other != instance)
+				pthread_mutex_unlock(&other->lock);
+			candidate->hash = ~hash;
+			return done ? 2 : 0;
+		}
+		if (other != instance)
+			pthread_mutex_unlock(&other->lock);
+	}
+
+	/* First time seen: remember it as a candidate */
+	candidate = &store->candidates[store->candidates_count];
+	candidate->hash = hash;
+	candidate->instance = instance->index;
+	candidate->page = page;
+	candidate->next = store->candidate_buckets[bucket];
+	store->candidate_buckets[bucket] = store->candidates_count++;
+	return 0;
+}
+
+int SkyCPU_dedup_init(SkyCPU_dedup_t* store, const uint32_t capacity,
+		const uint32_t max_instances) {
+	uint32_t buckets = 1;
+	memset(store, 0, sizeof(SkyCPU_dedup_t));
+	store->fd = -1;
+
+	/* Memory MUST be made of whole host pages, header MUST fit before it */
+	store->page_size = sysconf(_SC_PAGESIZE);
+	if (store->page_size < SKYCPU_DEDUP_MIN_PAGE
+			|| (MEMORY_MASK + 1) % store->page_size
+			|| sizeof(SkyCPU_dedup_instance_t) + RUNTIME_HEAD > store->page_size
+			|| !capacity || !max_instances)
+		return -1;
+	store->instance_pages = (MEMORY_MASK + 1) / store->page_size;
+	store->capacity = capacity;
+	store->instances_capacity = max_instances;
+	store->free_head = -1;
+
+	/* Store memfd (sparse, pages are allocated when filled) */
+	store->fd = memfd_create("skycpu-pages", MFD_CLOEXEC);
+	if (store->fd < 0)
+		goto error;
+	if (ftruncate(store->fd, (off_t) capacity * store->page_size))
+		goto error;
+	store->view = mmap(NULL, (size_t) capacity * store->page_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+	if (store->view == MAP_FAILED) {
+		store->view = NULL;
+		goto error;
+	}
+
+	/* Tables (buckets count: power of two, at least pages count) */
+	while (buckets < capacity
+			|| buckets < max_instances * store->instance_pages)
+		buckets <<= 1;
+	store->buckets_mask = buckets - 1;
+	store->hashes = malloc(capacity * sizeof(uint64_t));
+	store->references = malloc(capacity * sizeof(uint32_t));
+	store->next = malloc(capacity * sizeof(int32_t));
+	store->buckets = malloc(buckets * sizeof(int32_t));
+	store->candidate_buckets = malloc(buckets * sizeof(int32_t));
+	store->candidates = malloc(
+			max_instances * store->instance_pages
+					* sizeof(SkyCPU_dedup_candidate_t));
+	store->instances = malloc(
+			max_instances * sizeof(SkyCPU_dedup_instance_t*));
+	if (!store->hashes || !store->references || !store->next
+			|| !store->buckets || !store->candidate_buckets
+			|| !store->candidates || !store->instances)
+		goto error;
+	memset(store->buckets, 0xFF, buckets * sizeof(int32_t));
+	reset_candidates(store);
+
+	/* Scanner */
+	pthread_mutex_init(&store->lock, NULL);
+	store->pages_to_scan = DEFAULT_PAGES_TO_SCAN;
+	store->sleep_ms = DEFAULT_SLEEP_MS;
+	return 0;
+
+	error: if (store->view)
+		munmap(store->view, (size_t) capacity * store->page_size);
+	if (store->fd >= 0)
+		close(store->fd);
+	free(store->hashes);
+	free(store->references);
+	free(store->next);
+	free(store->buckets);
+	free(store->candidate_buckets);
+	free(store->candidates);
+	free(store->instances);
+	return -1;
+}
+
+void SkyCPU_dedup_free(SkyCPU_dedup_t* store) {
+	SkyCPU_dedup_stop(store);
+	while (store->instances_count)
+		SkyCPU_dedup_release(store, store->instances[0]->runtime);
+	pthread_mutex_destroy(&store->lock);
+	munmap(store->view, (size_t) store->capacity * store->page_size);
+	close(store->fd);
+	free(store->hashes);
+	free(store->references);
+	free(store->next);
+	free(store->buckets);
+	free(store->candidate_buckets);
+	free(store->candidates);
+	free(store->instances);
+}
+
+SkyCPU_runtime_t* SkyCPU_dedup_alloc(SkyCPU_dedup_t* store) {
+	SkyCPU_dedup_instance_t* instance;
+	uint8_t* base;
+	uint32_t page;
+
+	/* Header page, then memory on host pages boundary */
+	pthread_mutex_lock(&store->lock);
+	if (store->instances_count == store->instances_capacity) {
+		pthread_mutex_unlock(&store->lock);
+		return NULL;
+	}
+	base = mmap(NULL, instance_size(store), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		pthread_mutex_unlock(&store->lock);
+		return NULL;
+	}
+	instance = (SkyCPU_dedup_instance_t*) base;
+	instance->runtime = (SkyCPU_runtime_t*) (base + store->page_size
+			- RUNTIME_HEAD);
+	for (page = 0; page < store->instance_pages; ++page)
+		instance->pages[page] = SKYCPU_DEDUP_PRIVATE;
+	pthread_mutex_init(&instance->lock, NULL);
+
+	/* Register it */
+	instance->index = store->instances_count;
+	store->instances[store->instances_count++] = instance;
+	pthread_mutex_unlock(&store->lock);
+	return instance->runtime;
+}
+
+void SkyCPU_dedup_release(SkyCPU_dedup_t* store, SkyCPU_runtime_t* runtime) {
+	SkyCPU_dedup_instance_t* instance = SkyCPU_dedup_instance(store, runtime);
+	uint32_t page, last;
+
+	/* Drop its shared pages */
+	pthread_mutex_lock(&store->lock);
+	pthread_mutex_lock(&instance->lock);
+	for (page = 0; page < store->instance_pages; ++page)
+		unshare_page(store, instance, page);
+
+	/* Unregister it, the last instance take its place (candidates indexes are now stale) */
+	last = --store->instances_count;
+	store->instances[instance->index] = store->instances[last];
+	store->instances[instance->index]->index = instance->index;
+
+	/* Scan cursor: follow the moved instance, restart the page of a new one */
+	if (store->cursor_instance == instance->index)
+		store->cursor_page = 0;
+	else if (store->cursor_instance == last)
+		store->cursor_instance = instance->index;
+	reset_candidates(store);
+	pthread_mutex_unlock(&store->lock);
+
+	/* Free it */
+	pthread_mutex_unlock(&instance->lock);
+	pthread_mutex_destroy(&instance->lock);
+	munmap(instance, instance_size(store));
+}
+
+uint32_t SkyCPU_dedup_scan(SkyCPU_dedup_t* store, const uint32_t pages) {
+	uint32_t i, count = 0;
+	pthread_mutex_lock(&store->lock);
+	for (i = 0; i < pages && store->instances_count; ++i) {
+		SkyCPU_dedup_instance_t* instance;
+
+		/* Wrap around: new full scan */
+		if (store->cursor_instance >= store->instances_count) {
+			store->cursor_instance = 0;
+			store->cursor_page = 0;
+			store->full_scans++;
+			reset_candidates(store);
+		}
+
+		/* Scan the page (skip running instances) */
+		instance = store->instances[store->cursor_instance];
+		if (!pthread_mutex_trylock(&instance->lock)) {
+			count += scan_page(store, instance, store->cursor_page);
+			pthread_mutex_unlock(&instance->lock);
+		}
+		if (++store->cursor_page == store->instance_pages) {
+			store->cursor_page = 0;
+			store->cursor_instance++;
+		}
+	}
+	pthread_mutex_unlock(&store->lock);
+	return count;
+}
+
+void SkyCPU_dedup_throttle(SkyCPU_dedup_t* store,
+		const uint32_t pages_to_scan, const uint32_t sleep_ms) {
+	__atomic_store_n(&store->pages_to_scan, pages_to_scan, __ATOMIC_RELAXED);
+	__atomic_store_n(&store->sleep_ms, sleep_ms, __ATOMIC_RELAXED);
+}
+
+/**
+ * Scanner thread: scan pages_to_scan pages, sleep sleep_ms, repeat
+ *
+ * @param argument Pointer to the pages store
+ * @return NULL
+ */
+static void* scanner_thread(void* argument) {
+	SkyCPU_dedup_t* store = (SkyCPU_dedup_t*) argument;
+	while (__atomic_load_n(&store->running, __ATOMIC_ACQUIRE)) {
+		uint32_t sleep_ms = __atomic_load_n(&store->sleep_ms, __ATOMIC_RELAXED);
+		struct timespec delay;
+		SkyCPU_dedup_scan(store,
+				__atomic_load_n(&store->pages_to_scan, __ATOMIC_RELAXED));
+		delay.tv_sec = sleep_ms / 1000;
+		delay.tv_nsec = (sleep_ms % 1000) * 1000000L;
+		nanosleep(&delay, NULL);
+	}
+	return NULL;
+}
+
+int SkyCPU_dedup_start(SkyCPU_dedup_t* store) {
+	if (store->running)
+		return -1;
+	store->running = 1;
+	if (pthread_create(&store->thread, NULL, scanner_thread, store)) {
+		store->running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void SkyCPU_dedup_stop(SkyCPU_dedup_t* store) {
+	if (!store->running)
+		return;
+	__atomic_store_n(&store->running, 0, __ATOMIC_RELEASE);
+	pthread_join(store->thread, NULL);
+}
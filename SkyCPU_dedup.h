@@ -0,0 +1,227 @@
+/**
+ * @file SkyCPU_dedup.h
+ * @brief Content-addressed memory pages deduplication between SkyCPU runtime instances
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a host-wide pages store shared by many SkyCPU runtime instances.\n
+ * Instances allocated from the store have their memory aligned on host pages. A scanner (KSM style) hash\n
+ * the host pages of all instances, identical pages are moved into the store (a memfd) and mapped copy-on-write\n
+ * by every instance holding them, zeroed pages are dropped. A write to a shared page break the sharing (kernel\n
+ * copy-on-write), the CPU core itself is unchanged and run at full speed.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Linux only (memfd, MAP_FIXED). An instance MUST NOT run while the scanner thread is started,\n
+ * unless it is run between SkyCPU_dedup_lock() and SkyCPU_dedup_unlock() (locked instances are skipped).
+ */
+
+#ifndef _SKYCPU_DEDUP_H_
+#define _SKYCPU_DEDUP_H_
+
+/* Dependency */
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "FastSkyCPU.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Smallest supported host page size */
+#define SKYCPU_DEDUP_MIN_PAGE 4096
+
+#ifdef SKYCPU_MIRRORED_MEMORY
+#error "SkyCPU pages deduplication require the memory inside the runtime structure (no SKYCPU_MIRRORED_MEMORY)"
+#endif
+
+#if (MEMORY_MASK + 1) < SKYCPU_DEDUP_MIN_PAGE
+#error "SkyCPU pages deduplication require at least one host page of memory"
+#endif
+
+/* Host pages states (besides store page index) */
+#define SKYCPU_DEDUP_PRIVATE -1 /*!< Page owned by the instance */
+#define SKYCPU_DEDUP_ZERO -2 /*!< Zeroed page, dropped */
+
+/**
+ * Instance header (stored in the host page just before the instance memory)
+ */
+typedef struct {
+	pthread_mutex_t lock; /*!< Held while the instance run or is scanned */
+	SkyCPU_runtime_t* runtime; /*!< Runtime instance */
+	uint32_t index; /*!< Position in the store instances array */
+	int32_t pages[(MEMORY_MASK + 1) / SKYCPU_DEDUP_MIN_PAGE]; /*!< Store page index of each host page (or SKYCPU_DEDUP_*) */
+} SkyCPU_dedup_instance_t;
+
+/**
+ * Unstable candidate (private page seen once during the current full scan)
+ */
+typedef struct {
+	uint64_t hash; /*!< Page content hash */
+	int32_t next; /*!< Next candidate with the same bucket (-1 if none) */
+	uint32_t instance; /*!< Instance index */
+	uint32_t page; /*!< Host page index */
+} SkyCPU_dedup_candidate_t;
+
+/**
+ * Pages store structure
+ */
+typedef struct {
+	int fd; /*!< Store memfd */
+	uint8_t* view; /*!< Store pages (shared mapping of the memfd) */
+	size_t page_size; /*!< Host page size */
+	uint32_t instance_pages; /*!< Host pages per instance memory */
+	uint32_t capacity; /*!< Store capacity in pages */
+	uint32_t used; /*!< Store pages ever allocated */
+	int32_t free_head; /*!< First free store page (-1 if none) */
+	uint64_t* hashes; /*!< Content hash of each store page */
+	uint32_t* references; /*!< Instances pages mapped on each store page */
+	int32_t* next; /*!< Next store page with the same bucket (or next free page) */
+	int32_t* buckets; /*!< Stable table: first store page of each bucket */
+	int32_t* candidate_buckets; /*!< Unstable table: first candidate of each bucket */
+	uint32_t buckets_mask; /*!< Buckets count - 1 */
+	SkyCPU_dedup_candidate_t* candidates; /*!< Unstable candidates */
+	uint32_t candidates_count; /*!< Candidates used */
+	SkyCPU_dedup_instance_t** instances; /*!< Registered instances */
+	uint32_t instances_count; /*!< Registered instances count */
+	uint32_t instances_capacity; /*!< Maximum instances count */
+	uint32_t cursor_instance, cursor_page; /*!< Next host page to scan */
+	pthread_mutex_t lock; /*!< Protect the store (scans, allocations and releases) */
+	pthread_t thread; /*!< Scanner thread */
+	int running; /*!< If true the scanner thread is started */
+	uint32_t pages_to_scan; /*!< Scanner throttle: host pages scanned per pass */
+	uint32_t sleep_ms; /*!< Scanner throttle: sleep between passes (milliseconds) */
+	uint32_t pages_shared; /*!< Store pages in use */
+	uint32_t pages_sharing; /*!< Instances pages mapped on store pages */
+	uint32_t pages_zero; /*!< Instances zeroed pages dropped */
+	uint64_t full_scans; /*!< Completed scans of all instances */
+} SkyCPU_dedup_t;
+
+/**
+ * Initialize a pages store
+ *
+ * @param store Pointer to the pages store to initialize
+ * @param capacity Store capacity in host pages (distinct shared pages)
+ * @param max_instances Maximum number of instances allocated from the store
+ * @return 0 on success, -1 on error (memory size not a multiple of the host page size, out of memory, ...)
+ */
+int SkyCPU_dedup_init(SkyCPU_dedup_t* store, const uint32_t capacity,
+		const uint32_t max_instances);
+
+/**
+ * Stop the scanner, release all instances and free a pages store
+ *
+ * @param store Pointer to the pages store to free
+ */
+void SkyCPU_dedup_free(SkyCPU_dedup_t* store);
+
+/**
+ * Allocate a SkyCPU runtime instance from a pages store
+ *
+ * @remarks The memory is zeroed, the runtime still need SkyCPU_runtime_init().
+ * @param store Pointer to the pages store
+ * @return Pointer to the runtime instance, NULL on error (too many instances, out of memory)
+ */
+SkyCPU_runtime_t* SkyCPU_dedup_alloc(SkyCPU_dedup_t* store);
+
+/**
+ * Release a SkyCPU runtime instance allocated from a pages store
+ *
+ * @param store Pointer to the pages store
+ * @param runtime Pointer to the runtime instance (MUST NOT be locked)
+ */
+void SkyCPU_dedup_release(SkyCPU_dedup_t* store, SkyCPU_runtime_t* runtime);
+
+/**
+ * Get the header of a SkyCPU runtime instance allocated from a pages store
+ *
+ * @param store Pointer to the pages store
+ * @param runtime Pointer to the runtime instance
+ * @return Pointer to the instance header
+ */
+static __inline__ SkyCPU_dedup_instance_t* SkyCPU_dedup_instance(
+		const SkyCPU_dedup_t* store, SkyCPU_runtime_t* runtime) {
+	return (SkyCPU_dedup_instance_t*) (runtime->memory - store->page_size);
+}
+
+/**
+ * Lock a SkyCPU runtime instance before running it (the scanner skip it)
+ *
+ * @param store Pointer to the pages store
+ * @param runtime Pointer to the runtime instance
+ */
+static __inline__ void SkyCPU_dedup_lock(const SkyCPU_dedup_t* store,
+		SkyCPU_runtime_t* runtime) {
+	pthread_mutex_lock(&SkyCPU_dedup_instance(store, runtime)->lock);
+}
+
+/**
+ * Unlock a SkyCPU runtime instance after running it
+ *
+ * @param store Pointer to the pages store
+ * @param runtime Pointer to the runtime instance
+ */
+static __inline__ void SkyCPU_dedup_unlock(const SkyCPU_dedup_t* store,
+		SkyCPU_runtime_t* runtime) {
+	pthread_mutex_unlock(&SkyCPU_dedup_instance(store, runtime)->lock);
+}
+
+/**
+ * Scan some host pages of the instances (round robin over all instances)
+ *
+ * @remarks Instance pages seen twice with the same content during a full scan are moved into the store,
+ * pages matching a store page are mapped on it, zeroed pages are dropped.
+ * @param store Pointer to the pages store
+ * @param pages Number of host pages to scan
+ * @return Number of instances pages newly shared or dropped
+ */
+uint32_t SkyCPU_dedup_scan(SkyCPU_dedup_t* store, const uint32_t pages);
+
+/**
+ * Set the scanner throttle (take effect at the next pass)
+ *
+ * @param store Pointer to the pages store
+ * @param pages_to_scan Host pages scanned per pass
+ * @param sleep_ms Sleep between passes (milliseconds)
+ */
+void SkyCPU_dedup_throttle(SkyCPU_dedup_t* store,
+		const uint32_t pages_to_scan, const uint32_t sleep_ms);
+
+/**
+ * Start the background scanner thread
+ *
+ * @param store Pointer to the pages store
+ * @return 0 on success, -1 on error (already started, thread creation failed)
+ */
+int SkyCPU_dedup_start(SkyCPU_dedup_t* store);
+
+/**
+ * Stop the background scanner thread (wait for the current pass)
+ *
+ * @param store Pointer to the pages store
+ */
+void SkyCPU_dedup_stop(SkyCPU_dedup_t* store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_DEDUP_H_ */
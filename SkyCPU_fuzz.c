@@ -0,0 +1,64 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <string.h>
+#include "SkyCPU_fuzz.h"
+#include "Endian_utility.h"
+#include "FastSkyCPU_opcodes.h"
+
+void SkyCPU_fuzz_init(SkyCPU_fuzz_t* fuzz, SkyCPU_runtime_t* runtime,
+		uint8_t* coverage_map, const uint16_t input_address,
+		const uint16_t input_size_max) {
+
+	/* Setup harness */
+	fuzz->coverage_map = coverage_map;
+	fuzz->input_address = input_address;
+	fuzz->input_size_max = input_size_max;
+	fuzz->halted = 0;
+
+	/* Bind coverage bitmap & snapshot the warmed-up instance */
+	SkyCPU_coverage_setup(runtime, coverage_map);
+	SkyCPU_snapshot_take(&fuzz->snapshot, runtime);
+}
+
+uint32_t SkyCPU_fuzz_run(SkyCPU_fuzz_t* fuzz, SkyCPU_runtime_t* runtime,
+		const uint8_t* input, uint16_t input_size,
+		const uint32_t max_instructions) {
+	uint32_t count = 0;
+
+	/* Reset instance (dirty pages only) and coverage */
+	SkyCPU_snapshot_restore(&fuzz->snapshot, runtime);
+	memset(fuzz->coverage_map, 0, SKYCPU_COVERAGE_SIZE);
+	runtime->previous_location = 0;
+	fuzz->halted = 0;
+
+	/* Load input data (size in r0:r1) */
+	if (input_size > fuzz->input_size_max)
+		input_size = fuzz->input_size_max;
+	SkyCPU_memory_copy(runtime, input, input_size, fuzz->input_address);
+	set16bitsValue(runtime->registers, REGISTER_0, input_size);
+
+	/* Run until halted or out of budget */
+	while (!fuzz->halted && count < max_instructions) {
+		SkyCPU_fetch_and_execute(runtime);
+		++count;
+	}
+
+	/* Return executed instructions count */
+	return count;
+}
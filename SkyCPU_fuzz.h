@@ -0,0 +1,105 @@
+/**
+ * @file SkyCPU_fuzz.h
+ * @brief High-throughput fuzzing harness for SkyCPU guest programs
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a fuzzing harness mode for SkyCPU runtime instances.\n
+ * A warmed-up instance is snapshotted once, then each iteration only restore the pages\n
+ * dirtied by the previous input (stores, PUSH and CALL) and record an AFL-style edges\n
+ * coverage bitmap (jumps and skips decisions).\n
+ * \n
+ * Input data is copied at a fixed guest address and its size is stored in r0:r1 (16 bits).\n
+ * An iteration end when the breakpoint callback call SkyCPU_fuzz_halt() or when the\n
+ * instructions budget is exhausted.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_FUZZING to be defined for ALL source files !
+ */
+
+#ifndef _SKYCPU_FUZZ_H_
+#define _SKYCPU_FUZZ_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_snapshot.h"
+
+#ifndef SKYCPU_FUZZING
+#error "SkyCPU fuzzing harness require SKYCPU_FUZZING"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fuzzing harness structure
+ */
+typedef struct {
+	SkyCPU_snapshot_t snapshot; /*!< Warmed-up runtime snapshot */
+	uint8_t* coverage_map; /*!< Edges coverage bitmap (SKYCPU_COVERAGE_SIZE bytes) */
+	uint16_t input_address; /*!< Guest address of input data */
+	uint16_t input_size_max; /*!< Maximum size of input data */
+	uint8_t halted; /*!< If true the current iteration is over */
+} SkyCPU_fuzz_t;
+
+/**
+ * Initialize a fuzzing harness from a warmed-up SkyCPU runtime instance
+ *
+ * @param fuzz Pointer to the fuzzing harness to initialize
+ * @param runtime Pointer to the warmed-up SkyCPU runtime instance
+ * @param coverage_map Pointer to the coverage bitmap (SKYCPU_COVERAGE_SIZE bytes, can be AFL shared memory)
+ * @param input_address Guest address of input data
+ * @param input_size_max Maximum size of input data
+ */
+void SkyCPU_fuzz_init(SkyCPU_fuzz_t* fuzz, SkyCPU_runtime_t* runtime,
+		uint8_t* coverage_map, const uint16_t input_address,
+		const uint16_t input_size_max);
+
+/**
+ * Run one fuzzing iteration
+ *
+ * @param fuzz Pointer to the fuzzing harness
+ * @param runtime Pointer to the SkyCPU runtime instance (the snapshotted one)
+ * @param input Input data buffer
+ * @param input_size Input data size (truncated to input_size_max)
+ * @param max_instructions Instructions budget of the iteration
+ * @return Number of executed instructions
+ */
+uint32_t SkyCPU_fuzz_run(SkyCPU_fuzz_t* fuzz, SkyCPU_runtime_t* runtime,
+		const uint8_t* input, uint16_t input_size,
+		const uint32_t max_instructions);
+
+/**
+ * Stop the current fuzzing iteration (to be called from callbacks)
+ *
+ * @param fuzz Pointer to the fuzzing harness
+ */
+static __inline__ void SkyCPU_fuzz_halt(SkyCPU_fuzz_t* fuzz) {
+	fuzz->halted = 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_FUZZ_H_ */
@@ -0,0 +1,510 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "SkyCPU_gdb.h"
+#include "FastSkyCPU_opcodes.h"
+
+/* Packets buffer size (also reported as PacketSize) */
+#define PACKET_SIZE 4096
+
+/* Registers numbers */
+#define REGISTER_PC 32
+#define REGISTER_SP 33
+#define REGISTERS_COUNT 34
+
+/* Signals reported to GDB */
+#define SIGNAL_INT 2
+#define SIGNAL_ILL 4
+#define SIGNAL_TRAP 5
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(const char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static char* hex_byte(char* out, const uint8_t value) {
+	*out++ = hex_digits[value >> 4];
+	*out++ = hex_digits[value & 15];
+	return out;
+}
+
+static int parse_byte(const char* in) {
+	int high = hex_value(in[0]), low = (high < 0) ? -1 : hex_value(in[1]);
+	return (low < 0) ? -1 : (high << 4) | low;
+}
+
+static int send_packet(const int fd, const char* data) {
+	char buffer[PACKET_SIZE + 4];
+	size_t length = strlen(data), i = 0;
+	uint8_t checksum = 0;
+
+	/* Frame packet ($data#checksum) */
+	buffer[0] = '$';
+	for (; i < length; ++i)
+		checksum += (uint8_t) data[i];
+	memcpy(buffer + 1, data, length);
+	buffer[length + 1] = '#';
+	hex_byte(buffer + length + 2, checksum);
+
+	/* Send it (acks are ignored by receive_packet) */
+	return (write(fd, buffer, length + 4) == (ssize_t) (length + 4)) ? 0 : -1;
+}
+
+static int receive_packet(const int fd, char* data) {
+	size_t length = 0;
+	uint8_t checksum = 0;
+	int state = 0;
+	char c, sum[2];
+
+	/* Read byte by byte (packets are small, GDB wait for each reply) */
+	for (;;) {
+		if (read(fd, &c, 1) != 1)
+			return -1;
+
+		switch (state) {
+		case 0: /* Wait for packet start (acks & stray bytes ignored) */
+			if (c == '$') {
+				length = 0;
+				checksum = 0;
+				state = 1;
+			} else if (c == 3) { /* Interrupt outside of a run */
+				strcpy(data, "\x03");
+				return 0;
+			}
+			break;
+
+		case 1: /* Packet data */
+			if (c == '#')
+				state = 2;
+			else if (length < PACKET_SIZE - 1) {
+				data[length++] = c;
+				checksum += (uint8_t) c;
+			}
+			break;
+
+		case 2: /* First checksum digit */
+			sum[0] = c;
+			state = 3;
+			break;
+
+		case 3: /* Second checksum digit */
+			sum[1] = c;
+			data[length] = '\0';
+			if (parse_byte(sum) == checksum) {
+				if (write(fd, "+", 1) != 1)
+					return -1;
+				return 0;
+			}
+			if (write(fd, "-", 1) != 1)
+				return -1;
+			state = 0;
+			break;
+		}
+	}
+}
+
+static int interrupt_pending(const int fd) {
+	struct pollfd pfd;
+	char c;
+
+	/* Check for Ctrl-C without blocking */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) <= 0)
+		return 0;
+	if (read(fd, &c, 1) != 1)
+		return -1; /* Disconnected */
+	return c == 3;
+}
+
+static uint8_t read_register(const SkyCPU_runtime_t* runtime,
+		const uint8_t number, uint8_t* value) {
+	if (number < 32) {
+		value[0] = runtime->registers[number];
+		return 1;
+	}
+	value[0] = ((number == REGISTER_PC) ? runtime->program_counter
+			: runtime->stack_pointer) >> 8;
+	value[1] = ((number == REGISTER_PC) ? runtime->program_counter
+			: runtime->stack_pointer) & 0xFF;
+	return 2;
+}
+
+static void write_register(SkyCPU_runtime_t* runtime, const uint8_t number,
+		const uint8_t* value) {
+	if (number < 32)
+		runtime->registers[number] = value[0];
+	else if (number == REGISTER_PC)
+		runtime->program_counter = (value[0] << 8) | value[1];
+	else
+		runtime->stack_pointer = (value[0] << 8) | value[1];
+}
+
+static void stop_reply(const SkyCPU_debugger_t* debugger,
+		const SkyCPU_debug_stop_t stop, char* reply) {
+	switch (stop) {
+	case SKYCPU_DEBUG_WATCHPOINT:
+		sprintf(reply, "T%02xwatch:%04x;", SIGNAL_TRAP, debugger->stop_address);
+		break;
+
+	case SKYCPU_DEBUG_BREAKPOINT:
+		sprintf(reply, "T%02xswbreak:;", SIGNAL_TRAP);
+		break;
+
+	case SKYCPU_DEBUG_ILLEGAL:
+		sprintf(reply, "S%02x", SIGNAL_ILL);
+		break;
+
+	case SKYCPU_DEBUG_HALTED:
+		sprintf(reply, "S%02x", SIGNAL_INT);
+		break;
+
+	default: /* Single step done */
+		sprintf(reply, "S%02x", SIGNAL_TRAP);
+		break;
+	}
+}
+
+static SkyCPU_debug_stop_t resume(SkyCPU_debugger_t* debugger, const int fd,
+		const char* command) {
+	SkyCPU_debug_stop_t stop;
+	int interrupted;
+
+	/* Optional resume address */
+	if (command[1])
+		debugger->runtime->program_counter = strtoul(command + 1, 0, 16);
+
+	/* Single step */
+	if (command[0] == 's')
+		return SkyCPU_debug_step(debugger);
+
+	/* Continue by slices (check for Ctrl-C between slices) */
+	for (;;) {
+		stop = SkyCPU_debug_run(debugger, SKYCPU_GDB_SLICE);
+		if (stop != SKYCPU_DEBUG_NONE)
+			return stop;
+		interrupted = interrupt_pending(fd);
+		if (interrupted)
+			return SKYCPU_DEBUG_HALTED;
+	}
+}
+
+static void handle_memory(SkyCPU_debugger_t* debugger, const char* command,
+		char* reply) {
+	unsigned long address, length, i;
+	char* cursor;
+	int value;
+
+	/* Parse address & length */
+	address = strtoul(command + 1, &cursor, 16);
+	if (*cursor != ',') {
+		strcpy(reply, "E01");
+		return;
+	}
+	length = strtoul(cursor + 1, &cursor, 16);
+
+	if (command[0] == 'm') { /* Read memory */
+		if (length > (PACKET_SIZE - 1) / 2)
+			length = (PACKET_SIZE - 1) / 2;
+		for (i = 0; i < length; ++i)
+			reply = hex_byte(reply,
+					SkyCPU_debug_memory_read(debugger, address + i));
+		*reply = '\0';
+
+	} else { /* Write memory */
+		if (*cursor != ':' || strlen(++cursor) < length * 2) {
+			strcpy(reply, "E01");
+			return;
+		}
+		for (i = 0; i < length; ++i) {
+			if (parse_byte(cursor + i * 2) < 0) { /* No partial write */
+				strcpy(reply, "E01");
+				return;
+			}
+		}
+		for (i = 0; i < length; ++i, cursor += 2) {
+			value = parse_byte(cursor);
+			SkyCPU_debug_memory_write(debugger, address + i, value);
+		}
+		strcpy(reply, "OK");
+	}
+}
+
+static void handle_registers(SkyCPU_debugger_t* debugger, const char* command,
+		char* reply) {
+	SkyCPU_runtime_t* runtime = debugger->runtime;
+	uint8_t value[2], i, j, size;
+	unsigned long number;
+	char* cursor;
+	int byte;
+
+	switch (command[0]) {
+	case 'g': /* Read all registers */
+		for (i = 0; i < REGISTERS_COUNT; ++i) {
+			size = read_register(runtime, i, value);
+			for (j = 0; j < size; ++j)
+				reply = hex_byte(reply, value[j]);
+		}
+		*reply = '\0';
+		break;
+
+	case 'G': /* Write all registers */
+		if (strlen(command + 1) < (32 + 2 + 2) * 2) {
+			strcpy(reply, "E01");
+			return;
+		}
+		for (i = 0; i < (32 + 2 + 2) * 2; i += 2) {
+			if (parse_byte(command + 1 + i) < 0) { /* No partial write */
+				strcpy(reply, "E01");
+				return;
+			}
+		}
+		for (i = 0, ++command; i < REGISTERS_COUNT; ++i) {
+			size = (i < 32) ? 1 : 2;
+			for (j = 0; j < size; ++j, command += 2)
+				value[j] = parse_byte(command);
+			write_register(runtime, i, value);
+		}
+		strcpy(reply, "OK");
+		break;
+
+	case 'p': /* Read one register */
+		number = strtoul(command + 1, 0, 16);
+		if (number >= REGISTERS_COUNT) {
+			strcpy(reply, "E01");
+			return;
+		}
+		size = read_register(runtime, number, value);
+		for (j = 0; j < size; ++j)
+			reply = hex_byte(reply, value[j]);
+		*reply = '\0';
+		break;
+
+	case 'P': /* Write one register */
+		number = strtoul(command + 1, &cursor, 16);
+		if (number >= REGISTERS_COUNT || *cursor != '=') {
+			strcpy(reply, "E01");
+			return;
+		}
+		size = (number < 32) ? 1 : 2;
+		for (j = 0, ++cursor; j < size; ++j, cursor += 2) {
+			byte = parse_byte(cursor);
+			if (byte < 0) {
+				strcpy(reply, "E01");
+				return;
+			}
+			value[j] = byte;
+		}
+		write_register(runtime, number, value);
+		strcpy(reply, "OK");
+		break;
+	}
+}
+
+static void handle_points(SkyCPU_debugger_t* debugger, const char* command,
+		char* reply) {
+	unsigned long type, address, kind;
+	char* cursor;
+	int result;
+
+	/* Parse type, address & kind (Z/z type,address,kind) */
+	type = strtoul(command + 1, &cursor, 16);
+	if (*cursor != ',') {
+		strcpy(reply, "E01");
+		return;
+	}
+	address = strtoul(cursor + 1, &cursor, 16);
+	kind = (*cursor == ',') ? strtoul(cursor + 1, 0, 16) : 1;
+
+	switch (type) {
+	case 0: /* Software breakpoint */
+	case 1: /* Hardware breakpoint (same thing here) */
+		result = (command[0] == 'Z') ?
+				SkyCPU_debug_breakpoint_insert(debugger, address) :
+				SkyCPU_debug_breakpoint_remove(debugger, address);
+		break;
+
+	case 2: /* Write watchpoint (length checked before narrowing) */
+		if (!kind || kind > SKYCPU_DEBUG_MAX_WATCH_LENGTH) {
+			strcpy(reply, "E01");
+			return;
+		}
+		result = (command[0] == 'Z') ?
+				SkyCPU_debug_watchpoint_insert(debugger, address, kind) :
+				SkyCPU_debug_watchpoint_remove(debugger, address, kind);
+		break;
+
+	default: /* Read / access watchpoints not supported */
+		reply[0] = '\0';
+		return;
+	}
+
+	/* Report result */
+	strcpy(reply, result ? "E0E" : "OK");
+}
+
+int SkyCPU_gdb_listen(const char* endpoint) {
+	int fd, yes = 1;
+
+	if (endpoint[0] == '/' || endpoint[0] == '.') { /* Unix socket */
+		struct sockaddr_un address;
+		if (strlen(endpoint) >= sizeof(address.sun_path))
+			return -1;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strcpy(address.sun_path, endpoint);
+		unlink(endpoint);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+			close(fd);
+			return -1;
+		}
+
+	} else { /* Local TCP port */
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(atoi(endpoint));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+		if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	/* Single client */
+	if (listen(fd, 1) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* Return listening socket */
+	return fd;
+}
+
+int SkyCPU_gdb_serve(SkyCPU_debugger_t* debugger, const int listen_fd) {
+	char command[PACKET_SIZE], reply[PACKET_SIZE];
+	SkyCPU_debug_stop_t last_stop = SKYCPU_DEBUG_NONE;
+	int fd, yes = 1, result = 0;
+
+	/* Wait for GDB */
+	fd = accept(listen_fd, 0, 0);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	/* Serve commands until detach / kill / disconnection */
+	while (receive_packet(fd, command) == 0) {
+		reply[0] = '\0';
+
+		switch (command[0]) {
+		case '?': /* Last stop reason */
+			stop_reply(debugger, last_stop, reply);
+			break;
+
+		case '\x03': /* Interrupt while stopped */
+			last_stop = SKYCPU_DEBUG_HALTED;
+			stop_reply(debugger, last_stop, reply);
+			break;
+
+		case 'g': /* Registers */
+		case 'G':
+		case 'p':
+		case 'P':
+			handle_registers(debugger, command, reply);
+			break;
+
+		case 'm': /* Memory */
+		case 'M':
+			handle_memory(debugger, command, reply);
+			break;
+
+		case 'c': /* Continue / step */
+		case 's':
+			last_stop = resume(debugger, fd, command);
+			stop_reply(debugger, last_stop, reply);
+			break;
+
+		case 'Z': /* Breakpoints & watchpoints */
+		case 'z':
+			handle_points(debugger, command, reply);
+			break;
+
+		case 'H': /* Single thread */
+			strcpy(reply, "OK");
+			break;
+
+		case 'q': /* Queries */
+			if (!strncmp(command, "qSupported", 10))
+				sprintf(reply, "PacketSize=%x;swbreak+", PACKET_SIZE - 1);
+			else if (!strcmp(command, "qAttached"))
+				strcpy(reply, "1");
+			else if (!strcmp(command, "qC"))
+				strcpy(reply, "QC1");
+			break;
+
+		case 'D': /* Detach (instance left as is, breakpoints removed) */
+			SkyCPU_debug_detach(debugger);
+			send_packet(fd, "OK");
+			close(fd);
+			return 0;
+
+		case 'k': /* Kill */
+			SkyCPU_debug_detach(debugger);
+			close(fd);
+			return 1;
+
+		default: /* Unsupported (empty reply) */
+			break;
+		}
+
+		/* Send reply */
+		if (send_packet(fd, reply) < 0) {
+			result = -1;
+			break;
+		}
+	}
+
+	/* Disconnected */
+	SkyCPU_debug_detach(debugger);
+	close(fd);
+	return result;
+}
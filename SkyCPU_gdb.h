@@ -0,0 +1,70 @@
+/**
+ * @file SkyCPU_gdb.h
+ * @brief GDB remote serial protocol stub for SkyCPU runtime instances
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a GDB remote stub (local TCP port or Unix socket) on top of the SkyCPU debugger.\n
+ * Registers order (g packet): r0 ... r31 (8 bits each), PC and SP (16 bits, big-endian).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_DEBUGGER to be defined for ALL source files !\n
+ * POSIX sockets only, one client at a time.
+ */
+
+#ifndef _SKYCPU_GDB_H_
+#define _SKYCPU_GDB_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "SkyCPU_debug.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Instructions run between two checks for a GDB interrupt (Ctrl-C) */
+#ifndef SKYCPU_GDB_SLICE
+#define SKYCPU_GDB_SLICE 65536
+#endif
+
+/**
+ * Open a listening socket for GDB
+ *
+ * @param endpoint TCP port number (bound to 127.0.0.1, "1234") or Unix socket path ("/tmp/skycpu.sock")
+ * @return Listening socket on success, -1 on error
+ */
+int SkyCPU_gdb_listen(const char* endpoint);
+
+/**
+ * Accept one GDB client and serve it until detach, kill or disconnection
+ *
+ * @param debugger Pointer to the debugger (attached to the instance to debug)
+ * @param listen_fd Listening socket (see SkyCPU_gdb_listen())
+ * @return 0 on detach / disconnection, 1 on kill request, -1 on error
+ */
+int SkyCPU_gdb_serve(SkyCPU_debugger_t* debugger, const int listen_fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_GDB_H_ */
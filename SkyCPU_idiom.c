@@ -0,0 +1,811 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <string.h>
+#include "SkyCPU_idiom.h"
+#include "SkyCPU_decode.h"
+#include "Endian_utility.h"
+#include "FastSkyCPU_opcodes.h"
+#ifdef SKYCPU_METRICS
+#include "SkyCPU_metrics.h"
+#endif
+
+/* Memory size */
+#define MEMORY_SIZE ((uint32_t) MEMORY_MASK + 1)
+
+/* Loops heads bitmaps */
+#define BIT_TEST(bitmap, address) ((bitmap)[(address) >> 3] & (1 << ((address) & 7)))
+#define BIT_SET(bitmap, address) ((bitmap)[(address) >> 3] |= (1 << ((address) & 7)))
+#define BIT_CLEAR(bitmap, address) ((bitmap)[(address) >> 3] &= ~(1 << ((address) & 7)))
+
+/* Kernels vectors (16 bytes, GCC / clang vector extension) */
+typedef uint8_t vector_t __attribute__ ((vector_size (16)));
+
+/**
+ * Get the size in bytes of a bits mode
+ *
+ * @param bits_mode Bits mode
+ * @return Size in bytes
+ */
+static uint8_t mode_size(const uint8_t bits_mode) {
+	return bits_mode == DOUBLE_WORD ? 4 : bits_mode;
+}
+
+/**
+ * Read a register
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param code Register code
+ * @param bits_mode Bits mode
+ * @return Register value
+ */
+static uint32_t read_register(const SkyCPU_runtime_t* runtime,
+		const uint8_t code, const uint8_t bits_mode) {
+	switch (bits_mode) {
+	case SINGLE_BYTE:
+		return get8bitsValue(runtime->registers, code);
+	case SINGLE_WORD:
+		return get16bitsValue(runtime->registers, code);
+	default:
+		return get32bitsValue(runtime->registers, code);
+	}
+}
+
+/**
+ * Write a register (value truncated to the bits mode)
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param code Register code
+ * @param bits_mode Bits mode
+ * @param value Register value
+ */
+static void write_register(SkyCPU_runtime_t* runtime, const uint8_t code,
+		const uint8_t bits_mode, const uint32_t value) {
+	switch (bits_mode) {
+	case SINGLE_BYTE:
+		set8bitsValue(runtime->registers, code, value);
+		break;
+	case SINGLE_WORD:
+		set16bitsValue(runtime->registers, code, value);
+		break;
+	default:
+		set32bitsValue(runtime->registers, code, value);
+		break;
+	}
+}
+
+/**
+ * Mark pages of a kernel write as dirty
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param address Base address of the write
+ * @param length Length of the write
+ */
+static void touch_range(SkyCPU_runtime_t* runtime, const uint16_t address,
+		const uint32_t length) {
+#ifdef SKYCPU_PAGE_TRACKING
+	uint32_t offset = 0;
+	for (; offset < length; offset += 1UL << SKYCPU_PAGE_SHIFT)
+		SkyCPU_page_touch(runtime, address + offset, 1);
+	if (length)
+		SkyCPU_page_touch(runtime, address + length - 1, 1);
+#else
+	(void) runtime;
+	(void) address;
+	(void) length;
+#endif
+}
+
+/**
+ * Reduce a byte into an accumulator
+ *
+ * @param opcode Reduction instruction code (ADD, SUB, AND, OR, XOR)
+ * @param value Accumulator value
+ * @param byte Byte to reduce
+ * @return Accumulator new value
+ */
+static uint8_t reduce_byte(const uint8_t opcode, const uint8_t value,
+		const uint8_t byte) {
+	switch (opcode) {
+	case INSTRUCTION_SUB:
+		return value - byte;
+	case INSTRUCTION_AND:
+		return value & byte;
+	case INSTRUCTION_OR:
+		return value | byte;
+	case INSTRUCTION_XOR:
+		return value ^ byte;
+	default:
+		return value + byte;
+	}
+}
+
+/**
+ * Reduce bytes into an accumulator (ADD, SUB, AND, OR, XOR)
+ *
+ * @param data Bytes to reduce
+ * @param size Bytes count
+ * @param opcode Reduction instruction code
+ * @param value Accumulator initial value
+ * @return Accumulator final value
+ */
+static uint8_t reduce_bytes(const uint8_t* data, const uint32_t size,
+		const uint8_t opcode, uint8_t value) {
+	vector_t lanes, block;
+	uint8_t folded[sizeof(vector_t)];
+	uint32_t i = 0, j;
+
+	/* Reduce blocks lane by lane (SUB accumulate the sum of the bytes) */
+	memset(&lanes, opcode == INSTRUCTION_AND ? 0xFF : 0, sizeof(lanes));
+#define REDUCE_BLOCKS(operator) \
+	for (; i + sizeof(block) <= size; i += sizeof(block)) { \
+		memcpy(&block, data + i, sizeof(block)); \
+		lanes operator block; \
+	}
+	switch (opcode) {
+	case INSTRUCTION_AND:
+		REDUCE_BLOCKS(&=)
+		break;
+	case INSTRUCTION_OR:
+		REDUCE_BLOCKS(|=)
+		break;
+	case INSTRUCTION_XOR:
+		REDUCE_BLOCKS(^=)
+		break;
+	default:
+		REDUCE_BLOCKS(+=)
+		break;
+	}
+#undef REDUCE_BLOCKS
+
+	/* Fold lanes, then the remaining bytes */
+	memcpy(folded, &lanes, sizeof(folded));
+	for (j = 0; j < sizeof(folded); ++j)
+		value = reduce_byte(opcode, value, folded[j]);
+	for (; i < size; ++i)
+		value = reduce_byte(opcode, value, data[i]);
+	return value;
+}
+
+/**
+ * Count bytes equal (or not) to a value
+ *
+ * @param data Bytes to check
+ * @param size Bytes count
+ * @param value Value
+ * @param equal If true count bytes equal to the value, else bytes different
+ * @return Matching bytes count
+ */
+static uint32_t count_bytes(const uint8_t* data, const uint32_t size,
+		const uint8_t value, const uint8_t equal) {
+	vector_t splat, lanes, block;
+	uint8_t folded[sizeof(vector_t)];
+	uint32_t matches = 0, i = 0, j, blocks;
+	memset(&splat, value, sizeof(splat));
+
+	/* Count per lane (8 bits lanes counters flushed every 255 blocks) */
+	while (i + sizeof(block) <= size) {
+		memset(&lanes, 0, sizeof(lanes));
+		for (blocks = 0; blocks < 255 && i + sizeof(block) <= size;
+				++blocks, i += sizeof(block)) {
+			memcpy(&block, data + i, sizeof(block));
+			lanes -= (vector_t) (block == splat);
+		}
+		memcpy(folded, &lanes, sizeof(folded));
+		for (j = 0; j < sizeof(folded); ++j)
+			matches += folded[j];
+	}
+
+	/* Remaining bytes */
+	for (; i < size; ++i)
+		matches += data[i] == value;
+	return equal ? matches : size - matches;
+}
+
+/**
+ * Find the first byte equal (or not) to a value
+ *
+ * @param data Bytes to check
+ * @param size Bytes count
+ * @param value Value
+ * @param equal If true find a byte equal to the value, else a byte different
+ * @return Index of the byte, size if not found
+ */
+static uint32_t find_byte(const uint8_t* data, const uint32_t size,
+		const uint8_t value, const uint8_t equal) {
+	vector_t splat, block;
+	uint64_t halves[2];
+	uint32_t i = 0;
+
+	/* strlen / memchr */
+	if (equal) {
+		const uint8_t* found = (const uint8_t*) memchr(data, value, size);
+		return found ? (uint32_t) (found - data) : size;
+	}
+
+	/* Skip blocks of bytes all equal to the value */
+	memset(&splat, value, sizeof(splat));
+	for (; i + sizeof(block) <= size; i += sizeof(block)) {
+		memcpy(&block, data + i, sizeof(block));
+		block ^= splat;
+		memcpy(halves, &block, sizeof(halves));
+		if (halves[0] | halves[1])
+			break;
+	}
+	for (; i < size && data[i] == value; ++i)
+		;
+	return i;
+}
+
+/**
+ * Check if an instruction is JMP to a constant address
+ *
+ * @param instruction Pointer to the decoded instruction
+ * @param target Address
+ * @return True if the instruction is JMP #target
+ */
+static uint8_t is_jump(const SkyCPU_instruction_t* instruction,
+		const uint16_t target) {
+	return instruction->opcode == INSTRUCTION_JMP
+			&& instruction->arguments[0].type == ARGUMENT_TYPE_CONSTANT
+			&& (uint16_t) instruction->arguments[0].value == target;
+}
+
+/**
+ * Check if an instruction is INC / DEC of a general purpose register
+ *
+ * @param instruction Pointer to the decoded instruction
+ * @param opcode INSTRUCTION_INC or INSTRUCTION_DEC
+ * @return True if the instruction match
+ */
+static uint8_t is_step(const SkyCPU_instruction_t* instruction,
+		const uint8_t opcode) {
+	return instruction->opcode == opcode
+			&& instruction->arguments[0].type == ARGUMENT_TYPE_REGISTER;
+}
+
+/**
+ * Match a byte value operand (rV or #c)
+ *
+ * @param argument Pointer to the decoded argument
+ * @param loop Pointer to the loop (operand and value set)
+ * @return True if the argument match
+ */
+static uint8_t match_value(const SkyCPU_argument_t* argument,
+		SkyCPU_idiom_loop_t* loop) {
+	if (argument->type == ARGUMENT_TYPE_REGISTER) {
+		loop->operand = argument->code;
+		return 1;
+	}
+	if (argument->type == ARGUMENT_TYPE_CONSTANT) {
+		loop->value = argument->value;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Match a byte condition (Cond.b [rP], rV|#c, or Cond.b [rP] against 0)
+ *
+ * @param instruction Pointer to the decoded instruction
+ * @param loop Pointer to the loop (source, equal, operand and value set)
+ * @return True if the instruction match
+ */
+static uint8_t match_condition(const SkyCPU_instruction_t* instruction,
+		SkyCPU_idiom_loop_t* loop) {
+	const SkyCPU_argument_t* arguments = instruction->arguments;
+	if (instruction->bits_mode != SINGLE_BYTE)
+		return 0;
+
+	/* Next instruction executed when the byte match */
+	switch (instruction->opcode) {
+	case INSTRUCTION_JN:
+	case INSTRUCTION_SNN:
+	case INSTRUCTION_JE:
+	case INSTRUCTION_SNE:
+		loop->equal = 1;
+		break;
+	case INSTRUCTION_JNN:
+	case INSTRUCTION_SN:
+	case INSTRUCTION_JNE:
+	case INSTRUCTION_SE:
+		loop->equal = 0;
+		break;
+	default:
+		return 0;
+	}
+
+	/* Test against 0 */
+	if (instruction->arguments_count == 1) {
+		if (arguments[0].type != ARGUMENT_TYPE_POINTED_REGISTER)
+			return 0;
+		loop->source = arguments[0].code;
+		loop->value = 0;
+		return 1;
+	}
+
+	/* Compare (both arguments orders) */
+	if (arguments[0].type == ARGUMENT_TYPE_POINTED_REGISTER
+			&& match_value(&arguments[1], loop)) {
+		loop->source = arguments[0].code;
+		return 1;
+	}
+	if (arguments[1].type == ARGUMENT_TYPE_POINTED_REGISTER
+			&& match_value(&arguments[0], loop)) {
+		loop->source = arguments[1].code;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Reserve the bytes of a register (loop registers MUST NOT overlap)
+ *
+ * @param used Pointer to the used register bytes mask
+ * @param code Register code (SKYCPU_IDIOM_NONE = nothing to reserve)
+ * @param size Register size in bytes
+ * @return True if the register is free
+ */
+static uint8_t reserve_register(uint32_t* used, const uint8_t code,
+		const uint8_t size) {
+	uint32_t bytes;
+	if (code == SKYCPU_IDIOM_NONE)
+		return 1;
+	if (code + size > 32)
+		return 0;
+	bytes = (uint32_t) (((uint64_t) 1 << size) - 1) << code;
+	if (*used & bytes)
+		return 0;
+	*used |= bytes;
+	return 1;
+}
+
+/**
+ * Match a scan loop: Cond.b [rP], JMP #exit, INC.w rP, [INC rC,] JMP #head
+ *
+ * @param loop Pointer to the loop
+ * @param code Decoded loop instructions
+ * @param count Loop instructions count
+ * @return True if the loop match
+ */
+static uint8_t match_scan(SkyCPU_idiom_loop_t* loop,
+		const SkyCPU_instruction_t* code, const uint8_t count) {
+	uint8_t i, pointer = 0;
+	if (count < 4 || count > 5 || !match_condition(&code[0], loop)
+			|| code[1].opcode != INSTRUCTION_JMP
+			|| code[1].arguments[0].type != ARGUMENT_TYPE_CONSTANT)
+		return 0;
+	loop->kind = SKYCPU_IDIOM_SCAN;
+	loop->exit = code[1].arguments[0].value;
+
+	/* Pointer and optional counter increments */
+	for (i = 2; i < count - 1; ++i) {
+		if (!is_step(&code[i], INSTRUCTION_INC))
+			return 0;
+		if (code[i].arguments[0].code == loop->source
+				&& code[i].bits_mode == SINGLE_WORD && !pointer)
+			pointer = 1;
+		else if (loop->result == SKYCPU_IDIOM_NONE) {
+			loop->result = code[i].arguments[0].code;
+			loop->result_mode = code[i].bits_mode;
+		} else
+			return 0;
+	}
+	return pointer;
+}
+
+/**
+ * Match a counted loop: operation, INC.w pointers and DEC rN (any order), JNN rN, JMP #head
+ *
+ * @param loop Pointer to the loop
+ * @param code Decoded loop instructions
+ * @param count Loop instructions count
+ * @return True if the loop match
+ */
+static uint8_t match_counted(SkyCPU_idiom_loop_t* loop,
+		const SkyCPU_instruction_t* code, const uint8_t count) {
+	const SkyCPU_argument_t* arguments = code[0].arguments;
+	uint8_t i = 1, destination = 0, source = 0;
+	if (count < 4)
+		return 0;
+
+	/* Operation */
+	if (code[0].opcode == INSTRUCTION_MOV && code[0].bits_mode == SINGLE_BYTE
+			&& arguments[0].type == ARGUMENT_TYPE_POINTED_REGISTER) {
+		loop->destination = arguments[0].code;
+		if (arguments[1].type == ARGUMENT_TYPE_POINTED_REGISTER) {
+			loop->kind = SKYCPU_IDIOM_COPY;
+			loop->source = arguments[1].code;
+		} else if (match_value(&arguments[1], loop))
+			loop->kind = SKYCPU_IDIOM_FILL;
+		else
+			return 0;
+
+	} else if ((code[0].opcode == INSTRUCTION_ADD
+			|| code[0].opcode == INSTRUCTION_SUB
+			|| code[0].opcode == INSTRUCTION_AND
+			|| code[0].opcode == INSTRUCTION_OR
+			|| code[0].opcode == INSTRUCTION_XOR)
+			&& code[0].bits_mode == SINGLE_BYTE
+			&& arguments[0].type == ARGUMENT_TYPE_REGISTER
+			&& arguments[1].type == ARGUMENT_TYPE_POINTED_REGISTER) {
+		loop->kind = SKYCPU_IDIOM_REDUCE;
+		loop->opcode = code[0].opcode;
+		loop->result = arguments[0].code;
+		loop->result_mode = SINGLE_BYTE;
+		loop->source = arguments[1].code;
+
+	} else if (match_condition(&code[0], loop)
+			&& is_step(&code[1], INSTRUCTION_INC)) {
+		loop->kind = SKYCPU_IDIOM_COUNT;
+		loop->result = code[1].arguments[0].code;
+		loop->result_mode = code[1].bits_mode;
+		i = 2;
+
+	} else
+		return 0;
+
+	/* Pointers increments and counter decrement */
+	for (; i < count - 2; ++i) {
+		uint8_t code_register = code[i].arguments[0].code;
+		if (is_step(&code[i], INSTRUCTION_INC)
+				&& code[i].bits_mode == SINGLE_WORD) {
+			if (code_register == loop->destination && !destination)
+				destination = 1;
+			else if (code_register == loop->source && !source)
+				source = 1;
+			else
+				return 0;
+		} else if (is_step(&code[i], INSTRUCTION_DEC)
+				&& loop->counter == SKYCPU_IDIOM_NONE) {
+			loop->counter = code_register;
+			loop->counter_mode = code[i].bits_mode;
+		} else
+			return 0;
+	}
+
+	/* Every pointer stepped, exit test on the counter */
+	return destination == (loop->destination != SKYCPU_IDIOM_NONE)
+			&& source == (loop->source != SKYCPU_IDIOM_NONE)
+			&& loop->counter != SKYCPU_IDIOM_NONE
+			&& code[count - 2].opcode == INSTRUCTION_JNN
+			&& code[count - 2].bits_mode == loop->counter_mode
+			&& code[count - 2].arguments[0].type == ARGUMENT_TYPE_REGISTER
+			&& code[count - 2].arguments[0].code == loop->counter;
+}
+
+/**
+ * Analyze the loop starting at a back-edge target
+ *
+ * @param idiom Pointer to the idiom runner
+ * @param head Loop head
+ * @param loop Pointer to the loop to fill
+ * @return True if the loop match an idiom
+ */
+static uint8_t analyze(const SkyCPU_idiom_t* idiom, const uint16_t head,
+		SkyCPU_idiom_loop_t* loop) {
+	const uint8_t* memory = idiom->runtime->memory;
+	SkyCPU_instruction_t code[SKYCPU_IDIOM_MAX_INSTRUCTIONS];
+	SkyCPU_idiom_loop_t pristine;
+	uint32_t address = head, used = 0;
+	uint8_t count = 0, i;
+
+	/* Decode up to the back-edge (JMP #head) */
+	do {
+		if (count == SKYCPU_IDIOM_MAX_INSTRUCTIONS
+				|| address - head >= SKYCPU_IDIOM_MAX_CODE)
+			return 0;
+		address += SkyCPU_decode(memory, address, &code[count]);
+		if (code[count].bits_mode == NO_TYPE)
+			return 0;
+	} while (!is_jump(&code[count++], head));
+	if (address > MEMORY_SIZE || address - head > SKYCPU_IDIOM_MAX_CODE)
+		return 0;
+
+	/* Match a loop shape */
+	memset(loop, 0, sizeof(SkyCPU_idiom_loop_t));
+	loop->head = head;
+	loop->exit = address;
+	loop->length = address - head;
+	loop->instructions = count;
+	loop->destination = loop->source = loop->counter = loop->result =
+			loop->operand = SKYCPU_IDIOM_NONE;
+	pristine = *loop;
+	if (!match_scan(loop, code, count)) {
+		*loop = pristine;
+		if (!match_counted(loop, code, count))
+			return 0;
+	}
+
+	/* Registers MUST NOT overlap (pointers are 16 bits, byte operands) */
+	if (!reserve_register(&used, loop->destination, 2)
+			|| (loop->source != loop->destination
+					&& !reserve_register(&used, loop->source, 2))
+			|| (loop->source == loop->destination
+					&& loop->source != SKYCPU_IDIOM_NONE)
+			|| !reserve_register(&used, loop->counter,
+					mode_size(loop->counter_mode))
+			|| !reserve_register(&used, loop->result,
+					mode_size(loop->result_mode))
+			|| !reserve_register(&used, loop->operand, 1))
+		return 0;
+
+	/* Keep the code to detect modifications */
+	for (i = 0; i < loop->length; ++i)
+		loop->code[i] = memory[head + i];
+	return 1;
+}
+
+/**
+ * Count a back-edge, analyze its target once hot
+ *
+ * @param idiom Pointer to the idiom runner
+ * @param target Back-edge target
+ */
+static void back_edge(SkyCPU_idiom_t* idiom, const uint16_t target) {
+	SkyCPU_idiom_hot_t* hot = &idiom->hot[((target * 0x9E3779B1UL) >> 16)
+			& (SKYCPU_IDIOM_HOT_SLOTS - 1)];
+
+	/* Count (slot taken over by the last target) */
+	if (hot->target != target || !hot->count) {
+		hot->target = target;
+		hot->count = 1;
+		return;
+	}
+	if (++hot->count < SKYCPU_IDIOM_THRESHOLD)
+		return;
+	hot->count = 0;
+
+	/* Analyze once (unmatched loops are left to the interpreter) */
+	BIT_SET(idiom->analyzed, target);
+	++idiom->analyzed_count;
+	if (idiom->loops_count < SKYCPU_IDIOM_MAX_LOOPS
+			&& analyze(idiom, target, &idiom->loops[idiom->loops_count])) {
+		BIT_SET(idiom->matched, target);
+		++idiom->loops_count;
+	}
+}
+
+/**
+ * Run the iterations of a counted loop
+ *
+ * @param idiom Pointer to the idiom runner
+ * @param loop Pointer to the loop
+ * @param budget Instructions budget
+ * @return Number of retired instructions (0 if nothing done)
+ */
+static uint32_t run_counted(SkyCPU_idiom_t* idiom,
+		const SkyCPU_idiom_loop_t* loop, const uint32_t budget) {
+	SkyCPU_runtime_t* runtime = idiom->runtime;
+	uint8_t* memory = runtime->memory;
+	uint32_t counter = read_register(runtime, loop->counter,
+			loop->counter_mode);
+	uint64_t total = counter ?
+			counter : (uint64_t) 1 << (8 * mode_size(loop->counter_mode));
+	uint64_t iterations = budget / loop->instructions;
+	uint32_t destination = 0, source = 0;
+	uint8_t value = loop->value;
+
+	/* Iterations within the memory (no wrap around) and before the loop code */
+	if (iterations > total)
+		iterations = total;
+	if (loop->source != SKYCPU_IDIOM_NONE) {
+		source = get16bitsValue(runtime->registers, loop->source);
+		if (iterations > MEMORY_SIZE - source)
+			iterations = source < MEMORY_SIZE ? MEMORY_SIZE - source : 0;
+	}
+	if (loop->destination != SKYCPU_IDIOM_NONE) {
+		destination = get16bitsValue(runtime->registers, loop->destination);
+		if (iterations > MEMORY_SIZE - destination)
+			iterations = destination < MEMORY_SIZE ?
+					MEMORY_SIZE - destination : 0;
+		if (destination < loop->head + loop->length
+				&& loop->head < destination + iterations)
+			iterations = loop->head > destination ?
+					loop->head - destination : 0;
+	}
+	if (!iterations)
+		return 0;
+	if (loop->operand != SKYCPU_IDIOM_NONE)
+		value = get8bitsValue(runtime->registers, loop->operand);
+
+	/* Kernel */
+	switch (loop->kind) {
+	case SKYCPU_IDIOM_COPY:
+		if (destination > source && destination < source + iterations) {
+			/* Overlapping forward copy: repeat the pattern (as byte by byte) */
+			uint32_t i = 0;
+			for (; i < iterations; ++i)
+				memory[destination + i] = memory[source + i];
+		} else
+			memmove(memory + destination, memory + source, iterations);
+		touch_range(runtime, destination, iterations);
+		break;
+
+	case SKYCPU_IDIOM_FILL:
+		memset(memory + destination, value, iterations);
+		touch_range(runtime, destination, iterations);
+		break;
+
+	case SKYCPU_IDIOM_REDUCE:
+		write_register(runtime, loop->result, SINGLE_BYTE,
+				reduce_bytes(memory + source, iterations, loop->opcode,
+						get8bitsValue(runtime->registers, loop->result)));
+		break;
+
+	case SKYCPU_IDIOM_COUNT:
+		write_register(runtime, loop->result, loop->result_mode,
+				read_register(runtime, loop->result, loop->result_mode)
+						+ count_bytes(memory + source, iterations, value,
+								loop->equal));
+		break;
+	}
+
+	/* Pointers, counter and PC (loop exit once the counter reach 0) */
+	if (loop->source != SKYCPU_IDIOM_NONE)
+		set16bitsValue(runtime->registers, loop->source, source + iterations);
+	if (loop->destination != SKYCPU_IDIOM_NONE)
+		set16bitsValue(runtime->registers, loop->destination,
+				destination + iterations);
+	write_register(runtime, loop->counter, loop->counter_mode,
+			counter - (uint32_t) iterations);
+	if (iterations == total)
+		runtime->program_counter = loop->exit;
+	idiom->iterations += iterations;
+	return iterations * loop->instructions;
+}
+
+/**
+ * Run the iterations of a scan loop
+ *
+ * @param idiom Pointer to the idiom runner
+ * @param loop Pointer to the loop
+ * @param budget Instructions budget
+ * @return Number of retired instructions (0 if nothing done)
+ */
+static uint32_t run_scan(SkyCPU_idiom_t* idiom, const SkyCPU_idiom_loop_t* loop,
+		const uint32_t budget) {
+	SkyCPU_runtime_t* runtime = idiom->runtime;
+	uint32_t pointer = get16bitsValue(runtime->registers, loop->source);
+	uint32_t iterations = budget / loop->instructions, size, found, retired;
+	uint8_t value = loop->value;
+	if (pointer >= MEMORY_SIZE)
+		return 0;
+	if (loop->operand != SKYCPU_IDIOM_NONE)
+		value = get8bitsValue(runtime->registers, loop->operand);
+
+	/* Search the exit byte within the budget and the memory */
+	size = MEMORY_SIZE - pointer;
+	if (size > iterations + 1)
+		size = iterations + 1;
+	found = find_byte(runtime->memory + pointer, size, value, loop->equal);
+
+	/* Exit reached (condition then JMP #exit), or full iterations only */
+	if (found < size
+			&& (uint64_t) found * loop->instructions + 2 <= budget) {
+		iterations = found;
+		retired = found * loop->instructions + 2;
+		runtime->program_counter = loop->exit;
+	} else {
+		if (iterations > size)
+			iterations = size;
+		if (iterations > found)
+			iterations = found;
+		if (!iterations)
+			return 0;
+		retired = iterations * loop->instructions;
+	}
+
+	/* Pointer and optional counter */
+	set16bitsValue(runtime->registers, loop->source, pointer + iterations);
+	if (loop->result != SKYCPU_IDIOM_NONE)
+		write_register(runtime, loop->result, loop->result_mode,
+				read_register(runtime, loop->result, loop->result_mode)
+						+ iterations);
+	idiom->iterations += iterations;
+	return retired;
+}
+
+/**
+ * Run a matched loop from its head
+ *
+ * @param idiom Pointer to the idiom runner
+ * @param head Loop head
+ * @param budget Instructions budget
+ * @return Number of retired instructions (0 if nothing done)
+ */
+static uint32_t run_loop(SkyCPU_idiom_t* idiom, const uint16_t head,
+		const uint32_t budget) {
+	SkyCPU_idiom_loop_t* loop = idiom->loops;
+	SkyCPU_idiom_loop_t* end = idiom->loops + idiom->loops_count;
+	uint32_t retired;
+	for (; loop != end && loop->head != head; ++loop)
+		;
+	if (loop == end || !(idiom->enabled & loop->kind))
+		return 0;
+
+	/* Modified code: forget the loop (analyzed again once hot) */
+	if (memcmp(idiom->runtime->memory + head, loop->code, loop->length)) {
+		BIT_CLEAR(idiom->matched, head);
+		BIT_CLEAR(idiom->analyzed, head);
+		*loop = *(end - 1);
+		--idiom->loops_count;
+		return 0;
+	}
+
+	/* Kernel */
+	retired = loop->kind == SKYCPU_IDIOM_SCAN ?
+			run_scan(idiom, loop, budget) :
+			run_counted(idiom, loop, budget);
+	if (retired) {
+		++idiom->kernels;
+#ifdef SKYCPU_METRICS
+		if (idiom->runtime->metrics)
+			SkyCPU_metrics_add(&idiom->runtime->metrics->instructions, retired);
+#endif
+	}
+	return retired;
+}
+
+void SkyCPU_idiom_init(SkyCPU_idiom_t* idiom, SkyCPU_runtime_t* runtime) {
+	idiom->runtime = runtime;
+	idiom->enabled = SKYCPU_IDIOM_ALL;
+	SkyCPU_idiom_reset(idiom);
+}
+
+void SkyCPU_idiom_reset(SkyCPU_idiom_t* idiom) {
+	memset(idiom->analyzed, 0, sizeof(idiom->analyzed));
+	memset(idiom->matched, 0, sizeof(idiom->matched));
+	memset(idiom->hot, 0, sizeof(idiom->hot));
+	idiom->loops_count = 0;
+	idiom->analyzed_count = 0;
+	idiom->kernels = 0;
+	idiom->iterations = 0;
+}
+
+uint32_t SkyCPU_idiom_run(SkyCPU_idiom_t* idiom,
+		const uint32_t max_instructions, const uint8_t* halted) {
+	SkyCPU_runtime_t* runtime = idiom->runtime;
+	uint32_t count = 0;
+
+	/* Run until halted or out of budget */
+	while (count < max_instructions && !(halted && *halted)) {
+		uint16_t address = runtime->program_counter;
+
+		/* Matched loop head (no skip pending) */
+		if (!runtime->skip_next && BIT_TEST(idiom->matched, address & MEMORY_MASK)) {
+			uint32_t retired = run_loop(idiom, address,
+					max_instructions - count);
+			if (retired) {
+				count += retired;
+				continue;
+			}
+		}
+
+		/* Interpreter, back-edges counted */
+		SkyCPU_fetch_and_execute(runtime);
+		++count;
+		if (runtime->program_counter <= address
+				&& !BIT_TEST(idiom->analyzed,
+						runtime->program_counter & MEMORY_MASK))
+			back_edge(idiom, runtime->program_counter);
+	}
+
+	/* Return retired instructions count */
+	return count;
+}
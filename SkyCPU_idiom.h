@@ -0,0 +1,159 @@
+/**
+ * @file SkyCPU_idiom.h
+ * @brief Idiom recognition: hot guest loops (copy, fill, checksum, count, scan) run as native vectorized kernels
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a runner replacing common guest loops by native kernels.\n
+ * Back-edges (PC moving backward after an instruction, ex: JMP / J* + JMP to a loop head) are counted, once a\n
+ * target is hot the loop starting at it is analyzed and matched against known loop shapes (byte loops over\n
+ * 16 bits pointers, "Cond" being JN / JNN / JE / JNE / SE / SNE / SN / SNN comparing the byte with rV or #c):\n
+ * - COPY (memcpy / memmove): MOV.b [rD], [rS]\n
+ * - FILL (memset): MOV.b [rD], rV|#c\n
+ * - REDUCE (checksum): ADD|SUB|AND|OR|XOR.b rA, [rS]\n
+ * - COUNT (matching bytes): Cond.b [rS], rV|#c then INC rC\n
+ *   followed by INC.w of each pointer and DEC rN (any order), then JNN rN and JMP back to the loop head\n
+ * - SCAN (strlen / memchr): Cond.b [rP], rV|#c then JMP to the exit, INC.w rP (and optionally INC rC), then JMP\n
+ *   back to the loop head\n
+ * \n
+ * When the loop head is reached the kernel does all the iterations the budget allow at once: memory, pointers,\n
+ * counters, accumulator, PC and retired instructions count are exactly the ones of the interpreter. Unmatched loops\n
+ * (and matched loops which code was modified) are interpreted. Each idiom can be disabled (verification).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Not compatible with SKYCPU_COVERAGE (skip decisions of the replaced iterations would not be recorded).\n
+ * Kernels never wrap around the memory end nor write into the loop code (those iterations are interpreted).
+ */
+
+#ifndef _SKYCPU_IDIOM_H_
+#define _SKYCPU_IDIOM_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifdef SKYCPU_COVERAGE
+#error "SkyCPU idioms are not compatible with SKYCPU_COVERAGE"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Idioms (mask of enabled kernels) */
+#define SKYCPU_IDIOM_COPY 1 /*!< Counted copy loop */
+#define SKYCPU_IDIOM_FILL 2 /*!< Counted fill loop */
+#define SKYCPU_IDIOM_REDUCE 4 /*!< Counted reduction loop */
+#define SKYCPU_IDIOM_COUNT 8 /*!< Counted matching bytes loop */
+#define SKYCPU_IDIOM_SCAN 16 /*!< Scan until a (non) matching byte loop */
+#define SKYCPU_IDIOM_ALL 31
+
+/* Back-edges to a target before the loop is analyzed */
+#define SKYCPU_IDIOM_THRESHOLD 16
+
+/* Back-edges counters (direct mapped, power of two) */
+#define SKYCPU_IDIOM_HOT_SLOTS 64
+
+/* Analyzed loops per instance */
+#define SKYCPU_IDIOM_MAX_LOOPS 64
+
+/* Loops limits (longer loops are never matched) */
+#define SKYCPU_IDIOM_MAX_INSTRUCTIONS 8
+#define SKYCPU_IDIOM_MAX_CODE 48
+
+/* No register */
+#define SKYCPU_IDIOM_NONE 0xFF
+
+/**
+ * Matched loop
+ */
+typedef struct {
+	uint16_t head; /*!< Loop head (back-edge target) */
+	uint16_t exit; /*!< Address after the loop (counted loops) or exit jump target (scan loops) */
+	uint8_t kind; /*!< Idiom (SKYCPU_IDIOM_*) */
+	uint8_t length; /*!< Loop code length */
+	uint8_t instructions; /*!< Instructions per iteration */
+	uint8_t opcode; /*!< Reduction instruction code (REDUCE) */
+	uint8_t equal; /*!< If true the byte match when equal to the value, else when different (COUNT, SCAN) */
+	uint8_t destination; /*!< Destination pointer register (COPY, FILL) */
+	uint8_t source; /*!< Source pointer register (COPY, REDUCE, COUNT, SCAN) */
+	uint8_t counter, counter_mode; /*!< Loop counter register and bits mode (counted loops) */
+	uint8_t result, result_mode; /*!< Accumulator (REDUCE) or matches counter (COUNT, optional for SCAN) register and bits mode */
+	uint8_t operand; /*!< Value register (FILL, COUNT, SCAN), SKYCPU_IDIOM_NONE for the constant */
+	uint8_t value; /*!< Value constant */
+	uint8_t code[SKYCPU_IDIOM_MAX_CODE]; /*!< Loop code when matched (the loop is analyzed again if modified) */
+} SkyCPU_idiom_loop_t;
+
+/**
+ * Back-edges counter
+ */
+typedef struct {
+	uint16_t target; /*!< Back-edge target */
+	uint16_t count; /*!< Back-edges count */
+} SkyCPU_idiom_hot_t;
+
+/**
+ * Idiom runner structure (one per runtime instance)
+ */
+typedef struct {
+	SkyCPU_runtime_t* runtime; /*!< Runtime instance */
+	uint32_t enabled; /*!< Enabled idioms (mask of SKYCPU_IDIOM_*) */
+	uint8_t analyzed[(MEMORY_MASK + 1) / 8]; /*!< Analyzed loops heads (bitmap) */
+	uint8_t matched[(MEMORY_MASK + 1) / 8]; /*!< Matched loops heads (bitmap) */
+	SkyCPU_idiom_hot_t hot[SKYCPU_IDIOM_HOT_SLOTS]; /*!< Back-edges counters */
+	SkyCPU_idiom_loop_t loops[SKYCPU_IDIOM_MAX_LOOPS]; /*!< Matched loops */
+	uint32_t loops_count; /*!< Matched loops count */
+	uint32_t analyzed_count; /*!< Analyzed loops count (matched or not) */
+	uint64_t kernels; /*!< Kernels calls */
+	uint64_t iterations; /*!< Iterations done by kernels */
+} SkyCPU_idiom_t;
+
+/**
+ * Initialize an idiom runner (all idioms enabled, no loop analyzed)
+ *
+ * @param idiom Pointer to the idiom runner to initialize
+ * @param runtime Pointer to the SkyCPU runtime instance
+ */
+void SkyCPU_idiom_init(SkyCPU_idiom_t* idiom, SkyCPU_runtime_t* runtime);
+
+/**
+ * Forget all analyzed loops (ex: after loading another program)
+ *
+ * @param idiom Pointer to the idiom runner
+ */
+void SkyCPU_idiom_reset(SkyCPU_idiom_t* idiom);
+
+/**
+ * Run a SkyCPU runtime instance, hot loops matching an enabled idiom run as native kernels
+ *
+ * @param idiom Pointer to the idiom runner of the instance
+ * @param max_instructions Instructions budget
+ * @param halted Pointer to a "stop now" flag set by callbacks (can be NULL)
+ * @return Number of retired instructions (kernels iterations included)
+ */
+uint32_t SkyCPU_idiom_run(SkyCPU_idiom_t* idiom,
+		const uint32_t max_instructions, const uint8_t* halted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_IDIOM_H_ */
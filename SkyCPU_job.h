@@ -0,0 +1,164 @@
+/**
+ * @file SkyCPU_job.h
+ * @brief Jobs protocol (Unix socket + shared memory slots) of the SkyCPU job server
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define the protocol between the SkyCPU job server (SkyServer) and its clients.\n
+ * The client create a shared memory array of jobs slots (memfd) and pass it with the hello message,\n
+ * sent at once within one second of the connection. The memfd MUST be sealed with F_SEAL_SHRINK.\n
+ * then submit ranges of filled slots (batches) over the Unix socket. The server reply with ranges of completed slots.\n
+ * Inputs and outputs never go through the socket.\n
+ * \n
+ * Guest ABI : input copied at the server input address (size in r0:r1), the guest stop with BRK,\n
+ * output pointed by r2:r3 (address) and r4:r5 (size).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+#ifndef _SKYCPU_JOB_H_
+#define _SKYCPU_JOB_H_
+
+/* Dependency */
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Protocol definition */
+#define SKYCPU_JOB_MAGIC 0x534B594AUL /* "SKYJ" */
+#define SKYCPU_JOB_VERSION 1
+#ifndef SKYCPU_JOB_DATA_SIZE
+#define SKYCPU_JOB_DATA_SIZE 1024 /* Maximum input / output size of a job */
+#endif
+
+/**
+ * Job status
+ */
+typedef enum {
+	SKYCPU_JOB_DONE, /*!< Guest stopped with BRK */
+	SKYCPU_JOB_BUDGET, /*!< Instructions budget exhausted */
+	SKYCPU_JOB_BAD_IMAGE /*!< Unknown image ID */
+} SkyCPU_job_status_t;
+
+/**
+ * Job slot (shared memory)
+ */
+typedef struct {
+	uint16_t image; /*!< Image ID (written by client) */
+	uint16_t input_size; /*!< Input size (written by client) */
+	uint32_t max_instructions; /*!< Instructions budget (written by client, capped by server) */
+	uint32_t status; /*!< Job status (written by server) */
+	uint32_t instructions; /*!< Executed instructions (written by server) */
+	uint16_t output_size; /*!< Output size (written by server) */
+	uint16_t reserved;
+	uint8_t data[SKYCPU_JOB_DATA_SIZE]; /*!< Input (client), then output (server) */
+} SkyCPU_job_slot_t;
+
+/**
+ * Hello message (client -> server with the memfd, then server -> client)
+ */
+typedef struct {
+	uint32_t magic; /*!< SKYCPU_JOB_MAGIC */
+	uint32_t version; /*!< SKYCPU_JOB_VERSION */
+	uint32_t slots_count; /*!< Number of slots in shared memory */
+	uint32_t images_count; /*!< Number of images (server reply) */
+} SkyCPU_job_hello_t;
+
+/**
+ * Batch message (submitted or completed slots, indexes modulo slots_count)
+ */
+typedef struct {
+	uint32_t first; /*!< First slot */
+	uint32_t count; /*!< Number of slots */
+} SkyCPU_job_batch_t;
+
+/* Latency histogram definition (8 sub-buckets per power of two, < 12.5% error) */
+#define SKYCPU_LATENCY_BUCKETS (62 * 8)
+
+/**
+ * Latency histogram structure
+ */
+typedef struct {
+	uint64_t counts[SKYCPU_LATENCY_BUCKETS]; /*!< Samples per bucket */
+	uint64_t total; /*!< Number of samples */
+	uint64_t max; /*!< Highest sample */
+} SkyCPU_latency_t;
+
+/**
+ * Record a latency sample
+ *
+ * @param latency Pointer to the latency histogram
+ * @param value Sample value (nanoseconds)
+ */
+static __inline__ void SkyCPU_latency_record(SkyCPU_latency_t* latency,
+		const uint64_t value) {
+	uint32_t index = value;
+	if (value >= 8) {
+		uint32_t exponent = 63 - __builtin_clzll(value);
+		index = (exponent - 2) * 8 + ((value >> (exponent - 3)) & 7);
+	}
+	++latency->counts[index];
+	++latency->total;
+	if (value > latency->max)
+		latency->max = value;
+}
+
+/**
+ * Merge a latency histogram into another one
+ *
+ * @param latency Pointer to the destination latency histogram
+ * @param other Pointer to the latency histogram to add
+ */
+static __inline__ void SkyCPU_latency_merge(SkyCPU_latency_t* latency,
+		const SkyCPU_latency_t* other) {
+	uint32_t i = 0;
+	for (; i < SKYCPU_LATENCY_BUCKETS; ++i)
+		latency->counts[i] += other->counts[i];
+	latency->total += other->total;
+	if (other->max > latency->max)
+		latency->max = other->max;
+}
+
+/**
+ * Get a latency percentile
+ *
+ * @param latency Pointer to the latency histogram
+ * @param percentile Percentile (0 - 100)
+ * @return Latency (nanoseconds, lower bound of the bucket)
+ */
+static __inline__ uint64_t SkyCPU_latency_percentile(
+		const SkyCPU_latency_t* latency, const double percentile) {
+	uint64_t rank = (uint64_t) (latency->total * percentile / 100.0), seen = 0;
+	uint32_t i = 0;
+	for (; i < SKYCPU_LATENCY_BUCKETS; ++i) {
+		seen += latency->counts[i];
+		if (seen > rank || (seen && seen == latency->total))
+			return (i < 8) ? i : (uint64_t) (8 + (i & 7)) << (i / 8 - 1);
+	}
+	return latency->max;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_JOB_H_ */
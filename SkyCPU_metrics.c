@@ -0,0 +1,136 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SkyCPU_metrics.h"
+
+/**
+ * Get the size of a stats segment
+ *
+ * @param count Records count
+ * @return Size in bytes
+ */
+static size_t segment_size(const uint32_t count) {
+	return sizeof(SkyCPU_metrics_segment_t)
+			+ (size_t) count * sizeof(SkyCPU_metrics_t);
+}
+
+SkyCPU_metrics_segment_t* SkyCPU_metrics_create(const char* name,
+		const uint32_t count) {
+	SkyCPU_metrics_segment_t* segment;
+	int fd;
+
+	/* Create and size the shared memory */
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, 0) || ftruncate(fd, segment_size(count))) {
+		close(fd);
+		return NULL;
+	}
+	segment = mmap(NULL, segment_size(count), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED)
+		return NULL;
+
+	/* Header last (agents check the magic) */
+	segment->count = count;
+	segment->record_size = sizeof(SkyCPU_metrics_t);
+	segment->version = SKYCPU_METRICS_VERSION;
+	__atomic_store_n(&segment->magic, SKYCPU_METRICS_MAGIC, __ATOMIC_RELEASE);
+	return segment;
+}
+
+const SkyCPU_metrics_segment_t* SkyCPU_metrics_open(const char* name) {
+	SkyCPU_metrics_segment_t* segment;
+	struct stat status;
+	uint32_t count;
+	int fd;
+
+	/* Map the header only */
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &status)
+			|| (size_t) status.st_size < sizeof(SkyCPU_metrics_segment_t)) {
+		close(fd);
+		return NULL;
+	}
+	segment = mmap(NULL, sizeof(SkyCPU_metrics_segment_t), PROT_READ,
+			MAP_SHARED, fd, 0);
+	if (segment == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Check it, then map the records */
+	count = segment->count;
+	if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE)
+			!= SKYCPU_METRICS_MAGIC
+			|| segment->version != SKYCPU_METRICS_VERSION
+			|| segment->record_size != sizeof(SkyCPU_metrics_t)
+			|| (size_t) status.st_size < segment_size(count)) {
+		munmap(segment, sizeof(SkyCPU_metrics_segment_t));
+		close(fd);
+		return NULL;
+	}
+	munmap(segment, sizeof(SkyCPU_metrics_segment_t));
+	segment = mmap(NULL, segment_size(count), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return segment == MAP_FAILED ? NULL : segment;
+}
+
+void SkyCPU_metrics_close(const SkyCPU_metrics_segment_t* segment) {
+	munmap((void*) segment, segment_size(segment->count));
+}
+
+int SkyCPU_metrics_attach(SkyCPU_metrics_segment_t* segment,
+		SkyCPU_runtime_t* runtime, const char* name) {
+	uint32_t i;
+	for (i = 0; i < segment->count; ++i) {
+		SkyCPU_metrics_t* record = &segment->records[i];
+		uint32_t state = SKYCPU_METRICS_FREE;
+
+		/* Claim a free record (other threads / processes may attach too) */
+		if (!__atomic_compare_exchange_n(&record->state, &state,
+				SKYCPU_METRICS_USED, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			continue;
+
+		/* Reset it */
+		memset((uint8_t*) record + sizeof(record->state), 0,
+				sizeof(SkyCPU_metrics_t) - sizeof(record->state));
+		record->owner = getpid();
+		strncpy(record->name, name, SKYCPU_METRICS_NAME_SIZE - 1);
+		runtime->metrics = record;
+		return 0;
+	}
+	return -1;
+}
+
+void SkyCPU_metrics_detach(SkyCPU_runtime_t* runtime) {
+	if (!runtime->metrics)
+		return;
+	__atomic_store_n(&runtime->metrics->state, SKYCPU_METRICS_FREE,
+			__ATOMIC_RELEASE);
+	runtime->metrics = 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file SkyCPU_metrics.h
+ * @brief Per-instance metrics exported through a shared memory stats segment
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define a stats segment (POSIX shared memory) holding one metrics record per SkyCPU runtime instance.\n
+ * The CPU core update the record of its instance (retired instructions, INT / BRK, stack high-water mark, stalls),\n
+ * the host count time slices. Each record has a single writer, an external agent (see SkyTop) read it without locking.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_METRICS to be defined for ALL source files !
+ */
+
+#ifndef _SKYCPU_METRICS_H_
+#define _SKYCPU_METRICS_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_METRICS
+#error "SkyCPU metrics require SKYCPU_METRICS"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Stats segment definition */
+#define SKYCPU_METRICS_MAGIC 0x534B594DUL /*!< "SKYM" */
+#define SKYCPU_METRICS_VERSION 2
+#define SKYCPU_METRICS_ALIGN 64 /*!< Cache line size (records never share a line) */
+#define SKYCPU_METRICS_NAME_SIZE 24
+
+/* Records states */
+#define SKYCPU_METRICS_FREE 0 /*!< Record unused */
+#define SKYCPU_METRICS_USED 1 /*!< Record attached to an instance */
+
+/**
+ * Metrics record (one per instance)
+ */
+struct SkyCPU_metrics {
+	uint32_t state; /*!< Record state (SKYCPU_METRICS_FREE or SKYCPU_METRICS_USED) */
+	uint32_t owner; /*!< Process ID of the instance owner */
+	char name[SKYCPU_METRICS_NAME_SIZE]; /*!< Instance name (NUL terminated) */
+	uint64_t instructions; /*!< Retired instructions (skipped included, stalled excluded) */
+	uint64_t interrupts; /*!< INT count */
+	uint64_t breakpoints; /*!< BRK count */
+	uint64_t slices; /*!< Time slices run (counted by the host) */
+	uint64_t stalls[SKYCPU_STALL_WIDTH + 1]; /*!< Stalls count by reason (SKYCPU_STALL_*, NONE unused) */
+	uint64_t stack_high_water; /*!< Deepest stack seen by PUSH / CALL (MEMORY_MASK - lowest SP) */
+} __attribute__((aligned(SKYCPU_METRICS_ALIGN)));
+
+/**
+ * Stats segment (header followed by its records)
+ */
+typedef struct {
+	uint32_t magic; /*!< SKYCPU_METRICS_MAGIC */
+	uint32_t version; /*!< SKYCPU_METRICS_VERSION */
+	uint32_t count; /*!< Records count */
+	uint32_t record_size; /*!< sizeof(SkyCPU_metrics_t) */
+	SkyCPU_metrics_t records[] __attribute__((aligned(SKYCPU_METRICS_ALIGN))); /*!< Records */
+} SkyCPU_metrics_segment_t;
+
+/**
+ * Create (or reset) a stats segment
+ *
+ * @param name Shared memory name (ex: "/skycpu-metrics")
+ * @param count Records count
+ * @return Pointer to the stats segment, NULL on error
+ */
+SkyCPU_metrics_segment_t* SkyCPU_metrics_create(const char* name,
+		const uint32_t count);
+
+/**
+ * Open an existing stats segment read-only (agent side)
+ *
+ * @param name Shared memory name
+ * @return Pointer to the stats segment, NULL on error (missing, bad magic or version)
+ */
+const SkyCPU_metrics_segment_t* SkyCPU_metrics_open(const char* name);
+
+/**
+ * Unmap a stats segment (the shared memory itself is removed by shm_unlink())
+ *
+ * @param segment Pointer to the stats segment
+ */
+void SkyCPU_metrics_close(const SkyCPU_metrics_segment_t* segment);
+
+/**
+ * Attach a SkyCPU runtime instance to a free record of a stats segment
+ *
+ * @param segment Pointer to the stats segment
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @param name Instance name (truncated to SKYCPU_METRICS_NAME_SIZE - 1 characters)
+ * @return 0 on success, -1 on error (no free record)
+ */
+int SkyCPU_metrics_attach(SkyCPU_metrics_segment_t* segment,
+		SkyCPU_runtime_t* runtime, const char* name);
+
+/**
+ * Detach a SkyCPU runtime instance from its record (record freed)
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ */
+void SkyCPU_metrics_detach(SkyCPU_runtime_t* runtime);
+
+/**
+ * Add to a counter of a record (writer side, never torn)
+ *
+ * Each record has a single writer: a plain read followed by an atomic store is enough,
+ * no read-modify-write (locked) instruction is needed.
+ *
+ * @param counter Pointer to the counter
+ * @param value Value to add (wrap around to subtract)
+ */
+static __inline__ void SkyCPU_metrics_add(uint64_t* counter,
+		const uint64_t value) {
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+			__ATOMIC_RELAXED);
+}
+
+/**
+ * Count a time slice run by the host
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ */
+static __inline__ void SkyCPU_metrics_slice(SkyCPU_runtime_t* runtime) {
+	if (runtime->metrics)
+		SkyCPU_metrics_add(&runtime->metrics->slices, 1);
+}
+
+/**
+ * Read a counter of a record (agent side, never torn)
+ *
+ * @param counter Pointer to the counter
+ * @return Counter value
+ */
+static __inline__ uint64_t SkyCPU_metrics_read(const uint64_t* counter) {
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_METRICS_H_ */
@@ -0,0 +1,74 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <sys/mman.h>
+#include "SkyCPU_mirror.h"
+
+/* Memory size and whole mapping size */
+#define MEMORY_SIZE ((size_t) MEMORY_MASK + 1)
+#define MAPPING_SIZE (MEMORY_SIZE * SKYCPU_MIRROR_VIEWS)
+
+int SkyCPU_mirror_map(SkyCPU_runtime_t* runtime) {
+	uint8_t* base;
+	uint32_t view;
+	int fd;
+
+	/* Memory MUST be made of whole host pages */
+	if (MEMORY_SIZE % sysconf(_SC_PAGESIZE))
+		return -1;
+
+	/* Memory backing (shared by all views) */
+	fd = memfd_create("skycpu-memory", MFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, MEMORY_SIZE)) {
+		close(fd);
+		return -1;
+	}
+
+	/* Reserve the address range, then map the views over it */
+	base = mmap(NULL, MAPPING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	for (view = 0; view < SKYCPU_MIRROR_VIEWS; ++view) {
+		if (mmap(base + view * MEMORY_SIZE, MEMORY_SIZE,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)
+				== MAP_FAILED) {
+			munmap(base, MAPPING_SIZE);
+			close(fd);
+			return -1;
+		}
+	}
+
+	/* Views keep the memfd alive */
+	close(fd);
+	runtime->memory = base;
+	return 0;
+}
+
+void SkyCPU_mirror_unmap(SkyCPU_runtime_t* runtime) {
+	if (!runtime->memory)
+		return;
+	munmap(runtime->memory, MAPPING_SIZE);
+	runtime->memory = 0;
+}
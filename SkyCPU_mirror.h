@@ -0,0 +1,75 @@
+/**
+ * @file SkyCPU_mirror.h
+ * @brief Mirrored mapping of the SkyCPU memory space
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define the mirrored memory allocator. The memory of a runtime instance is a memfd mapped\n
+ * several times back to back, covering the whole 16 bits address space plus one extra copy.\n
+ * Accesses crossing the end of the memory (ex: 32 bits value at 0xFFFE, instruction at 0xFFFF) wrap around\n
+ * to address 0 in hardware, the CPU core never mask addresses nor check bounds.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_MIRRORED_MEMORY to be defined for ALL source files ! Linux only (memfd).
+ */
+
+#ifndef _SKYCPU_MIRROR_H_
+#define _SKYCPU_MIRROR_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_MIRRORED_MEMORY
+#error "SkyCPU mirrored memory require SKYCPU_MIRRORED_MEMORY"
+#endif
+
+#if (MEMORY_MASK + 1) < 4096
+#error "SkyCPU mirrored memory require at least one host page of memory"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Memory copies mapped back to back (whole 16 bits address space + one for the overrun) */
+#define SKYCPU_MIRROR_VIEWS (0x10000 / (MEMORY_MASK + 1) + 1)
+
+/**
+ * Map the (zeroed) mirrored memory of a SkyCPU runtime instance
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ * @return 0 on success, -1 on error (memory size not a multiple of the host page size, out of memory, ...)
+ */
+int SkyCPU_mirror_map(SkyCPU_runtime_t* runtime);
+
+/**
+ * Unmap the mirrored memory of a SkyCPU runtime instance
+ *
+ * @param runtime Pointer to the SkyCPU runtime instance
+ */
+void SkyCPU_mirror_unmap(SkyCPU_runtime_t* runtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_MIRROR_H_ */
@@ -0,0 +1,247 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <numa.h>
+#include <numaif.h>
+#include "SkyCPU_numa.h"
+#ifdef SKYCPU_MIRRORED_MEMORY
+#include "SkyCPU_mirror.h"
+#endif
+
+/* Pages moved per move_pages() call */
+#define MOVE_BATCH 64
+
+/* Nodes count (0 = NUMA not usable, plain allocations) */
+static int nodes_count;
+static pthread_once_t nodes_once = PTHREAD_ONCE_INIT;
+
+static void detect_nodes(void) {
+	if (numa_available() >= 0 && numa_max_node() > 0)
+		nodes_count = numa_max_node() + 1;
+}
+
+/**
+ * Check if NUMA placement is usable (more than one node)
+ *
+ * @return True if libnuma routines must be used
+ */
+static int numa_usable(void) {
+	pthread_once(&nodes_once, detect_nodes);
+	return nodes_count > 1;
+}
+
+int SkyCPU_numa_nodes(void) {
+	return numa_usable() ? nodes_count : 1;
+}
+
+int SkyCPU_numa_current_node(void) {
+	int cpu, node;
+	if (!numa_usable() || (cpu = sched_getcpu()) < 0)
+		return 0;
+	node = numa_node_of_cpu(cpu);
+	return node < 0 ? 0 : node;
+}
+
+int SkyCPU_numa_node_of(const void* address) {
+	int node = -1;
+	if (!numa_usable())
+		return 0;
+	if (get_mempolicy(&node, NULL, 0, (void*) address,
+			MPOL_F_NODE | MPOL_F_ADDR) < 0)
+		return -1;
+	return node;
+}
+
+int SkyCPU_numa_pin(const int node) {
+	if (!numa_usable())
+		return 0;
+	if (numa_run_on_node(node % nodes_count) < 0)
+		return -1;
+	numa_set_preferred(node % nodes_count);
+	return 0;
+}
+
+void* SkyCPU_numa_alloc(const size_t size, const int node) {
+	void* area;
+
+	/* Pages allocated on the node at first touch (mbind) */
+	if (numa_usable())
+		return numa_alloc_onnode(size, node % nodes_count);
+
+	/* Plain (zeroed, page aligned) mapping */
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return area == MAP_FAILED ? NULL : area;
+}
+
+void SkyCPU_numa_free(void* area, const size_t size) {
+	if (area)
+		munmap(area, size);
+}
+
+int SkyCPU_numa_move(void* area, const size_t size, const int node) {
+	size_t page_size = sysconf(_SC_PAGESIZE), offset = 0;
+	void* pages[MOVE_BATCH];
+	int nodes[MOVE_BATCH], status[MOVE_BATCH], failed = 0;
+	unsigned long count, i;
+	if (!numa_usable())
+		return 0;
+
+	/* Future faults of the area go to the node */
+	numa_tonode_memory(area, size, node % nodes_count);
+
+	/* Migrate the pages already allocated (not allocated ones are skipped) */
+	while (offset < size) {
+		for (count = 0; count < MOVE_BATCH && offset < size;
+				++count, offset += page_size) {
+			pages[count] = (uint8_t*) area + offset;
+			nodes[count] = node % nodes_count;
+		}
+		if (numa_move_pages(0, count, pages, nodes, status, MPOL_MF_MOVE) < 0)
+			return -1;
+		for (i = 0; i < count; ++i)
+			if (status[i] >= 0 ? status[i] != node % nodes_count
+					: status[i] != -ENOENT)
+				++failed;
+	}
+	return failed;
+}
+
+#ifdef SKYCPU_MIRRORED_MEMORY
+/**
+ * Place the (not allocated yet) guest memory of a mirrored mapping on a node
+ *
+ * @remarks The policy is set on the memfd itself (shared policy), whatever the view used to fault a page.
+ * Preferred, not bound: a full node fall back to another node instead of a SIGBUS.
+ * @param memory Pointer to the mirrored mapping
+ * @param node Node number (modulo the number of nodes)
+ * @return 0 on success, -1 on error
+ */
+static int prefer_node(uint8_t* memory, const int node) {
+	struct bitmask* mask;
+	int result;
+	if (!numa_usable())
+		return 0;
+	mask = numa_allocate_nodemask();
+	if (!mask)
+		return -1;
+	numa_bitmask_setbit(mask, node % nodes_count);
+	result = mbind(memory, MEMORY_MASK + 1, MPOL_PREFERRED, mask->maskp,
+			mask->size + 1, 0);
+	numa_bitmask_free(mask);
+	return result < 0 ? -1 : 0;
+}
+
+/**
+ * Count the guest memory pages of a mirrored mapping not on a node (all allocated)
+ *
+ * @param memory Pointer to the mirrored mapping
+ * @param node Node number (modulo the number of nodes)
+ * @return Number of pages not on the node, -1 on error
+ */
+static int count_remote(uint8_t* memory, const int node) {
+	size_t page_size = sysconf(_SC_PAGESIZE), offset = 0;
+	void* pages[MOVE_BATCH];
+	int status[MOVE_BATCH], remote = 0;
+	unsigned long count, i;
+	if (!numa_usable())
+		return 0;
+	while (offset <= MEMORY_MASK) {
+		for (count = 0; count < MOVE_BATCH && offset <= MEMORY_MASK;
+				++count, offset += page_size)
+			pages[count] = memory + offset;
+		if (numa_move_pages(0, count, pages, NULL, status, 0) < 0)
+			return -1;
+		for (i = 0; i < count; ++i)
+			if (status[i] != node % nodes_count)
+				++remote;
+	}
+	return remote;
+}
+#endif
+
+SkyCPU_runtime_t* SkyCPU_numa_runtime_create(const int node) {
+	SkyCPU_runtime_t* runtime = SkyCPU_numa_alloc(sizeof(SkyCPU_runtime_t),
+			node);
+	if (!runtime)
+		return NULL;
+
+	/* Control block (first touch, the guest memory too unless mirrored) */
+	memset(runtime, 0, sizeof(SkyCPU_runtime_t));
+	SkyCPU_runtime_init(runtime);
+
+#ifdef SKYCPU_MIRRORED_MEMORY
+	/* Guest memory mapping placed on the node, then allocated */
+	if (SkyCPU_mirror_map(runtime)) {
+		SkyCPU_numa_free(runtime, sizeof(SkyCPU_runtime_t));
+		return NULL;
+	}
+	prefer_node(runtime->memory, node);
+	memset(runtime->memory, 0, MEMORY_MASK + 1);
+#endif
+	return runtime;
+}
+
+void SkyCPU_numa_runtime_destroy(SkyCPU_runtime_t* runtime) {
+	if (!runtime)
+		return;
+#ifdef SKYCPU_MIRRORED_MEMORY
+	SkyCPU_mirror_unmap(runtime);
+#endif
+	SkyCPU_numa_free(runtime, sizeof(SkyCPU_runtime_t));
+}
+
+int SkyCPU_numa_runtime_move(SkyCPU_runtime_t* runtime, const int node) {
+	int failed = SkyCPU_numa_move(runtime, sizeof(SkyCPU_runtime_t), node);
+#ifdef SKYCPU_MIRRORED_MEMORY
+	SkyCPU_runtime_t mirror;
+	int memory_failed;
+	if (failed < 0 || !numa_usable())
+		return failed;
+
+	/*
+	 * Mirrored pages are mapped once per view, move_pages() refuse them (-EACCES):
+	 * copy the guest memory into a new mirrored mapping placed on the node instead
+	 */
+	mirror.memory = NULL;
+	if (SkyCPU_mirror_map(&mirror))
+		return -1;
+	if (prefer_node(mirror.memory, node)) {
+		SkyCPU_mirror_unmap(&mirror);
+		return -1;
+	}
+	memcpy(mirror.memory, runtime->memory, MEMORY_MASK + 1);
+	SkyCPU_mirror_unmap(runtime);
+	runtime->memory = mirror.memory;
+
+	/* Pages the node could not hold */
+	memory_failed = count_remote(runtime->memory, node);
+	if (memory_failed < 0)
+		return -1;
+	failed += memory_failed;
+#endif
+	return failed;
+}
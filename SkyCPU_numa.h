@@ -0,0 +1,144 @@
+/**
+ * @file SkyCPU_numa.h
+ * @brief NUMA placement of SkyCPU runtime instances (control block and guest memory) and workers threads
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define routines to keep a runtime instance on the NUMA node of the worker thread running it.\n
+ * Instances are created on a node (control block and guest memory, the mirrored memory mapping included), moved\n
+ * with their pages when they change of worker, and workers threads are pinned to the CPUs of their node.\n
+ * Every guest memory access of the CPU core (fetch, arguments, commit) is then a local one.\n
+ * \n
+ * Without NUMA support (kernel or machine) or on single node machines, all routines degrade to plain allocations\n
+ * and no-ops: SkyCPU_numa_nodes() return 1 and every node number is node 0.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_NUMA and libnuma (link with -lnuma). Linux only.
+ */
+
+#ifndef _SKYCPU_NUMA_H_
+#define _SKYCPU_NUMA_H_
+
+/* Dependency */
+#include <stddef.h>
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_NUMA
+#error "SkyCPU NUMA placement require SKYCPU_NUMA"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum nodes accounted in statistics */
+#define SKYCPU_NUMA_MAX_NODES 64
+
+/**
+ * Get the number of NUMA nodes
+ *
+ * @return Number of nodes (1 without NUMA support)
+ */
+int SkyCPU_numa_nodes(void);
+
+/**
+ * Get the NUMA node of the CPU running the calling thread
+ *
+ * @return Node number (0 without NUMA support)
+ */
+int SkyCPU_numa_current_node(void);
+
+/**
+ * Get the NUMA node holding a memory page
+ *
+ * @param address Address in the page (page allocated)
+ * @return Node number, -1 if unknown (0 without NUMA support)
+ */
+int SkyCPU_numa_node_of(const void* address);
+
+/**
+ * Pin the calling thread to the CPUs of a node (its allocations prefer the node too)
+ *
+ * @param node Node number (modulo the number of nodes)
+ * @return 0 on success, -1 on error
+ */
+int SkyCPU_numa_pin(const int node);
+
+/**
+ * Allocate a zeroed memory area on a node (page aligned)
+ *
+ * @param size Size of the area
+ * @param node Node number (modulo the number of nodes)
+ * @return Pointer to the area, NULL on error
+ */
+void* SkyCPU_numa_alloc(const size_t size, const int node);
+
+/**
+ * Free a memory area allocated by SkyCPU_numa_alloc()
+ *
+ * @param area Pointer to the area (can be NULL)
+ * @param size Size of the area
+ */
+void SkyCPU_numa_free(void* area, const size_t size);
+
+/**
+ * Move the pages of a memory area to a node (later allocations of the area go to the node too)
+ *
+ * @param area Pointer to the area (page aligned)
+ * @param size Size of the area
+ * @param node Node number (modulo the number of nodes)
+ * @return Number of pages not moved (0 on success), -1 on error
+ */
+int SkyCPU_numa_move(void* area, const size_t size, const int node);
+
+/**
+ * Create a SkyCPU runtime instance on a node (control block and guest memory, initialized)
+ *
+ * @remarks With SKYCPU_MIRRORED_MEMORY the guest memory is mapped (SkyCPU_mirror_map()) and bound to the node.
+ * @param node Node number (modulo the number of nodes)
+ * @return Pointer to the instance, NULL on error
+ */
+SkyCPU_runtime_t* SkyCPU_numa_runtime_create(const int node);
+
+/**
+ * Destroy a SkyCPU runtime instance created by SkyCPU_numa_runtime_create()
+ *
+ * @param runtime Pointer to the instance (can be NULL)
+ */
+void SkyCPU_numa_runtime_destroy(SkyCPU_runtime_t* runtime);
+
+/**
+ * Move a SkyCPU runtime instance (control block and guest memory) to a node
+ *
+ * @remarks Call it when the instance change of worker, before running it. The instance MUST NOT run meanwhile.
+ * With SKYCPU_MIRRORED_MEMORY the guest memory is copied into a new mirrored mapping on the node (runtime->memory change).
+ * @param runtime Pointer to the instance
+ * @param node Node number (modulo the number of nodes)
+ * @return Number of pages not moved (0 on success), -1 on error
+ */
+int SkyCPU_numa_runtime_move(SkyCPU_runtime_t* runtime, const int node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_NUMA_H_ */
@@ -0,0 +1,77 @@
+/*
+ * See header file for details
+ *
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ *
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ *
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <string.h>
+#include "SkyCPU_snapshot.h"
+
+/* Dirty flag repeated in each byte of a 64 bits word */
+#define DIRTY_FLAGS_MASK (0x0101010101010101ULL * SKYCPU_PAGE_DIRTY)
+
+void SkyCPU_snapshot_take(SkyCPU_snapshot_t* snapshot,
+		SkyCPU_runtime_t* runtime) {
+	uint16_t page;
+
+	/* Copy CPU state and whole memory */
+	memcpy(snapshot->registers, runtime->registers, sizeof(snapshot->registers));
+	snapshot->skip_next = runtime->skip_next;
+	snapshot->program_counter = runtime->program_counter;
+	snapshot->stack_pointer = runtime->stack_pointer;
+	memcpy(snapshot->memory, runtime->memory, MEMORY_MASK + 1);
+
+	/* Memory is now clean */
+	for (page = 0; page < SKYCPU_PAGE_COUNT; ++page)
+		runtime->page_flags[page] &= ~SKYCPU_PAGE_DIRTY;
+}
+
+uint16_t SkyCPU_snapshot_restore(const SkyCPU_snapshot_t* snapshot,
+		SkyCPU_runtime_t* runtime) {
+	uint16_t page = 0, count = 0;
+
+	/* Restore CPU state */
+	memcpy(runtime->registers, snapshot->registers, sizeof(runtime->registers));
+	runtime->skip_next = snapshot->skip_next;
+	runtime->program_counter = snapshot->program_counter;
+	runtime->stack_pointer = snapshot->stack_pointer;
+
+	/* Restore dirty pages only (check flags 8 at time) */
+	while (page < SKYCPU_PAGE_COUNT) {
+
+		/* Fast path : eight clean pages */
+		if (page + 8 <= SKYCPU_PAGE_COUNT) {
+			uint64_t flags;
+			memcpy(&flags, runtime->page_flags + page, sizeof(flags));
+			if (!(flags & DIRTY_FLAGS_MASK)) {
+				page += 8;
+				continue;
+			}
+		}
+
+		/* Copy back dirty page */
+		if (runtime->page_flags[page] & SKYCPU_PAGE_DIRTY) {
+			memcpy(runtime->memory + ((uint32_t) page << SKYCPU_PAGE_SHIFT),
+					snapshot->memory + ((uint32_t) page << SKYCPU_PAGE_SHIFT),
+					SKYCPU_PAGE_SIZE);
+			runtime->page_flags[page] &= ~SKYCPU_PAGE_DIRTY;
+			++count;
+		}
+		++page;
+	}
+
+	/* Return restored pages count */
+	return count;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file SkyCPU_snapshot.h
+ * @brief Snapshot & dirty pages restore of SkyCPU runtime instances
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This header file define routines to snapshot a (warmed-up) SkyCPU runtime instance\n
+ * and to restore it quickly by copying back only the pages written since the snapshot.\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ * @section other_sec Others notes and compatibility warning
+ * Require SKYCPU_PAGE_TRACKING (or SKYCPU_FUZZING) to be defined for ALL source files !
+ */
+
+#ifndef _SKYCPU_SNAPSHOT_H_
+#define _SKYCPU_SNAPSHOT_H_
+
+/* Dependency */
+#include <stdint.h>
+#include "FastSkyCPU.h"
+
+#ifndef SKYCPU_PAGE_TRACKING
+#error "SkyCPU snapshots require SKYCPU_PAGE_TRACKING"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Snapshot structure
+ */
+typedef struct {
+	uint8_t registers[32 + 3]; /*!< General purpose register (+ 3 dummy bytes) */
+	uint8_t skip_next; /*!< Skip next instruction flag */
+	uint16_t program_counter, stack_pointer; /*!< Program counter and stack pointer */
+	uint8_t memory[MEMORY_MASK + 1]; /*!< Runtime memory space */
+} SkyCPU_snapshot_t;
+
+/**
+ * Take a snapshot of a SkyCPU runtime instance
+ *
+ * @remarks Dirty flags of the runtime instance are cleared.
+ * @param snapshot Pointer to the snapshot to fill
+ * @param runtime Pointer to the SkyCPU runtime instance to snapshot
+ */
+void SkyCPU_snapshot_take(SkyCPU_snapshot_t* snapshot,
+		SkyCPU_runtime_t* runtime);
+
+/**
+ * Restore a SkyCPU runtime instance from a snapshot
+ *
+ * @remarks Only pages marked as dirty are copied back from the snapshot.
+ * @param snapshot Pointer to the snapshot to restore
+ * @param runtime Pointer to the SkyCPU runtime instance to restore
+ * @return Number of restored pages
+ */
+uint16_t SkyCPU_snapshot_restore(const SkyCPU_snapshot_t* snapshot,
+		SkyCPU_runtime_t* runtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKYCPU_SNAPSHOT_H_ */
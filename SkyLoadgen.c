@@ -0,0 +1,232 @@
+/**
+ * @file SkyLoadgen.c
+ * @brief Load generator for the SkyCPU job server
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program submit jobs to a SkyCPU job server (SkyServer) through shared memory slots,\n
+ * keeping a fixed number of jobs in flight, and report throughput and end-to-end latency percentiles.\n
+ * \n
+ * Usage : SkyLoadgen [-n jobs] [-d depth] [-b batch] [-s input_size] [-m max_instructions] [-I image] socket\n
+ * Build : cc -O2 SkyLoadgen.c -o SkyLoadgen\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "SkyCPU_job.h"
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int connect_server(const char* path, const uint32_t slots_count,
+		SkyCPU_job_slot_t** slots, uint32_t* images_count) {
+	SkyCPU_job_hello_t hello;
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &hello, sizeof(hello) };
+	struct sockaddr_un address;
+	struct msghdr message;
+	struct cmsghdr* cmsg;
+	size_t map_size = (size_t) slots_count * sizeof(SkyCPU_job_slot_t);
+	int fd, shm_fd;
+
+	/* Shared slots (sealed against shrinking, required by the server) */
+	shm_fd = memfd_create("skycpu-jobs", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (shm_fd < 0 || ftruncate(shm_fd, map_size) < 0
+			|| fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0)
+		return -1;
+	*slots = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+	if (*slots == MAP_FAILED)
+		return -1;
+
+	/* Connect */
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) < 0)
+		return -1;
+
+	/* Hello with the shared memory file descriptor */
+	hello.magic = SKYCPU_JOB_MAGIC;
+	hello.version = SKYCPU_JOB_VERSION;
+	hello.slots_count = slots_count;
+	hello.images_count = 0;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&message);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
+	if (sendmsg(fd, &message, 0) != sizeof(hello)
+			|| recv(fd, &hello, sizeof(hello), MSG_WAITALL) != sizeof(hello)
+			|| hello.magic != SKYCPU_JOB_MAGIC)
+		return -1;
+	close(shm_fd);
+	*images_count = hello.images_count;
+
+	/* Return connected socket */
+	return fd;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_latency_t latency;
+	uint32_t jobs = 100000, depth = 64, batch = 16, input_size = 64, budget =
+			100000, image = 0, images_count, i, option;
+	uint64_t submitted = 0, completed = 0, statuses[3] = { 0, 0, 0 }, start,
+			elapsed, instructions = 0;
+	uint32_t next = 0, in_flight = 0;
+	SkyCPU_job_slot_t* slots;
+	uint64_t* submit_time;
+	uint8_t* busy;
+	int fd;
+
+	/* Parse options */
+	while ((option = getopt(argc, argv, "n:d:b:s:m:I:")) != (uint32_t) -1) {
+		switch (option) {
+		case 'n':
+			jobs = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			input_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			budget = strtoul(optarg, NULL, 0);
+			break;
+		case 'I':
+			image = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (argc - optind != 1 || !depth || !batch
+			|| input_size > SKYCPU_JOB_DATA_SIZE) {
+		fprintf(stderr, "Usage: %s [-n jobs] [-d depth] [-b batch] [-s input_size] [-m max_instructions] [-I image] socket\n",
+				argv[0]);
+		return 1;
+	}
+
+	/* Connect (twice as many slots as jobs in flight) */
+	fd = connect_server(argv[optind], depth * 2, &slots, &images_count);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	submit_time = calloc(depth * 2, sizeof(uint64_t));
+	busy = calloc(depth * 2, 1);
+	if (!submit_time || !busy)
+		return 1;
+	fprintf(stderr, "connected, %u images\n", images_count);
+
+	/* Keep depth jobs in flight */
+	start = now_ns();
+	while (completed < jobs) {
+		SkyCPU_job_batch_t message;
+
+		/* Submit contiguous batches of free slots */
+		while (submitted < jobs && in_flight < depth) {
+			message.first = next;
+			message.count = 0;
+			while (message.count < batch && submitted < jobs
+					&& in_flight < depth && !busy[next]) {
+				SkyCPU_job_slot_t* slot = &slots[next];
+				slot->image = image;
+				slot->input_size = input_size;
+				slot->max_instructions = budget;
+				for (i = 0; i < input_size; ++i)
+					slot->data[i] = (uint8_t) (submitted + i);
+				busy[next] = 1;
+				submit_time[next] = now_ns();
+				next = (next + 1) % (depth * 2);
+				++message.count;
+				++submitted;
+				++in_flight;
+			}
+			if (!message.count)
+				break;
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			if (send(fd, &message, sizeof(message), 0) != sizeof(message)) {
+				perror("send");
+				return 1;
+			}
+		}
+
+		/* Wait for a completion */
+		if (recv(fd, &message, sizeof(message), MSG_WAITALL)
+				!= sizeof(message)) {
+			fprintf(stderr, "server disconnected\n");
+			return 1;
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		for (i = 0; i < message.count; ++i) {
+			uint32_t index = (message.first + i) % (depth * 2);
+			SkyCPU_job_slot_t* slot = &slots[index];
+			SkyCPU_latency_record(&latency, now_ns() - submit_time[index]);
+			if (slot->status < 3)
+				++statuses[slot->status];
+			instructions += slot->instructions;
+			busy[index] = 0;
+		}
+		completed += message.count;
+		in_flight -= message.count;
+	}
+	elapsed = now_ns() - start;
+
+	/* Report */
+	printf("jobs=%llu time=%.3fs rate=%.0f jobs/s instructions=%.1fM\n",
+			(unsigned long long) completed, elapsed / 1e9,
+			completed / (elapsed / 1e9), instructions / 1e6);
+	printf("status done=%llu budget=%llu bad_image=%llu\n",
+			(unsigned long long) statuses[SKYCPU_JOB_DONE],
+			(unsigned long long) statuses[SKYCPU_JOB_BUDGET],
+			(unsigned long long) statuses[SKYCPU_JOB_BAD_IMAGE]);
+	printf("latency p50=%.1fus p90=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus\n",
+			SkyCPU_latency_percentile(&latency, 50) / 1e3,
+			SkyCPU_latency_percentile(&latency, 90) / 1e3,
+			SkyCPU_latency_percentile(&latency, 99) / 1e3,
+			SkyCPU_latency_percentile(&latency, 99.9) / 1e3, latency.max / 1e3);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,561 @@
+/**
+ * @file SkyOpt.c
+ * @brief Offline peephole optimizer for SkyCPU guest images
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program recover the control flow of a guest image (from its entry points), apply size / speed\n
+ * reducing rewrites and relocate jump targets :\n
+ * - full constants that fit in 5 bits become inline constants (values and addresses)\n
+ * - jumps / calls to an unconditional jump go directly to its target\n
+ * - NOP, MOV r, r and neutral arithmetic (ADD #0, MUL #1, AND #mask ...) on registers are removed\n
+ * \n
+ * Each contiguous run of code is compacted in place (padded with NOP), data never move.\n
+ * Instructions following a conditional one (skip target) are never removed.\n
+ * The image is left untouched if code addresses could be observed or computed :\n
+ * PC read or computed write, non-constant jump / call, stack accesses besides CALL / RET (if used),\n
+ * constant pointers into code, 16 / 32 bits constants (besides jump targets) that could address moved code,\n
+ * code outside the image or overlapping instructions.\n
+ * \n
+ * Usage : SkyOpt image.bin output.bin [load_address [entry ...]] (addresses in hexadecimal)\n
+ * Build : cc SkyOpt.c SkyCPU_decode.c -o SkyOpt\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_decode.h"
+
+/* Maximum jumps followed when threading a jump */
+#define MAX_THREADING 16
+
+/* Instruction flags */
+#define FLAG_CODE 1 /* Instruction start */
+#define FLAG_DELETED 2 /* Removed instruction */
+#define FLAG_TARGET 4 /* Relocated constant (argument A, or B for MOV PC) */
+
+/* Optimizer context */
+typedef struct {
+	uint8_t memory[MEMORY_MASK + 1]; /* Guest image */
+	uint32_t image_start, image_end; /* Image bounds (end excluded) */
+	uint8_t flags[MEMORY_MASK + 1]; /* Instruction flags (by original address) */
+	uint8_t owner[MEMORY_MASK + 1]; /* Bytes covered by instructions */
+	SkyCPU_instruction_t instructions[MEMORY_MASK + 1]; /* Decoded instructions (by original address) */
+	uint32_t targets[MEMORY_MASK + 1]; /* Relocated constants (original target address) */
+	uint32_t new_address[MEMORY_MASK + 1]; /* Address after compaction (by original address) */
+	uint16_t worklist[MEMORY_MASK + 1]; /* Addresses to walk */
+	uint32_t worklist_count;
+	uint8_t has_call, has_stack; /* Call / return used, other stack accesses used */
+	const char* failure; /* Reason for leaving the image untouched */
+	uint32_t inlined, threaded, deleted; /* Rewrites count */
+} optimizer_t;
+
+/* Check if an address is inside the image */
+static int in_image(const optimizer_t* optimizer, const uint32_t address) {
+	return address >= optimizer->image_start && address < optimizer->image_end;
+}
+
+/* Give up (first reason kept) */
+static void fail(optimizer_t* optimizer, const char* reason) {
+	if (!optimizer->failure)
+		optimizer->failure = reason;
+}
+
+/* Add an address to walk */
+static void add_code(optimizer_t* optimizer, const uint32_t address) {
+	if (!in_image(optimizer, address)) {
+		fail(optimizer, "code outside of the image");
+		return;
+	}
+	if (optimizer->flags[address] & FLAG_CODE)
+		return;
+	optimizer->flags[address] |= FLAG_CODE;
+	optimizer->worklist[optimizer->worklist_count++] = address;
+}
+
+/* Bits mode width in bytes (0 if none) */
+static uint8_t width_of(const uint8_t bits_mode) {
+	return (bits_mode == DOUBLE_WORD) ? 4 : bits_mode;
+}
+
+/* Bits mode mask */
+static uint32_t mask_of(const uint8_t bits_mode) {
+	return (bits_mode == DOUBLE_WORD) ? 0xFFFFFFFFUL :
+			(bits_mode == SINGLE_WORD) ? 0xFFFFUL :
+			(bits_mode == SINGLE_BYTE) ? 0xFFUL : 0;
+}
+
+/* Check if an argument is PC or SP (raw or pointed) */
+static int is_sfr(const SkyCPU_argument_t* argument, const uint8_t code) {
+	return (argument->type == ARGUMENT_TYPE_SFR
+			|| argument->type == ARGUMENT_TYPE_POINTED_SFR)
+			&& argument->code == code;
+}
+
+/* Check if an instruction is MOV PC, #constant (relocatable jump) */
+static int is_move_pc(const SkyCPU_instruction_t* instruction) {
+	return instruction->opcode == INSTRUCTION_MOV
+			&& instruction->arguments[0].type == ARGUMENT_TYPE_SFR
+			&& instruction->arguments[0].code == REGISTER_PC
+			&& instruction->arguments[1].type == ARGUMENT_TYPE_CONSTANT;
+}
+
+/* Check and record the arguments of an instruction */
+static void check_arguments(optimizer_t* optimizer,
+		const SkyCPU_instruction_t* instruction) {
+	uint8_t i = 0;
+
+	for (; i < instruction->arguments_count; ++i) {
+		const SkyCPU_argument_t* argument = &instruction->arguments[i];
+
+		/* PC exposed (or computed jump) */
+		if (is_sfr(argument, REGISTER_PC) && !(i == 0 && is_move_pc(instruction)))
+			fail(optimizer, "PC read or computed PC write");
+
+		/* Stack accessed directly */
+		if (is_sfr(argument, REGISTER_SP))
+			optimizer->has_stack = 1;
+	}
+
+	/* Stack instructions */
+	switch (instruction->opcode) {
+	case INSTRUCTION_CALL:
+	case INSTRUCTION_RET:
+		optimizer->has_call = 1;
+		break;
+
+	case INSTRUCTION_PUSH:
+	case INSTRUCTION_POP:
+		optimizer->has_stack = 1;
+		break;
+	}
+}
+
+/* Walk one instruction, add its successors */
+static void walk(optimizer_t* optimizer, const uint16_t address) {
+	SkyCPU_instruction_t* instruction = &optimizer->instructions[address];
+	SkyCPU_instruction_t next;
+	uint32_t end, i;
+
+	/* Decode & check overlapping */
+	SkyCPU_decode(optimizer->memory, address, instruction);
+	end = (uint32_t) address + instruction->length;
+	if (end > optimizer->image_end) {
+		fail(optimizer, "code outside of the image");
+		return;
+	}
+	for (i = address; i < end; ++i) {
+		if (optimizer->owner[i] || (i != address
+				&& (optimizer->flags[i] & FLAG_CODE)))
+			fail(optimizer, "overlapping instructions");
+		optimizer->owner[i] = 1;
+	}
+	check_arguments(optimizer, instruction);
+
+	/* Successors */
+	switch (instruction->opcode) {
+	case INSTRUCTION_RET: /* Return address from CALL */
+		break;
+
+	case INSTRUCTION_JMP: /* Constant jump */
+	case INSTRUCTION_CALL:
+		if (instruction->arguments[0].type != ARGUMENT_TYPE_CONSTANT) {
+			fail(optimizer, "computed jump or call");
+			return;
+		}
+		optimizer->flags[address] |= FLAG_TARGET;
+		optimizer->targets[address] = instruction->arguments[0].value
+				& MEMORY_MASK;
+		add_code(optimizer, optimizer->targets[address]);
+		if (instruction->opcode == INSTRUCTION_CALL)
+			add_code(optimizer, end);
+		break;
+
+	default:
+		if (is_move_pc(instruction)) { /* Constant jump */
+			optimizer->flags[address] |= FLAG_TARGET;
+			optimizer->targets[address] = instruction->arguments[1].value
+					& MEMORY_MASK;
+			add_code(optimizer, optimizer->targets[address]);
+			break;
+		}
+
+		/* Next instruction (and the one after it if skipped) */
+		add_code(optimizer, end);
+		if (SkyCPU_is_conditional(instruction->opcode) && in_image(optimizer, end)) {
+			SkyCPU_decode(optimizer->memory, end, &next);
+			add_code(optimizer, end + next.length);
+		}
+		break;
+	}
+}
+
+/* Check if an instruction has no effect (removable) */
+static int is_neutral(const SkyCPU_instruction_t* instruction) {
+	const SkyCPU_argument_t* A = &instruction->arguments[0];
+	const SkyCPU_argument_t* B = &instruction->arguments[1];
+
+	/* NOP */
+	if (instruction->opcode == INSTRUCTION_NOP)
+		return 1;
+
+	/* Only registers destinations (no memory access) */
+	if (instruction->arguments_count != 2 || A->type != ARGUMENT_TYPE_REGISTER
+			|| !instruction->bits_mode)
+		return 0;
+
+	/* MOV r, r */
+	if (instruction->opcode == INSTRUCTION_MOV)
+		return B->type == ARGUMENT_TYPE_REGISTER && B->code == A->code;
+
+	/* Neutral constant */
+	if (B->type != ARGUMENT_TYPE_CONSTANT)
+		return 0;
+	switch (instruction->opcode) {
+	case INSTRUCTION_ADD:
+	case INSTRUCTION_SUB:
+	case INSTRUCTION_OR:
+	case INSTRUCTION_XOR:
+	case INSTRUCTION_LSL:
+	case INSTRUCTION_LSR:
+		return B->value == 0;
+
+	case INSTRUCTION_MUL:
+	case INSTRUCTION_DIV:
+		return B->value == 1;
+
+	case INSTRUCTION_AND:
+		return B->value == mask_of(instruction->bits_mode);
+
+	default:
+		return 0;
+	}
+}
+
+/* Find the instruction reached at an original address (skip removed ones) */
+static uint32_t resolve(const optimizer_t* optimizer, uint32_t address) {
+	while (in_image(optimizer, address)
+			&& (optimizer->flags[address] & FLAG_DELETED))
+		address += optimizer->instructions[address].length;
+	return address;
+}
+
+/* Thread a jump target through unconditional constant jumps */
+static uint32_t thread(const optimizer_t* optimizer, uint32_t target,
+		const uint32_t mask) {
+	uint32_t i = 0, final;
+
+	for (; i < MAX_THREADING; ++i) {
+		const SkyCPU_instruction_t* instruction;
+		target = resolve(optimizer, target);
+		instruction = &optimizer->instructions[target];
+		if (!(optimizer->flags[target] & FLAG_CODE)
+				|| instruction->opcode != INSTRUCTION_JMP)
+			break;
+		final = optimizer->targets[target];
+		if (final > mask || final == target)
+			break;
+		target = final;
+	}
+	return target;
+}
+
+/* Encoded size of an argument (value = relocated constant if any) */
+static uint8_t encode_argument(const SkyCPU_argument_t* argument,
+		const uint8_t bits_mode, const uint32_t value, uint8_t* output) {
+	uint8_t size, i;
+
+	switch (argument->type) {
+	case ARGUMENT_TYPE_CONSTANT:
+		if (!width_of(bits_mode)) { /* No bits mode : constant left as is */
+			output[0] = argument->raw;
+			return 1;
+		}
+		if (value <= 31) { /* Inline constant */
+			output[0] = 0x80 | 0x20 | value;
+			return 1;
+		}
+		size = width_of(bits_mode);
+		output[0] = argument->inlined ? 0x80 : argument->raw;
+		for (i = 0; i < size; ++i)
+			output[1 + i] = value >> (8 * (size - 1 - i));
+		return 1 + size;
+
+	case ARGUMENT_TYPE_POINTED_CONSTANT:
+		if (value <= 31) { /* Inline address */
+			output[0] = 0xC0 | 0x20 | value;
+			return 1;
+		}
+		output[0] = 0xC0;
+		output[1] = value >> 8;
+		output[2] = value & 0xFF;
+		return 3;
+
+	default: /* Registers */
+		output[0] = argument->raw;
+		return 1;
+	}
+}
+
+/* Encode an instruction at its new place, return its size (count new inline constants) */
+static uint8_t encode(const optimizer_t* optimizer, const uint32_t address,
+		uint8_t* output, uint32_t* inlined) {
+	const SkyCPU_instruction_t* instruction = &optimizer->instructions[address];
+	uint8_t size = 1, length, i;
+
+	output[0] = instruction->raw;
+	for (i = 0; i < instruction->arguments_count; ++i) {
+		const SkyCPU_argument_t* argument = &instruction->arguments[i];
+		uint32_t value = argument->value;
+
+		/* Relocated jump target (A, or B of MOV PC) */
+		if ((optimizer->flags[address] & FLAG_TARGET)
+				&& i == (is_move_pc(instruction) ? 1 : 0))
+			value = optimizer->new_address[resolve(optimizer,
+					optimizer->targets[address])];
+
+		length = encode_argument(argument, instruction->bits_mode, value,
+				output + size);
+		if (inlined && length < argument->size)
+			++*inlined;
+		size += length;
+	}
+	return size;
+}
+
+/* Check if compaction changed the code run holding an address, up to this address */
+static int is_moved(const optimizer_t* optimizer, const uint8_t* output,
+		const uint32_t address) {
+	uint32_t start = address;
+	while (start > optimizer->image_start && optimizer->owner[start - 1])
+		--start;
+	return memcmp(output + start, optimizer->memory + start,
+			address - start + 1) != 0;
+}
+
+/* Compute new addresses, return 1 if anything changed */
+static int layout(optimizer_t* optimizer) {
+	uint8_t buffer[16];
+	uint32_t address = optimizer->image_start, position = 0, changed = 0;
+	int in_segment = 0;
+
+	for (; address < optimizer->image_end; ++address) {
+
+		/* Data keep their address (segments restart there) */
+		if (!optimizer->owner[address]) {
+			in_segment = 0;
+			continue;
+		}
+		if (!in_segment) {
+			position = address;
+			in_segment = 1;
+		}
+		if (!(optimizer->flags[address] & FLAG_CODE))
+			continue;
+
+		/* Place instruction */
+		if (optimizer->new_address[address] != position) {
+			optimizer->new_address[address] = position;
+			changed = 1;
+		}
+		if (!(optimizer->flags[address] & FLAG_DELETED))
+			position += encode(optimizer, address, buffer, NULL);
+	}
+	return changed;
+}
+
+int main(int argc, char** argv) {
+	static optimizer_t optimizer;
+	static uint8_t output[MEMORY_MASK + 1];
+	uint32_t load_address = 0, size, address, previous, end = 0, last = 0,
+			output_end, code_before = 0, code_after = 0, i;
+	FILE* file;
+
+	/* Check arguments */
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s image.bin output.bin [load_address [entry ...]]\n",
+				argv[0]);
+		return 1;
+	}
+	if (argc > 3)
+		load_address = strtoul(argv[3], NULL, 16) & MEMORY_MASK;
+
+	/* Load guest image */
+	file = fopen(argv[1], "rb");
+	if (!file) {
+		perror(argv[1]);
+		return 1;
+	}
+	size = fread(optimizer.memory + load_address, 1,
+			MEMORY_MASK + 1 - load_address, file);
+	fclose(file);
+	optimizer.image_start = load_address;
+	optimizer.image_end = load_address + size;
+	memcpy(output, optimizer.memory, sizeof(output));
+	output_end = optimizer.image_end;
+
+	/* Recover control flow from entry points */
+	if (argc > 4)
+		for (i = 4; i < (uint32_t) argc; ++i)
+			add_code(&optimizer, strtoul(argv[i], NULL, 16));
+	else
+		add_code(&optimizer, load_address);
+	while (optimizer.worklist_count && !optimizer.failure)
+		walk(&optimizer, optimizer.worklist[--optimizer.worklist_count]);
+
+	/* Return addresses must only be seen by RET */
+	if (optimizer.has_call && optimizer.has_stack)
+		fail(&optimizer, "stack accessed besides CALL / RET");
+
+	/* Constant pointers must not reach code (self reading / modifying code) */
+	for (address = optimizer.image_start;
+			address < optimizer.image_end && !optimizer.failure; ++address) {
+		const SkyCPU_instruction_t* instruction = &optimizer.instructions[address];
+		if (!(optimizer.flags[address] & FLAG_CODE))
+			continue;
+		for (i = 0; i < instruction->arguments_count; ++i) {
+			const SkyCPU_argument_t* argument = &instruction->arguments[i];
+			uint32_t pointer = argument->value & MEMORY_MASK;
+			if (argument->type != ARGUMENT_TYPE_POINTED_CONSTANT)
+				continue;
+			end = pointer + width_of(instruction->bits_mode);
+			for (; pointer < end && pointer <= MEMORY_MASK; ++pointer)
+				if (in_image(&optimizer, pointer) && optimizer.owner[pointer])
+					fail(&optimizer, "constant pointer into code");
+		}
+	}
+
+	if (!optimizer.failure) {
+
+		/* Remove neutral instructions (never a skip target) */
+		previous = 0xFFFFFFFFUL;
+		for (address = optimizer.image_start; address < optimizer.image_end;
+				++address) {
+			const SkyCPU_instruction_t* instruction;
+			if (!(optimizer.flags[address] & FLAG_CODE))
+				continue;
+			instruction = &optimizer.instructions[address];
+			code_before += instruction->length;
+			if (is_neutral(instruction) && !(previous != 0xFFFFFFFFUL
+					&& previous + optimizer.instructions[previous].length == address
+					&& SkyCPU_is_conditional(optimizer.instructions[previous].opcode))) {
+				optimizer.flags[address] |= FLAG_DELETED;
+				++optimizer.deleted;
+			}
+			previous = address;
+		}
+
+		/* Thread jumps through unconditional jumps */
+		for (address = optimizer.image_start; address < optimizer.image_end;
+				++address) {
+			const SkyCPU_instruction_t* instruction = &optimizer.instructions[address];
+			uint32_t target;
+			if ((optimizer.flags[address] & (FLAG_TARGET | FLAG_DELETED))
+					!= FLAG_TARGET)
+				continue;
+			target = thread(&optimizer, optimizer.targets[address],
+					mask_of(instruction->bits_mode) & MEMORY_MASK);
+			if (target != resolve(&optimizer, optimizer.targets[address])) {
+				optimizer.targets[address] = target;
+				++optimizer.threaded;
+			}
+		}
+
+		/* Compute new addresses (sizes only shrink, until stable) */
+		for (address = 0; address <= MEMORY_MASK; ++address)
+			optimizer.new_address[address] = address;
+		while (layout(&optimizer))
+			;
+
+		/* Emit compacted code (each segment padded with NOP) */
+		for (address = optimizer.image_start; address < optimizer.image_end;
+				++address)
+			if (optimizer.owner[address])
+				output[address] = INSTRUCTION_NOP;
+		for (address = optimizer.image_start; address < optimizer.image_end;
+				++address) {
+			if ((optimizer.flags[address] & (FLAG_CODE | FLAG_DELETED))
+					!= FLAG_CODE)
+				continue;
+			end = optimizer.new_address[address]
+					+ encode(&optimizer, address,
+							output + optimizer.new_address[address],
+							&optimizer.inlined);
+			code_after += end - optimizer.new_address[address];
+			last = address;
+		}
+
+		/* Constants that could be code addresses (MOV.w r2, #label ...) must not reach moved code */
+		for (address = optimizer.image_start;
+				address < optimizer.image_end && !optimizer.failure; ++address) {
+			const SkyCPU_instruction_t* instruction = &optimizer.instructions[address];
+			if ((optimizer.flags[address] & (FLAG_CODE | FLAG_DELETED))
+					!= FLAG_CODE || width_of(instruction->bits_mode) < 2)
+				continue;
+			for (i = 0; i < instruction->arguments_count; ++i) {
+				const SkyCPU_argument_t* argument = &instruction->arguments[i];
+				uint32_t pointer = argument->value, limit = pointer + 4;
+				if (argument->type != ARGUMENT_TYPE_CONSTANT
+						|| pointer > MEMORY_MASK
+						|| ((optimizer.flags[address] & FLAG_TARGET)
+								&& i == (is_move_pc(instruction) ? 1 : 0)))
+					continue;
+				for (; pointer < limit && pointer <= MEMORY_MASK; ++pointer) /* Up to a 32 bits access */
+					if (in_image(&optimizer, pointer) && optimizer.owner[pointer]
+							&& is_moved(&optimizer, output, pointer))
+						fail(&optimizer, "constant address into compacted code");
+			}
+		}
+
+		/* Drop the padding at the end of the image (never executed) */
+		if (optimizer.owner[optimizer.image_end - 1]
+				&& (optimizer.instructions[last].opcode == INSTRUCTION_JMP
+						|| optimizer.instructions[last].opcode == INSTRUCTION_RET
+						|| is_move_pc(&optimizer.instructions[last])))
+			output_end = end;
+
+		/* Refused after compaction: back to the original image */
+		if (optimizer.failure) {
+			memcpy(output, optimizer.memory, sizeof(output));
+			output_end = optimizer.image_end;
+		}
+	}
+
+	/* Write output image */
+	file = fopen(argv[2], "wb");
+	if (!file) {
+		perror(argv[2]);
+		return 1;
+	}
+	fwrite(output + load_address, 1, output_end - load_address, file);
+	fclose(file);
+
+	/* Report */
+	if (optimizer.failure)
+		fprintf(stderr, "Image left untouched: %s\n", optimizer.failure);
+	else
+		fprintf(stderr, "Code %u -> %u bytes (image %u -> %u bytes), %u inlined constants, %u threaded jumps, %u removed instructions\n",
+				code_before, code_after, size, output_end - load_address,
+				optimizer.inlined, optimizer.threaded, optimizer.deleted);
+	return 0;
+}
@@ -0,0 +1,896 @@
+/**
+ * @file SkyServer.c
+ * @brief Local job server running guest programs on a pool of SkyCPU runtime instances
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program load some guest images, snapshot them, and serve jobs (image ID, input, instructions budget)\n
+ * submitted over a Unix socket (see SkyCPU_job.h). Each worker own a runtime instance, reset between jobs\n
+ * by restoring only the dirty pages of the image snapshot. Small jobs are batched onto workers.\n
+ * Guests never reach host memory: instances use the mirrored memory mapping (accesses crossing 0xFFFF wrap\n
+ * around) and callbacks are set again before each job. Completions are sent without blocking the workers\n
+ * (queued per client while its socket is full). Hellos are read without blocking the event loop, the jobs slots\n
+ * memfd MUST be sealed against shrinking.\n
+ * \n
+ * Usage : SkyServer [-w workers] [-b batch] [-i input_address] [-m max_instructions] [-M shm_name] [-u] socket image.bin[@load_address] ...\n
+ * Build : cc -O2 -DSKYCPU_PAGE_TRACKING -DSKYCPU_MIRRORED_MEMORY SkyServer.c FastSkyCPU.c SkyCPU_snapshot.c SkyCPU_mirror.c -lpthread -o SkyServer\n
+ * \n
+ * Latency percentiles (batch received to job completed) are printed on SIGUSR1 and on exit.\n
+ * Built with -DSKYCPU_METRICS (and SkyCPU_metrics.c), -M shm_name export the workers metrics (see SkyTop).\n
+ * Built with -DSKYCPU_NUMA (and SkyCPU_numa.c, -lnuma), workers are spread over the nodes, pinned, with their instance\n
+ * and a replica of the images on their node. With -u workers are not pinned: the instance of a worker follow its\n
+ * thread (moved between two batches if the scheduler changed its node).\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_snapshot.h"
+#include "SkyCPU_job.h"
+#include "SkyCPU_mirror.h" /* Guests accesses crossing 0xFFFF MUST NOT reach host memory */
+#include "Endian_utility.h"
+#include "FastSkyCPU_opcodes.h"
+#ifdef SKYCPU_METRICS
+#include "SkyCPU_metrics.h"
+#endif
+#ifdef SKYCPU_NUMA
+#include "SkyCPU_numa.h"
+#endif
+
+/* Server limits */
+#define MAX_CLIENTS 64
+#define MAX_IMAGES 256
+#define MAX_WORKERS 64
+#define MAX_BACKLOG (1024 * 1024) /* Completions queued for a client not reading its socket */
+#define MAX_CONNECTIONS 16 /* Connections waiting for their hello */
+#define HELLO_TIMEOUT 1000 /* Hello delay (ms) before a new connection is dropped */
+
+/* Client connection */
+typedef struct {
+	int fd; /* Client socket */
+	SkyCPU_job_slot_t* slots; /* Shared jobs slots */
+	uint32_t slots_count;
+	size_t map_size;
+	pthread_mutex_t write_lock; /* Completions may be sent by any worker */
+	uint8_t* backlog; /* Completions not sent yet, socket full (write lock) */
+	size_t backlog_size, backlog_capacity;
+	uint8_t broken; /* Send error or backlog overflow, to be dropped (write lock) */
+	uint32_t references; /* Pending work items + connection (queue lock) */
+	uint8_t closed; /* Disconnected (no more completions sent, atomic) */
+	uint8_t pending[sizeof(SkyCPU_job_batch_t)]; /* Partial batch message */
+	uint8_t pending_size;
+} client_t;
+
+/* New connection (hello not received yet) */
+typedef struct {
+	int fd; /* Client socket (non-blocking) */
+	uint64_t deadline; /* Hello timeout (ns) */
+} connection_t;
+
+/* Work item (a batch of up to batch_size slots) */
+typedef struct work {
+	struct work* next;
+	client_t* client;
+	uint32_t first, count;
+	uint64_t received; /* Batch reception time (ns) */
+} work_t;
+
+/* Worker (one runtime instance each) */
+typedef struct {
+	pthread_t thread;
+	SkyCPU_runtime_t* runtime;
+	int32_t current_image; /* Image in runtime memory (-1 if none) */
+	uint8_t halted; /* Guest stopped with BRK */
+	SkyCPU_latency_t latency; /* Jobs latency */
+	uint64_t jobs; /* Completed jobs */
+#ifdef SKYCPU_NUMA
+	int node; /* Node of the instance (and of the thread if pinned) */
+	uint64_t migrations; /* Instance moves (unpinned thread changed of node) */
+#endif
+} worker_t;
+
+/* Server state */
+static SkyCPU_snapshot_t* images[MAX_IMAGES];
+static uint32_t images_count;
+static worker_t* workers[MAX_WORKERS];
+static uint32_t workers_count = 1, batch_size = 16;
+static uint32_t max_instructions = 10000000;
+static uint16_t input_address = 0x8000;
+static work_t *queue_head, *queue_tail;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static volatile sig_atomic_t stop_requested, stats_requested;
+static int wakeup_fd = -1; /* Event loop wakeup (completions queued) */
+static connection_t connections[MAX_CONNECTIONS]; /* Event loop only */
+static uint32_t connections_count;
+#ifdef SKYCPU_METRICS
+static const char* metrics_name; /* Stats segment name (NULL if not exported) */
+#endif
+#ifdef SKYCPU_NUMA
+static SkyCPU_snapshot_t* node_images[SKYCPU_NUMA_MAX_NODES][MAX_IMAGES]; /* Images replicas (NULL on single node machines) */
+static int unpinned; /* Workers not pinned, instances follow their thread */
+#endif
+
+/* Worker of the current thread (for callbacks) */
+static __thread worker_t* current_worker;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void on_signal(int signal_number) {
+	if (signal_number == SIGUSR1)
+		stats_requested = 1;
+	else
+		stop_requested = 1;
+}
+
+/* BRK end the job, INT is ignored */
+static void on_breakpoint(uint32_t bcode) {
+	(void) bcode;
+	current_worker->halted = 1;
+}
+
+static void on_interrupt(uint32_t icode) {
+	(void) icode;
+}
+
+static void release_client(client_t* client) {
+	uint32_t references;
+
+	pthread_mutex_lock(&queue_lock);
+	references = --client->references;
+	pthread_mutex_unlock(&queue_lock);
+
+	/* Last reference (connection closed, no pending work) */
+	if (!references) {
+		munmap(client->slots, client->map_size);
+		close(client->fd);
+		pthread_mutex_destroy(&client->write_lock);
+		free(client->backlog);
+		free(client);
+	}
+}
+
+/**
+ * Send queued completions without blocking (write lock held)
+ *
+ * @param client Pointer to the client
+ * @return 0 on success (some completions may stay queued), -1 on send error
+ */
+static int flush_backlog(client_t* client) {
+	ssize_t sent;
+
+	while (client->backlog_size) {
+		sent = send(client->fd, client->backlog, client->backlog_size,
+				MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ?
+					0 : -1;
+		client->backlog_size -= sent;
+		memmove(client->backlog, client->backlog + sent, client->backlog_size);
+	}
+
+	/* No error */
+	return 0;
+}
+
+/**
+ * Queue a completion behind the pending ones and send what the socket accept
+ *
+ * @param client Pointer to the client
+ * @param completion Completion message
+ */
+static void send_completion(client_t* client,
+		const SkyCPU_job_batch_t* completion) {
+	uint64_t wakeup = 1;
+
+	pthread_mutex_lock(&client->write_lock);
+	if (__atomic_load_n(&client->closed, __ATOMIC_ACQUIRE) || client->broken) {
+		pthread_mutex_unlock(&client->write_lock);
+		return;
+	}
+
+	/* Append to the backlog (keep completions order) */
+	if (client->backlog_size + sizeof(*completion) > client->backlog_capacity) {
+		size_t capacity = client->backlog_capacity ?
+				client->backlog_capacity * 2 : 16 * sizeof(*completion);
+		uint8_t* backlog = capacity <= MAX_BACKLOG ?
+				realloc(client->backlog, capacity) : NULL;
+		if (!backlog) {
+			client->broken = 1;
+			goto wakeup;
+		}
+		client->backlog = backlog;
+		client->backlog_capacity = capacity;
+	}
+	memcpy(client->backlog + client->backlog_size, completion,
+			sizeof(*completion));
+	client->backlog_size += sizeof(*completion);
+
+	/* Send now, the event loop send the rest when the socket is writable */
+	if (flush_backlog(client))
+		client->broken = 1;
+	if (!client->backlog_size && !client->broken) {
+		pthread_mutex_unlock(&client->write_lock);
+		return;
+	}
+
+wakeup:
+	pthread_mutex_unlock(&client->write_lock);
+	if (write(wakeup_fd, &wakeup, sizeof(wakeup)) < 0) {
+		/* Counter saturated, the event loop is already woken up */
+	}
+}
+
+/* Snapshot of an image to restore (replica of the worker node if any) */
+static const SkyCPU_snapshot_t* image_of(const worker_t* worker,
+		const uint16_t image) {
+#ifdef SKYCPU_NUMA
+	if (worker->node < SKYCPU_NUMA_MAX_NODES && node_images[worker->node][image])
+		return node_images[worker->node][image];
+#else
+	(void) worker;
+#endif
+	return images[image];
+}
+
+static void run_job(worker_t* worker, SkyCPU_job_slot_t* slot) {
+	SkyCPU_runtime_t* runtime = worker->runtime;
+	uint32_t budget = slot->max_instructions, count = 0, i;
+	uint16_t image = slot->image, input_size = slot->input_size;
+	uint16_t output_address, output_size;
+
+	/* Check image */
+	if (image >= images_count) {
+		slot->status = SKYCPU_JOB_BAD_IMAGE;
+		slot->instructions = 0;
+		slot->output_size = 0;
+		return;
+	}
+
+	/* Reset runtime (dirty pages only, unless the image changed) */
+	if (worker->current_image != image) {
+		memset(runtime->page_flags, SKYCPU_PAGE_DIRTY, SKYCPU_PAGE_COUNT);
+		worker->current_image = image;
+	}
+	SkyCPU_snapshot_restore(image_of(worker, image), runtime);
+	SkyCPU_callback_setup(runtime, on_interrupt, on_breakpoint);
+
+	/* Load input (size in r0:r1) */
+	if (input_size > SKYCPU_JOB_DATA_SIZE)
+		input_size = SKYCPU_JOB_DATA_SIZE;
+	SkyCPU_memory_copy(runtime, slot->data, input_size, input_address);
+	set16bitsValue(runtime->registers, REGISTER_0, input_size);
+
+	/* Run until BRK or out of budget (one job = one time slice) */
+	if (budget > max_instructions)
+		budget = max_instructions;
+	worker->halted = 0;
+#ifdef SKYCPU_METRICS
+	SkyCPU_metrics_slice(runtime);
+#endif
+	while (!worker->halted && count < budget) {
+		SkyCPU_fetch_and_execute(runtime);
+		++count;
+	}
+
+	/* Store output (address in r2:r3, size in r4:r5) */
+	output_address = get16bitsValue(runtime->registers, REGISTER_2);
+	output_size = get16bitsValue(runtime->registers, REGISTER_4);
+	if (output_size > SKYCPU_JOB_DATA_SIZE)
+		output_size = SKYCPU_JOB_DATA_SIZE;
+	for (i = 0; i < output_size; ++i)
+		slot->data[i] = runtime->memory[(output_address + i) & MEMORY_MASK];
+	slot->output_size = output_size;
+	slot->instructions = count;
+	slot->status = worker->halted ? SKYCPU_JOB_DONE : SKYCPU_JOB_BUDGET;
+}
+
+#ifdef SKYCPU_NUMA
+/* Move the instance of an unpinned worker to the node its thread now run on */
+static void follow_thread(worker_t* worker) {
+	int node = SkyCPU_numa_current_node();
+	if (node == worker->node
+			|| SkyCPU_numa_runtime_move(worker->runtime, node) != 0)
+		return; /* Not moved (or only partly), tried again next batch */
+	worker->node = node;
+	worker->migrations++;
+}
+#endif
+
+static void* worker_main(void* argument) {
+	worker_t* worker = argument;
+	current_worker = worker;
+#ifdef SKYCPU_NUMA
+	if (!unpinned && SkyCPU_numa_pin(worker->node))
+		fprintf(stderr, "Cannot pin a worker to node %d\n", worker->node);
+#endif
+
+	for (;;) {
+		SkyCPU_job_batch_t completion;
+		client_t* client;
+		work_t* work;
+		uint64_t done;
+		uint32_t i;
+
+		/* Wait for work */
+		pthread_mutex_lock(&queue_lock);
+		while (!queue_head && !stop_requested)
+			pthread_cond_wait(&queue_cond, &queue_lock);
+		if (!queue_head) {
+			pthread_mutex_unlock(&queue_lock);
+			return NULL;
+		}
+		work = queue_head;
+		queue_head = work->next;
+		if (!queue_head)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&queue_lock);
+
+		/* Run the batch (skipped if the client is gone) */
+		client = work->client;
+		if (!__atomic_load_n(&client->closed, __ATOMIC_ACQUIRE)) {
+#ifdef SKYCPU_NUMA
+			if (unpinned)
+				follow_thread(worker);
+#endif
+			for (i = 0; i < work->count; ++i)
+				run_job(worker,
+						&client->slots[(work->first + i) % client->slots_count]);
+
+			/* Report completion */
+			completion.first = work->first;
+			completion.count = work->count;
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			send_completion(client, &completion);
+
+			/* Account latency */
+			done = now_ns();
+			for (i = 0; i < work->count; ++i)
+				SkyCPU_latency_record(&worker->latency, done - work->received);
+			worker->jobs += work->count;
+		}
+
+		release_client(client);
+		free(work);
+	}
+}
+
+static void submit_batch(client_t* client, const SkyCPU_job_batch_t* batch,
+		const uint64_t received) {
+	work_t *first = NULL, *last = NULL;
+	uint32_t offset = 0, count;
+
+	/* Split into work items of up to batch_size slots */
+	while (offset < batch->count) {
+		work_t* work = malloc(sizeof(work_t));
+		if (!work)
+			break;
+		count = batch->count - offset;
+		if (count > batch_size)
+			count = batch_size;
+		work->next = NULL;
+		work->client = client;
+		work->first = (batch->first + offset) % client->slots_count;
+		work->count = count;
+		work->received = received;
+		if (last)
+			last->next = work;
+		else
+			first = work;
+		last = work;
+		offset += count;
+	}
+
+	/* Queue all items at once */
+	if (!first)
+		return;
+	pthread_mutex_lock(&queue_lock);
+	for (last = first; last; last = last->next)
+		++client->references;
+	for (last = first; last->next; last = last->next)
+		;
+	if (queue_tail)
+		queue_tail->next = first;
+	else
+		queue_head = first;
+	queue_tail = last;
+	pthread_cond_broadcast(&queue_cond);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+/* Accept a connection, its hello is read later by the event loop (never block it) */
+static int accept_connection(const int listen_fd) {
+	uint32_t i;
+	int fd;
+
+	/* Accept connection (non-blocking socket) */
+	fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (connections_count == MAX_CONNECTIONS) {
+		close(fd);
+		return -1;
+	}
+
+	/* Wait for its hello up to HELLO_TIMEOUT */
+	i = connections_count++;
+	connections[i].fd = fd;
+	connections[i].deadline = now_ns() + HELLO_TIMEOUT * 1000000ULL;
+
+	/* No error */
+	return 0;
+}
+
+/**
+ * Read the hello message of a new connection and map its jobs slots
+ *
+ * @param connection Pointer to the connection
+ * @param client Pointer to the new client (NULL until the hello is received)
+ * @return 0 on success or if the hello is not there yet, -1 if the connection MUST be dropped (socket left open)
+ */
+static int read_hello(const connection_t* connection, client_t** client) {
+	SkyCPU_job_hello_t hello;
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &hello, sizeof(hello) };
+	struct msghdr message;
+	struct cmsghdr* cmsg;
+	struct stat status;
+	ssize_t size;
+	int fd = connection->fd, shm_fd = -1, seals;
+
+	/* Receive hello message with the shared memory file descriptor (all at once) */
+	*client = NULL;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	size = recvmsg(fd, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return 0;
+	for (cmsg = CMSG_FIRSTHDR(&message); size > 0 && cmsg;
+			cmsg = CMSG_NXTHDR(&message, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+				&& cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+			memcpy(&shm_fd, CMSG_DATA(cmsg), sizeof(int));
+	if (size != sizeof(hello) || (message.msg_flags & MSG_CTRUNC)
+			|| hello.magic != SKYCPU_JOB_MAGIC
+			|| hello.version != SKYCPU_JOB_VERSION || !hello.slots_count)
+		goto error;
+
+	/* Slots MUST NOT shrink once mapped (SIGBUS in the workers) */
+	seals = shm_fd < 0 ? -1 : fcntl(shm_fd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK))
+		goto error;
+
+	/* Map shared slots */
+	*client = calloc(1, sizeof(client_t));
+	if (!*client)
+		goto error;
+	(*client)->fd = fd;
+	(*client)->slots_count = hello.slots_count;
+	(*client)->map_size = (size_t) hello.slots_count
+			* sizeof(SkyCPU_job_slot_t);
+	if (fstat(shm_fd, &status) < 0
+			|| (size_t) status.st_size < (*client)->map_size
+			|| ((*client)->slots = mmap(NULL, (*client)->map_size,
+					PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0))
+					== MAP_FAILED) {
+		free(*client);
+		*client = NULL;
+		goto error;
+	}
+	close(shm_fd);
+	pthread_mutex_init(&(*client)->write_lock, NULL);
+	(*client)->references = 1;
+
+	/* Reply hello (fresh socket, cannot be full) */
+	hello.images_count = images_count;
+	if (send(fd, &hello, sizeof(hello), MSG_DONTWAIT | MSG_NOSIGNAL)
+			!= sizeof(hello)) {
+		munmap((*client)->slots, (*client)->map_size);
+		pthread_mutex_destroy(&(*client)->write_lock);
+		free(*client);
+		*client = NULL;
+		return -1;
+	}
+
+	/* No error */
+	return 0;
+
+error:
+	if (shm_fd >= 0)
+		close(shm_fd);
+	return -1;
+}
+
+static int read_client(client_t* client) {
+	uint8_t buffer[64 * sizeof(SkyCPU_job_batch_t)];
+	SkyCPU_job_batch_t batch;
+	uint64_t received;
+	ssize_t size, i;
+
+	/* Read available batch messages */
+	size = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+	if (size == 0 || (size < 0 && errno != EAGAIN && errno != EINTR))
+		return -1;
+	received = now_ns();
+
+	/* Reassemble messages (stream socket) */
+	for (i = 0; i < size; ++i) {
+		client->pending[client->pending_size++] = buffer[i];
+		if (client->pending_size < sizeof(batch))
+			continue;
+		client->pending_size = 0;
+		memcpy(&batch, client->pending, sizeof(batch));
+		if (batch.first >= client->slots_count
+				|| batch.count > client->slots_count)
+			return -1;
+		submit_batch(client, &batch, received);
+	}
+
+	/* No error */
+	return 0;
+}
+
+static void print_stats(void) {
+	static SkyCPU_latency_t latency;
+	uint64_t jobs = 0;
+	uint32_t i;
+
+	/* Merge workers histograms (approximate while running) */
+	memset(&latency, 0, sizeof(latency));
+	for (i = 0; i < workers_count; ++i) {
+		SkyCPU_latency_merge(&latency, &workers[i]->latency);
+		jobs += workers[i]->jobs;
+	}
+
+	fprintf(stderr, "jobs=%llu p50=%lluus p90=%lluus p99=%lluus p99.9=%lluus max=%lluus\n",
+			(unsigned long long) jobs,
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 50) / 1000,
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 90) / 1000,
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 99) / 1000,
+			(unsigned long long) SkyCPU_latency_percentile(&latency, 99.9) / 1000,
+			(unsigned long long) latency.max / 1000);
+#ifdef SKYCPU_NUMA
+	for (i = 0; i < workers_count; ++i)
+		fprintf(stderr, "worker%u node=%d migrations=%llu\n", i,
+				workers[i]->node, (unsigned long long) workers[i]->migrations);
+#endif
+}
+
+static int load_image(const char* argument) {
+	static SkyCPU_runtime_t runtime;
+	static uint8_t buffer[MEMORY_MASK + 1];
+	char path[4096];
+	const char* at = strrchr(argument, '@');
+	uint16_t load_address = 0;
+	size_t size;
+	FILE* file;
+
+	/* Parse path[@load_address] */
+	if (images_count == MAX_IMAGES)
+		return -1;
+	snprintf(path, sizeof(path), "%.*s",
+			(int) (at ? (size_t) (at - argument) : strlen(argument)), argument);
+	if (at)
+		load_address = strtoul(at + 1, NULL, 16) & MEMORY_MASK;
+
+	/* Read image */
+	file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+	size = fread(buffer, 1, MEMORY_MASK + 1 - load_address, file);
+	fclose(file);
+
+	/* Pre-initialize a runtime and snapshot it (PC at load address) */
+	images[images_count] = malloc(sizeof(SkyCPU_snapshot_t));
+	if (!images[images_count])
+		return -1;
+	SkyCPU_runtime_init(&runtime);
+	if (!runtime.memory && SkyCPU_mirror_map(&runtime))
+		return -1;
+	memset(runtime.memory, 0, MEMORY_MASK + 1);
+	SkyCPU_memory_copy(&runtime, buffer, size, load_address);
+	runtime.program_counter = load_address;
+	SkyCPU_snapshot_take(images[images_count++], &runtime);
+
+	/* No error */
+	return 0;
+}
+
+#ifdef SKYCPU_NUMA
+/* Replicate the images on every node (restores are then local reads) */
+static int replicate_images(void) {
+	int nodes = SkyCPU_numa_nodes(), node;
+	uint32_t i;
+	if (nodes == 1)
+		return 0;
+	for (node = 0; node < nodes && node < SKYCPU_NUMA_MAX_NODES; ++node) {
+		for (i = 0; i < images_count; ++i) {
+			node_images[node][i] = SkyCPU_numa_alloc(sizeof(SkyCPU_snapshot_t),
+					node);
+			if (!node_images[node][i])
+				return -1;
+			memcpy(node_images[node][i], images[i], sizeof(SkyCPU_snapshot_t));
+		}
+	}
+	return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+	static client_t* clients[MAX_CLIENTS];
+	struct pollfd fds[MAX_CLIENTS + MAX_CONNECTIONS + 2];
+	struct sockaddr_un address;
+	struct sigaction action;
+	uint32_t clients_count = 0, polled, i;
+	uint64_t now;
+	int listen_fd, option, timeout;
+#ifdef SKYCPU_METRICS
+	SkyCPU_metrics_segment_t* metrics = NULL;
+#endif
+
+	/* Parse options */
+	while ((option = getopt(argc, argv, "w:b:i:m:M:u")) != -1) {
+		switch (option) {
+		case 'w':
+			workers_count = atoi(optarg);
+			break;
+		case 'b':
+			batch_size = atoi(optarg);
+			break;
+		case 'i':
+			input_address = strtoul(optarg, NULL, 16) & MEMORY_MASK;
+			break;
+		case 'm':
+			max_instructions = strtoul(optarg, NULL, 0);
+			break;
+#ifdef SKYCPU_METRICS
+		case 'M':
+			metrics_name = optarg;
+			break;
+#endif
+#ifdef SKYCPU_NUMA
+		case 'u':
+			unpinned = 1;
+			break;
+#endif
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (argc - optind < 2 || !workers_count || workers_count > MAX_WORKERS
+			|| !batch_size) {
+		fprintf(stderr, "Usage: %s [-w workers] [-b batch] [-i input_address] [-m max_instructions] [-M shm_name] [-u] socket image.bin[@load_address] ...\n",
+				argv[0]);
+		return 1;
+	}
+
+#ifdef SKYCPU_METRICS
+	/* Stats segment (one record per worker) */
+	if (metrics_name) {
+		metrics = SkyCPU_metrics_create(metrics_name, workers_count);
+		if (!metrics) {
+			perror(metrics_name);
+			return 1;
+		}
+	}
+#endif
+
+	/* Load images */
+	for (i = optind + 1; i < (uint32_t) argc; ++i)
+		if (load_image(argv[i]))
+			return 1;
+#ifdef SKYCPU_NUMA
+	if (replicate_images())
+		return 1;
+#endif
+
+	/* Event loop wakeup */
+	wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeup_fd < 0) {
+		perror("eventfd");
+		return 1;
+	}
+
+	/* Start workers (pre-initialized runtimes) */
+	for (i = 0; i < workers_count; ++i) {
+		workers[i] = calloc(1, sizeof(worker_t));
+		if (!workers[i])
+			return 1;
+#ifdef SKYCPU_NUMA
+		workers[i]->node = i % SkyCPU_numa_nodes();
+		workers[i]->runtime = SkyCPU_numa_runtime_create(workers[i]->node);
+		if (!workers[i]->runtime)
+			return 1;
+#else
+		workers[i]->runtime = calloc(1, sizeof(SkyCPU_runtime_t));
+		if (!workers[i]->runtime)
+			return 1;
+		SkyCPU_runtime_init(workers[i]->runtime);
+		if (SkyCPU_mirror_map(workers[i]->runtime))
+			return 1;
+#endif
+		SkyCPU_callback_setup(workers[i]->runtime, on_interrupt, on_breakpoint);
+#ifdef SKYCPU_METRICS
+		if (metrics) {
+			char name[SKYCPU_METRICS_NAME_SIZE];
+			snprintf(name, sizeof(name), "worker %u", i);
+			SkyCPU_metrics_attach(metrics, workers[i]->runtime, name);
+		}
+#endif
+		workers[i]->current_image = -1;
+		if (pthread_create(&workers[i]->thread, NULL, worker_main, workers[i]))
+			return 1;
+	}
+
+	/* Signals */
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	sigaction(SIGUSR1, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Listen */
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, argv[optind], sizeof(address.sun_path) - 1);
+	unlink(address.sun_path);
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*) &address,
+			sizeof(address)) < 0 || listen(listen_fd, 16) < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fprintf(stderr, "%u images, %u workers, listening on %s\n", images_count,
+			workers_count, address.sun_path);
+
+	/* Event loop */
+	while (!stop_requested) {
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = wakeup_fd;
+		fds[1].events = POLLIN;
+		for (i = 0; i < clients_count; ++i) {
+			fds[i + 2].fd = clients[i]->fd;
+			fds[i + 2].events = POLLIN;
+			pthread_mutex_lock(&clients[i]->write_lock);
+			if (clients[i]->backlog_size)
+				fds[i + 2].events |= POLLOUT;
+			pthread_mutex_unlock(&clients[i]->write_lock);
+		}
+
+		/* New connections (wake up on their hello or their deadline) */
+		timeout = 1000;
+		now = now_ns();
+		for (i = 0; i < connections_count; ++i) {
+			fds[clients_count + i + 2].fd = connections[i].fd;
+			fds[clients_count + i + 2].events = POLLIN;
+			if (connections[i].deadline <= now)
+				timeout = 0;
+			else if ((connections[i].deadline - now) / 1000000 + 1
+					< (uint64_t) timeout)
+				timeout = (connections[i].deadline - now) / 1000000 + 1;
+		}
+		polled = clients_count;
+		if (poll(fds, clients_count + connections_count + 2, timeout) < 0
+				&& errno != EINTR)
+			break;
+		if (fds[1].revents & POLLIN) {
+			uint64_t wakeups;
+			if (read(wakeup_fd, &wakeups, sizeof(wakeups)) < 0) {
+				/* Nothing to read (EAGAIN) */
+			}
+		}
+
+		/* Statistics request */
+		if (stats_requested) {
+			stats_requested = 0;
+			print_stats();
+		}
+
+		/* Clients requests and queued completions (before new clients, indexes match fds) */
+		for (i = clients_count; i-- > 0;) {
+			int drop = 0;
+			if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))
+				drop = read_client(clients[i]);
+			pthread_mutex_lock(&clients[i]->write_lock);
+			if (!clients[i]->broken && clients[i]->backlog_size
+					&& flush_backlog(clients[i]))
+				clients[i]->broken = 1;
+			drop |= clients[i]->broken;
+			if (drop)
+				__atomic_store_n(&clients[i]->closed, 1, __ATOMIC_RELEASE);
+			pthread_mutex_unlock(&clients[i]->write_lock);
+			if (drop) {
+				release_client(clients[i]);
+				clients[i] = clients[--clients_count];
+			}
+		}
+
+		/* Hello of new connections (before accept, indexes match fds) */
+		now = now_ns();
+		for (i = connections_count; i-- > 0;) {
+			client_t* client = NULL;
+			int drop = 0;
+			if (fds[polled + i + 2].revents & (POLLIN | POLLHUP | POLLERR))
+				drop = read_hello(&connections[i], &client);
+			if (!drop && !client && connections[i].deadline > now)
+				continue;
+			if (drop || !client)
+				close(connections[i].fd); /* Invalid hello or timeout */
+			else if (clients_count < MAX_CLIENTS)
+				clients[clients_count++] = client;
+			else
+				release_client(client);
+			connections[i] = connections[--connections_count];
+		}
+
+		/* New connection */
+		if (fds[0].revents & POLLIN)
+			accept_connection(listen_fd);
+	}
+
+	/* Drop connections still waiting for their hello */
+	for (i = 0; i < connections_count; ++i)
+		close(connections[i].fd);
+
+	/* Stop workers */
+	pthread_mutex_lock(&queue_lock);
+	pthread_cond_broadcast(&queue_cond);
+	pthread_mutex_unlock(&queue_lock);
+	for (i = 0; i < workers_count; ++i)
+		pthread_join(workers[i]->thread, NULL);
+	print_stats();
+	unlink(address.sun_path);
+#ifdef SKYCPU_METRICS
+	if (metrics) {
+		SkyCPU_metrics_close(metrics);
+		shm_unlink(metrics_name);
+	}
+#endif
+	return 0;
+}
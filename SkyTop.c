@@ -0,0 +1,222 @@
+/**
+ * @file SkyTop.c
+ * @brief Top-like reader of SkyCPU stats segments
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program sample some SkyCPU stats segments (see SkyCPU_metrics.h) without locking, and show\n
+ * the busiest instances (retired instructions per second), with their INT / BRK / time slices / stalls rates\n
+ * and stack high-water mark. The screen is refreshed in place when the output is a terminal.\n
+ * \n
+ * Usage : SkyTop [-n count] [-d delay_ms] [-i iterations] shm_name ...\n
+ * Build : cc -O2 -DSKYCPU_METRICS SkyTop.c SkyCPU_metrics.c -o SkyTop\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ *
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SkyCPU_metrics.h"
+
+/* Reader limits */
+#define MAX_SEGMENTS 16
+
+/* Counters sampled from a record */
+#define COUNTERS (4 + SKYCPU_STALL_WIDTH)
+
+/* One sampled record */
+typedef struct {
+	uint32_t segment, record; /* Position */
+	uint32_t owner; /* Process ID (sample reset if changed) */
+	uint32_t stack_high_water;
+	char name[SKYCPU_METRICS_NAME_SIZE];
+	uint64_t counters[COUNTERS]; /* Current values */
+	double rates[COUNTERS]; /* Per second since the previous sample */
+} sample_t;
+
+/* Reader state */
+static const SkyCPU_metrics_segment_t* segments[MAX_SEGMENTS];
+static uint32_t segments_count;
+static sample_t* samples[MAX_SEGMENTS]; /* Previous sample of each record */
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Busiest first */
+static int compare_samples(const void* a, const void* b) {
+	double x = (*(const sample_t* const *) a)->rates[0];
+	double y = (*(const sample_t* const *) b)->rates[0];
+	return (x < y) - (x > y);
+}
+
+/* Sample all records, compute rates since the previous call */
+static uint32_t sample_all(sample_t** used, const double elapsed) {
+	uint32_t segment, record, count = 0, i;
+	for (segment = 0; segment < segments_count; ++segment) {
+		for (record = 0; record < segments[segment]->count; ++record) {
+			const SkyCPU_metrics_t* metrics =
+					&segments[segment]->records[record];
+			sample_t* sample = &samples[segment][record];
+			uint64_t counters[COUNTERS];
+			int fresh;
+
+			/* Free record */
+			if (__atomic_load_n(&metrics->state, __ATOMIC_ACQUIRE)
+					!= SKYCPU_METRICS_USED) {
+				sample->owner = 0;
+				continue;
+			}
+
+			/* Read counters (no lock, each counter is read atomically) */
+			counters[0] = SkyCPU_metrics_read(&metrics->instructions);
+			counters[1] = SkyCPU_metrics_read(&metrics->interrupts);
+			counters[2] = SkyCPU_metrics_read(&metrics->breakpoints);
+			counters[3] = SkyCPU_metrics_read(&metrics->slices);
+			for (i = 1; i <= SKYCPU_STALL_WIDTH; ++i)
+				counters[3 + i] = SkyCPU_metrics_read(&metrics->stalls[i]);
+
+			/* New instance in this record: no rate yet */
+			fresh = sample->owner != metrics->owner
+					|| counters[0] < sample->counters[0];
+			for (i = 0; i < COUNTERS; ++i) {
+				sample->rates[i] = (fresh || elapsed <= 0) ?
+						0 : (counters[i] - sample->counters[i]) / elapsed;
+				sample->counters[i] = counters[i];
+			}
+			sample->segment = segment;
+			sample->record = record;
+			sample->owner = metrics->owner;
+			sample->stack_high_water = SkyCPU_metrics_read(
+					&metrics->stack_high_water);
+			memcpy(sample->name, metrics->name, sizeof(sample->name));
+			sample->name[sizeof(sample->name) - 1] = '\0';
+			used[count++] = sample;
+		}
+	}
+	return count;
+}
+
+static void print_top(sample_t** used, const uint32_t count,
+		const uint32_t top, const int clear) {
+	double total = 0;
+	uint32_t i;
+
+	/* Summary */
+	for (i = 0; i < count; ++i)
+		total += used[i]->rates[0];
+	if (clear)
+		printf("\033[H\033[2J");
+	printf("SkyTop - %u segments, %u instances, %.2f Minsn/s total\n\n",
+			segments_count, count, total / 1e6);
+	printf("SEG  REC     PID NAME                     MINSN/S     INT/S     BRK/S   SLICE/S  STACK    FULL/S   EMPTY/S UNBOUND/S   WIDTH/S\n");
+
+	/* Busiest instances */
+	qsort(used, count, sizeof(sample_t*), compare_samples);
+	for (i = 0; i < count && i < top; ++i) {
+		const sample_t* sample = used[i];
+		printf("%3u %4u %7u %-23s %8.2f %9.0f %9.0f %9.0f %6u %9.0f %9.0f %9.0f %9.0f\n",
+				sample->segment, sample->record, sample->owner, sample->name,
+				sample->rates[0] / 1e6, sample->rates[1], sample->rates[2],
+				sample->rates[3], sample->stack_high_water,
+				sample->rates[3 + SKYCPU_STALL_FULL],
+				sample->rates[3 + SKYCPU_STALL_EMPTY],
+				sample->rates[3 + SKYCPU_STALL_UNBOUND],
+				sample->rates[3 + SKYCPU_STALL_WIDTH]);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+	uint32_t top = 10, delay_ms = 1000, iterations = 0, records = 0, i;
+	int option, clear = isatty(STDOUT_FILENO);
+	sample_t** used;
+	double last;
+
+	/* Parse options */
+	while ((option = getopt(argc, argv, "n:d:i:")) != -1) {
+		switch (option) {
+		case 'n':
+			top = atoi(optarg);
+			break;
+		case 'd':
+			delay_ms = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (argc - optind < 1 || argc - optind > MAX_SEGMENTS || !delay_ms) {
+		fprintf(stderr, "Usage: %s [-n count] [-d delay_ms] [-i iterations] shm_name ...\n",
+				argv[0]);
+		return 1;
+	}
+
+	/* Open segments */
+	for (i = optind; i < (uint32_t) argc; ++i) {
+		segments[segments_count] = SkyCPU_metrics_open(argv[i]);
+		if (!segments[segments_count]) {
+			fprintf(stderr, "%s: not a SkyCPU stats segment\n", argv[i]);
+			return 1;
+		}
+		samples[segments_count] = calloc(segments[segments_count]->count,
+				sizeof(sample_t));
+		records += segments[segments_count++]->count;
+	}
+	used = malloc((records ? records : 1) * sizeof(sample_t*));
+	if (!used)
+		return 1;
+
+	/* First sample (rates need two), then refresh every delay */
+	sample_all(used, 0);
+	last = now_s();
+	for (i = 0; !iterations || i < iterations; ++i) {
+		struct timespec delay;
+		double current;
+		uint32_t count;
+		delay.tv_sec = delay_ms / 1000;
+		delay.tv_nsec = (delay_ms % 1000) * 1000000L;
+		nanosleep(&delay, NULL);
+		current = now_s();
+		count = sample_all(used, current - last);
+		last = current;
+		print_top(used, count, top, clear);
+	}
+
+	/* Close segments */
+	for (i = 0; i < segments_count; ++i) {
+		SkyCPU_metrics_close(segments[i]);
+		free(samples[i]);
+	}
+	free(used);
+	return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file endian.c
+ * @brief Memory accesses micro-benchmark (Endian_utility.h)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program time get8/16/32bitsValue() and set8/16/32bitsValue() over a 64KB buffer (addresses stepping by 7,\n
+ * so most 16 / 32 bits accesses are unaligned) and print the nanoseconds per access of each width.\n
+ * Build it twice to compare the single host access path (default) with the byte by byte one\n
+ * (-DENDIAN_NO_FAST_ACCESS), the checksum line MUST be the same for both builds.\n
+ * \n
+ * Usage : endian [iterations]\n
+ * Build : cc -O2 [-DENDIAN_NO_FAST_ACCESS] -I.. endian.c -o endian\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Endian_utility.h"
+
+/* Accesses per timed loop, address step */
+#define DEFAULT_ITERATIONS 100000000UL
+#define STEP 7
+
+/* 64KB + the bytes of a 32 bits access at 0xFFFF */
+static uint8_t buffer[0x10000 + 3];
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Timed loop of reads (summed in checksum) or writes (value = loop counter) */
+#define BENCH_GET(bits) \
+	static double bench_get##bits(const unsigned long iterations, uint32_t* checksum) { \
+		uint64_t start = now_ns(); \
+		uint32_t sum = 0; \
+		uint16_t address = 0; \
+		unsigned long i; \
+		for (i = 0; i < iterations; ++i) { \
+			sum += get##bits##bitsValue(buffer, address); \
+			address += STEP; \
+		} \
+		*checksum ^= sum; \
+		return (double) (now_ns() - start) / iterations; \
+	}
+#define BENCH_SET(bits) \
+	static double bench_set##bits(const unsigned long iterations) { \
+		uint64_t start = now_ns(); \
+		uint16_t address = 0; \
+		unsigned long i; \
+		for (i = 0; i < iterations; ++i) { \
+			set##bits##bitsValue(buffer, address, i); \
+			address += STEP; \
+		} \
+		return (double) (now_ns() - start) / iterations; \
+	}
+
+BENCH_GET(8)
+BENCH_GET(16)
+BENCH_GET(32)
+BENCH_SET(8)
+BENCH_SET(16)
+BENCH_SET(32)
+
+int main(int argc, char** argv) {
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	uint32_t checksum = 0, i;
+	double get8, get16, get32, set8, set16, set32;
+
+	if (argc > 2 || (argc == 2 && !(iterations = strtoul(argv[1], NULL, 0)))) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+	for (i = 0; i < sizeof(buffer); ++i)
+		buffer[i] = (uint8_t) (i * 13 + (i >> 8));
+
+	/* Reads first (pattern), then writes read back (stored values) */
+	get8 = bench_get8(iterations, &checksum);
+	get16 = bench_get16(iterations, &checksum);
+	get32 = bench_get32(iterations, &checksum);
+	set8 = bench_set8(iterations);
+	set16 = bench_set16(iterations);
+	set32 = bench_set32(iterations);
+	bench_get32(0x10000, &checksum);
+
+#ifdef ENDIAN_FAST_ACCESS
+	printf("path: single host access\n");
+#else
+	printf("path: byte by byte\n");
+#endif
+	printf(" 8 bits: get %.3f ns, set %.3f ns\n", get8, set8);
+	printf("16 bits: get %.3f ns, set %.3f ns\n", get16, set16);
+	printf("32 bits: get %.3f ns, set %.3f ns\n", get32, set32);
+	printf("checksum: %08x\n", checksum);
+	return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file aot_collision.c
+ * @brief Checksum collision check of the translated code pages (SkyCPU_aot)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program load a guest image (at address 0), attach its translated module, then rewrite the end of the\n
+ * first code page with different bytes having the same FNV-1a checksum (meet in the middle over the last 6\n
+ * bytes of the page). SkyCPU_aot_check() MUST still see the page as modified (no CODE flag, blocks interpreted),\n
+ * and as translated code again once the original bytes are written back.\n
+ * Exit status is 0 if all checks pass, 1 otherwise, 2 on error.\n
+ * \n
+ * Usage : aot_collision image.bin image_aot.so\n
+ * Build : cc -O2 -DSKYCPU_PAGE_TRACKING -I../.. aot_collision.c ../../FastSkyCPU.c ../../SkyCPU_aot.c -ldl -o aot_collision\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_aot.h"
+
+/* FNV-1a prime, searched bytes (3 bytes each side, first byte of each side on 4 bits) */
+#define FNV_PRIME 16777619UL
+#define SIDE (1UL << 20)
+
+typedef struct {
+	uint32_t hash; /* Hash state in the middle */
+	uint32_t bytes; /* Forward bytes */
+} middle_t;
+
+static int compare_middles(const void* a, const void* b) {
+	uint32_t x = ((const middle_t*) a)->hash, y = ((const middle_t*) b)->hash;
+	return (x > y) - (x < y);
+}
+
+static void on_event(uint32_t code) {
+	(void) code;
+}
+
+/**
+ * Find 6 bytes ending a page with the same checksum as the original ones (and different from them)
+ *
+ * @param page Page content (last 6 bytes replaced on success)
+ * @param checksum Checksum of the original page
+ * @return 0 on success, -1 if none found
+ */
+static int collide(uint8_t* page, const uint32_t checksum) {
+	static middle_t forward[SIDE];
+	uint8_t original[6];
+	uint32_t prefix = 2166136261UL, inverse = FNV_PRIME, i, j;
+
+	/* Hash state before the last 6 bytes, inverse of the prime (modulo 2^32) */
+	memcpy(original, page + SKYCPU_PAGE_SIZE - 6, 6);
+	for (i = 0; i < SKYCPU_PAGE_SIZE - 6; ++i)
+		prefix = (prefix ^ page[i]) * FNV_PRIME;
+	for (i = 0; i < 5; ++i)
+		inverse *= 2 - FNV_PRIME * inverse;
+
+	/* Forward states (bytes 0 to 2 of the 6) */
+	for (i = 0; i < SIDE; ++i) {
+		uint32_t hash = prefix;
+		hash = (hash ^ (i >> 16)) * FNV_PRIME;
+		hash = (hash ^ ((i >> 8) & 0xFF)) * FNV_PRIME;
+		hash = (hash ^ (i & 0xFF)) * FNV_PRIME;
+		forward[i].hash = hash;
+		forward[i].bytes = i;
+	}
+	qsort(forward, SIDE, sizeof(middle_t), compare_middles);
+
+	/* Backward states (bytes 5 to 3 of the 6, from the checksum), meet forward ones */
+	for (j = 0; j < SIDE; ++j) {
+		middle_t key, *match;
+		key.hash = checksum;
+		key.hash = (key.hash * inverse) ^ (j & 0xFF);
+		key.hash = (key.hash * inverse) ^ ((j >> 8) & 0xFF);
+		key.hash = (key.hash * inverse) ^ (j >> 16);
+		match = bsearch(&key, forward, SIDE, sizeof(middle_t), compare_middles);
+		if (!match)
+			continue;
+		page[SKYCPU_PAGE_SIZE - 6] = match->bytes >> 16;
+		page[SKYCPU_PAGE_SIZE - 5] = match->bytes >> 8;
+		page[SKYCPU_PAGE_SIZE - 4] = match->bytes;
+		page[SKYCPU_PAGE_SIZE - 3] = j >> 16;
+		page[SKYCPU_PAGE_SIZE - 2] = j >> 8;
+		page[SKYCPU_PAGE_SIZE - 1] = j;
+		if (memcmp(page + SKYCPU_PAGE_SIZE - 6, original, 6))
+			return 0;
+	}
+	memcpy(page + SKYCPU_PAGE_SIZE - 6, original, 6);
+	return -1;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_runtime_t runtime;
+	static SkyCPU_aot_module_t module;
+	static uint8_t image[MEMORY_MASK + 1];
+	uint8_t page[SKYCPU_PAGE_SIZE], original[SKYCPU_PAGE_SIZE];
+	const SkyCPU_aot_page_t* code;
+	uint16_t base;
+	int failures = 0;
+	size_t size;
+	FILE* file;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s image.bin image_aot.so\n", argv[0]);
+		return 2;
+	}
+
+	/* Image and module */
+	file = fopen(argv[1], "rb");
+	if (!file) {
+		perror(argv[1]);
+		return 2;
+	}
+	size = fread(image, 1, sizeof(image), file);
+	fclose(file);
+	SkyCPU_runtime_init(&runtime);
+	SkyCPU_callback_setup(&runtime, on_event, on_event);
+	SkyCPU_memory_copy(&runtime, image, size, 0);
+	if (SkyCPU_aot_load(&module, argv[2])
+			|| SkyCPU_aot_attach(&module, &runtime)
+			|| !module.descriptor->pages_count) {
+		fprintf(stderr, "%s: cannot load or attach the module\n", argv[2]);
+		return 2;
+	}
+
+	/* Colliding content for the first code page */
+	code = &module.descriptor->pages[0];
+	base = code->page << SKYCPU_PAGE_SHIFT;
+	memcpy(original, runtime.memory + base, SKYCPU_PAGE_SIZE);
+	memcpy(page, original, SKYCPU_PAGE_SIZE);
+	if (collide(page, code->checksum)) {
+		fprintf(stderr, "%s: no collision found\n", argv[1]);
+		return 2;
+	}
+
+	/* Written (same checksum, other bytes): page MUST be seen as modified */
+	SkyCPU_memory_copy(&runtime, page, SKYCPU_PAGE_SIZE, base);
+	if (SkyCPU_aot_checksum(runtime.memory, code->page) != code->checksum) {
+		printf("FAIL: crafted page checksum differ\n");
+		++failures;
+	}
+	if (SkyCPU_aot_check(&module, &runtime) != 1
+			|| (runtime.page_flags[code->page] & SKYCPU_PAGE_CODE)) {
+		printf("FAIL: colliding page still seen as translated code\n");
+		++failures;
+	}
+	if (SkyCPU_aot_attach(&module, &runtime) == 0) {
+		printf("FAIL: module attached over a colliding page\n");
+		++failures;
+	}
+
+	/* Written back: translated code again */
+	SkyCPU_memory_copy(&runtime, original, SKYCPU_PAGE_SIZE, base);
+	if (SkyCPU_aot_check(&module, &runtime) != 0
+			|| !(runtime.page_flags[code->page] & SKYCPU_PAGE_CODE)) {
+		printf("FAIL: written back page not translated code again\n");
+		++failures;
+	}
+	printf("%s: %s (page %u)\n", argv[1],
+			failures ? "COLLISION NOT DETECTED" : "collision detected",
+			(unsigned) code->page);
+	SkyCPU_aot_unload(&module);
+	return failures ? 1 : 0;
+}
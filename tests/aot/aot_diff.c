@@ -0,0 +1,130 @@
+/**
+ * @file aot_diff.c
+ * @brief Differential check of translated code (SkyCPU_aot) against the interpreter
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program load a guest image (at address 0) into two instances, run the first one with the interpreter\n
+ * and the second one with the translated module for the same instructions budget, then compare everything:\n
+ * registers, PC, SP, pending skip, memory and the sequence of INT / BRK callbacks codes.\n
+ * Exit status is 0 if both instances match, 1 on mismatch, 2 on error.\n
+ * Built with -DSKYCPU_MIRRORED_MEMORY (and SkyCPU_mirror.c), both instances use the mirrored mapping: images\n
+ * accessing past the end of the memory then have a defined behavior (wrap around) and can be compared too.\n
+ * \n
+ * Usage : aot_diff image.bin image_aot.so max_instructions\n
+ * Build : cc -O2 -DSKYCPU_PAGE_TRACKING -I../.. aot_diff.c ../../FastSkyCPU.c ../../SkyCPU_aot.c -ldl -o aot_diff\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_aot.h"
+#ifdef SKYCPU_MIRRORED_MEMORY
+#include "SkyCPU_mirror.h"
+#endif
+
+/* Callbacks codes log (INT and BRK, in order) */
+#define MAX_EVENTS 4096
+static uint32_t events[MAX_EVENTS];
+static uint32_t events_count;
+
+static void on_event(uint32_t code) {
+	if (events_count < MAX_EVENTS)
+		events[events_count++] = code;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_runtime_t interpreted, translated;
+	static SkyCPU_aot_module_t module;
+	static uint8_t image[MEMORY_MASK + 1];
+	static uint32_t interpreted_events[MAX_EVENTS];
+	uint32_t max_instructions, interpreted_count, retired, i;
+	size_t size;
+	FILE* file;
+
+	if (argc != 4) {
+		fprintf(stderr, "Usage: %s image.bin image_aot.so max_instructions\n",
+				argv[0]);
+		return 2;
+	}
+	max_instructions = strtoul(argv[3], NULL, 0);
+
+	/* Same image in both instances */
+	file = fopen(argv[1], "rb");
+	if (!file) {
+		perror(argv[1]);
+		return 2;
+	}
+	size = fread(image, 1, sizeof(image), file);
+	fclose(file);
+	SkyCPU_runtime_init(&interpreted);
+	SkyCPU_runtime_init(&translated);
+#ifdef SKYCPU_MIRRORED_MEMORY
+	if (SkyCPU_mirror_map(&interpreted) || SkyCPU_mirror_map(&translated)) {
+		fprintf(stderr, "cannot map the mirrored memory\n");
+		return 2;
+	}
+#endif
+	SkyCPU_callback_setup(&interpreted, on_event, on_event);
+	SkyCPU_memory_copy(&interpreted, image, size, 0);
+	SkyCPU_callback_setup(&translated, on_event, on_event);
+	SkyCPU_memory_copy(&translated, image, size, 0);
+	if (SkyCPU_aot_load(&module, argv[2])
+			|| SkyCPU_aot_attach(&module, &translated)) {
+		fprintf(stderr, "%s: cannot load or attach the module\n", argv[2]);
+		return 2;
+	}
+
+	/* Reference run */
+	events_count = 0;
+	for (i = 0; i < max_instructions; ++i)
+		SkyCPU_fetch_and_execute(&interpreted);
+	interpreted_count = events_count;
+	memcpy(interpreted_events, events, sizeof(events));
+
+	/* Translated run */
+	events_count = 0;
+	retired = SkyCPU_aot_run(&module, &translated, max_instructions, NULL);
+	SkyCPU_aot_unload(&module);
+
+	/* Compare */
+	if (retired != max_instructions
+			|| memcmp(interpreted.registers, translated.registers,
+					sizeof(interpreted.registers))
+			|| interpreted.program_counter != translated.program_counter
+			|| interpreted.stack_pointer != translated.stack_pointer
+			|| interpreted.skip_next != translated.skip_next
+			|| memcmp(interpreted.memory, translated.memory, MEMORY_MASK + 1)
+			|| interpreted_count != events_count
+			|| memcmp(interpreted_events, events,
+					interpreted_count * sizeof(uint32_t))) {
+		printf("%s: DIFF retired=%u pc=%04x/%04x sp=%04x/%04x events=%u/%u\n",
+				argv[1], retired, interpreted.program_counter,
+				translated.program_counter, interpreted.stack_pointer,
+				translated.stack_pointer, interpreted_count, events_count);
+		return 1;
+	}
+	printf("%s: MATCH pc=%04x events=%u\n", argv[1],
+			translated.program_counter, events_count);
+	return 0;
+}
@@ -0,0 +1,23 @@
+ MOV.d r0, #0x12345678
+ MOV.w r4, #0
+ DIV.b r0, r4
+ INT.b r0
+ MOV.d r0, #0x12345678
+ DIV.w r0, #0
+ INT.w r0
+ MOV.d r0, #0x12345678
+ DIV.d r0, r4
+ INT.d r0
+ MOV.w r8, #0x9000
+ MOV.d [r8], #0xCAFEBABE
+ DIV.d [r8], [#0x9004]
+ INT.d [r8]
+ MOV.w r10, #7
+ DIV.w r10, r10
+ INT.w r10
+ CLR.w r12
+ DIV.w r10, r12
+ INT.w r10
+ BRK.b #1
+E:
+ JMP.w #E
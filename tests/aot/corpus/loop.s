@@ -0,0 +1,23 @@
+ MOV.w r0, #0
+ MOV.w r2, #0
+L:
+ ADD.w r2, r0
+ INC.w r0
+ SE.w r0, #100
+ JMP.w #L
+ MOV.b [#0x8000], r3
+ PUSH.w r2
+ CALL.w #F
+ INT.b #7
+ MOV.w r4, #0x9000
+ MOV.d [r4], #0x11223344
+ SWAP.d [r4]
+ ROL.w r2, #1
+ BRK.b #42
+E:
+ JMP.w #E
+F:
+ POP.w r10
+ PUSH.w r10
+ INT.w [SP]
+ RET
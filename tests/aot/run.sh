@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Differential test of the ahead-of-time translator (SkyAOT + SkyCPU_aot)
+#
+# Every image of corpus/ is translated, built as a module, then run for the same
+# instructions budget with the interpreter and with the translated code (aot_diff).
+# All images MUST match (registers, PC, SP, pending skip, memory, INT / BRK codes).
+#
+# Usage : tests/aot/run.sh [max_instructions] (CC and CFLAGS honored)
+#
+# Corpus images are loaded and entered at address 0. They are random images biased
+# toward valid opcodes (plus a few hand written programs). Images of corpus/mirrored/
+# access past the end of the memory within the default budget: they are only run
+# with the mirrored memory (SKYCPU_MIRRORED_MEMORY), where such accesses wrap around.
+# Every image is run with the mirrored memory too. A code page of loop.bin is then
+# rewritten with colliding content (same checksum): it MUST be seen as modified.
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+BUDGET=${1:-2000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Translator
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -I"$ROOT" "$ROOT/SkyAOT.c" \
+	"$ROOT/SkyCPU_decode.c" -o "$WORK/SkyAOT"
+
+# Translate, build and compare images (flags, extra sources, then images)
+passed=0
+failed=0
+compare() {
+	flags=$1
+	sources=$2
+	shift 2
+	$CC $CFLAGS $flags -I"$ROOT" "$HERE/aot_diff.c" "$ROOT/FastSkyCPU.c" \
+		"$ROOT/SkyCPU_aot.c" $sources -ldl -o "$WORK/aot_diff"
+	for image in "$@"; do
+		name=$(basename "$image" .bin)
+		"$WORK/SkyAOT" "$image" "$WORK/$name.c" > /dev/null
+		$CC $CFLAGS $flags -shared -fPIC -I"$ROOT" \
+			"$WORK/$name.c" -o "$WORK/$name.so"
+		if "$WORK/aot_diff" "$image" "$WORK/$name.so" "$BUDGET"; then
+			passed=$((passed + 1))
+		else
+			failed=$((failed + 1))
+		fi
+	done
+}
+compare "-DSKYCPU_PAGE_TRACKING" "" "$HERE"/corpus/*.bin
+compare "-DSKYCPU_PAGE_TRACKING -DSKYCPU_MIRRORED_MEMORY" "$ROOT/SkyCPU_mirror.c" \
+	"$HERE"/corpus/*.bin "$HERE"/corpus/mirrored/*.bin
+
+# Checksum collision on a code page (bytes compared too)
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -I"$ROOT" "$HERE/aot_collision.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_aot.c" -ldl -o "$WORK/aot_collision"
+"$WORK/SkyAOT" "$HERE/corpus/loop.bin" "$WORK/collision.c" > /dev/null
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -shared -fPIC -I"$ROOT" \
+	"$WORK/collision.c" -o "$WORK/collision.so"
+if "$WORK/aot_collision" "$HERE/corpus/loop.bin" "$WORK/collision.so"; then
+	passed=$((passed + 1))
+else
+	failed=$((failed + 1))
+fi
+
+echo "aot: $passed passed, $failed failed"
+test "$failed" -eq 0
@@ -0,0 +1,117 @@
+/**
+ * @file numa_move.c
+ * @brief Runtime instance placement check (SkyCPU_numa)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program create a runtime instance on a node, fill its registers and guest memory, then move it to every\n
+ * node: SkyCPU_numa_runtime_move() MUST succeed (0 on a single node or without NUMA support, where nothing is\n
+ * moved), the instance MUST keep its registers and memory (mirror views too with SKYCPU_MIRRORED_MEMORY) and a\n
+ * fully moved guest memory MUST be on the target node.\n
+ * Exit status is 0 if all checks pass, 1 otherwise, 2 on error.\n
+ * \n
+ * Usage : numa_move\n
+ * Build : cc -O2 -DSKYCPU_NUMA [-DSKYCPU_MIRRORED_MEMORY] -I../.. numa_move.c ../../SkyCPU_numa.c [../../SkyCPU_mirror.c] ../../FastSkyCPU.c -lpthread -lnuma -o numa_move\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_numa.h"
+
+static int failures;
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+/* Guest memory pattern */
+static uint8_t pattern(const uint32_t address) {
+	return (uint8_t) (address * 13 + (address >> 8));
+}
+
+/* Check the instance content after a move */
+static void check_content(const SkyCPU_runtime_t* runtime, const char* what) {
+	char message[128];
+	uint32_t address, bad = 0;
+	for (address = 0; address <= MEMORY_MASK; ++address)
+		if (runtime->memory[address] != pattern(address))
+			++bad;
+#ifdef SKYCPU_MIRRORED_MEMORY
+	/* Second view of the mirror (same pages) */
+	for (address = 0; address < 16; ++address)
+		if (runtime->memory[MEMORY_MASK + 1 + address] != pattern(address))
+			++bad;
+#endif
+	snprintf(message, sizeof(message), "%s: %u bad bytes", what, bad);
+	check(!bad, message);
+	snprintf(message, sizeof(message), "%s: registers kept", what);
+	check(runtime->registers[7] == 0x77 && runtime->program_counter == 0x1234
+			&& runtime->stack_pointer == 0xFF00, message);
+}
+
+int main(void) {
+	int nodes = SkyCPU_numa_nodes(), node, failed;
+	SkyCPU_runtime_t* runtime;
+	uint32_t address;
+	char what[64];
+
+	/* Instance on node 0, filled */
+	check(nodes >= 1 && nodes <= SKYCPU_NUMA_MAX_NODES, "nodes count");
+	runtime = SkyCPU_numa_runtime_create(0);
+	if (!runtime) {
+		fprintf(stderr, "cannot create a runtime instance\n");
+		return 2;
+	}
+	check(runtime->stack_pointer == MEMORY_MASK && !runtime->program_counter,
+			"instance initialized");
+	for (address = 0; address <= MEMORY_MASK; ++address)
+		runtime->memory[address] = pattern(address);
+	runtime->registers[7] = 0x77;
+	runtime->program_counter = 0x1234;
+	runtime->stack_pointer = 0xFF00;
+
+	/* Move to every node (and one past the last: modulo the nodes count) */
+	for (node = 0; node <= nodes; ++node) {
+		failed = SkyCPU_numa_runtime_move(runtime, node);
+		snprintf(what, sizeof(what), "move to node %d (%d pages not moved)",
+				node, failed);
+		if (nodes == 1)
+			check(failed == 0, what);
+		else
+			check(failed >= 0, what);
+		snprintf(what, sizeof(what), "move to node %d", node);
+		check_content(runtime, what);
+		if (failed == 0) {
+			snprintf(what, sizeof(what), "guest memory on node %d", node % nodes);
+			check(SkyCPU_numa_node_of(runtime->memory) == node % nodes, what);
+		}
+	}
+	SkyCPU_numa_runtime_destroy(runtime);
+
+	printf("numa move: %d node(s), %s\n", nodes,
+			failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
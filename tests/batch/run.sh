@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+# End-to-end test of the batch mode (SkyBatch + SkyBatchgen)
+#
+# SkyBatchgen build an input file from raw columns (a, b: 16 bits, loop: 8 bits),
+# SkyBatch run sum.bin over it (a + b into the output buffer, endless loop when
+# loop is not 0) on several workers, then the dumped output file (sum column and
+# status column) MUST match the expected one. When libnuma is available, SkyBatch
+# is built again with SKYCPU_NUMA: every -n placement MUST give the same output and
+# a per node report (workers of all nodes = -w, local <= workers), and numa_move
+# check SkyCPU_numa_runtime_move() (plain and mirrored guest memory).
+#
+# Usage : tests/batch/run.sh (CC and CFLAGS honored)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -I"$ROOT" "$ROOT/SkyBatch.c" \
+	"$ROOT/SkyCPU_batch.c" "$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_snapshot.c" \
+	-lpthread -o "$WORK/SkyBatch"
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -I"$ROOT" "$ROOT/SkyBatchgen.c" -o "$WORK/SkyBatchgen"
+
+# Columns (big endian words, like the guest memory)
+printf '\001\002\377\377\022\064\200\000\000\377\000\000' > "$WORK/a.bin"
+printf '\003\004\000\001\021\021\200\000\000\001\000\000' > "$WORK/b.bin"
+printf '\000\000\001\000\000\000' > "$WORK/loop.bin"
+"$WORK/SkyBatchgen" "$WORK/input.skyb" 2:"$WORK/a.bin" 2:"$WORK/b.bin" \
+	1:"$WORK/loop.bin"
+
+# Sum (2 bytes at 0x9000) and status (0 = BRK, 1 = budget exhausted)
+cat > "$WORK/expected.txt" <<END
+records=6 columns=2 widths=2,1
+0: 0406 00
+1: 0000 00
+2: 2345 01
+3: 0000 00
+4: 0100 00
+5: 0000 00
+END
+"$WORK/SkyBatch" -w 3 -i 8000 -o 9000 -s 2 -m 1000 "$HERE/sum.bin" \
+	"$WORK/input.skyb" "$WORK/output.skyb"
+"$WORK/SkyBatchgen" -d "$WORK/output.skyb" > "$WORK/output.txt"
+if diff "$WORK/expected.txt" "$WORK/output.txt"; then
+	echo "batch: output and status columns match"
+else
+	echo "batch: FAILED"
+	exit 1
+fi
+
+# NUMA placement (skipped without libnuma)
+if ! $CC $CFLAGS -DSKYCPU_PAGE_TRACKING -DSKYCPU_NUMA -I"$ROOT" \
+		"$ROOT/SkyBatch.c" "$ROOT/SkyCPU_batch.c" "$ROOT/SkyCPU_numa.c" \
+		"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_snapshot.c" -lpthread -lnuma \
+		-o "$WORK/SkyBatch_numa" 2> /dev/null; then
+	echo "batch numa: libnuma not available, skipped"
+	exit 0
+fi
+for placement in unpinned local remote; do
+	"$WORK/SkyBatch_numa" -w 3 -i 8000 -o 9000 -s 2 -m 1000 -n "$placement" \
+		"$HERE/sum.bin" "$WORK/input.skyb" "$WORK/output_$placement.skyb" \
+		2> "$WORK/report_$placement.txt"
+	"$WORK/SkyBatchgen" -d "$WORK/output_$placement.skyb" \
+		> "$WORK/output_$placement.txt"
+	if ! diff "$WORK/expected.txt" "$WORK/output_$placement.txt"; then
+		echo "batch numa: FAILED ($placement output)"
+		exit 1
+	fi
+
+	# Per node lines: workers sum to -w, local never above workers (all local when pinned local)
+	if ! awk -v placement="$placement" '
+		/^node[0-9]+ workers=[0-9]+ local=[0-9]+ records\/s=[0-9]+ instructions\/s=[0-9]+$/ {
+			split($2, w, "="); split($3, l, "=");
+			workers += w[2]; lines++;
+			if (l[2] > w[2] || (placement == "local" && l[2] != w[2])) bad++;
+		}
+		END { exit !(lines > 0 && workers == 3 && !bad) }' \
+			"$WORK/report_$placement.txt"; then
+		echo "batch numa: FAILED ($placement report)"
+		cat "$WORK/report_$placement.txt"
+		exit 1
+	fi
+done
+echo "batch numa: unpinned, local and remote outputs match"
+
+$CC $CFLAGS -DSKYCPU_NUMA -I"$ROOT" "$HERE/numa_move.c" "$ROOT/SkyCPU_numa.c" \
+	"$ROOT/FastSkyCPU.c" -lpthread -lnuma -o "$WORK/numa_move"
+"$WORK/numa_move"
+$CC $CFLAGS -DSKYCPU_NUMA -DSKYCPU_MIRRORED_MEMORY -I"$ROOT" "$HERE/numa_move.c" \
+	"$ROOT/SkyCPU_numa.c" "$ROOT/SkyCPU_mirror.c" "$ROOT/FastSkyCPU.c" \
+	-lpthread -lnuma -o "$WORK/numa_move_mirrored"
+"$WORK/numa_move_mirrored"
@@ -0,0 +1,9 @@
+ BRK.b #0
+S:
+ MOV.w r2, [#0x8000]
+ ADD.w r2, [#0x8002]
+ MOV.w [#0x9000], r2
+ SNE.b [#0x8004], #0
+ BRK.b #1
+E:
+ JMP.w #E
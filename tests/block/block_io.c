@@ -0,0 +1,259 @@
+/**
+ * @file block_io.c
+ * @brief Requests check of the block device (SkyCPU_block)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program play the guest side of a block device ring (no guest code is run) over a pattern-filled backing\n
+ * file: READ MUST fill the guest buffer (and nothing around it), WRITE MUST land in the file, FLUSH MUST complete,\n
+ * bad opcodes and buffers crossing the end of memory MUST complete at once with -EINVAL / -EFAULT, and no\n
+ * descriptor MUST be taken while the completion ring is full (pending + in-flight >= entries).\n
+ * Built with SKYCPU_PAGE_TRACKING, pages written by the host (data read, completions, ring indexes) MUST be\n
+ * marked dirty and code pages MUST raise a code event.\n
+ * Exit status is 0 if all checks pass, 1 on failure, 2 on error (io_uring not available ...).\n
+ * \n
+ * Usage : block_io\n
+ * Build : cc -O2 [-DSKYCPU_PAGE_TRACKING] -I../.. block_io.c ../../FastSkyCPU.c ../../SkyCPU_block.c -o block_io\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "SkyCPU_block.h"
+#include "Endian_utility.h"
+
+/* Guest layout and backing file */
+#define RING 0x8000
+#define ENTRIES 8
+#define COMPLETIONS (RING + SKYCPU_BLOCK_HEADER_SIZE + ENTRIES * SKYCPU_BLOCK_DESCRIPTOR_SIZE)
+#define BUFFER 0x9000
+#define SECTORS 16
+
+static SkyCPU_runtime_t runtime;
+static SkyCPU_block_t device;
+static uint16_t sq_tail, cq_head;
+static int failures;
+
+/* Backing file pattern (byte of a sector offset) */
+static uint8_t pattern(const uint32_t sector, const uint32_t offset) {
+	return (uint8_t) (sector * 31 + offset * 7 + 1);
+}
+
+/* Queue a request (guest side) */
+static void queue(const uint8_t opcode, const uint16_t buffer,
+		const uint16_t length, const uint16_t tag, const uint32_t sector) {
+	uint16_t descriptor = RING + SKYCPU_BLOCK_HEADER_SIZE
+			+ (sq_tail & (ENTRIES - 1)) * SKYCPU_BLOCK_DESCRIPTOR_SIZE;
+	memset(runtime.memory + descriptor, 0, SKYCPU_BLOCK_DESCRIPTOR_SIZE);
+	set8bitsValue(runtime.memory, descriptor, opcode);
+	set16bitsValue(runtime.memory, descriptor + 2, buffer);
+	set16bitsValue(runtime.memory, descriptor + 4, length);
+	set16bitsValue(runtime.memory, descriptor + 6, tag);
+	set32bitsValue(runtime.memory, descriptor + 8, sector);
+	set16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_SQ_TAIL, ++sq_tail);
+}
+
+/* Service until no request is in-flight, return the completions count */
+static int service_all(void) {
+	int posted = 0, ret;
+	do {
+		ret = SkyCPU_block_service(&device, 1);
+		if (ret < 0) {
+			perror("SkyCPU_block_service");
+			exit(2);
+		}
+		posted += ret;
+	} while (device.inflight);
+	return posted;
+}
+
+/* Consume the next completion (guest side), 0 if none */
+static int consume(uint16_t* tag, int32_t* result) {
+	uint16_t entry = COMPLETIONS
+			+ (cq_head & (ENTRIES - 1)) * SKYCPU_BLOCK_COMPLETION_SIZE;
+	if (cq_head == get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_CQ_TAIL))
+		return 0;
+	*tag = get16bitsValue(runtime.memory, entry);
+	*result = (int32_t) get32bitsValue(runtime.memory, entry + 4);
+	set16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_CQ_HEAD, ++cq_head);
+	return 1;
+}
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+/* Run one request to completion, check its tag and result */
+static void request(const uint8_t opcode, const uint16_t buffer,
+		const uint16_t length, const uint16_t tag, const uint32_t sector,
+		const int32_t expected, const char* what) {
+	char message[128];
+	uint16_t got_tag = 0;
+	int32_t result = 0;
+	queue(opcode, buffer, length, tag, sector);
+	service_all();
+	if (!consume(&got_tag, &result) || got_tag != tag || result != expected) {
+		snprintf(message, sizeof(message), "%s (tag %u, result %d)", what,
+				got_tag, result);
+		check(0, message);
+	}
+}
+
+int main(void) {
+	char path[] = "/tmp/block_ioXXXXXX";
+	static uint8_t file[SECTORS * SKYCPU_BLOCK_SECTOR], sector[SKYCPU_BLOCK_SECTOR];
+	uint32_t i, s, invalid = 0, seen = 0;
+	uint16_t tag;
+	int32_t result;
+	int fd = mkstemp(path), ok;
+
+	/* Pattern-filled backing file */
+	for (s = 0; s < SECTORS; ++s)
+		for (i = 0; i < SKYCPU_BLOCK_SECTOR; ++i)
+			file[s * SKYCPU_BLOCK_SECTOR + i] = pattern(s, i);
+	if (fd < 0 || write(fd, file, sizeof(file)) != sizeof(file)) {
+		perror(path);
+		return 2;
+	}
+	unlink(path);
+	SkyCPU_runtime_init(&runtime);
+	memset(runtime.memory, 0xEE, MEMORY_MASK + 1);
+	if (SkyCPU_block_init(&device, &runtime, fd, RING, ENTRIES, 0)) {
+		fprintf(stderr, "io_uring not available\n");
+		return 2;
+	}
+
+	/* READ: buffer filled with the sector, bytes around it untouched */
+#ifdef SKYCPU_PAGE_TRACKING
+	for (i = 0; i < SKYCPU_PAGE_COUNT; ++i)
+		runtime.page_flags[i] = 0;
+	runtime.page_flags[(BUFFER >> SKYCPU_PAGE_SHIFT) + 1] = SKYCPU_PAGE_CODE;
+	runtime.page_events = 0;
+#endif
+	request(SKYCPU_BLOCK_READ, BUFFER, SKYCPU_BLOCK_SECTOR, 1, 5,
+			SKYCPU_BLOCK_SECTOR, "READ a whole sector");
+	check(!memcmp(runtime.memory + BUFFER, file + 5 * SKYCPU_BLOCK_SECTOR,
+			SKYCPU_BLOCK_SECTOR), "guest buffer holds the sector");
+	check(runtime.memory[BUFFER - 1] == 0xEE
+			&& runtime.memory[BUFFER + SKYCPU_BLOCK_SECTOR] == 0xEE,
+			"bytes around the buffer untouched");
+#ifdef SKYCPU_PAGE_TRACKING
+	check((runtime.page_flags[BUFFER >> SKYCPU_PAGE_SHIFT] & SKYCPU_PAGE_DIRTY)
+			&& (runtime.page_flags[(BUFFER >> SKYCPU_PAGE_SHIFT) + 1]
+					& SKYCPU_PAGE_DIRTY), "pages read into are dirty");
+	check(!(runtime.page_flags[(BUFFER >> SKYCPU_PAGE_SHIFT) + 2]
+			& SKYCPU_PAGE_DIRTY), "page after the buffer not dirty");
+	check(runtime.page_events & SKYCPU_PAGE_CODE, "code page read into raise an event");
+	check((runtime.page_flags[RING >> SKYCPU_PAGE_SHIFT] & SKYCPU_PAGE_DIRTY)
+			&& (runtime.page_flags[COMPLETIONS >> SKYCPU_PAGE_SHIFT]
+					& SKYCPU_PAGE_DIRTY), "ring pages dirty (head, completion)");
+#endif
+
+	/* Partial READ at an odd address */
+	request(SKYCPU_BLOCK_READ, BUFFER + 0x301, 100, 2, 9, 100, "READ 100 bytes");
+	check(!memcmp(runtime.memory + BUFFER + 0x301, file + 9 * SKYCPU_BLOCK_SECTOR, 100)
+			&& runtime.memory[BUFFER + 0x300] == 0xEE
+			&& runtime.memory[BUFFER + 0x301 + 100] == 0xEE,
+			"partial buffer filled, nothing more");
+
+	/* WRITE: file updated at the sector, other sectors untouched */
+	for (i = 0; i < SKYCPU_BLOCK_SECTOR; ++i)
+		runtime.memory[BUFFER + 0x400 + i] = (uint8_t) (0xA5 ^ i);
+	request(SKYCPU_BLOCK_WRITE, BUFFER + 0x400, SKYCPU_BLOCK_SECTOR, 3, 7,
+			SKYCPU_BLOCK_SECTOR, "WRITE a whole sector");
+	ok = pread(fd, sector, sizeof(sector), 7 * SKYCPU_BLOCK_SECTOR)
+			== sizeof(sector);
+	check(ok && !memcmp(sector, runtime.memory + BUFFER + 0x400, sizeof(sector)),
+			"file holds the written sector");
+	ok = pread(fd, sector, sizeof(sector), 6 * SKYCPU_BLOCK_SECTOR)
+			== sizeof(sector);
+	check(ok && !memcmp(sector, file + 6 * SKYCPU_BLOCK_SECTOR, sizeof(sector)),
+			"sector before the written one untouched");
+	ok = pread(fd, sector, sizeof(sector), 8 * SKYCPU_BLOCK_SECTOR)
+			== sizeof(sector);
+	check(ok && !memcmp(sector, file + 8 * SKYCPU_BLOCK_SECTOR, sizeof(sector)),
+			"sector after the written one untouched");
+
+	/* FLUSH */
+	request(SKYCPU_BLOCK_FLUSH, 0, 0, 4, 0, 0, "FLUSH");
+
+	/* Invalid requests: completed at once, nothing submitted */
+	memset(runtime.memory + BUFFER, 0xEE, SKYCPU_BLOCK_SECTOR);
+	s = (uint32_t) device.submitted;
+	request(0, BUFFER, SKYCPU_BLOCK_SECTOR, 5, 0, -EINVAL, "opcode 0");
+	request(SKYCPU_BLOCK_FLUSH + 1, BUFFER, SKYCPU_BLOCK_SECTOR, 6, 0, -EINVAL,
+			"unknown opcode");
+	invalid += 2;
+#ifndef SKYCPU_MIRRORED_MEMORY
+	request(SKYCPU_BLOCK_READ, MEMORY_MASK - 10, SKYCPU_BLOCK_SECTOR, 7, 0,
+			-EFAULT, "READ crossing the end of memory");
+	request(SKYCPU_BLOCK_WRITE, MEMORY_MASK, 2, 8, 0, -EFAULT,
+			"WRITE crossing the end of memory");
+	invalid += 2;
+#endif
+	check(device.submitted == s, "invalid requests not submitted");
+	check(runtime.memory[BUFFER] == 0xEE, "invalid READ left the buffer alone");
+
+	/* Backpressure: no descriptor taken while pending + in-flight >= entries (completions in any order) */
+	for (i = 0; i < ENTRIES; ++i)
+		queue(SKYCPU_BLOCK_READ, BUFFER + i * 16, 16, 100 + i, i);
+	check(SkyCPU_block_service(&device, 0) >= 0 && device.inflight
+			+ (uint16_t) (get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_CQ_TAIL)
+					- cq_head) == ENTRIES, "descriptors taken up to the ring entries");
+	queue(SKYCPU_BLOCK_READ, BUFFER + 8 * 16, 16, 108, 8);
+	queue(SKYCPU_BLOCK_READ, BUFFER + 9 * 16, 16, 109, 9);
+	service_all();
+	check(get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_SQ_HEAD)
+			== (uint16_t) (sq_tail - 2), "no descriptor taken past the ring entries");
+	check((uint16_t) (get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_CQ_TAIL)
+			- cq_head) == ENTRIES, "completion ring full");
+	check(SkyCPU_block_service(&device, 1) == 0 && !device.inflight
+			&& get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_SQ_HEAD)
+					== (uint16_t) (sq_tail - 2), "nothing taken while the completion ring is full");
+	for (i = 0, ok = 1; i < 3; ++i) {
+		ok &= consume(&tag, &result) && tag >= 100 && tag < 100 + ENTRIES + 2
+				&& result == 16 && !(seen & (1UL << (tag - 100)));
+		seen |= 1UL << (tag - 100);
+	}
+	check(ok, "first completions consumed");
+	service_all();
+	check(get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_SQ_HEAD) == sq_tail,
+			"remaining descriptors taken once room is made");
+	while (consume(&tag, &result)) {
+		ok &= tag >= 100 && tag < 100 + ENTRIES + 2 && result == 16
+				&& !(seen & (1UL << (tag - 100)));
+		seen |= 1UL << (tag - 100);
+	}
+	check(ok && seen == (1UL << (ENTRIES + 2)) - 1, "every completion posted once");
+	check(!device.inflight && device.completed == device.submitted + invalid,
+			"every request completed");
+
+	SkyCPU_block_free(&device);
+	close(fd);
+	printf("block io: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
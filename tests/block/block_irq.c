@@ -0,0 +1,158 @@
+/**
+ * @file block_irq.c
+ * @brief Interrupts delivery check of the block device (SkyCPU_block)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program play the guest side of a block device ring (no guest code is run) and check that every\n
+ * completion is signaled: completions posted while the interrupt is not armed, or while a skip is pending,\n
+ * MUST be signaled by a later service call once possible, exactly once.\n
+ * Exit status is 0 if all checks pass, 1 on failure, 2 on error (io_uring not available ...).\n
+ * \n
+ * Usage : block_irq\n
+ * Build : cc -O2 -I../.. block_irq.c ../../FastSkyCPU.c ../../SkyCPU_block.c -o block_irq\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "SkyCPU_block.h"
+#include "Endian_utility.h"
+
+/* Guest layout */
+#define RING 0x8000
+#define ENTRIES 8
+#define BUFFER 0x9000
+#define VECTOR 0x0100
+#define RESUME 0x0040
+
+static SkyCPU_runtime_t runtime;
+static SkyCPU_block_t device;
+static uint16_t sq_tail;
+static int failures;
+
+/* Queue a read request (guest side) */
+static void queue_read(const uint16_t tag) {
+	uint16_t descriptor = RING + SKYCPU_BLOCK_HEADER_SIZE
+			+ (sq_tail & (ENTRIES - 1)) * SKYCPU_BLOCK_DESCRIPTOR_SIZE;
+	memset(runtime.memory + descriptor, 0, SKYCPU_BLOCK_DESCRIPTOR_SIZE);
+	set8bitsValue(runtime.memory, descriptor, SKYCPU_BLOCK_READ);
+	set16bitsValue(runtime.memory, descriptor + 2, BUFFER);
+	set16bitsValue(runtime.memory, descriptor + 4, SKYCPU_BLOCK_SECTOR);
+	set16bitsValue(runtime.memory, descriptor + 6, tag);
+	set16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_SQ_TAIL, ++sq_tail);
+}
+
+/* Arm or disarm the interrupt (guest side) */
+static void arm(const uint8_t armed) {
+	set8bitsValue(runtime.memory, RING + SKYCPU_BLOCK_IRQ_ARMED, armed);
+}
+
+/* Return from the handler (guest side: consume completions, RET) */
+static void handler_return(void) {
+	set16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_CQ_HEAD,
+			get16bitsValue(runtime.memory, RING + SKYCPU_BLOCK_CQ_TAIL));
+	runtime.program_counter = get16bitsValue(runtime.memory,
+			runtime.stack_pointer);
+	runtime.stack_pointer += 2;
+}
+
+/* Service until all requests are posted, return the completions count */
+static int service_all(void) {
+	int posted = 0, ret;
+	do {
+		ret = SkyCPU_block_service(&device, 1);
+		if (ret < 0) {
+			perror("SkyCPU_block_service");
+			exit(2);
+		}
+		posted += ret;
+	} while (device.inflight);
+	return posted;
+}
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s (pc=%04x interrupts=%llu)\n", what,
+				runtime.program_counter,
+				(unsigned long long) device.interrupts);
+		++failures;
+	}
+}
+
+int main(void) {
+	char path[] = "/tmp/block_irqXXXXXX";
+	static uint8_t sector[SKYCPU_BLOCK_SECTOR];
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, sector, sizeof(sector)) != sizeof(sector)) {
+		perror(path);
+		return 2;
+	}
+	unlink(path);
+	SkyCPU_runtime_init(&runtime);
+	if (SkyCPU_block_init(&device, &runtime, fd, RING, ENTRIES, VECTOR)) {
+		fprintf(stderr, "io_uring not available\n");
+		return 2;
+	}
+	runtime.program_counter = RESUME;
+
+	/* Completion posted while armed: signaled at once */
+	arm(1);
+	queue_read(1);
+	check(service_all() == 1, "one completion posted");
+	check(runtime.program_counter == VECTOR && device.interrupts == 1,
+			"armed completion signaled");
+
+	/* Completion posted inside the handler (not armed): pending */
+	queue_read(2);
+	service_all();
+	check(device.interrupts == 1, "no interrupt while not armed");
+	handler_return();
+	check(runtime.program_counter == RESUME, "handler returned");
+
+	/* Re-armed, nothing new posted: the pending completion MUST be signaled */
+	arm(1);
+	check(SkyCPU_block_service(&device, 0) == 0, "nothing new posted");
+	check(runtime.program_counter == VECTOR && device.interrupts == 2,
+			"pending completion signaled once re-armed");
+	handler_return();
+	arm(1);
+	SkyCPU_block_service(&device, 0);
+	check(device.interrupts == 2, "signaled once only");
+
+	/* Completion posted while a skip is pending: signaled after the skip */
+	runtime.skip_next = 1;
+	queue_read(3);
+	service_all();
+	check(device.interrupts == 2, "no interrupt while a skip is pending");
+	runtime.skip_next = 0;
+	SkyCPU_block_service(&device, 0);
+	check(runtime.program_counter == VECTOR && device.interrupts == 3,
+			"pending completion signaled after the skip");
+	handler_return();
+
+	SkyCPU_block_free(&device);
+	close(fd);
+	printf("block: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Block device test (SkyCPU_block)
+#
+# block_irq play the guest side of a ring: completions posted while the interrupt
+# is not armed (inside the handler) or while a skip is pending MUST be signaled
+# once re-armed / after the skip, exactly once. block_io run READ / WRITE / FLUSH
+# requests over a pattern-filled backing file, invalid requests and a full
+# completion ring, built again with SKYCPU_PAGE_TRACKING (dirty pages, code events).
+#
+# Usage : tests/block/run.sh (CC and CFLAGS honored, Linux with io_uring only)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -I"$ROOT" "$HERE/block_irq.c" "$ROOT/FastSkyCPU.c" \
+	"$ROOT/SkyCPU_block.c" -o "$WORK/block_irq"
+"$WORK/block_irq"
+
+$CC $CFLAGS -I"$ROOT" "$HERE/block_io.c" "$ROOT/FastSkyCPU.c" \
+	"$ROOT/SkyCPU_block.c" -o "$WORK/block_io"
+"$WORK/block_io"
+
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -I"$ROOT" "$HERE/block_io.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_block.c" -o "$WORK/block_io_pages"
+"$WORK/block_io_pages"
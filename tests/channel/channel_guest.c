@@ -0,0 +1,200 @@
+/**
+ * @file channel_guest.c
+ * @brief Guest SEND / RECV stalls and scheduler check (SkyCPU_channel)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program run small guests exchanging messages through channels:\n
+ * - a SEND -> RECV pipeline (producer sum 10 ... 1 through a 4 messages channel, consumer send the sum to the\n
+ *   host) run by SkyCPU_channel_schedule(), which MUST stop once both guests are stalled for good,\n
+ * - SEND on a full channel, RECV on an empty one, on an unbound one and with a bits mode other than the channel\n
+ *   width: the instruction MUST not retire (PC unchanged, nothing sent or received, stall_reason set) and MUST\n
+ *   retire once the host fixed the channel.\n
+ * Exit status is 0 if all checks pass, 1 otherwise.\n
+ * \n
+ * Usage : channel_guest\n
+ * Build : cc -O2 -DSKYCPU_CHANNELS -I../.. channel_guest.c ../../FastSkyCPU.c ../../SkyCPU_channel.c -o channel_guest\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_channel.h"
+
+/* Producer: send 10 ... 1 then 0 on channel 0, then wait forever on channel 1 (never sent) */
+static const uint8_t producer[] = {
+	0x89, 0x00, 0xaa, /* 0x00: MOV.b r0, #10 */
+	0xd1, 0xa0, 0x00, /* 0x03: SEND.b #0, r0 */
+	0x21, 0x00, /* 0x06: DEC.b r0 */
+	0x45, 0x00, /* 0x08: SN.b r0 */
+	0x0a, 0x80, 0x00, 0x03, /* 0x0a: JMP.w #0x03 */
+	0xd1, 0xa0, 0xa0, /* 0x0e: SEND.b #0, #0 */
+	0xd5, 0x00, 0xa1 /* 0x11: RECV.b r0, #1 */
+};
+
+/* Consumer: sum channel 0 messages until 0, send the sum on channel 2, then RECV on unbound channel 3 */
+static const uint8_t consumer[] = {
+	0xd5, 0x01, 0xa0, /* 0x00: RECV.b r1, #0 */
+	0x4d, 0x02, 0x01, /* 0x03: ADD.b r2, r1 */
+	0x45, 0x01, /* 0x06: SN.b r1 */
+	0x0a, 0x80, 0x00, 0x00, /* 0x08: JMP.w #0x00 */
+	0xd1, 0xa2, 0x02, /* 0x0c: SEND.b #2, r2 */
+	0xd5, 0x03, 0xa3 /* 0x0f: RECV.b r3, #3 */
+};
+
+/* Stalls: SEND.w on a 8 bits channel, RECV.d on a 16 bits one, SEND.b on a full channel */
+static const uint8_t staller[] = {
+	0xd2, 0xa4, 0x00, /* 0x00: SEND.w #4, r0 */
+	0xd7, 0x05, 0xa5, /* 0x03: RECV.d r5, #5 */
+	0xd1, 0xa7, 0xa1, /* 0x06: SEND.b #7, #1 */
+	0xd5, 0x09, 0xa6 /* 0x09: RECV.b r9, #6 */
+};
+
+static int failures;
+
+static void on_event(uint32_t code) {
+	(void) code;
+}
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+static SkyCPU_channel_t* channel_new(const uint8_t width,
+		const uint32_t capacity) {
+	SkyCPU_channel_t* channel = aligned_alloc(SKYCPU_CHANNEL_ALIGN,
+			(SkyCPU_channel_size(capacity) + SKYCPU_CHANNEL_ALIGN - 1)
+					& ~(size_t) (SKYCPU_CHANNEL_ALIGN - 1));
+	if (!channel || SkyCPU_channel_init(channel, SKYCPU_CHANNEL_SPSC, width,
+			capacity)) {
+		printf("cannot create a channel\n");
+		exit(1);
+	}
+	return channel;
+}
+
+static void load(SkyCPU_runtime_t* runtime, const uint8_t* program,
+		const size_t size) {
+	SkyCPU_runtime_init(runtime);
+	SkyCPU_callback_setup(runtime, on_event, on_event);
+	memset(runtime->memory, 0, MEMORY_MASK + 1);
+	SkyCPU_memory_copy(runtime, program, size, 0);
+}
+
+/* Run one instruction of a guest expected to stall */
+static void expect_stall(SkyCPU_runtime_t* runtime, const uint8_t reason,
+		const uint16_t pc, const char* what) {
+	char message[128];
+	uint32_t retired = SkyCPU_channel_run(runtime, 1);
+	snprintf(message, sizeof(message), "%s (retired %u, stall %u, pc %04x)",
+			what, retired, runtime->stall_reason, runtime->program_counter);
+	check(!retired && runtime->stall_reason == reason
+			&& runtime->program_counter == pc, message);
+}
+
+/* Run one instruction of a guest expected to retire */
+static void expect_retire(SkyCPU_runtime_t* runtime, const uint16_t pc,
+		const char* what) {
+	uint32_t retired = SkyCPU_channel_run(runtime, 1);
+	check(retired == 1 && runtime->stall_reason == SKYCPU_STALL_NONE
+			&& runtime->program_counter == pc, what);
+}
+
+int main(void) {
+	static SkyCPU_runtime_t runtimes[3];
+	SkyCPU_runtime_t* pipeline[2] = { &runtimes[0], &runtimes[1] };
+	SkyCPU_channel_t *data = channel_new(1, 4), *sleep = channel_new(1, 4);
+	SkyCPU_channel_t *result = channel_new(1, 4), *narrow = channel_new(1, 4);
+	SkyCPU_channel_t *word = channel_new(2, 4), *wide = channel_new(4, 4);
+	SkyCPU_channel_t *full = channel_new(1, 2);
+	uint64_t retired;
+	uint32_t value;
+
+	/* Pipeline: scheduled until both guests stall for good */
+	load(&runtimes[0], producer, sizeof(producer));
+	load(&runtimes[1], consumer, sizeof(consumer));
+	SkyCPU_channel_bind(&runtimes[0], 0, data);
+	SkyCPU_channel_bind(&runtimes[0], 1, sleep);
+	SkyCPU_channel_bind(&runtimes[1], 0, data);
+	SkyCPU_channel_bind(&runtimes[1], 2, result);
+	retired = SkyCPU_channel_schedule(pipeline, 2, 3, 1000000);
+	check(retired > 0 && retired < 1000000, "scheduler stop once all guests are stalled");
+	check(SkyCPU_channel_schedule(pipeline, 2, 3, 1000000) == 0,
+			"stalled guests retire nothing");
+	check(runtimes[0].stall_reason == SKYCPU_STALL_EMPTY
+			&& runtimes[0].program_counter == 0x11, "producer stalled on an empty channel");
+	check(runtimes[1].stall_reason == SKYCPU_STALL_UNBOUND
+			&& runtimes[1].program_counter == 0x0f, "consumer stalled on an unbound channel");
+	check(SkyCPU_channel_receive(result, &value) && value == 55,
+			"sum of the pipeline messages");
+	check(!SkyCPU_channel_receive(data, &value), "pipeline channel drained");
+
+	/* Width mismatch: never masked, retire once the channel match */
+	load(&runtimes[2], staller, sizeof(staller));
+	runtimes[2].registers[0] = 0x12;
+	runtimes[2].registers[1] = 0x34;
+	SkyCPU_channel_bind(&runtimes[2], 4, narrow);
+	expect_stall(&runtimes[2], SKYCPU_STALL_WIDTH, 0x00, "SEND.w on a 8 bits channel");
+	check(!SkyCPU_channel_receive(narrow, &value), "nothing sent on a width mismatch");
+	SkyCPU_channel_bind(&runtimes[2], 4, word);
+	expect_retire(&runtimes[2], 0x03, "SEND.w on a 16 bits channel");
+	check(SkyCPU_channel_receive(word, &value) && value == 0x1234,
+			"16 bits message sent whole");
+
+	SkyCPU_channel_send(word, 0x5678);
+	SkyCPU_channel_bind(&runtimes[2], 5, word);
+	expect_stall(&runtimes[2], SKYCPU_STALL_WIDTH, 0x03, "RECV.d on a 16 bits channel");
+	check(SkyCPU_channel_receive(word, &value) && value == 0x5678,
+			"nothing received on a width mismatch");
+	SkyCPU_channel_bind(&runtimes[2], 5, wide);
+	expect_stall(&runtimes[2], SKYCPU_STALL_EMPTY, 0x03, "RECV.d on an empty channel");
+	SkyCPU_channel_send(wide, 0xDEADBEEFUL);
+	expect_retire(&runtimes[2], 0x06, "RECV.d on a 32 bits channel");
+	check(runtimes[2].registers[5] == 0xDE && runtimes[2].registers[6] == 0xAD
+			&& runtimes[2].registers[7] == 0xBE && runtimes[2].registers[8] == 0xEF,
+			"32 bits message received whole");
+
+	/* Full channel, then unbound one */
+	SkyCPU_channel_bind(&runtimes[2], 7, full);
+	SkyCPU_channel_send(full, 0xA);
+	SkyCPU_channel_send(full, 0xB);
+	expect_stall(&runtimes[2], SKYCPU_STALL_FULL, 0x06, "SEND on a full channel");
+	check(SkyCPU_channel_receive(full, &value) && value == 0xA, "full channel order");
+	expect_retire(&runtimes[2], 0x09, "SEND once room is made");
+	check(SkyCPU_channel_receive(full, &value) && value == 0xB
+			&& SkyCPU_channel_receive(full, &value) && value == 1,
+			"message sent after the stall");
+	expect_stall(&runtimes[2], SKYCPU_STALL_UNBOUND, 0x09, "RECV on an unbound channel");
+
+	free(data);
+	free(sleep);
+	free(result);
+	free(narrow);
+	free(word);
+	free(wide);
+	free(full);
+	printf("channel guest: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
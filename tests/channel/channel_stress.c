@@ -0,0 +1,182 @@
+/**
+ * @file channel_stress.c
+ * @brief Multi-threaded stress of the lock-free channels rings (SkyCPU_channel)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program push messages through small channels from host threads: one producer and one consumer on a\n
+ * SPSC channel, several producers and consumers on a MPMC channel. Every message MUST be received exactly once\n
+ * (no loss, no duplicate) and the messages of one producer MUST be received in order by each consumer.\n
+ * Build it with -fsanitize=thread to check the rings memory ordering too.\n
+ * Exit status is 0 if all checks pass, 1 otherwise.\n
+ * \n
+ * Usage : channel_stress [messages_per_producer]\n
+ * Build : cc -O2 -DSKYCPU_CHANNELS -I../.. channel_stress.c ../../FastSkyCPU.c ../../SkyCPU_channel.c -lpthread -o channel_stress\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "SkyCPU_channel.h"
+
+/* Threads and channels (message = producer << 24 | sequence) */
+#define MAX_THREADS 4
+#define CAPACITY 16
+#define SEQUENCE_MASK 0xFFFFFFUL
+
+typedef struct {
+	SkyCPU_channel_t* channel; /* Channel */
+	uint32_t index; /* Producer or consumer index */
+	uint32_t errors; /* Out of order messages (consumers) */
+} worker_t;
+
+static uint32_t messages = 200000;
+static uint32_t producers_count, expected_total;
+static uint32_t received_total; /* Atomic */
+static uint8_t* seen; /* Receptions count of each message (atomic) */
+static int failures;
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+static void* producer_main(void* argument) {
+	worker_t* worker = argument;
+	uint32_t sequence = 0;
+	while (sequence < messages) {
+		if (SkyCPU_channel_send(worker->channel,
+				(worker->index << 24) | sequence))
+			++sequence;
+		else
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void* consumer_main(void* argument) {
+	worker_t* worker = argument;
+	uint32_t next[MAX_THREADS], value, producer, sequence;
+	memset(next, 0, sizeof(next));
+	while (__atomic_load_n(&received_total, __ATOMIC_RELAXED) < expected_total) {
+		if (!SkyCPU_channel_receive(worker->channel, &value)) {
+			sched_yield();
+			continue;
+		}
+		producer = value >> 24;
+		sequence = value & SEQUENCE_MASK;
+		if (producer >= producers_count || sequence >= messages) {
+			++worker->errors;
+			continue;
+		}
+
+		/* Messages of a producer in order, each one once */
+		if (sequence < next[producer])
+			++worker->errors;
+		next[producer] = sequence + 1;
+		__atomic_fetch_add(&seen[producer * messages + sequence], 1,
+				__ATOMIC_RELAXED);
+		__atomic_fetch_add(&received_total, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/* Run producers and consumers over a new channel, check what was received */
+static void stress(const SkyCPU_channel_kind_t kind, const uint32_t producers,
+		const uint32_t consumers, const char* name) {
+	pthread_t threads[2 * MAX_THREADS];
+	worker_t workers[2 * MAX_THREADS];
+	SkyCPU_channel_t* channel;
+	uint32_t i, errors = 0, missing = 0, duplicated = 0;
+	char what[128];
+
+	/* Channel and receptions table */
+	channel = aligned_alloc(SKYCPU_CHANNEL_ALIGN,
+			(SkyCPU_channel_size(CAPACITY) + SKYCPU_CHANNEL_ALIGN - 1)
+					& ~(size_t) (SKYCPU_CHANNEL_ALIGN - 1));
+	if (!channel || SkyCPU_channel_init(channel, kind, 4, CAPACITY)) {
+		check(0, "channel creation");
+		free(channel);
+		return;
+	}
+	producers_count = producers;
+	expected_total = producers * messages;
+	received_total = 0;
+	seen = calloc(expected_total, 1);
+	if (!seen) {
+		check(0, "receptions table allocation");
+		free(channel);
+		return;
+	}
+
+	/* Consumers then producers */
+	for (i = 0; i < producers + consumers; ++i) {
+		workers[i].channel = channel;
+		workers[i].index = (i < consumers) ? i : i - consumers;
+		workers[i].errors = 0;
+		if (pthread_create(&threads[i], NULL,
+				(i < consumers) ? consumer_main : producer_main, &workers[i])) {
+			check(0, "thread creation");
+			exit(1);
+		}
+	}
+	for (i = 0; i < producers + consumers; ++i) {
+		pthread_join(threads[i], NULL);
+		errors += workers[i].errors;
+	}
+
+	/* Each message received once */
+	for (i = 0; i < expected_total; ++i) {
+		if (!seen[i])
+			++missing;
+		else if (seen[i] > 1)
+			++duplicated;
+	}
+	snprintf(what, sizeof(what), "%s: %u out of order, %u lost, %u duplicated",
+			name, errors, missing, duplicated);
+	check(!errors && !missing && !duplicated, what);
+	check(!SkyCPU_channel_receive(channel, &i), "channel empty at the end");
+	printf("%s: %u producers, %u consumers, %u messages\n", name, producers,
+			consumers, expected_total);
+	free(seen);
+	free(channel);
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1)
+		messages = strtoul(argv[1], NULL, 0);
+	if (!messages || messages > SEQUENCE_MASK + 1) {
+		fprintf(stderr, "Usage: %s [messages_per_producer]\n", argv[0]);
+		return 1;
+	}
+
+	stress(SKYCPU_CHANNEL_SPSC, 1, 1, "spsc");
+	stress(SKYCPU_CHANNEL_MPMC, 1, 1, "mpmc 1x1");
+	stress(SKYCPU_CHANNEL_MPMC, MAX_THREADS, MAX_THREADS, "mpmc");
+
+	printf("channel stress: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
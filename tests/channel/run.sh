@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Channels test (SkyCPU_channel)
+#
+# channel_stress push messages through SPSC and MPMC rings from host threads: every
+# message MUST be received once and in order per producer. It is built again with
+# -fsanitize=thread when the compiler support it. channel_guest run SEND / RECV
+# guests: a pipeline scheduled until all guests stall, then full, empty, unbound and
+# width mismatch stalls (instruction not retired until the host fix the channel).
+#
+# Usage : tests/channel/run.sh [messages_per_producer] (CC and CFLAGS honored)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+MESSAGES=${1:-200000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -DSKYCPU_CHANNELS -I"$ROOT" "$HERE/channel_guest.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_channel.c" -o "$WORK/channel_guest"
+"$WORK/channel_guest"
+
+$CC $CFLAGS -DSKYCPU_CHANNELS -I"$ROOT" "$HERE/channel_stress.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_channel.c" -lpthread \
+	-o "$WORK/channel_stress"
+"$WORK/channel_stress" "$MESSAGES"
+
+# Same stress under ThreadSanitizer (skipped if not supported)
+if $CC $CFLAGS -fsanitize=thread -DSKYCPU_CHANNELS -I"$ROOT" \
+		"$HERE/channel_stress.c" "$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_channel.c" \
+		-lpthread -o "$WORK/channel_stress_tsan" 2> /dev/null \
+		&& "$WORK/channel_stress_tsan" 1 > /dev/null 2>&1; then
+	TSAN_OPTIONS=halt_on_error=1 "$WORK/channel_stress_tsan" $((MESSAGES / 10))
+else
+	echo "channel stress: ThreadSanitizer not available, skipped"
+fi
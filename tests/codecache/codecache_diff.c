@@ -0,0 +1,148 @@
+/**
+ * @file codecache_diff.c
+ * @brief Differential check of the decoded code cache (SkyCPU_codecache) against the interpreter
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program load a guest image (at address 0) into three instances, run the first one with the interpreter\n
+ * and the two others with the code cache (two views of the same cache: the second one run on shared pages)\n
+ * for the same instructions budget, in random slices, then compare everything: registers, PC, SP, pending\n
+ * skip, memory and the sequence of INT / BRK callbacks codes.\n
+ * Exit status is 0 if all instances match, 1 on mismatch, 2 on error.\n
+ * \n
+ * Usage : codecache_diff image.bin max_instructions seed\n
+ * Build : cc -O2 -DSKYCPU_PAGE_TRACKING -I../.. codecache_diff.c ../../FastSkyCPU.c ../../SkyCPU_codecache.c -lpthread -o codecache_diff\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FastSkyCPU.h"
+#include "SkyCPU_codecache.h"
+
+/* Instances (interpreter, first view, second view) */
+#define INSTANCES 3
+
+/* Callbacks codes log (INT and BRK, in order, per instance) */
+#define MAX_EVENTS 4096
+static uint32_t events[INSTANCES][MAX_EVENTS];
+static uint32_t events_count[INSTANCES];
+static int current;
+
+static void on_event(uint32_t code) {
+	if (events_count[current] < MAX_EVENTS)
+		events[current][events_count[current]++] = code;
+}
+
+/**
+ * Compare an instance with the interpreted one
+ *
+ * @param name Image name (for the report)
+ * @param interpreted Reference instance
+ * @param cached Instance run with the code cache
+ * @param instance Instance number (events log)
+ * @return 0 if both instances match, 1 otherwise
+ */
+static int compare(const char* name, const SkyCPU_runtime_t* interpreted,
+		const SkyCPU_runtime_t* cached, const int instance) {
+	if (!memcmp(interpreted->registers, cached->registers,
+			sizeof(interpreted->registers))
+			&& interpreted->program_counter == cached->program_counter
+			&& interpreted->stack_pointer == cached->stack_pointer
+			&& interpreted->skip_next == cached->skip_next
+			&& !memcmp(interpreted->memory, cached->memory, MEMORY_MASK + 1)
+			&& events_count[0] == events_count[instance]
+			&& !memcmp(events[0], events[instance],
+					events_count[0] * sizeof(uint32_t)))
+		return 0;
+	printf("%s: DIFF view=%d pc=%04x/%04x sp=%04x/%04x events=%u/%u\n", name,
+			instance, interpreted->program_counter, cached->program_counter,
+			interpreted->stack_pointer, cached->stack_pointer, events_count[0],
+			events_count[instance]);
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_runtime_t runtimes[INSTANCES];
+	static SkyCPU_codecache_view_t views[INSTANCES];
+	static uint8_t image[MEMORY_MASK + 1];
+	SkyCPU_codecache_t cache;
+	uint32_t max_instructions, retired, slice, i;
+	size_t size;
+	FILE* file;
+	int status = 0;
+
+	if (argc != 4) {
+		fprintf(stderr, "Usage: %s image.bin max_instructions seed\n", argv[0]);
+		return 2;
+	}
+	max_instructions = strtoul(argv[2], NULL, 0);
+	srand(strtoul(argv[3], NULL, 0));
+
+	/* Same image in all instances */
+	file = fopen(argv[1], "rb");
+	if (!file) {
+		perror(argv[1]);
+		return 2;
+	}
+	size = fread(image, 1, sizeof(image), file);
+	fclose(file);
+	if (SkyCPU_codecache_init(&cache, 64)) {
+		fprintf(stderr, "cannot create the code cache\n");
+		return 2;
+	}
+	for (i = 0; i < INSTANCES; ++i) {
+		SkyCPU_runtime_init(&runtimes[i]);
+		SkyCPU_callback_setup(&runtimes[i], on_event, on_event);
+		SkyCPU_memory_copy(&runtimes[i], image, size, 0);
+	}
+
+	/* Reference run */
+	current = 0;
+	for (i = 0; i < max_instructions; ++i)
+		SkyCPU_fetch_and_execute(&runtimes[0]);
+
+	/* Cached runs (random slices, the second view join pages decoded by the first one) */
+	for (current = 1; current < INSTANCES; ++current) {
+		SkyCPU_codecache_view_init(&views[current], &cache, &runtimes[current]);
+		for (retired = 0; retired < max_instructions; retired += slice) {
+			slice = 1 + rand() % 64;
+			if (slice > max_instructions - retired)
+				slice = max_instructions - retired;
+			if (SkyCPU_codecache_run(&views[current], slice, NULL) != slice) {
+				printf("%s: view=%d stopped early\n", argv[1], current);
+				status = 1;
+				break;
+			}
+		}
+		status |= compare(argv[1], &runtimes[0], &runtimes[current], current);
+	}
+
+	/* Cleanup */
+	for (i = 1; i < INSTANCES; ++i)
+		SkyCPU_codecache_view_free(&views[i]);
+	SkyCPU_codecache_free(&cache);
+	if (!status)
+		printf("%s: MATCH pc=%04x events=%u\n", argv[1],
+				runtimes[0].program_counter, events_count[0]);
+	return status;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Differential test of the decoded code cache (SkyCPU_codecache)
+#
+# Every image of the AOT and optimizer corpora is run for the same instructions
+# budget with the interpreter and with two views of one code cache, in random
+# slices (codecache_diff). All instances MUST match (registers, PC, SP, pending
+# skip, memory, INT / BRK codes).
+#
+# Usage : tests/codecache/run.sh [max_instructions] (CC and CFLAGS honored)
+#
+# The random images of tests/aot/corpus/ write over their own code: the check and
+# rewrite paths of the cache are covered too.
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+BUDGET=${1:-2000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Differential driver
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -I"$ROOT" "$HERE/codecache_diff.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_codecache.c" -lpthread \
+	-o "$WORK/codecache_diff"
+
+# Compare every image (seeded by its position)
+passed=0
+failed=0
+seed=0
+for image in "$ROOT"/tests/aot/corpus/*.bin "$ROOT"/tests/opt/corpus/*.bin; do
+	seed=$((seed + 1))
+	if "$WORK/codecache_diff" "$image" "$BUDGET" "$seed"; then
+		passed=$((passed + 1))
+	else
+		failed=$((failed + 1))
+	fi
+done
+
+echo "codecache: $passed passed, $failed failed"
+test "$failed" -eq 0
@@ -0,0 +1,78 @@
+/**
+ * @file cxx_reject.cpp
+ * @brief Sources the C++ front-end MUST reject at compile time (FastSkyCPU.hpp)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * Each REJECT_CASE (1 to N) is a source which MUST fail to compile, with the error message given after\n
+ * "expect:". REJECT_CASE 0 MUST compile (the harness itself works). tests/cxx/run.sh compile every case.\n
+ * \n
+ * Usage : c++ -std=c++20 -fsyntax-only -I../.. -DREJECT_CASE=n cxx_reject.cpp\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include "FastSkyCPU.hpp"
+
+#if REJECT_CASE == 0 /* expect: nothing */
+constexpr auto program = SkyCPU::assemble<"MOV.b r0, #1\nBRK.b r0">();
+#elif REJECT_CASE == 1 /* expect: unknown mnemonic */
+constexpr auto program = SkyCPU::assemble<"FOO.b r0">();
+#elif REJECT_CASE == 2 /* expect: missing bits mode */
+constexpr auto program = SkyCPU::assemble<"MOV r0, r1">();
+#elif REJECT_CASE == 3 /* expect: bad bits mode */
+constexpr auto program = SkyCPU::assemble<"MOV.q r0, r1">();
+#elif REJECT_CASE == 4 /* expect: wrong operands count */
+constexpr auto program = SkyCPU::assemble<"MOV.b r0">();
+#elif REJECT_CASE == 5 /* expect: missing operand */
+constexpr auto program = SkyCPU::assemble<"MOV.b r0,">();
+#elif REJECT_CASE == 6 /* expect: bad operand */
+constexpr auto program = SkyCPU::assemble<"MOV.b r32, r0">();
+#elif REJECT_CASE == 7 /* expect: constant out of range */
+constexpr auto program = SkyCPU::assemble<"MOV.b r0, #256">();
+#elif REJECT_CASE == 8 /* expect: constant out of range */
+constexpr auto program = SkyCPU::assemble<"MOV.w r0, #-32769">();
+#elif REJECT_CASE == 9 /* expect: address out of range */
+constexpr auto program = SkyCPU::assemble<"MOV.b r0, [#0x10000]">();
+#elif REJECT_CASE == 10 /* expect: destination is a constant */
+constexpr auto program = SkyCPU::assemble<"MOV.b #1, r0">();
+#elif REJECT_CASE == 11 /* expect: destination is a constant */
+constexpr auto program = SkyCPU::assemble<"CXH.b r0, #1">();
+#elif REJECT_CASE == 12 /* expect: unknown label */
+constexpr auto program = SkyCPU::assemble<"JMP.w #nowhere">();
+#elif REJECT_CASE == 13 /* expect: duplicate label */
+constexpr auto program = SkyCPU::assemble<"here: NOP\nhere: NOP">();
+#elif REJECT_CASE == 14 /* expect: bad label name */
+constexpr auto program = SkyCPU::assemble<"1st: NOP">();
+#elif REJECT_CASE == 15 /* expect: unknown directive */
+constexpr auto program = SkyCPU::assemble<".long 1">();
+#elif REJECT_CASE == 16 /* expect: program too large */
+constexpr auto program = SkyCPU::assemble<".word 1, 2", 0xFFFE>();
+#elif REJECT_CASE == 17 /* expect: unknown mnemonic */
+constexpr auto program = SkyCPU::assemble<"TRAP">();
+#elif REJECT_CASE == 18 /* expect: 8, 16 or 32 bits wide */
+std::uint64_t value(const SkyCPU::Runtime<>& runtime) {
+	return runtime.reg<std::uint64_t>(0);
+}
+#elif REJECT_CASE == 19 /* expect: deleted */
+void copy(const SkyCPU::Runtime<>& runtime) {
+	SkyCPU::Runtime<> other(runtime);
+}
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file cxx_runtime.cpp
+ * @brief C++ front-end check (FastSkyCPU.hpp assembler and runtime wrapper)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program check SkyCPU::assemble<>() at compile time (static_assert on the emitted bytes of programs\n
+ * covering every operand encoding, labels, origin and directives), then run an assembled program in a\n
+ * SkyCPU::Runtime with lambdas as INT / BRK callbacks: codes received in order, registers, PC and SP state,\n
+ * and callbacks still called after the runtime was moved.\n
+ * Exit status is 0 if all checks pass, 1 otherwise.\n
+ * \n
+ * Usage : cxx_runtime\n
+ * Build : c++ -std=c++20 -O2 -I../.. cxx_runtime.cpp -o cxx_runtime\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <cstdio>
+#include <vector>
+#include "FastSkyCPU.hpp"
+
+namespace {
+
+template <std::size_t N>
+constexpr bool bytes(const std::array<std::uint8_t, N>& program,
+		const std::array<std::uint8_t, N>& expected) {
+	return program == expected;
+}
+
+/* Operands: registers, inline / full / negative constants, pointers, PC and SP */
+static_assert(bytes(SkyCPU::assemble<"BRK.b #42">(), { 0x15, 0x80, 0x2a }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b r0, #5">(), { 0x89, 0x00, 0xa5 }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b r0, #31">(), { 0x89, 0x00, 0xbf }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b r0, #32">(), { 0x89, 0x00, 0x80, 0x20 }));
+static_assert(bytes(SkyCPU::assemble<"mov.B r1, #-1">(), { 0x89, 0x01, 0x80, 0xff }));
+static_assert(bytes(SkyCPU::assemble<"MOV.w r2, #0x1234">(),
+		{ 0x8a, 0x02, 0x80, 0x12, 0x34 }));
+static_assert(bytes(SkyCPU::assemble<"MOV.d r4, #0xDEADBEEF">(),
+		{ 0x8b, 0x04, 0x80, 0xde, 0xad, 0xbe, 0xef }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b [r3], r31">(), { 0x89, 0x43, 0x1f }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b r0, [#4]">(), { 0x89, 0x00, 0xe4 }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b [#0x1000], r0">(),
+		{ 0x89, 0xc0, 0x10, 0x00, 0x00 }));
+static_assert(bytes(SkyCPU::assemble<"MOV.w r0, SP">(), { 0x8a, 0x00, 0x21 }));
+static_assert(bytes(SkyCPU::assemble<"MOV.b r0, [PC]">(), { 0x89, 0x00, 0x60 }));
+static_assert(bytes(SkyCPU::assemble<"NOP\nRET">(), { 0x01, 0x05 }));
+
+/* Comments, labels (always full constants, origin applied) and directives */
+static_assert(bytes(SkyCPU::assemble<"start: JMP.w #start ; loop", 0x200>(),
+		{ 0x0a, 0x80, 0x02, 0x00 }));
+static_assert(bytes(SkyCPU::assemble<"JMP.w #data\ndata: .byte 1, 0xFF\n.word 0xBEEF">(),
+		{ 0x0a, 0x80, 0x00, 0x04, 0x01, 0xff, 0xbe, 0xef }));
+
+/* INT r0 for r0 = 3 ... 1, then r4:r5 = 0x1234, BRK 42 and loop forever */
+constexpr auto program = SkyCPU::assemble<R"(
+		MOV.b r0, #3
+loop:	INT.b r0
+		DEC.b r0
+		SN.b r0         ; skip the jump once r0 is 0
+		JMP.w #loop
+		MOV.w r4, #0x1234
+		BRK.b #42
+end:	JMP.w #end
+)">();
+static_assert(bytes(program, { 0x89, 0x00, 0xa3, 0x19, 0x00, 0x21, 0x00, 0x45,
+		0x00, 0x0a, 0x80, 0x00, 0x03, 0x8a, 0x04, 0x80, 0x12, 0x34, 0x15, 0x80,
+		0x2a, 0x0a, 0x80, 0x00, 0x15 }));
+
+int failures;
+
+void check(const bool condition, const char* what) {
+	if (!condition) {
+		std::printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+} /* namespace */
+
+int main() {
+	std::vector<std::uint32_t> interrupts, breakpoints;
+	auto on_interrupt = [&](const std::uint32_t code) {
+		interrupts.push_back(code);
+	};
+	auto on_breakpoint = [&](const std::uint32_t code) {
+		breakpoints.push_back(code);
+	};
+	SkyCPU::Runtime runtime(on_interrupt, on_breakpoint);
+
+	/* Fresh instance */
+	check(runtime.pc() == 0 && runtime.sp() == MEMORY_MASK, "initial PC and SP");
+	runtime.load(program);
+	check(runtime.memory()[0] == 0x89 && runtime.memory()[program.size() - 1] == 0x15,
+			"program loaded");
+
+	/* Run until the BRK: INT codes in order, one BRK, registers and PC */
+	const std::uint64_t count = runtime.run_until([&] {
+		return !breakpoints.empty();
+	}, 1000);
+	check(count == 15, "instructions executed until the BRK (skipped JMP included)");
+	check(interrupts == std::vector<std::uint32_t> { 3, 2, 1 }, "INT codes");
+	check(breakpoints == std::vector<std::uint32_t> { 42 }, "BRK code");
+	check(runtime.pc() == 0x15, "PC after the BRK");
+	check(runtime.reg<std::uint8_t>(0) == 0, "r0 counted down");
+	check(runtime.reg<std::uint16_t>(4) == 0x1234 && runtime.reg<std::uint8_t>(4) == 0x12
+			&& runtime.reg<std::uint8_t>(5) == 0x34, "16 bits register big-endian");
+	check(runtime.sp() == MEMORY_MASK, "SP untouched");
+	runtime.run(10);
+	check(runtime.pc() == 0x15 && breakpoints.size() == 1, "endless loop");
+
+	/* Registers and PC written by the host */
+	runtime.set_reg<std::uint32_t>(8, 0xDEADBEEF);
+	check(runtime.reg<std::uint8_t>(8) == 0xDE && runtime.reg<std::uint8_t>(11) == 0xEF
+			&& runtime.get()->registers[9] == 0xAD, "32 bits register write");
+	runtime.set_reg<std::uint8_t>(0, 1);
+	runtime.set_pc(0x03);
+	runtime.step();
+	check(interrupts.size() == 4 && interrupts.back() == 1 && runtime.pc() == 0x05,
+			"step from a host set PC");
+
+	/* Moved runtime: same instance, same callbacks */
+	SkyCPU::Runtime moved(std::move(runtime));
+	moved.set_pc(0);
+	moved.run_until([&] {
+		return breakpoints.size() == 2;
+	}, 1000);
+	check(interrupts.size() == 7 && breakpoints.size() == 2 && moved.pc() == 0x15,
+			"callbacks called after a move");
+
+	std::printf("cxx: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
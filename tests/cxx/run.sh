@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# C++ front-end test (FastSkyCPU.hpp)
+#
+# cxx_runtime check the bytes emitted by SkyCPU::assemble<>() with static_assert (a
+# wrong encoding fail the build), then run a program with lambdas as INT / BRK
+# callbacks. Every case of cxx_reject MUST fail to compile with its expected error
+# (case 0 MUST compile).
+#
+# Usage : tests/cxx/run.sh (CXX and CXXFLAGS honored)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CXX -std=c++20 $CXXFLAGS -Wall -I"$ROOT" "$HERE/cxx_runtime.cpp" \
+	-o "$WORK/cxx_runtime"
+"$WORK/cxx_runtime"
+
+# Rejected sources (case number and expected message from the "expect:" comments)
+failures=0
+cases=0
+sed -n 's|^#.*if REJECT_CASE == \([0-9]*\) /\* expect: \(.*\) \*/$|\1:\2|p' \
+		"$HERE/cxx_reject.cpp" > "$WORK/cases"
+while IFS=: read -r number message; do
+	cases=$((cases + 1))
+	if $CXX -std=c++20 -fsyntax-only -I"$ROOT" -DREJECT_CASE="$number" \
+			"$HERE/cxx_reject.cpp" > "$WORK/output" 2>&1; then
+		if [ "$number" -ne 0 ]; then
+			echo "FAIL: case $number compiled (expected: $message)"
+			failures=$((failures + 1))
+		fi
+	elif [ "$number" -eq 0 ] || ! grep -q "$message" "$WORK/output"; then
+		echo "FAIL: case $number rejected without \"$message\":"
+		head -n 20 "$WORK/output"
+		failures=$((failures + 1))
+	fi
+done < "$WORK/cases"
+if [ "$failures" -ne 0 ] || [ "$cases" -lt 2 ]; then
+	echo "cxx reject: FAILED"
+	exit 1
+fi
+echo "cxx reject: $((cases - 1)) sources rejected"
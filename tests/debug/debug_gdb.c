@@ -0,0 +1,285 @@
+/**
+ * @file debug_gdb.c
+ * @brief GDB stub and debugger check (SkyCPU_gdb + SkyCPU_debug)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program serve a small guest with SkyCPU_gdb_serve() on a Unix socket (stub thread) and play GDB: canned\n
+ * remote serial protocol packets are sent and every reply is checked. It cover packets framing (checksum, NAK),\n
+ * registers and memory packets (malformed g/G/m/M payloads MUST be rejected without partial writes),\n
+ * breakpoints (TRAP patched, hidden from memory reads, stepped over, pages marked dirty and code events raised),\n
+ * write watchpoints (lengths checked, stop address reported), single step, stray TRAP, Ctrl-C while running and\n
+ * while stopped, and detach (original code restored).\n
+ * Exit status is 0 if all checks pass, 1 otherwise.\n
+ * \n
+ * Usage : debug_gdb\n
+ * Build : cc -O2 -DSKYCPU_DEBUGGER -I../.. debug_gdb.c ../../FastSkyCPU.c ../../SkyCPU_debug.c ../../SkyCPU_gdb.c -lpthread -o debug_gdb\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "SkyCPU_debug.h"
+#include "SkyCPU_gdb.h"
+
+/* Guest program */
+static const uint8_t program[] = {
+	0x89, 0x00, 0xa5, /* 0x00: MOV.b r0, #5 */
+	0x89, 0xc0, 0x10, 0x00, 0x00, /* 0x03: MOV.b [#0x1000], r0 */
+	0x1d, 0x00, /* 0x08: INC.b r0 */
+	0x89, 0xc0, 0x10, 0x01, 0x00, /* 0x0a: MOV.b [#0x1001], r0 */
+	0x0a, 0x80, 0x00, 0x0f, /* 0x0f: JMP.w #0x0f */
+	0xfc /* 0x13: TRAP (no breakpoint) */
+};
+
+static SkyCPU_runtime_t runtime;
+static SkyCPU_debugger_t debugger;
+static int listen_fd, served, failures;
+
+static void on_interrupt(uint32_t icode) {
+	(void) icode;
+}
+
+static void on_breakpoint(uint32_t bcode) {
+	(void) bcode;
+}
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+/* Stub thread (serve one GDB session) */
+static void* stub_main(void* argument) {
+	(void) argument;
+	served = SkyCPU_gdb_serve(&debugger, listen_fd);
+	return NULL;
+}
+
+/* Send raw bytes */
+static void send_raw(const int fd, const char* data) {
+	if (write(fd, data, strlen(data)) != (ssize_t) strlen(data))
+		check(0, "write to the stub");
+}
+
+/* Send a framed packet ($data#checksum) */
+static void send_packet(const int fd, const char* data) {
+	char buffer[4200];
+	uint8_t checksum = 0;
+	size_t i = 0;
+	for (; data[i]; ++i)
+		checksum += (uint8_t) data[i];
+	snprintf(buffer, sizeof(buffer), "$%s#%02x", data, checksum);
+	send_raw(fd, buffer);
+}
+
+/* Receive a reply packet (acks skipped, checksum checked), NULL on error */
+static const char* receive_reply(const int fd) {
+	static char reply[4200];
+	size_t length = 0;
+	uint8_t checksum = 0;
+	char c, sum[3] = { 0, 0, 0 };
+
+	/* Packet start, data, then checksum */
+	do {
+		if (read(fd, &c, 1) != 1)
+			return NULL;
+	} while (c != '$');
+	for (;;) {
+		if (read(fd, &c, 1) != 1)
+			return NULL;
+		if (c == '#')
+			break;
+		if (length < sizeof(reply) - 1) {
+			reply[length++] = c;
+			checksum += (uint8_t) c;
+		}
+	}
+	reply[length] = '\0';
+	if (read(fd, sum, 1) != 1 || read(fd, sum + 1, 1) != 1
+			|| strtoul(sum, NULL, 16) != checksum)
+		return NULL;
+	return reply;
+}
+
+/* Send a packet and check the reply */
+static void expect(const int fd, const char* command, const char* expected) {
+	const char* reply;
+	send_packet(fd, command);
+	reply = receive_reply(fd);
+	if (!reply || strcmp(reply, expected)) {
+		printf("FAIL: %s -> \"%s\" (expected \"%s\")\n", command,
+				reply ? reply : "(no reply)", expected);
+		++failures;
+	}
+}
+
+int main(void) {
+	struct sockaddr_un address;
+	char path[64], command[128];
+	const char* reply;
+	pthread_t stub;
+	int fd;
+	char c;
+
+	/* Guest and debugger */
+	SkyCPU_runtime_init(&runtime);
+	SkyCPU_callback_setup(&runtime, on_interrupt, on_breakpoint);
+	memset(runtime.memory, 0, MEMORY_MASK + 1);
+	SkyCPU_memory_copy(&runtime, program, sizeof(program), 0);
+	SkyCPU_debug_init(&debugger, &runtime);
+
+	/* Stub on a Unix socket, then connect as GDB */
+	snprintf(path, sizeof(path), "/tmp/skycpu_debug_%d.sock", (int) getpid());
+	listen_fd = SkyCPU_gdb_listen(path);
+	if (listen_fd < 0) {
+		perror(path);
+		return 1;
+	}
+	if (pthread_create(&stub, NULL, stub_main, NULL))
+		return 1;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address))) {
+		perror(path);
+		return 1;
+	}
+
+	/* Framing: bad checksum NAKed, good packet ACKed */
+	send_raw(fd, "$qSupported#00");
+	check(read(fd, &c, 1) == 1 && c == '-', "bad checksum answered '-'");
+	send_packet(fd, "qSupported");
+	check(read(fd, &c, 1) == 1 && c == '+', "good checksum answered '+'");
+	reply = receive_reply(fd);
+	check(reply && !strcmp(reply, "PacketSize=fff;swbreak+"), "qSupported reply");
+	expect(fd, "?", "S05");
+	expect(fd, "Hg0", "OK");
+	expect(fd, "vMustReplyEmpty", "");
+
+	/* Registers (r0 ... r31, PC, SP) */
+	send_packet(fd, "g");
+	reply = receive_reply(fd);
+	check(reply && strlen(reply) == (32 + 2 + 2) * 2
+			&& !strncmp(reply + 64, "0000", 4), "g reply (PC 0)");
+	expect(fd, "P5=a7", "OK");
+	expect(fd, "p5", "a7");
+	expect(fd, "P5=z7", "E01");
+	expect(fd, "p5", "a7");
+	expect(fd, "p22", "E01");
+	expect(fd, "G00", "E01");
+	strcpy(command, "G");
+	memset(command + 1, '0', (32 + 2 + 2) * 2);
+	command[1 + (32 + 2 + 2) * 2] = '\0';
+	command[1 + 10] = 'x';
+	expect(fd, command, "E01");
+	expect(fd, "p5", "a7");
+	command[1 + 10] = '0';
+	expect(fd, command, "OK");
+	expect(fd, "p5", "00");
+
+	/* Memory: no partial write on bad hex or short payload */
+	expect(fd, "m0,3", "8900a5");
+	expect(fd, "M1000,2:aabb", "OK");
+	expect(fd, "m1000,2", "aabb");
+	expect(fd, "M1000,2:11z2", "E01");
+	expect(fd, "M1000,2:11", "E01");
+	expect(fd, "M1000:11", "E01");
+	expect(fd, "m1000,2", "aabb");
+	expect(fd, "M1000,2:0000", "OK");
+
+	/* Breakpoint: TRAP patched (hidden from m), page dirty, code event raised */
+	runtime.page_flags[0] = SKYCPU_PAGE_CODE;
+	runtime.page_events = 0;
+	expect(fd, "Z0,8,1", "OK");
+	check(runtime.memory[8] == (63 << 2), "TRAP patched");
+	check(runtime.page_flags[0] & SKYCPU_PAGE_DIRTY, "patched page dirty");
+	check(runtime.page_events & SKYCPU_PAGE_CODE, "patched code page event");
+	check(!(runtime.page_events & SKYCPU_PAGE_WATCH), "no watch event for a patch");
+	expect(fd, "m8,1", "1d");
+	expect(fd, "c", "T05swbreak:;");
+	expect(fd, "p20", "0008");
+	expect(fd, "p0", "05");
+	expect(fd, "m1000,1", "05");
+
+	/* Debugger write: page dirty */
+	runtime.page_flags[0x10] = 0;
+	expect(fd, "M1002,1:42", "OK");
+	check(runtime.page_flags[0x10] & SKYCPU_PAGE_DIRTY, "written page dirty");
+
+	/* Watchpoint: lengths checked, stop address reported (breakpoint stepped over) */
+	expect(fd, "Z2,1001,0", "E01");
+	expect(fd, "Z2,1001,101", "E01");
+	expect(fd, "Z2,1001,9", "E01");
+	expect(fd, "Z2,1001,1", "OK");
+	expect(fd, "M1001,1:00", "OK");
+	expect(fd, "c", "T05watch:1001;");
+	expect(fd, "p20", "000f");
+	expect(fd, "m1001,1", "06");
+	expect(fd, "z2,1001,2", "E0E");
+	expect(fd, "z2,1001,1", "OK");
+
+	/* Single step (JMP to itself) */
+	expect(fd, "s", "S05");
+	expect(fd, "p20", "000f");
+
+	/* Ctrl-C while running (endless loop), then while stopped */
+	send_packet(fd, "c");
+	send_raw(fd, "\x03");
+	reply = receive_reply(fd);
+	check(reply && !strcmp(reply, "S02"), "Ctrl-C while running");
+	send_raw(fd, "\x03");
+	reply = receive_reply(fd);
+	check(reply && !strcmp(reply, "S02"), "Ctrl-C while stopped");
+	expect(fd, "?", "S02");
+
+	/* Stray TRAP (resume address) */
+	expect(fd, "c13", "S04");
+
+	/* Breakpoint removed: original opcode restored */
+	expect(fd, "z0,8,1", "OK");
+	expect(fd, "z0,8,1", "E0E");
+	check(runtime.memory[8] == 0x1d, "original opcode restored");
+	expect(fd, "Z0,3,1", "OK");
+	expect(fd, "Z3,3,1", "");
+
+	/* Detach: remaining breakpoints removed */
+	expect(fd, "D", "OK");
+	pthread_join(stub, NULL);
+	check(served == 0, "detach end the session");
+	check(runtime.memory[3] == 0x89, "breakpoints removed on detach");
+	check(!debugger.breakpoints_count && !debugger.watchpoints_count,
+			"debugger empty after detach");
+	close(fd);
+	close(listen_fd);
+	unlink(path);
+
+	printf("debug: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
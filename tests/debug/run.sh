@@ -0,0 +1,23 @@
+#!/bin/sh
+#
+# GDB stub and debugger test (SkyCPU_gdb + SkyCPU_debug)
+#
+# debug_gdb serve a small guest on a Unix socket and play GDB with canned packets:
+# every reply MUST match (framing, registers, memory, breakpoints, watchpoints,
+# step, Ctrl-C, stray TRAP, detach), malformed packets MUST not write anything.
+#
+# Usage : tests/debug/run.sh (CC and CFLAGS honored)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -DSKYCPU_DEBUGGER -I"$ROOT" "$HERE/debug_gdb.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_debug.c" "$ROOT/SkyCPU_gdb.c" \
+	-lpthread -o "$WORK/debug_gdb"
+timeout 60 "$WORK/debug_gdb"
@@ -0,0 +1,239 @@
+/**
+ * @file dedup_pages.c
+ * @brief Sharing, copy-on-write, zero pages and release check of the pages deduplication (SkyCPU_dedup)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program allocate four instances from a pages store, load the same code and data pages (plus one page\n
+ * of its own and zeroed pages) into each of them, then check that a full scan share the identical pages, keep\n
+ * the unique ones private and drop the zeroed ones without changing what the guests see.\n
+ * A guest then write into a shared page and into a dropped page: only its own memory MUST change, the next scan\n
+ * MUST forget both pages. Instances are released while the scan cursor is on them, before them or on the moved\n
+ * last instance: the cursor MUST keep pointing at the same instance and page (or at the start of the moved\n
+ * instance), and once all instances are released the store MUST be empty.\n
+ * Exit status is 0 if all checks pass, 1 otherwise.\n
+ * \n
+ * Usage : dedup_pages\n
+ * Build : cc -O2 -I../.. dedup_pages.c ../../FastSkyCPU.c ../../SkyCPU_dedup.c -lpthread -o dedup_pages\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_dedup.h"
+#include "Endian_utility.h"
+
+/* Instances and host pages layout (page 0: code, page 1: same data, page 2: own data, others: zeroed) */
+#define INSTANCES 4
+#define CODE_PAGE 0
+#define DATA_PAGE 1
+#define OWN_PAGE 2
+#define ZERO_PAGE 3
+
+/* Guest program (write into the shared data page and into a dropped page, then BRK #1) */
+static uint8_t program[] = {
+	0x89, 0xc0, 0x00, 0x00, 0x80, 0x77, /* MOV.b [#data + 5], #0x77 */
+	0x89, 0xc0, 0x00, 0x00, 0x80, 0x55, /* MOV.b [#zero], #0x55 */
+	0x15, 0x80, 0x01 /* BRK.b #1 */
+};
+
+static SkyCPU_dedup_t store;
+static int failures, halted;
+
+static void on_interrupt(uint32_t icode) {
+	(void) icode;
+}
+
+static void on_breakpoint(uint32_t bcode) {
+	(void) bcode;
+	halted = 1;
+}
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+/* Expected content of an instance page */
+static void expected_page(uint8_t* page, const uint32_t index,
+		const uint32_t instance) {
+	uint32_t i;
+	memset(page, 0, store.page_size);
+	if (index == CODE_PAGE)
+		memcpy(page, program, sizeof(program));
+	else if (index == DATA_PAGE)
+		for (i = 0; i < store.page_size; ++i)
+			page[i] = i * 7 + 3;
+	else if (index == OWN_PAGE)
+		for (i = 0; i < store.page_size; ++i)
+			page[i] = (i * 13) ^ (instance + 1);
+}
+
+/* Check that every page of an instance hold its expected content */
+static int content_intact(SkyCPU_runtime_t* runtime, const uint32_t instance) {
+	static uint8_t page[MEMORY_MASK + 1];
+	uint32_t index;
+	for (index = 0; index < store.instance_pages; ++index) {
+		expected_page(page, index, instance);
+		if (memcmp(runtime->memory + index * store.page_size, page,
+				store.page_size))
+			return 0;
+	}
+	return 1;
+}
+
+/* Scan every page of every instance, twice (unstable then stable table) */
+static void full_scans(void) {
+	SkyCPU_dedup_scan(&store, 2 * store.instances_count * store.instance_pages);
+}
+
+/* Sum of the store pages references (MUST match pages_sharing) */
+static uint32_t references(void) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < store.used; ++i)
+		sum += store.references[i];
+	return sum;
+}
+
+/* Release an instance with the scan cursor set, check where the cursor ends */
+static void release_at(SkyCPU_runtime_t* released, const uint32_t cursor_instance,
+		const uint32_t cursor_page, SkyCPU_runtime_t* expected_runtime,
+		const uint32_t expected_page, const char* what) {
+	SkyCPU_runtime_t* cursor;
+	store.cursor_instance = cursor_instance;
+	store.cursor_page = cursor_page;
+	SkyCPU_dedup_release(&store, released);
+	cursor = store.cursor_instance < store.instances_count ?
+			store.instances[store.cursor_instance]->runtime : NULL;
+	check(cursor == expected_runtime && store.cursor_page == expected_page,
+			what);
+	check(references() == store.pages_sharing, "references match after a release");
+}
+
+int main(void) {
+	static uint8_t page[MEMORY_MASK + 1];
+	SkyCPU_runtime_t* runtimes[INSTANCES];
+	int32_t shared;
+	uint32_t i, index, zero_pages;
+
+	/* Store and instances */
+	if (SkyCPU_dedup_init(&store, 64, INSTANCES)) {
+		printf("dedup: cannot create the pages store\n");
+		return 1;
+	}
+	zero_pages = store.instance_pages - ZERO_PAGE;
+	set16bitsValue(program, 2, DATA_PAGE * store.page_size + 5);
+	set16bitsValue(program, 8, ZERO_PAGE * store.page_size);
+	for (i = 0; i < INSTANCES; ++i) {
+		runtimes[i] = SkyCPU_dedup_alloc(&store);
+		if (!runtimes[i]) {
+			printf("dedup: cannot allocate an instance\n");
+			return 1;
+		}
+		SkyCPU_runtime_init(runtimes[i]);
+		SkyCPU_callback_setup(runtimes[i], on_interrupt, on_breakpoint);
+		for (index = 0; index < ZERO_PAGE; ++index) {
+			expected_page(page, index, i);
+			memcpy(runtimes[i]->memory + index * store.page_size, page,
+					store.page_size);
+		}
+	}
+	check(!SkyCPU_dedup_alloc(&store), "no more instances than max_instances");
+
+	/* Sharing: code and data pages shared, own pages private, zeroed pages dropped */
+	full_scans();
+	check(store.pages_shared == 2, "two store pages");
+	check(store.pages_sharing == 2 * INSTANCES, "every code and data page shared");
+	check(store.pages_zero == INSTANCES * zero_pages, "every zeroed page dropped");
+	check(references() == store.pages_sharing, "references match the shared pages");
+	for (i = 0; i < INSTANCES; ++i) {
+		SkyCPU_dedup_instance_t* instance = SkyCPU_dedup_instance(&store,
+				runtimes[i]);
+		check(instance->pages[CODE_PAGE] >= 0
+				&& instance->pages[CODE_PAGE]
+						== SkyCPU_dedup_instance(&store, runtimes[0])->pages[CODE_PAGE],
+				"code page mapped on one store page");
+		check(instance->pages[DATA_PAGE] >= 0
+				&& instance->pages[DATA_PAGE]
+						== SkyCPU_dedup_instance(&store, runtimes[0])->pages[DATA_PAGE],
+				"data page mapped on one store page");
+		check(instance->pages[OWN_PAGE] == SKYCPU_DEDUP_PRIVATE,
+				"own page left private");
+		for (index = ZERO_PAGE; index < store.instance_pages; ++index)
+			if (instance->pages[index] != SKYCPU_DEDUP_ZERO)
+				break;
+		check(index == store.instance_pages, "zeroed pages marked dropped");
+		check(content_intact(runtimes[i], i), "guest memory unchanged by sharing");
+	}
+
+	/* Copy-on-write: a guest write only change its own memory */
+	shared = SkyCPU_dedup_instance(&store, runtimes[0])->pages[DATA_PAGE];
+	SkyCPU_dedup_lock(&store, runtimes[0]);
+	for (halted = 0, i = 0; i < 16 && !halted; ++i)
+		SkyCPU_fetch_and_execute(runtimes[0]);
+	SkyCPU_dedup_unlock(&store, runtimes[0]);
+	check(halted, "guest reached BRK");
+	check(runtimes[0]->memory[DATA_PAGE * store.page_size + 5] == 0x77
+			&& runtimes[0]->memory[ZERO_PAGE * store.page_size] == 0x55,
+			"guest writes visible to the guest");
+	expected_page(page, DATA_PAGE, 0);
+	check(!memcmp(store.view + (size_t) shared * store.page_size, page,
+			store.page_size), "store page untouched by the write");
+	for (i = 1; i < INSTANCES; ++i)
+		check(content_intact(runtimes[i], i), "other guests untouched by the write");
+
+	/* Broken sharing forgotten by the next scan */
+	full_scans();
+	check(SkyCPU_dedup_instance(&store, runtimes[0])->pages[DATA_PAGE]
+			== SKYCPU_DEDUP_PRIVATE, "written shared page private again");
+	check(SkyCPU_dedup_instance(&store, runtimes[0])->pages[ZERO_PAGE]
+			== SKYCPU_DEDUP_PRIVATE, "written dropped page private again");
+	check(store.pages_sharing == 2 * INSTANCES - 1, "one less sharing page");
+	check(store.pages_zero == INSTANCES * zero_pages - 1, "one less dropped page");
+	check(references() == store.pages_sharing, "references match after the write");
+
+	/* Release (instances: 0 1 2 3): cursor on another instance stay on it */
+	release_at(runtimes[0], 2, 5, runtimes[2], 5,
+			"cursor stay on its instance when an earlier one is released");
+	/* Instances: 3 1 2, cursor on the last one (moved into the released slot) follow it */
+	release_at(runtimes[1], 2, 7, runtimes[2], 7,
+			"cursor follow the moved last instance");
+	/* Instances: 3 2, cursor on the released instance restart the moved one */
+	release_at(runtimes[3], 0, 3, runtimes[2], 0,
+			"cursor restart the instance moved over the scanned one");
+	check(content_intact(runtimes[2], 2), "remaining guest memory unchanged");
+	full_scans();
+	check(content_intact(runtimes[2], 2), "remaining guest memory unchanged by scans");
+
+	/* Last instance released: store empty */
+	SkyCPU_dedup_release(&store, runtimes[2]);
+	check(!store.instances_count, "no instance left");
+	check(!store.pages_shared && !store.pages_sharing && !store.pages_zero,
+			"store empty once all instances are released");
+	check(store.free_head >= 0, "store pages back in the free list");
+	SkyCPU_dedup_free(&store);
+
+	printf("dedup: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Sharing, copy-on-write, zero pages and release test of the pages deduplication (SkyCPU_dedup)
+#
+# dedup_pages share identical pages of four instances, drop their zeroed pages, break
+# a sharing with a guest write then release the instances around the scan cursor:
+# guests memory MUST never change and the store MUST be empty at the end.
+#
+# Usage : tests/dedup/run.sh (CC and CFLAGS honored, Linux with memfd only)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -I"$ROOT" "$HERE/dedup_pages.c" "$ROOT/FastSkyCPU.c" \
+	"$ROOT/SkyCPU_dedup.c" -lpthread -o "$WORK/dedup_pages"
+"$WORK/dedup_pages"
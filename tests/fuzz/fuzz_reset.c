@@ -0,0 +1,162 @@
+/**
+ * @file fuzz_reset.c
+ * @brief Dirty pages reset and edges coverage check of the fuzzing harness (SkyCPU_fuzz)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program run a guest doing 32 bits writes at addresses taken from its input (half of them crossing\n
+ * a page boundary) plus stack writes, then check after each iteration that restoring the snapshot copied\n
+ * back exactly the touched pages and that the whole instance (registers, PC, SP, memory) match the snapshot.\n
+ * Edges coverage MUST be the same for the same input and differ when the input take another path.\n
+ * Exit status is 0 if all checks pass, 1 otherwise.\n
+ * \n
+ * Usage : fuzz_reset [iterations]\n
+ * Build : cc -O2 -DSKYCPU_FUZZING -I../.. fuzz_reset.c ../../FastSkyCPU.c ../../SkyCPU_snapshot.c ../../SkyCPU_fuzz.c -o fuzz_reset\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SkyCPU_fuzz.h"
+#include "Endian_utility.h"
+
+/* Guest layout */
+#define INPUT 0xF000
+#define WRITES 8
+#define BUDGET 1000
+
+/* Guest program (write 0xA5C3E1F7 at each input word, BRK #1 if input[0] is odd, else BRK #2 after a CALL) */
+static const uint8_t program[] = {
+	0x8a, 0x02, 0x80, 0xf0, 0x00, /* MOV.w r2, #0xF000 */
+	0x89, 0x06, 0x80, 0x08, /* MOV.b r6, #8 */
+	0x8a, 0x04, 0x42, /* L: MOV.w r4, [r2] */
+	0x8b, 0x44, 0x80, 0xa5, 0xc3, 0xe1, 0xf7, /* MOV.d [r4], #0xA5C3E1F7 */
+	0x12, 0x04, /* PUSH.w r4 */
+	0x4a, 0x08, /* POP.w r8 */
+	0x4e, 0x02, 0x80, 0x00, 0x02, /* ADD.w r2, #2 */
+	0x21, 0x06, /* DEC.b r6 */
+	0x45, 0x06, /* SN.b r6 */
+	0x0a, 0x80, 0x00, 0x09, /* JMP.w #L */
+	0x89, 0x0a, 0xc0, 0xf0, 0x00, /* MOV.b r10, [#0xF000] */
+	0xcd, 0x0a, 0x80, 0x00, /* SBS.b r10, #0 */
+	0x0a, 0x80, 0x00, 0x34, /* JMP.w #B */
+	0x15, 0x80, 0x01, /* BRK.b #1 */
+	0x0e, 0x80, 0x00, 0x3b, /* B: CALL.w #F */
+	0x15, 0x80, 0x02, /* BRK.b #2 */
+	0x05 /* F: RET */
+};
+
+static SkyCPU_fuzz_t fuzz;
+static int failures;
+
+static void on_interrupt(uint32_t icode) {
+	(void) icode;
+}
+
+static void on_breakpoint(uint32_t bcode) {
+	(void) bcode;
+	SkyCPU_fuzz_halt(&fuzz);
+}
+
+static void check(const int condition, const char* what, const uint32_t iteration) {
+	if (!condition) {
+		printf("FAIL: %s (iteration %u)\n", what, iteration);
+		++failures;
+	}
+}
+
+/* Random write address out of the code, input and stack pages (half of them crossing a page) */
+static uint16_t random_address(void) {
+	uint16_t address = 0x0200 + rand() % 0xED00;
+	if (rand() & 1)
+		address |= 0xFD + rand() % 3;
+	return address;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_runtime_t runtime;
+	static uint8_t coverage[SKYCPU_COVERAGE_SIZE], first_coverage[SKYCPU_COVERAGE_SIZE];
+	static uint8_t touched[SKYCPU_PAGE_COUNT];
+	uint8_t input[WRITES * 2];
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000, i, w;
+	uint16_t address, expected, restored, page;
+	int differ = 0;
+
+	/* Warm-up instance: program loaded, snapshot taken by the harness */
+	SkyCPU_runtime_init(&runtime);
+	SkyCPU_callback_setup(&runtime, on_interrupt, on_breakpoint);
+	SkyCPU_memory_copy(&runtime, program, sizeof(program), 0);
+	SkyCPU_fuzz_init(&fuzz, &runtime, coverage, INPUT, sizeof(input));
+	srand(1);
+
+	for (i = 0; i < iterations; ++i) {
+
+		/* Random input (and the pages it MUST dirty: targets, input, stack) */
+		memset(touched, 0, sizeof(touched));
+		for (w = 0; w < WRITES; ++w) {
+			address = random_address();
+			set16bitsValue(input, w * 2, address);
+			touched[address >> SKYCPU_PAGE_SHIFT] = 1;
+			touched[(address + 3) >> SKYCPU_PAGE_SHIFT] = 1;
+		}
+		touched[INPUT >> SKYCPU_PAGE_SHIFT] = 1;
+		touched[MEMORY_MASK >> SKYCPU_PAGE_SHIFT] = 1;
+		for (expected = 0, page = 0; page < SKYCPU_PAGE_COUNT; ++page)
+			expected += touched[page];
+
+		/* Run, then restore by hand */
+		SkyCPU_fuzz_run(&fuzz, &runtime, input, sizeof(input), BUDGET);
+		check(fuzz.halted, "guest reached BRK", i);
+		check(get32bitsValue(runtime.memory,
+				get16bitsValue(input, (WRITES - 1) * 2))
+				== 0xA5C3E1F7, "guest wrote its input", i);
+		restored = SkyCPU_snapshot_restore(&fuzz.snapshot, &runtime);
+		check(restored == expected, "restored exactly the touched pages", i);
+		check(!memcmp(runtime.registers, fuzz.snapshot.registers,
+				sizeof(runtime.registers))
+				&& runtime.skip_next == fuzz.snapshot.skip_next
+				&& runtime.program_counter == fuzz.snapshot.program_counter
+				&& runtime.stack_pointer == fuzz.snapshot.stack_pointer,
+				"CPU state match the snapshot", i);
+		check(!memcmp(runtime.memory, fuzz.snapshot.memory, MEMORY_MASK + 1),
+				"memory match the snapshot", i);
+		for (page = 0; page < SKYCPU_PAGE_COUNT; ++page)
+			if (runtime.page_flags[page] & SKYCPU_PAGE_DIRTY)
+				break;
+		check(page == SKYCPU_PAGE_COUNT, "no page left dirty", i);
+
+		/* Same input again: same coverage */
+		memcpy(first_coverage, coverage, sizeof(coverage));
+		SkyCPU_fuzz_run(&fuzz, &runtime, input, sizeof(input), BUDGET);
+		check(!memcmp(first_coverage, coverage, sizeof(coverage)),
+				"same input, same coverage", i);
+
+		/* Other path (input[0] parity flipped): other edges */
+		input[0] ^= 1;
+		SkyCPU_fuzz_run(&fuzz, &runtime, input, sizeof(input), BUDGET);
+		differ += memcmp(first_coverage, coverage, sizeof(coverage)) != 0;
+	}
+	check(differ == (int) iterations, "other path, other coverage", iterations);
+
+	printf("fuzz: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#!/bin/sh
+#
+# Dirty pages reset and edges coverage test of the fuzzing harness (SkyCPU_fuzz)
+#
+# fuzz_reset run a guest writing across page boundaries: after each iteration the
+# snapshot restore MUST copy back exactly the touched pages and leave the whole
+# instance equal to the snapshot, coverage MUST only depend on the input.
+#
+# Usage : tests/fuzz/run.sh [iterations] (CC and CFLAGS honored)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -DSKYCPU_FUZZING -I"$ROOT" "$HERE/fuzz_reset.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_snapshot.c" "$ROOT/SkyCPU_fuzz.c" \
+	-o "$WORK/fuzz_reset"
+"$WORK/fuzz_reset" ${1:-10000}
@@ -0,0 +1,539 @@
+/**
+ * @file idiom_diff.c
+ * @brief Differential check of the idiom kernels (SkyCPU_idiom) against the interpreter on generated loop programs
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program generate one loop program per seed (copy, fill, checksum, count or scan loop, sometimes a near miss\n
+ * the recognizer MUST refuse, run a few rounds, optionally patching a loop constant between rounds) over random\n
+ * data, then run it in two instances for the same random instructions budget: the first one with the interpreter,\n
+ * the second one with SkyCPU_idiom_run() in random slices and with a random mask of enabled idioms.\n
+ * Registers, PC, SP, pending skip, memory and the sequence of INT / BRK callbacks codes MUST match.\n
+ * Exit status is 0 if all programs match, 1 on mismatch, 2 on error (or if no kernel ever ran).\n
+ * Built with -DSKYCPU_MIRRORED_MEMORY (and SkyCPU_mirror.c), pointers may also wrap around into the program\n
+ * and loops may write over their own code (wrap around accesses are defined there).\n
+ * \n
+ * Usage : idiom_diff first_seed count\n
+ * Build : cc -O2 -I../.. idiom_diff.c ../../FastSkyCPU.c ../../SkyCPU_idiom.c ../../SkyCPU_decode.c -o idiom_diff\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FastSkyCPU.h"
+#include "FastSkyCPU_opcodes.h"
+#include "SkyCPU_idiom.h"
+#ifdef SKYCPU_MIRRORED_MEMORY
+#include "SkyCPU_mirror.h"
+#endif
+
+/* Program area (data past it) and registers left to the loop (r28 - r31: rounds) */
+#define CODE_AREA 0x100
+#define LOOP_REGISTERS 28
+#define ROUNDS_REGISTER 30
+#define PATCH_REGISTER 29
+#define FREE_REGISTER 28
+
+/* Largest instructions budget */
+#define MAX_BUDGET 100000
+
+/* Callbacks codes log (INT and BRK, in order) */
+#define MAX_EVENTS 4096
+static uint32_t events[MAX_EVENTS];
+static uint32_t events_count;
+
+static void on_event(uint32_t code) {
+	if (events_count < MAX_EVENTS)
+		events[events_count++] = code;
+}
+
+/* Generator state (xorshift, per seed) */
+static uint32_t state;
+
+static uint32_t random_next(void) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static uint32_t random_below(const uint32_t bound) {
+	return random_next() % bound;
+}
+
+/**
+ * Program being generated
+ */
+typedef struct {
+	uint8_t code[CODE_AREA];
+	uint32_t size;
+} program_t;
+
+static void put(program_t* program, const uint8_t byte) {
+	if (program->size < CODE_AREA)
+		program->code[program->size] = byte;
+	++program->size;
+}
+
+static void instruction(program_t* program, const uint8_t opcode,
+		const uint8_t bits_mode) {
+	put(program, (opcode << 2) | bits_mode);
+}
+
+static void raw_register(program_t* program, const uint8_t code) {
+	put(program, code);
+}
+
+static void pointed_register(program_t* program, const uint8_t code) {
+	put(program, 64 | code);
+}
+
+/**
+ * Emit a constant argument (inline if small enough and picked)
+ *
+ * @return Address of the last constant byte (patchable), 0 if inline
+ */
+static uint32_t constant(program_t* program, const uint32_t value,
+		const uint8_t bits_mode) {
+	uint8_t size = (bits_mode == DOUBLE_WORD) ? 4 : bits_mode;
+	if (value < 32 && random_below(2)) {
+		put(program, 128 | 32 | value);
+		return 0;
+	}
+	put(program, 128);
+	while (size--)
+		put(program, value >> (8 * size));
+	return program->size - 1;
+}
+
+/* JMP.w #target (returns the address of the target to fix later) */
+static uint32_t jump(program_t* program, const uint16_t target) {
+	instruction(program, INSTRUCTION_JMP, SINGLE_WORD);
+	put(program, 128);
+	put(program, target >> 8);
+	put(program, target);
+	return program->size - 2;
+}
+
+static uint8_t size_of(const uint8_t bits_mode) {
+	return (bits_mode == DOUBLE_WORD) ? 4 : bits_mode;
+}
+
+/**
+ * Pick a register of the loop (overlapping registers sometimes allowed: the loop MUST then be refused)
+ *
+ * @param used Pointer to the used register bytes mask
+ * @param size Register size in bytes
+ * @return Register code
+ */
+static uint8_t pick_register(uint32_t* used, const uint8_t size) {
+	uint32_t bytes, tries = 0;
+	uint8_t code;
+	do {
+		code = random_below(LOOP_REGISTERS - size + 1);
+		bytes = ((1UL << size) - 1) << code;
+	} while ((*used & bytes) && random_below(16) && ++tries < 64);
+	*used |= bytes;
+	return code;
+}
+
+static uint8_t pick_mode(void) {
+	return SINGLE_BYTE + random_below(3);
+}
+
+/* Reductions */
+static const uint8_t reductions[] = { INSTRUCTION_ADD, INSTRUCTION_SUB,
+		INSTRUCTION_AND, INSTRUCTION_OR, INSTRUCTION_XOR };
+
+/* Byte conditions (one argument ones test against 0) */
+static const uint8_t conditions[] = { INSTRUCTION_JN, INSTRUCTION_JNN,
+		INSTRUCTION_SN, INSTRUCTION_SNN, INSTRUCTION_JE, INSTRUCTION_JNE,
+		INSTRUCTION_SE, INSTRUCTION_SNE };
+
+/**
+ * Emit Cond.b [rP], rV|#c (or Cond.b [rP])
+ *
+ * @return Address of the patchable value byte, 0 if none
+ */
+static uint32_t condition(program_t* program, const uint8_t pointer,
+		const uint8_t operand, const uint8_t value) {
+	uint8_t opcode = conditions[random_below(sizeof(conditions))];
+	uint32_t patch = 0;
+	instruction(program, opcode, SINGLE_BYTE);
+	if (opcode < INSTRUCTION_POP) {
+		pointed_register(program, pointer);
+		return 0;
+	}
+	if (random_below(4)) {
+		pointed_register(program, pointer);
+		if (operand != SKYCPU_IDIOM_NONE)
+			raw_register(program, operand);
+		else
+			patch = constant(program, value, SINGLE_BYTE);
+	} else {
+		if (operand != SKYCPU_IDIOM_NONE)
+			raw_register(program, operand);
+		else
+			patch = constant(program, value, SINGLE_BYTE);
+		pointed_register(program, pointer);
+	}
+	return patch;
+}
+
+/* Step instruction (INC / DEC register) */
+static void step(program_t* program, const uint8_t opcode, const uint8_t code,
+		const uint8_t bits_mode) {
+	instruction(program, opcode, bits_mode);
+	raw_register(program, code);
+}
+
+/**
+ * Emit steps (INC / DEC registers) in random order
+ *
+ * @param steps Steps (opcode, register, bits mode)
+ * @param count Steps count
+ * @param near_miss 1 to step a register with another size, 2 to add an unrelated step (refused loop)
+ */
+static void emit_steps(program_t* program, uint8_t steps[][3],
+		const uint8_t count, const uint8_t near_miss) {
+	uint8_t i, j, swap[3];
+	if (near_miss == 1)
+		steps[random_below(count)][2] = SINGLE_BYTE + random_below(3);
+	for (i = count; i > 1; --i) {
+		j = random_below(i);
+		memcpy(swap, steps[i - 1], 3);
+		memcpy(steps[i - 1], steps[j], 3);
+		memcpy(steps[j], swap, 3);
+	}
+	for (i = 0; i < count; ++i) {
+		if (near_miss == 2 && i == count - 1)
+			step(program, INSTRUCTION_INC, FREE_REGISTER, SINGLE_BYTE);
+		step(program, steps[i][0], steps[i][1], steps[i][2]);
+	}
+}
+
+/* Register setup: MOV.m rX, #value */
+static void setup(program_t* program, const uint8_t code,
+		const uint32_t value, const uint8_t bits_mode) {
+	instruction(program, INSTRUCTION_MOV, bits_mode);
+	raw_register(program, code);
+	constant(program, value, bits_mode);
+}
+
+/**
+ * Pick a pointer value
+ *
+ * @param wrap True if the pointer may wrap around into the program
+ * @return Pointer value
+ */
+static uint16_t pick_pointer(const int wrap) {
+	switch (random_below(8)) {
+	case 0: /* Near the memory end */
+		return 0xFF00 + random_below(0x100);
+	case 1: /* Into the program (mirrored memory only) */
+		if (wrap)
+			return random_below(CODE_AREA);
+		/* Falls through */
+	default:
+		return CODE_AREA + random_below(MEMORY_MASK + 1 - CODE_AREA);
+	}
+}
+
+/**
+ * Generate a loop program
+ *
+ * @param program Pointer to the program to fill
+ * @param wrap True if pointers may wrap around into the program (mirrored memory)
+ */
+static void generate(program_t* program, const int wrap) {
+	uint8_t kind = random_below(5), near_miss = !random_below(8);
+	uint8_t counter_mode = pick_mode(), result_mode = pick_mode();
+	uint8_t destination = SKYCPU_IDIOM_NONE, source = SKYCPU_IDIOM_NONE;
+	uint8_t counter = SKYCPU_IDIOM_NONE, result = SKYCPU_IDIOM_NONE;
+	uint8_t operand = SKYCPU_IDIOM_NONE, value = random_below(256), n;
+	uint32_t used = 0, patch = 0, exit_fix = 0, again, head, count, limit;
+	uint8_t steps[3][3];
+	uint16_t destination_value = pick_pointer(wrap);
+
+	memset(program, 0, sizeof(program_t));
+
+	/* Registers */
+	if (kind == 0 || kind == 1)
+		destination = pick_register(&used, 2);
+	if (kind != 1)
+		source = pick_register(&used, 2);
+	if (kind != 4)
+		counter = pick_register(&used, size_of(counter_mode));
+	if (kind == 2 || kind == 3 || (kind == 4 && random_below(2)))
+		result = pick_register(&used, kind == 2 ? 1 : size_of(result_mode));
+	if ((kind == 1 || kind == 3 || kind == 4) && random_below(2))
+		operand = pick_register(&used, 1);
+
+	/* Counter (writers never wrap around into the program without the mirrored memory) */
+	limit = (counter_mode == DOUBLE_WORD) ? 0xFFFFFFFFUL :
+			(1UL << (8 * size_of(counter_mode))) - 1;
+	count = (random_below(4) ? random_below(300) : random_next()) & limit;
+	if (destination != SKYCPU_IDIOM_NONE && !wrap) {
+		if (destination_value < CODE_AREA)
+			destination_value += CODE_AREA;
+		if (limit > (uint32_t) MEMORY_MASK + 1 - destination_value)
+			limit = MEMORY_MASK + 1 - destination_value;
+		if (!count || count > limit)
+			count = 1 + random_below(limit);
+	}
+
+	/* Rounds counter */
+	setup(program, ROUNDS_REGISTER, random_below(3), SINGLE_BYTE);
+	again = program->size;
+
+	/* Loop registers */
+	if (destination != SKYCPU_IDIOM_NONE)
+		setup(program, destination, destination_value, SINGLE_WORD);
+	if (source != SKYCPU_IDIOM_NONE)
+		setup(program, source, pick_pointer(1), SINGLE_WORD);
+	if (counter != SKYCPU_IDIOM_NONE)
+		setup(program, counter, count, counter_mode);
+	if (result != SKYCPU_IDIOM_NONE)
+		setup(program, result, random_next(),
+				kind == 2 ? SINGLE_BYTE : result_mode);
+	if (operand != SKYCPU_IDIOM_NONE)
+		setup(program, operand, random_below(256), SINGLE_BYTE);
+	head = program->size;
+
+	/* Loop body */
+	if (kind == 4) { /* Scan: Cond.b [rP], JMP #exit, INC.w rP, [INC rC], JMP #head */
+		patch = condition(program, source, operand, value);
+		exit_fix = jump(program, 0);
+		n = 0;
+		steps[n][0] = INSTRUCTION_INC;
+		steps[n][1] = source;
+		steps[n++][2] = SINGLE_WORD;
+		if (result != SKYCPU_IDIOM_NONE) {
+			steps[n][0] = INSTRUCTION_INC;
+			steps[n][1] = result;
+			steps[n++][2] = result_mode;
+		}
+		emit_steps(program, steps, n, near_miss);
+
+	} else { /* Counted: operation, INC.w pointers and DEC rN (any order), JNN rN */
+		switch (kind) {
+		case 0: /* Copy */
+			instruction(program, INSTRUCTION_MOV, SINGLE_BYTE);
+			pointed_register(program, destination);
+			pointed_register(program, source);
+			break;
+		case 1: /* Fill */
+			instruction(program, INSTRUCTION_MOV, SINGLE_BYTE);
+			pointed_register(program, destination);
+			if (operand != SKYCPU_IDIOM_NONE)
+				raw_register(program, operand);
+			else
+				patch = constant(program, value, SINGLE_BYTE);
+			break;
+		case 2: /* Checksum */
+			instruction(program, reductions[random_below(sizeof(reductions))],
+					SINGLE_BYTE);
+			raw_register(program, result);
+			pointed_register(program, source);
+			break;
+		default: /* Count */
+			patch = condition(program, source, operand, value);
+			step(program, INSTRUCTION_INC, result, result_mode);
+			break;
+		}
+
+		/* Steps in random order */
+		n = 0;
+		if (destination != SKYCPU_IDIOM_NONE) {
+			steps[n][0] = INSTRUCTION_INC;
+			steps[n][1] = destination;
+			steps[n++][2] = SINGLE_WORD;
+		}
+		if (source != SKYCPU_IDIOM_NONE) {
+			steps[n][0] = INSTRUCTION_INC;
+			steps[n][1] = source;
+			steps[n++][2] = SINGLE_WORD;
+		}
+		steps[n][0] = INSTRUCTION_DEC;
+		steps[n][1] = counter;
+		steps[n++][2] = counter_mode;
+		emit_steps(program, steps, n,
+				near_miss && (wrap || destination == SKYCPU_IDIOM_NONE) ?
+						near_miss : near_miss * 2);
+		instruction(program, INSTRUCTION_JNN, counter_mode);
+		raw_register(program, counter);
+	}
+	jump(program, head);
+
+	/* Exit: report, patch the loop constant, next round */
+	if (exit_fix) {
+		program->code[exit_fix] = program->size >> 8;
+		program->code[exit_fix + 1] = program->size;
+	}
+	instruction(program, INSTRUCTION_INT, SINGLE_BYTE);
+	constant(program, kind, SINGLE_BYTE);
+	if (patch && random_below(2)) {
+		step(program, INSTRUCTION_INC, PATCH_REGISTER, SINGLE_BYTE);
+		instruction(program, INSTRUCTION_MOV, SINGLE_BYTE);
+		put(program, 128 | 64);
+		put(program, patch >> 8);
+		put(program, patch);
+		raw_register(program, PATCH_REGISTER);
+	}
+	step(program, INSTRUCTION_DEC, ROUNDS_REGISTER, SINGLE_BYTE);
+	instruction(program, INSTRUCTION_JNN, SINGLE_BYTE);
+	raw_register(program, ROUNDS_REGISTER);
+	jump(program, again);
+	instruction(program, INSTRUCTION_BRK, SINGLE_BYTE);
+	constant(program, 1, SINGLE_BYTE);
+	jump(program, program->size);
+}
+
+/**
+ * Load a generated program and its random data into an instance
+ *
+ * @param runtime Instance to load
+ * @param program Generated program
+ * @param seed Data seed
+ */
+static void load(SkyCPU_runtime_t* runtime, const program_t* program,
+		const uint32_t seed) {
+	uint32_t i, filler;
+	state = seed;
+	filler = random_below(256);
+	for (i = CODE_AREA; i <= MEMORY_MASK; ++i) /* Runs of one byte or random bytes */
+		runtime->memory[i] = random_below(4) ? filler : random_below(256);
+	memcpy(runtime->memory, program->code, program->size);
+}
+
+/**
+ * Generate and check one program
+ *
+ * @param seed Program seed
+ * @param kernels Pointer to the kernels calls total
+ * @return 0 if both instances match, 1 on mismatch, 2 on error
+ */
+static int check(const uint32_t seed, uint64_t* kernels) {
+	static SkyCPU_runtime_t interpreted, optimized;
+	static SkyCPU_idiom_t idiom;
+	static uint32_t interpreted_events[MAX_EVENTS];
+	uint32_t budget, retired, slice, interpreted_count, i;
+	program_t program;
+	int wrap = 0;
+
+#ifdef SKYCPU_MIRRORED_MEMORY
+	wrap = 1;
+#endif
+	state = seed * 2654435761UL + 1;
+	generate(&program, wrap);
+	if (program.size > CODE_AREA) {
+		fprintf(stderr, "seed %u: program too long\n", seed);
+		return 2;
+	}
+	budget = 1 + random_below(MAX_BUDGET);
+
+	/* Same program and data in both instances */
+	SkyCPU_runtime_init(&interpreted);
+	SkyCPU_runtime_init(&optimized);
+#ifdef SKYCPU_MIRRORED_MEMORY
+	if (SkyCPU_mirror_map(&interpreted) || SkyCPU_mirror_map(&optimized)) {
+		fprintf(stderr, "cannot map the mirrored memory\n");
+		return 2;
+	}
+#endif
+	SkyCPU_callback_setup(&interpreted, on_event, on_event);
+	SkyCPU_callback_setup(&optimized, on_event, on_event);
+	load(&interpreted, &program, seed);
+	load(&optimized, &program, seed);
+
+	/* Reference run */
+	events_count = 0;
+	for (i = 0; i < budget; ++i)
+		SkyCPU_fetch_and_execute(&interpreted);
+	interpreted_count = events_count;
+	memcpy(interpreted_events, events, sizeof(events));
+
+	/* Idioms run (random mask, random slices) */
+	state = seed * 2246822519UL + 3;
+	SkyCPU_idiom_init(&idiom, &optimized);
+	idiom.enabled = random_below(4) ? random_below(SKYCPU_IDIOM_ALL + 1) :
+			SKYCPU_IDIOM_ALL;
+	events_count = 0;
+	for (retired = 0; retired < budget; retired += slice) {
+		slice = 1 + random_below(random_below(2) ? 64 : budget);
+		if (slice > budget - retired)
+			slice = budget - retired;
+		if (SkyCPU_idiom_run(&idiom, slice, NULL) != slice) {
+			printf("seed %u: DIFF idiom run stopped early\n", seed);
+			return 1;
+		}
+	}
+	*kernels += idiom.kernels;
+
+	/* Compare */
+	if (memcmp(interpreted.registers, optimized.registers,
+			sizeof(interpreted.registers))
+			|| interpreted.program_counter != optimized.program_counter
+			|| interpreted.stack_pointer != optimized.stack_pointer
+			|| interpreted.skip_next != optimized.skip_next
+			|| memcmp(interpreted.memory, optimized.memory, MEMORY_MASK + 1)
+			|| interpreted_count != events_count
+			|| memcmp(interpreted_events, events,
+					interpreted_count * sizeof(uint32_t))) {
+		printf("seed %u: DIFF budget=%u enabled=%u kernels=%lu pc=%04x/%04x events=%u/%u\n",
+				seed, budget, idiom.enabled, (unsigned long) idiom.kernels,
+				interpreted.program_counter, optimized.program_counter,
+				interpreted_count, events_count);
+		return 1;
+	}
+#ifdef SKYCPU_MIRRORED_MEMORY
+	SkyCPU_mirror_unmap(&interpreted);
+	SkyCPU_mirror_unmap(&optimized);
+#endif
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	uint32_t first, count, seed, failed = 0;
+	uint64_t kernels = 0;
+	int status;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s first_seed count\n", argv[0]);
+		return 2;
+	}
+	first = strtoul(argv[1], NULL, 0);
+	count = strtoul(argv[2], NULL, 0);
+
+	/* Check every program */
+	for (seed = first; seed < first + count; ++seed) {
+		status = check(seed, &kernels);
+		if (status == 2)
+			return 2;
+		failed += status;
+	}
+	printf("%u programs, %u failed, %lu kernels calls\n", count, failed,
+			(unsigned long) kernels);
+	if (failed)
+		return 1;
+	return kernels ? 0 : 2;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Differential test of the idiom kernels (SkyCPU_idiom)
+#
+# idiom_diff generate one loop program per seed (copy, fill, checksum, count and
+# scan loops, near misses the recognizer MUST refuse, loop constants patched between
+# rounds) over random data, and run it with the interpreter and with the kernels for
+# a random budget, in random slices, with a random mask of enabled idioms. All
+# programs MUST match (registers, PC, SP, pending skip, memory, INT / BRK codes).
+#
+# Usage : tests/idiom/run.sh [programs] (CC and CFLAGS honored)
+#
+# Programs are checked three times: default build, page tracking build, and page
+# tracking with the mirrored memory (pointers then also wrap around into the
+# program and loops write over their own code).
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+PROGRAMS=${1:-1300}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Build and check (flags, extra sources)
+failed=0
+check() {
+	$CC $CFLAGS $1 -I"$ROOT" "$HERE/idiom_diff.c" "$ROOT/FastSkyCPU.c" \
+		"$ROOT/SkyCPU_idiom.c" "$ROOT/SkyCPU_decode.c" $2 -o "$WORK/idiom_diff"
+	printf 'idiom %s: ' "${1:-default}"
+	"$WORK/idiom_diff" 1 "$PROGRAMS" || failed=$((failed + 1))
+}
+check "" ""
+check "-DSKYCPU_PAGE_TRACKING" ""
+check "-DSKYCPU_PAGE_TRACKING -DSKYCPU_MIRRORED_MEMORY" "$ROOT/SkyCPU_mirror.c"
+
+test "$failed" -eq 0
@@ -0,0 +1,216 @@
+/**
+ * @file metrics_count.c
+ * @brief Counters check of the per-instance metrics (SkyCPU_metrics)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program create a stats segment, attach an instance, run a fixed program (INT in a loop ending with a\n
+ * skipped JMP, CALL + PUSH in a subroutine, then SEND / RECV stalling once for each reason and BRK) and read\n
+ * its record back through SkyCPU_metrics_open() + SkyCPU_metrics_read(), like an agent would: instructions\n
+ * (skipped included, stalled excluded), INT, BRK, time slices, stalls by reason and stack high-water mark MUST\n
+ * match. Attach MUST claim a free record (reset, named), fail once all are used, and detach MUST free it.\n
+ * Exit status is 0 if all checks pass, 1 otherwise, 2 on error.\n
+ * \n
+ * Usage : metrics_count\n
+ * Build : cc -O2 -DSKYCPU_METRICS -DSKYCPU_CHANNELS -I../.. metrics_count.c ../../FastSkyCPU.c ../../SkyCPU_channel.c ../../SkyCPU_metrics.c -o metrics_count\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "SkyCPU_channel.h"
+#include "SkyCPU_metrics.h"
+
+/* INT 3 ... 1 (CALL + PUSH.d in the loop), PUSH.w, one stall of each reason, BRK 7, endless loop */
+static const uint8_t program[] = {
+	0x89, 0x00, 0xa3, /* 0x00: MOV.b r0, #3 */
+	0x19, 0x00, /* 0x03: INT.b r0 */
+	0x0e, 0x80, 0x00, 0x25, /* 0x05: CALL.w #0x25 */
+	0x21, 0x00, /* 0x09: DEC.b r0 */
+	0x45, 0x00, /* 0x0b: SN.b r0 */
+	0x0a, 0x80, 0x00, 0x03, /* 0x0d: JMP.w #0x03 */
+	0x12, 0x00, /* 0x11: PUSH.w r0 */
+	0xd5, 0x01, 0xa0, /* 0x13: RECV.b r1, #0 (empty) */
+	0xd1, 0xa2, 0x01, /* 0x16: SEND.b #2, r1 (full) */
+	0xd2, 0xa1, 0x02, /* 0x19: SEND.w #1, r2 (8 bits channel) */
+	0xd5, 0x03, 0xa3, /* 0x1c: RECV.b r3, #3 (unbound) */
+	0x15, 0xa7, /* 0x1f: BRK.b #7 */
+	0x0a, 0x80, 0x00, 0x21, /* 0x21: JMP.w #0x21 */
+	0x13, 0x04, /* 0x25: PUSH.d r4 */
+	0x4b, 0x04, /* 0x27: POP.d r4 */
+	0x05 /* 0x29: RET */
+};
+
+/* Expected counters (instructions of the loop: INT CALL PUSH POP RET DEC SN JMP, the last JMP skipped) */
+#define LOOP_INSTRUCTIONS (1 + 3 * 8 + 1)
+#define END_INSTRUCTIONS 10
+#define STACK_HIGH_WATER (2 + 4)
+
+static uint64_t interrupts, breakpoints, last_interrupt, last_breakpoint;
+static int failures;
+
+static void on_interrupt(uint32_t icode) {
+	++interrupts;
+	last_interrupt = icode;
+}
+
+static void on_breakpoint(uint32_t bcode) {
+	++breakpoints;
+	last_breakpoint = bcode;
+}
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+static SkyCPU_channel_t* channel_new(const uint8_t width) {
+	SkyCPU_channel_t* channel = aligned_alloc(SKYCPU_CHANNEL_ALIGN,
+			(SkyCPU_channel_size(1) + SKYCPU_CHANNEL_ALIGN - 1)
+					& ~(size_t) (SKYCPU_CHANNEL_ALIGN - 1));
+	if (!channel || SkyCPU_channel_init(channel, SKYCPU_CHANNEL_SPSC, width, 1)) {
+		printf("cannot create a channel\n");
+		exit(2);
+	}
+	return channel;
+}
+
+/* Run until the next stall, check its reason and the retired instructions */
+static uint64_t run_stall(SkyCPU_runtime_t* runtime, const uint32_t expected,
+		const uint8_t reason, const char* what) {
+	uint32_t retired = SkyCPU_channel_run(runtime, 1000);
+	check(retired == expected && runtime->stall_reason == reason, what);
+	return retired;
+}
+
+int main(void) {
+	static SkyCPU_runtime_t runtime, other, third;
+	SkyCPU_channel_t *input = channel_new(1), *narrow = channel_new(1);
+	SkyCPU_channel_t *word = channel_new(2), *full = channel_new(1);
+	SkyCPU_channel_t *late = channel_new(1);
+	SkyCPU_metrics_segment_t* segment;
+	const SkyCPU_metrics_segment_t* reader;
+	const SkyCPU_metrics_t* record;
+	uint64_t retired = 0;
+	uint32_t value;
+	char name[64];
+
+	/* Stats segment of 2 records, then the agent view */
+	snprintf(name, sizeof(name), "/skycpu-metrics-test-%d", (int) getpid());
+	segment = SkyCPU_metrics_create(name, 2);
+	reader = segment ? SkyCPU_metrics_open(name) : NULL;
+	if (!reader) {
+		perror(name);
+		if (segment)
+			shm_unlink(name);
+		return 2;
+	}
+	check(reader->count == 2 && reader->record_size == sizeof(SkyCPU_metrics_t),
+			"segment header");
+	check(SkyCPU_metrics_open("/skycpu-metrics-test-missing") == NULL,
+			"missing segment not opened");
+
+	/* Attach: records claimed in order, named, none left for a third instance */
+	SkyCPU_runtime_init(&runtime);
+	SkyCPU_runtime_init(&other);
+	SkyCPU_runtime_init(&third);
+	check(!SkyCPU_metrics_attach(segment, &runtime, "counted")
+			&& runtime.metrics == &segment->records[0], "first record claimed");
+	check(!SkyCPU_metrics_attach(segment, &other, "other")
+			&& other.metrics == &segment->records[1], "second record claimed");
+	check(SkyCPU_metrics_attach(segment, &third, "third") == -1 && !third.metrics,
+			"no free record left");
+	record = &reader->records[0];
+	check(__atomic_load_n(&record->state, __ATOMIC_ACQUIRE) == SKYCPU_METRICS_USED
+			&& record->owner == (uint32_t) getpid()
+			&& !strcmp(record->name, "counted"), "record seen by the agent");
+
+	/* Run the program, one stall of each reason fixed by the host */
+	SkyCPU_callback_setup(&runtime, on_interrupt, on_breakpoint);
+	SkyCPU_memory_copy(&runtime, program, sizeof(program), 0);
+	SkyCPU_channel_bind(&runtime, 0, input);
+	SkyCPU_channel_bind(&runtime, 1, narrow);
+	SkyCPU_channel_bind(&runtime, 2, full);
+	SkyCPU_channel_send(full, 0xAA);
+	retired += run_stall(&runtime, LOOP_INSTRUCTIONS, SKYCPU_STALL_EMPTY,
+			"loop then RECV on an empty channel");
+	SkyCPU_channel_send(input, 0x42);
+	retired += run_stall(&runtime, 1, SKYCPU_STALL_FULL, "SEND on a full channel");
+	SkyCPU_channel_receive(full, &value);
+	retired += run_stall(&runtime, 1, SKYCPU_STALL_WIDTH,
+			"SEND.w on a 8 bits channel");
+	SkyCPU_channel_bind(&runtime, 1, word);
+	retired += run_stall(&runtime, 1, SKYCPU_STALL_UNBOUND,
+			"RECV on an unbound channel");
+	SkyCPU_channel_bind(&runtime, 3, late);
+	SkyCPU_channel_send(late, 1);
+	retired += SkyCPU_channel_run(&runtime, 2 + END_INSTRUCTIONS);
+	check(retired == LOOP_INSTRUCTIONS + 3 + 2 + END_INSTRUCTIONS,
+			"retired instructions");
+
+	/* Counters read back by the agent */
+	check(SkyCPU_metrics_read(&record->instructions) == retired,
+			"instructions (skipped included, stalled excluded)");
+	check(SkyCPU_metrics_read(&record->interrupts) == 3 && interrupts == 3
+			&& last_interrupt == 1, "INT count");
+	check(SkyCPU_metrics_read(&record->breakpoints) == 1 && breakpoints == 1
+			&& last_breakpoint == 7, "BRK count");
+	check(SkyCPU_metrics_read(&record->slices) == 5, "time slices");
+	check(SkyCPU_metrics_read(&record->stalls[SKYCPU_STALL_NONE]) == 0
+			&& SkyCPU_metrics_read(&record->stalls[SKYCPU_STALL_FULL]) == 1
+			&& SkyCPU_metrics_read(&record->stalls[SKYCPU_STALL_EMPTY]) == 1
+			&& SkyCPU_metrics_read(&record->stalls[SKYCPU_STALL_UNBOUND]) == 1
+			&& SkyCPU_metrics_read(&record->stalls[SKYCPU_STALL_WIDTH]) == 1,
+			"stalls by reason");
+	check(SkyCPU_metrics_read(&record->stack_high_water) == STACK_HIGH_WATER,
+			"stack high-water mark (CALL + PUSH.d)");
+	check(!SkyCPU_metrics_read(&reader->records[1].instructions),
+			"other record untouched");
+
+	/* Detach: record freed, counting stopped, claimed again (reset) by the next attach */
+	SkyCPU_metrics_detach(&runtime);
+	check(!runtime.metrics && __atomic_load_n(&record->state, __ATOMIC_ACQUIRE)
+			== SKYCPU_METRICS_FREE, "detach free the record");
+	SkyCPU_channel_run(&runtime, 10);
+	check(SkyCPU_metrics_read(&record->instructions) == retired,
+			"detached instance not counted");
+	check(!SkyCPU_metrics_attach(segment, &third, "third")
+			&& third.metrics == &segment->records[0]
+			&& !SkyCPU_metrics_read(&record->instructions)
+			&& !SkyCPU_metrics_read(&record->stack_high_water)
+			&& !strcmp(record->name, "third"), "freed record claimed again");
+
+	SkyCPU_metrics_close(reader);
+	SkyCPU_metrics_close(segment);
+	shm_unlink(name);
+	free(input);
+	free(narrow);
+	free(word);
+	free(full);
+	free(late);
+	printf("metrics: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
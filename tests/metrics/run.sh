@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# Per-instance metrics test (SkyCPU_metrics)
+#
+# metrics_count attach an instance to a stats segment, run a fixed program (INT
+# loop with a skipped JMP, CALL + PUSH, one SEND / RECV stall of each reason, BRK)
+# and read its record back like an agent: instructions, INT / BRK, time slices,
+# stalls by reason and stack high-water mark MUST match, records MUST be claimed
+# and freed by attach / detach.
+#
+# Usage : tests/metrics/run.sh (CC and CFLAGS honored, POSIX shared memory only)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -DSKYCPU_METRICS -DSKYCPU_CHANNELS -I"$ROOT" "$HERE/metrics_count.c" \
+	"$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_channel.c" "$ROOT/SkyCPU_metrics.c" \
+	-o "$WORK/metrics_count"
+"$WORK/metrics_count"
@@ -0,0 +1,12 @@
+ MOV.w r2, #P
+ ADD.w r0, #0
+P:
+ MOV.b r4, [r2]
+ INT.b r4
+ MOV.w r6, #Q
+ MOV.b [r6], #0x15
+Q:
+ INT.b #9
+ BRK.b #1
+E:
+ JMP.w #E
@@ -0,0 +1,130 @@
+/**
+ * @file opt_diff.c
+ * @brief Differential check of an optimized image (SkyOpt) against the original one
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program load the original and the optimized image (at address 0) into two instances, run both up to\n
+ * the first BRK (optimized code retire less instructions), then compare what a guest can observe:\n
+ * registers, SP, memory past both images (stack area excepted) and the sequence of INT / BRK callbacks codes.\n
+ * Exit status is 0 if both instances match, 1 on mismatch, 2 on error (or no BRK within the budget).\n
+ * \n
+ * Usage : opt_diff original.bin optimized.bin max_instructions\n
+ * Build : cc -O2 -I../.. opt_diff.c ../../FastSkyCPU.c -o opt_diff\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FastSkyCPU.h"
+
+/* Stack area, not compared (stale return addresses of moved code) */
+#define STACK_AREA 256
+
+/* Callbacks codes log (INT and BRK, in order) */
+#define MAX_EVENTS 4096
+static uint32_t events[2][MAX_EVENTS];
+static uint32_t events_count[2];
+static int current, halted;
+
+static void on_interrupt(uint32_t code) {
+	if (events_count[current] < MAX_EVENTS)
+		events[current][events_count[current]++] = code;
+}
+
+static void on_break(uint32_t code) {
+	on_interrupt(code | 0x80000000);
+	halted = 1;
+}
+
+/**
+ * Load an image at address 0 and run it up to the first BRK
+ *
+ * @param runtime Instance to use
+ * @param filename Image file
+ * @param max_instructions Instructions budget
+ * @param size Image size (output)
+ * @return Retired instructions count, 0 on error or if the budget is exhausted
+ */
+static uint32_t run(SkyCPU_runtime_t* runtime, const char* filename,
+		const uint32_t max_instructions, size_t* size) {
+	static uint8_t image[MEMORY_MASK + 1];
+	uint32_t retired;
+	FILE* file = fopen(filename, "rb");
+	if (!file) {
+		perror(filename);
+		return 0;
+	}
+	*size = fread(image, 1, sizeof(image), file);
+	fclose(file);
+	SkyCPU_runtime_init(runtime);
+	SkyCPU_callback_setup(runtime, on_interrupt, on_break);
+	SkyCPU_memory_copy(runtime, image, *size, 0);
+	halted = 0;
+	for (retired = 0; retired < max_instructions && !halted; ++retired)
+		SkyCPU_fetch_and_execute(runtime);
+	return halted ? retired : 0;
+}
+
+int main(int argc, char** argv) {
+	static SkyCPU_runtime_t original, optimized;
+	uint32_t max_instructions, original_retired, optimized_retired;
+	size_t original_size, optimized_size, limit;
+
+	if (argc != 4) {
+		fprintf(stderr, "Usage: %s original.bin optimized.bin max_instructions\n",
+				argv[0]);
+		return 2;
+	}
+	max_instructions = strtoul(argv[3], NULL, 0);
+
+	/* Both runs */
+	current = 0;
+	original_retired = run(&original, argv[1], max_instructions, &original_size);
+	current = 1;
+	optimized_retired = run(&optimized, argv[2], max_instructions,
+			&optimized_size);
+	if (!original_retired) {
+		fprintf(stderr, "%s: no BRK within %u instructions\n", argv[1],
+				max_instructions);
+		return 2;
+	}
+
+	/* Compare (code may move, only memory past both images is compared) */
+	limit = original_size > optimized_size ? original_size : optimized_size;
+	if (!optimized_retired
+			|| memcmp(original.registers, optimized.registers,
+					sizeof(original.registers))
+			|| original.stack_pointer != optimized.stack_pointer
+			|| memcmp(original.memory + limit, optimized.memory + limit,
+					MEMORY_MASK + 1 - STACK_AREA - limit)
+			|| events_count[0] != events_count[1]
+			|| memcmp(events[0], events[1], events_count[0] * sizeof(uint32_t))) {
+		printf("%s: DIFF retired=%u/%u sp=%04x/%04x events=%u/%u\n", argv[1],
+				original_retired, optimized_retired, original.stack_pointer,
+				optimized.stack_pointer, events_count[0], events_count[1]);
+		return 1;
+	}
+	printf("%s: MATCH retired=%u/%u events=%u\n", argv[1], original_retired,
+			optimized_retired, events_count[0]);
+	return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Differential test of the peephole optimizer (SkyOpt)
+#
+# Every image of corpus/ is optimized, then the original and the optimized images
+# are run up to their first BRK (opt_diff). Both MUST match (registers, SP, memory
+# past the images but the stack area, INT / BRK codes). Images SkyOpt refuse are
+# copied untouched and trivially match.
+#
+# Usage : tests/opt/run.sh [max_instructions] (CC and CFLAGS honored)
+#
+# Corpus images are loaded and entered at address 0. They are random structured
+# programs (loops, calls, skips, removable instructions) ending with a BRK, plus a
+# few hand written programs (code_address : constant pointing into compacted code).
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+BUDGET=${1:-1000000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Optimizer and differential driver
+$CC $CFLAGS -I"$ROOT" "$ROOT/SkyOpt.c" "$ROOT/SkyCPU_decode.c" -o "$WORK/SkyOpt"
+$CC $CFLAGS -I"$ROOT" "$HERE/opt_diff.c" "$ROOT/FastSkyCPU.c" -o "$WORK/opt_diff"
+
+# Optimize and compare every image
+passed=0
+failed=0
+for image in "$HERE"/corpus/*.bin; do
+	name=$(basename "$image" .bin)
+	"$WORK/SkyOpt" "$image" "$WORK/$name.bin" > /dev/null
+	if "$WORK/opt_diff" "$image" "$WORK/$name.bin" "$BUDGET"; then
+		passed=$((passed + 1))
+	else
+		failed=$((failed + 1))
+	fi
+done
+
+echo "opt: $passed passed, $failed failed"
+test "$failed" -eq 0
@@ -0,0 +1,7 @@
+ MOV.w r2, [#0x8000]
+ ADD.w r2, [#0x8002]
+ MOV.w [#0x9000], r2
+ MOV.w [#0x9002], r0
+ MOV.w r2, #0x9000
+ MOV.w r4, #4
+ BRK.b #0
@@ -0,0 +1,3 @@
+; loaded at 0x100 (SkyServer ... loop.bin@100)
+E:
+ JMP.w #E
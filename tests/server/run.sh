@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# End-to-end test of the job server (SkyServer + SkyLoadgen)
+#
+# SkyServer serve add.bin (image 0: sum of two input words) and loop.bin@100
+# (image 1: endless loop) on a temporary socket. server_client check rejected
+# hellos (unsealed memfd, bad magic), outputs and statuses (DONE, BUDGET,
+# BAD_IMAGE) and batches wrapping around the slots. SkyLoadgen then run each image
+# and a bad image index, its status counts MUST match.
+#
+# Usage : tests/server/run.sh (CC and CFLAGS honored)
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O1}
+WORK=$(mktemp -d)
+SERVER=
+trap '[ -z "$SERVER" ] || kill "$SERVER" 2> /dev/null; rm -rf "$WORK"' EXIT
+
+$CC $CFLAGS -DSKYCPU_PAGE_TRACKING -DSKYCPU_MIRRORED_MEMORY -I"$ROOT" \
+	"$ROOT/SkyServer.c" "$ROOT/FastSkyCPU.c" "$ROOT/SkyCPU_snapshot.c" \
+	"$ROOT/SkyCPU_mirror.c" -lpthread -o "$WORK/SkyServer"
+$CC $CFLAGS -I"$ROOT" "$ROOT/SkyLoadgen.c" -o "$WORK/SkyLoadgen"
+$CC $CFLAGS -I"$ROOT" "$HERE/server_client.c" -o "$WORK/server_client"
+
+# Server (wait for its socket)
+"$WORK/SkyServer" -w 2 -b 4 -m 100000 "$WORK/server.sock" "$HERE/add.bin" \
+	"$HERE/loop.bin@100" 2> "$WORK/server.log" &
+SERVER=$!
+i=0
+while [ ! -S "$WORK/server.sock" ]; do
+	i=$((i + 1))
+	if [ $i -gt 50 ] || ! kill -0 "$SERVER" 2> /dev/null; then
+		echo "server: FAILED (not listening)"
+		cat "$WORK/server.log"
+		exit 1
+	fi
+	sleep 0.1
+done
+
+timeout 60 "$WORK/server_client" "$WORK/server.sock"
+
+# Load generator: status counts of each image and of a bad image index
+loadgen() {
+	timeout 60 "$WORK/SkyLoadgen" -n 200 -d 8 -b 4 -s 4 -m "$2" -I "$1" \
+		"$WORK/server.sock" 2> /dev/null > "$WORK/loadgen.txt"
+	if ! grep -q "^jobs=200 " "$WORK/loadgen.txt" \
+			|| ! grep -qx "status $3" "$WORK/loadgen.txt"; then
+		echo "server: FAILED (SkyLoadgen -I $1, expected status $3)"
+		cat "$WORK/loadgen.txt"
+		exit 1
+	fi
+}
+loadgen 0 1000 "done=200 budget=0 bad_image=0"
+loadgen 1 1000 "done=0 budget=200 bad_image=0"
+loadgen 7 1000 "done=0 budget=0 bad_image=200"
+echo "server: SkyLoadgen status counts match"
+
+kill "$SERVER"
+wait "$SERVER" || true
+SERVER=
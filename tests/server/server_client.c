@@ -0,0 +1,238 @@
+/**
+ * @file server_client.c
+ * @brief Jobs protocol check of the SkyCPU job server (SkyServer)
+ * @author SkyWodd
+ * @version 1.0
+ * @see http://skyduino.wordpress.com/
+ *
+ * @section intro_sec Introduction
+ * This program connect to a SkyServer serving add.bin (image 0) and loop.bin@100 (image 1) and check:\n
+ * - a hello with an unsealed jobs slots memfd MUST be rejected (connection closed, no reply),\n
+ * - a hello with a bad magic MUST be rejected,\n
+ * - add jobs MUST output the sum of the two input words and the input size, with the DONE status,\n
+ * - loop jobs MUST stop with the BUDGET status after exactly the budget,\n
+ * - jobs with an unknown image index MUST complete with the BAD_IMAGE status, nothing run, no output,\n
+ * - batches wrapping around the end of the slots array MUST be served.\n
+ * Exit status is 0 if all checks pass, 1 otherwise, 2 on error.\n
+ * \n
+ * Usage : server_client socket\n
+ * Build : cc -O2 -I../.. server_client.c -o server_client\n
+ * \n
+ * Please report bug to <skywodd at gmail.com>
+ *
+ * @section licence_sec Licence
+ *  This program is free software: you can redistribute it and/or modify\n
+ *  it under the terms of the GNU General Public License as published by\n
+ *  the Free Software Foundation, either version 3 of the License, or\n
+ *  (at your option) any later version.\n
+ * \n
+ *  This program is distributed in the hope that it will be useful,\n
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of\n
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n
+ *  GNU General Public License for more details.\n
+ * \n
+ *  You should have received a copy of the GNU General Public License\n
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.\n
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "SkyCPU_job.h"
+
+/* Slots of the session, instructions of an add job (7 instructions, BRK included) */
+#define SLOTS 8
+#define ADD_INSTRUCTIONS 7
+#define LOOP_BUDGET 500
+
+static const char* socket_path;
+static int failures;
+
+static void check(const int condition, const char* what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+/**
+ * Connect and send a hello with a jobs slots memfd
+ *
+ * @param magic Hello magic
+ * @param seal True to seal the memfd against shrinking
+ * @param slots Pointer to the mapped slots (if not NULL)
+ * @param reply Pointer to the hello reply
+ * @return Connected socket, -1 if the server closed the connection without reply, exit(2) on error
+ */
+static int hello(const uint32_t magic, const int seal, SkyCPU_job_slot_t** slots,
+		SkyCPU_job_hello_t* reply) {
+	SkyCPU_job_hello_t message = { magic, SKYCPU_JOB_VERSION, SLOTS, 0 };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &message, sizeof(message) };
+	struct timeval timeout = { 5, 0 };
+	struct sockaddr_un address;
+	struct msghdr header;
+	struct cmsghdr* cmsg;
+	size_t map_size = SLOTS * sizeof(SkyCPU_job_slot_t);
+	int fd, shm_fd;
+
+	/* Jobs slots */
+	shm_fd = memfd_create("skycpu-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (shm_fd < 0 || ftruncate(shm_fd, map_size) < 0
+			|| (seal && fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK) < 0)) {
+		perror("memfd");
+		exit(2);
+	}
+	if (slots) {
+		*slots = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+				shm_fd, 0);
+		if (*slots == MAP_FAILED) {
+			perror("mmap");
+			exit(2);
+		}
+	}
+
+	/* Connect, hello with the memfd */
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+		perror(socket_path);
+		exit(2);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	memset(&header, 0, sizeof(header));
+	header.msg_iov = &iov;
+	header.msg_iovlen = 1;
+	header.msg_control = control;
+	header.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&header);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
+	if (sendmsg(fd, &header, MSG_NOSIGNAL) != sizeof(message)) {
+		perror("sendmsg");
+		exit(2);
+	}
+	close(shm_fd);
+
+	/* Reply, or connection closed */
+	if (recv(fd, reply, sizeof(*reply), MSG_WAITALL) != sizeof(*reply)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Submit a batch, wait until all its slots are completed */
+static void run_batch(const int fd, const uint32_t first, const uint32_t count) {
+	SkyCPU_job_batch_t batch = { first, count };
+	uint32_t completed = 0;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (send(fd, &batch, sizeof(batch), MSG_NOSIGNAL) != sizeof(batch)) {
+		perror("send");
+		exit(2);
+	}
+	while (completed < count) {
+		if (recv(fd, &batch, sizeof(batch), MSG_WAITALL) != sizeof(batch)) {
+			check(0, "completions received");
+			return;
+		}
+		completed += batch.count;
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	check(completed == count, "no extra completion");
+}
+
+/* Fill an add job slot */
+static void add_job(SkyCPU_job_slot_t* slot, const uint16_t a, const uint16_t b) {
+	slot->image = 0;
+	slot->input_size = 4;
+	slot->max_instructions = 1000;
+	slot->data[0] = a >> 8;
+	slot->data[1] = a;
+	slot->data[2] = b >> 8;
+	slot->data[3] = b;
+	slot->status = 0xFF;
+}
+
+/* Check an add job slot */
+static void check_add(const SkyCPU_job_slot_t* slot, const uint16_t a,
+		const uint16_t b, const char* what) {
+	uint16_t sum = a + b;
+	check(slot->status == SKYCPU_JOB_DONE && slot->instructions == ADD_INSTRUCTIONS
+			&& slot->output_size == 4 && slot->data[0] == (uint8_t) (sum >> 8)
+			&& slot->data[1] == (uint8_t) sum && slot->data[2] == 0
+			&& slot->data[3] == 4, what);
+}
+
+int main(int argc, char** argv) {
+	SkyCPU_job_hello_t reply;
+	SkyCPU_job_slot_t* slots;
+	int fd;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s socket\n", argv[0]);
+		return 2;
+	}
+	socket_path = argv[1];
+
+	/* Rejected hellos: unsealed memfd, bad magic */
+	check(hello(SKYCPU_JOB_MAGIC, 0, NULL, &reply) < 0,
+			"unsealed jobs slots rejected");
+	check(hello(SKYCPU_JOB_MAGIC ^ 1, 1, NULL, &reply) < 0, "bad magic rejected");
+
+	/* Session */
+	fd = hello(SKYCPU_JOB_MAGIC, 1, &slots, &reply);
+	if (fd < 0) {
+		printf("FAIL: sealed jobs slots rejected\n");
+		return 1;
+	}
+	check(reply.magic == SKYCPU_JOB_MAGIC && reply.images_count == 2,
+			"hello reply (2 images)");
+
+	/* add, loop and bad images in one batch */
+	add_job(&slots[0], 0x0102, 0x0304);
+	add_job(&slots[1], 0xFFFF, 0x0001);
+	add_job(&slots[2], 0x1234, 0x1111);
+	add_job(&slots[3], 0x0000, 0x0000);
+	add_job(&slots[4], 0, 0);
+	slots[4].image = 1;
+	slots[4].max_instructions = LOOP_BUDGET;
+	add_job(&slots[5], 1, 2);
+	slots[5].image = 2;
+	add_job(&slots[6], 1, 2);
+	slots[6].image = 0xFFFF;
+	run_batch(fd, 0, 7);
+	check_add(&slots[0], 0x0102, 0x0304, "add job 0x0102 + 0x0304");
+	check_add(&slots[1], 0xFFFF, 0x0001, "add job 0xFFFF + 0x0001 (wrap)");
+	check_add(&slots[2], 0x1234, 0x1111, "add job 0x1234 + 0x1111");
+	check_add(&slots[3], 0, 0, "add job 0 + 0");
+	check(slots[4].status == SKYCPU_JOB_BUDGET
+			&& slots[4].instructions == LOOP_BUDGET, "loop job out of budget");
+	check(slots[5].status == SKYCPU_JOB_BAD_IMAGE && !slots[5].instructions
+			&& !slots[5].output_size, "image 2 is a bad image");
+	check(slots[6].status == SKYCPU_JOB_BAD_IMAGE && !slots[6].instructions
+			&& !slots[6].output_size, "image 0xFFFF is a bad image");
+
+	/* Batch wrapping around the end of the slots */
+	add_job(&slots[SLOTS - 1], 40, 2);
+	add_job(&slots[0], 1000, 337);
+	run_batch(fd, SLOTS - 1, 2);
+	check_add(&slots[SLOTS - 1], 40, 2, "add job in the last slot");
+	check_add(&slots[0], 1000, 337, "add job wrapped to the first slot");
+
+	close(fd);
+	printf("server: %s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}